@@ -0,0 +1,80 @@
+// ===========================================
+// filename: bench_crc.cpp
+// ===========================================
+// CRC16-CCITT over one PC frame (HDR 6 + DATA 512):
+// - check value and agreement of table / bitwise / chunked streaming
+// - ns per frame, bit-by-bit reference vs table driven
+// (host CPU numbers; the ratio is what carries over to the RP2040)
+
+#include "command.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+static constexpr int ITERS = 20000;
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main() {
+  const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+  if (crc16_ccitt(check, 9) != 0x29B1 || crc16_ccitt_bitwise(check, 9) != 0x29B1) {
+    printf("CHECK VALUE MISMATCH: table 0x%04X bitwise 0x%04X (want 0x29B1)\n",
+           crc16_ccitt(check, 9), crc16_ccitt_bitwise(check, 9));
+    return 1;
+  }
+
+  static uint8_t hdr[HDR_BYTES], data[DATA_BYTES];
+  wr_u16_le(hdr, MAGIC);
+  wr_u32_le(hdr + 2, 12345);
+  for (int i = 0; i < DATA_BYTES; ++i) data[i] = (uint8_t)(i * 37 + 11);
+
+  // reference: one contiguous [HDR + DATA] buffer, as the old checkBuf path did
+  static uint8_t whole[HDR_BYTES + DATA_BYTES];
+  memcpy(whole, hdr, HDR_BYTES);
+  memcpy(whole + HDR_BYTES, data, DATA_BYTES);
+  const uint16_t ref = crc16_ccitt_bitwise(whole, HDR_BYTES + DATA_BYTES);
+
+  // streaming in every chunk size the USB side may hand us
+  for (int chunk = 1; chunk <= 64; ++chunk) {
+    uint16_t c = crc16_update(crc16_init(), hdr, HDR_BYTES);
+    for (int got = 0; got < DATA_BYTES; got += chunk) {
+      const int n = (DATA_BYTES - got < chunk) ? (DATA_BYTES - got) : chunk;
+      c = crc16_update(c, data + got, n);
+    }
+    if (crc16_final(c) != ref) {
+      printf("STREAMING MISMATCH at chunk %d: 0x%04X vs 0x%04X\n", chunk, crc16_final(c), ref);
+      return 1;
+    }
+  }
+
+  volatile uint16_t sink = 0;
+
+  double t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    memcpy(whole, hdr, HDR_BYTES);                       // old path: stage, then bit loop
+    memcpy(whole + HDR_BYTES, data, DATA_BYTES);
+    sink = sink ^ crc16_ccitt_bitwise(whole, HDR_BYTES + DATA_BYTES);
+    data[it & (DATA_BYTES - 1)] ^= 1;                    // keep the compiler honest
+  }
+  const double bit_ns = (nowNs() - t0) / ITERS;
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    uint16_t c = crc16_init();                           // new path: in place, two spans
+    c = crc16_update(c, hdr, HDR_BYTES);
+    c = crc16_update(c, data, DATA_BYTES);
+    sink = sink ^ crc16_final(c);
+    data[it & (DATA_BYTES - 1)] ^= 1;
+  }
+  const double tab_ns = (nowNs() - t0) / ITERS;
+
+  printf("CRC16-CCITT over HDR+DATA (%d bytes), %d iterations\n", HDR_BYTES + DATA_BYTES, ITERS);
+  printf("  check(\"123456789\")        : 0x%04X\n", crc16_ccitt(check, 9));
+  printf("  bitwise + checkBuf copy   : %9.1f ns/frame\n", bit_ns);
+  printf("  table, streaming in place : %9.1f ns/frame\n", tab_ns);
+  printf("  speedup                   : %9.1fx\n", bit_ns / tab_ns);
+  return 0;
+}
@@ -0,0 +1,89 @@
+// ===========================================
+// filename: bench_dualcore.cpp
+// ===========================================
+// Wall-clock apply time of one full frame, single core vs DUAL_CORE handoff.
+// - Fake TwoWire in realtime mode: every transaction blocks for its bit time
+// - Core 1 is a host thread running the same coreLinkService() loop as loop1()
+
+#include "command.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+static constexpr uint32_t I2C_HZ = 1000000;
+static constexpr int      FRAMES = 8;
+
+static double nowUs() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main() {
+  static TwoWire w0, w1;
+  w0.setClock(I2C_HZ); w1.setClock(I2C_HZ);
+  w0.realtime = true;  w1.realtime = true;
+
+  static PcaBus bus0, bus1;
+  static CoreLink link;
+  pcaBusInit(bus0, w0, PCA_BASE_ADDR);
+  pcaBusInit(bus1, w1, PCA_BASE_ADDR);
+
+  static uint8_t X[2][X_VALUES];
+  for (int i = 0; i < X_VALUES; ++i) {
+    X[0][i] = (uint8_t)((i * 7 + 3) % 15);
+    X[1][i] = (uint8_t)((i * 5 + 1) % 15);
+  }
+  static uint8_t P[2][DATA_HALF];                 // same frames, packed as they arrive
+  for (int f = 0; f < 2; ++f) {
+    for (int i = 0; i < DATA_HALF; ++i) P[f][i] = (uint8_t)(X[f][2 * i] | (X[f][2 * i + 1] << 4));
+  }
+
+  // ---- A. single core: actionX ----
+  double t0 = nowUs();
+  for (int f = 0; f < FRAMES; ++f) {
+    pcaInvalidate(bus0); pcaInvalidate(bus1);
+    actionX(bus0, bus1, X[f & 1]);
+  }
+  const double single_us = (nowUs() - t0) / FRAMES;
+
+  // ---- B. dual core: bus1 on the "core 1" thread ----
+  std::atomic<bool> run(true);
+  std::thread core1([&] {
+    fakeSetCore(1);
+    while (run) coreLinkService(link);
+  });
+
+  static uint8_t regs0[PCA_BOARDS_PER_BUS][PCA_IMG_BYTES];
+  t0 = nowUs();
+  for (int f = 0; f < FRAMES; ++f) {
+    pcaInvalidate(bus0); pcaInvalidate(bus1);
+    coreLinkSubmit(link, bus1, P[f & 1] + PCA_PACKED_PER_BUS);
+    applyBusPacked(bus0, P[f & 1]);
+    coreLinkWait(link);
+  }
+  const double dual_us = (nowUs() - t0) / FRAMES;
+  run = false;
+  core1.join();
+
+  // registers must match a single-core write of the same frame
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    memcpy(regs0[dev], &w1.regs[PCA_BASE_ADDR + dev][PCA_REG_LED0_ON_L], PCA_IMG_BYTES);
+  }
+  static TwoWire r0, r1;
+  static PcaBus ref0, ref1;
+  pcaBusInit(ref0, r0, PCA_BASE_ADDR);
+  pcaBusInit(ref1, r1, PCA_BASE_ADDR);
+  actionX(ref0, ref1, X[(FRAMES - 1) & 1]);
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    if (memcmp(regs0[dev], &r1.regs[PCA_BASE_ADDR + dev][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0) {
+      printf("MISMATCH on bus1 board 0x%02X\n", PCA_BASE_ADDR + dev);
+      return 1;
+    }
+  }
+
+  printf("Full-frame apply time, one Pico @ %u Hz (realtime fake bus, %d frames)\n", (unsigned)I2C_HZ, FRAMES);
+  printf("  single core : %9.1f us/frame\n", single_us);
+  printf("  dual core   : %9.1f us/frame  (%.2fx)\n", dual_us, single_us / dual_us);
+  return 0;
+}
@@ -0,0 +1,156 @@
+// ===========================================
+// filename: bench_i2c.cpp
+// ===========================================
+// I2C cost per frame on the fake TwoWire:
+// - legacy: setPWM() per channel (2 per magnet) as before the burst path
+// - burst:  actionX() (one auto-increment write per board)
+// Both paths must leave the same register contents on every board.
+
+#include "command.h"
+
+#include <stdio.h>
+
+static constexpr uint32_t I2C_HZ       = 1000000;
+static constexpr int      DIRTY_FRAMES = 50;
+
+// legacy actionX body, kept here only as the reference to measure against
+static void legacyApplyBus(Adafruit_PWMServoDriver* boards[PCA_BOARDS_PER_BUS], const uint8_t* Xbase) {
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    for (int m = 0; m < PCA_MAG_PER_BOARD; ++m) {
+      const uint8_t value = Xbase[dev * PCA_MAG_PER_BOARD + m];
+      const int intensity = (value == 15) ? 0 : (int)value - 7;
+      const uint16_t pwm  = (uint16_t)((abs(intensity) * 4095) / 7);
+      boards[dev]->setPWM(2 * m,     0, intensity > 0 ? pwm : 0);
+      boards[dev]->setPWM(2 * m + 1, 0, intensity < 0 ? pwm : 0);
+    }
+  }
+}
+
+static void report(const char* name, const TwoWire& w0, const TwoWire& w1) {
+  const uint32_t tx = w0.transactions + w1.transactions;
+  const uint32_t by = w0.bytes + w1.bytes;
+  printf("  %-8s %6u transactions  %7u bytes  bus0 %8.1f us  bus1 %8.1f us\n",
+         name, (unsigned)tx, (unsigned)by, w0.busTimeUs(), w1.busTimeUs());
+}
+
+int main() {
+  static TwoWire lw0, lw1;                        // legacy buses
+  static TwoWire bw0, bw1;                        // burst buses
+  lw0.setClock(I2C_HZ); lw1.setClock(I2C_HZ);
+  bw0.setClock(I2C_HZ); bw1.setClock(I2C_HZ);
+
+  Adafruit_PWMServoDriver* legacy0[PCA_BOARDS_PER_BUS];
+  Adafruit_PWMServoDriver* legacy1[PCA_BOARDS_PER_BUS];
+  for (int i = 0; i < PCA_BOARDS_PER_BUS; ++i) {
+    legacy0[i] = new Adafruit_PWMServoDriver((uint8_t)(PCA_BASE_ADDR + i), &lw0);
+    legacy1[i] = new Adafruit_PWMServoDriver((uint8_t)(PCA_BASE_ADDR + i), &lw1);
+  }
+  static PcaBus bus0, bus1;
+  pcaBusInit(bus0, bw0, PCA_BASE_ADDR);
+  pcaBusInit(bus1, bw1, PCA_BASE_ADDR);
+
+  uint8_t X[X_VALUES];
+  for (int i = 0; i < X_VALUES; ++i) X[i] = (uint8_t)((i * 7 + 3) % 15);
+
+  lw0.resetCounters(); lw1.resetCounters();
+  bw0.resetCounters(); bw1.resetCounters();
+
+  legacyApplyBus(legacy0, X);
+  legacyApplyBus(legacy1, X + 256);
+  actionX(bus0, bus1, X);
+
+  printf("I2C cost per frame, one Pico (512 magnets, 64 boards) @ %u Hz\n", (unsigned)I2C_HZ);
+  report("legacy", lw0, lw1);
+  report("burst",  bw0, bw1);
+  printf("  actionX stats: bus0 %u txn / %u B, bus1 %u txn / %u B\n",
+         (unsigned)bus0.frame.transactions, (unsigned)bus0.frame.bytes,
+         (unsigned)bus1.frame.transactions, (unsigned)bus1.frame.bytes);
+  printf("  transactions: %.1fx fewer, wire bytes: %.2fx fewer, bus time: %.2fx less\n",
+         (double)(lw0.transactions + lw1.transactions) / (double)(bw0.transactions + bw1.transactions),
+         (double)(lw0.bytes + lw1.bytes) / (double)(bw0.bytes + bw1.bytes),
+         (lw0.busTimeUs() + lw1.busTimeUs()) / (bw0.busTimeUs() + bw1.busTimeUs()));
+
+  // real cores add a fixed software cost per endTransmission() on top of the bit time
+  printf("  frame time incl. per-transaction overhead (both buses back to back):\n");
+  const double bits_l = lw0.busTimeUs() + lw1.busTimeUs();
+  const double bits_b = bw0.busTimeUs() + bw1.busTimeUs();
+  const uint32_t tx_l = lw0.transactions + lw1.transactions;
+  const uint32_t tx_b = bw0.transactions + bw1.transactions;
+  const double overheads_us[] = { 0.0, 10.0, 25.0, 50.0 };
+  for (double ovh : overheads_us) {
+    const double tl = bits_l + ovh * tx_l;
+    const double tb = bits_b + ovh * tx_b;
+    printf("    %4.0f us/txn: legacy %8.1f us  burst %8.1f us  (%.2fx)\n", ovh, tl, tb, tl / tb);
+  }
+
+  // same LED registers on every board
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    const int a = PCA_BASE_ADDR + dev;
+    if (memcmp(&lw0.regs[a][PCA_REG_LED0_ON_L], &bw0.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0 ||
+        memcmp(&lw1.regs[a][PCA_REG_LED0_ON_L], &bw1.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0) {
+      printf("MISMATCH at board 0x%02X\n", a);
+      return 1;
+    }
+  }
+  printf("  register images match on all boards\n");
+
+  // dirty tracking: start from the frame above, then change k random magnets per frame
+  printf("\nDirty tracking, one Pico, average over %d frames (refresh off)\n", DIRTY_FRAMES);
+  const int changed[] = { 0, 1, 8, 32, 128, 512 };
+  uint32_t rng = 12345;
+  for (int k : changed) {
+    uint64_t tx = 0, by = 0;
+    double   us = 0;
+    for (int f = 0; f < DIRTY_FRAMES; ++f) {
+      for (int j = 0; j < k; ++j) {
+        rng = rng * 1103515245u + 12345u;
+        const int idx = (int)((rng >> 8) % X_VALUES);
+        X[idx] = (uint8_t)((X[idx] + 1 + (rng >> 24) % 13) % 15);
+      }
+      bw0.resetCounters(); bw1.resetCounters();
+      actionX(bus0, bus1, X);
+      tx += bw0.transactions + bw1.transactions;
+      by += bw0.bytes + bw1.bytes;
+      us += bw0.busTimeUs() + bw1.busTimeUs();
+    }
+    printf("  %3d changed: %7.1f transactions  %8.1f bytes  %8.1f us bus time\n", k,
+           (double)tx / DIRTY_FRAMES, (double)by / DIRTY_FRAMES, us / DIRTY_FRAMES);
+  }
+
+  // shadow path must still end in the same registers as a full write
+  legacyApplyBus(legacy0, X);
+  legacyApplyBus(legacy1, X + 256);
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    const int a = PCA_BASE_ADDR + dev;
+    if (memcmp(&lw0.regs[a][PCA_REG_LED0_ON_L], &bw0.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0 ||
+        memcmp(&lw1.regs[a][PCA_REG_LED0_ON_L], &bw1.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0) {
+      printf("MISMATCH after dirty frames at board 0x%02X\n", a);
+      return 1;
+    }
+  }
+  printf("  register images match on all boards\n");
+
+  // uniform frames go out as one ALL_CALL write per bus (BROADCAST in command.h)
+  printf("\nBroadcast, one Pico, uniform frames after the ones above\n");
+  const uint8_t levels[] = { 3, 11, 7 };
+  for (uint8_t v : levels) {
+    memset(X, v, sizeof(X));
+    bw0.resetCounters(); bw1.resetCounters();
+    actionX(bus0, bus1, X);
+    printf("  all at %2u: %u transactions  %u bytes  bus0 %6.1f us  bus1 %6.1f us\n", (unsigned)v,
+           (unsigned)(bw0.transactions + bw1.transactions), (unsigned)(bw0.bytes + bw1.bytes),
+           bw0.busTimeUs(), bw1.busTimeUs());
+    legacyApplyBus(legacy0, X);
+    legacyApplyBus(legacy1, X + 256);
+    for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+      const int a = PCA_BASE_ADDR + dev;
+      if (memcmp(&lw0.regs[a][PCA_REG_LED0_ON_L], &bw0.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0 ||
+          memcmp(&lw1.regs[a][PCA_REG_LED0_ON_L], &bw1.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0) {
+        printf("MISMATCH after a broadcast at board 0x%02X\n", a);
+        return 1;
+      }
+    }
+  }
+  printf("  register images match on all boards\n");
+  return 0;
+}
@@ -0,0 +1,193 @@
+// ===========================================
+// filename: bench_lut.cpp
+// ===========================================
+// CPU cost of turning one Pico's packed half frame (256 bytes, 512 magnets) into I2C writes:
+// - previous path: buildX -> X[512] -> subtract 7 / abs / divide / branch per magnet -> board image -> pcaWriteRegs
+// - table path   : applyBusPacked, nibble -> MAG_IMG row -> straight into the I2C transmit buffer
+// - calibrated   : applyBusPacked with per-board tables (CALIBRATION): same single lookup per magnet
+//                  (64 KB of tables vs 1 KB may miss L1 on the host; RP2040 SRAM has no cache, same cost)
+// - hand-off     : pcaWriteRegs of precomputed images (fake Wire cost both paths share; the table
+//                  path beats it because it skips the image -> queue copy)
+// x86 runs the per-magnet arithmetic in a few cycles; the Cortex-M0+ has no divide instruction and pays more.
+// Full writes every frame (pcaInvalidate) on the counting fake bus, async queue mode.
+// Also checks that deep frames keep the committed calibration while records are staged (calApply).
+
+#include "command.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr int ITERS = 20000;
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---- previous conversion, kept here as the reference ----
+static inline uint16_t refIntensityToPwm(int intensity) {
+  if (intensity == 0) return 0;
+  int mag = abs(intensity);
+  return (uint16_t)((mag * 4095) / 7);
+}
+
+static inline void refPackChannel(uint8_t* img, int ch, uint16_t off) {
+  uint8_t* p = img + ch * PCA_CH_BYTES;
+  p[0] = 0; p[1] = 0;
+  p[2] = (uint8_t)(off & 0xFF);
+  p[3] = (uint8_t)(off >> 8);
+}
+
+static void refBoardImage(const uint8_t* xb, uint8_t* img) {
+  for (int m = 0; m < PCA_MAG_PER_BOARD; ++m) {
+    const int intensity = (xb[m] == 15) ? 0 : (int)xb[m] - 7;
+    const uint16_t pwm  = refIntensityToPwm(intensity);
+    if (intensity > 0)      { refPackChannel(img, 2 * m, pwm); refPackChannel(img, 2 * m + 1, 0); }
+    else if (intensity < 0) { refPackChannel(img, 2 * m, 0);   refPackChannel(img, 2 * m + 1, pwm); }
+    else                    { refPackChannel(img, 2 * m, 0);   refPackChannel(img, 2 * m + 1, 0); }
+  }
+}
+
+static void refApply(PcaBus& bus0, PcaBus& bus1, const uint8_t* packed256, uint8_t* X512) {
+  uint8_t img[PCA_IMG_BYTES];
+  buildX(packed256, X512);
+  PcaBus* bus[2] = { &bus0, &bus1 };
+  for (int b = 0; b < 2; ++b) {
+    for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+      refBoardImage(X512 + b * PCA_MAG_PER_BUS + dev * PCA_MAG_PER_BOARD, img);
+      pcaWriteRegs(*bus[b], dev, PCA_REG_LED0_ON_L, img, PCA_IMG_BYTES);
+    }
+  }
+}
+
+static void setupBus(TwoWire& w, PcaBus& bus) {
+  pcaBusInit(bus, w, PCA_BASE_ADDR);
+  i2cAsyncEnable(bus);
+}
+
+// full deep frame to both buses, queues drained, then every board's LED registers into regs
+static void deepSnapshot(PcaBus& bus0, PcaBus& bus1, const uint8_t* half, int depth,
+                         uint8_t regs[2][PCA_BOARDS_PER_BUS][PCA_IMG_BYTES]) {
+  pcaInvalidate(bus0); pcaInvalidate(bus1);
+  actionDepth(bus0, bus1, half, depth);
+  while (!i2cPump(bus0) || !i2cPump(bus1)) {}
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    memcpy(regs[0][dev], &bus0.wire->regs[PCA_BASE_ADDR + dev][PCA_REG_LED0_ON_L], PCA_IMG_BYTES);
+    memcpy(regs[1][dev], &bus1.wire->regs[PCA_BASE_ADDR + dev][PCA_REG_LED0_ON_L], PCA_IMG_BYTES);
+  }
+}
+
+int main() {
+  static uint8_t P[2][DATA_HALF];
+  for (int f = 0; f < 2; ++f) {
+    for (int i = 0; i < DATA_HALF; ++i) P[f][i] = (uint8_t)(((i * 7 + f * 3) % 16) | (((i * 5 + f) % 16) << 4));
+  }
+  static uint8_t X512[X_VALUES];
+  static uint8_t imgs[2][PCA_BOARDS_PER_BUS][PCA_IMG_BYTES];
+
+  static TwoWire rw0, rw1, tw0, tw1, hw0, hw1;
+  static PcaBus  ref0, ref1, tab0, tab1, hof0, hof1;
+  setupBus(rw0, ref0); setupBus(rw1, ref1);
+  setupBus(tw0, tab0); setupBus(tw1, tab1);
+  setupBus(hw0, hof0); setupBus(hw1, hof1);
+
+  // both paths must leave identical registers (including value 15 -> OFF)
+  for (int f = 0; f < 2; ++f) {
+    refApply(ref0, ref1, P[f], X512);
+    actionPacked(tab0, tab1, P[f]);
+    while (!i2cPump(ref0) || !i2cPump(ref1) || !i2cPump(tab0) || !i2cPump(tab1)) {}
+    for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+      const int a = PCA_BASE_ADDR + dev;
+      if (memcmp(&rw0.regs[a][PCA_REG_LED0_ON_L], &tw0.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0 ||
+          memcmp(&rw1.regs[a][PCA_REG_LED0_ON_L], &tw1.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES) != 0) {
+        printf("MISMATCH at board 0x%02X (frame %d)\n", a, f);
+        return 1;
+      }
+      memcpy(imgs[0][dev], &rw0.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES);
+      memcpy(imgs[1][dev], &rw1.regs[a][PCA_REG_LED0_ON_L], PCA_IMG_BYTES);
+    }
+  }
+
+  double t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+      pcaWriteRegs(hof0, dev, PCA_REG_LED0_ON_L, imgs[0][dev], PCA_IMG_BYTES);
+      pcaWriteRegs(hof1, dev, PCA_REG_LED0_ON_L, imgs[1][dev], PCA_IMG_BYTES);
+    }
+  }
+  const double hof_ns = (nowNs() - t0) / ITERS;
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) refApply(ref0, ref1, P[it & 1], X512);
+  const double ref_ns = (nowNs() - t0) / ITERS;
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    pcaInvalidate(tab0); pcaInvalidate(tab1);
+    actionPacked(tab0, tab1, P[it & 1]);
+  }
+  const double tab_ns = (nowNs() - t0) / ITERS;
+
+  // per-magnet gains / offsets / swaps: only the table each board reads from changes
+  static CalSet   cal;
+  static BoardLut lut[2 * PCA_BOARDS_PER_BUS];
+  calDefaults(cal);
+  cal.version = 1;
+  for (int j = 0; j < CAL_MAGNETS; ++j) {
+    const uint16_t gain = (uint16_t)(CAL_GAIN_ONE - 3 * (j % 64));
+    const uint16_t off  = (uint16_t)(j % 100);
+    const uint8_t  rec[CAL_REC_BYTES] = { (uint8_t)(gain & 0xFF), (uint8_t)(gain >> 8), (uint8_t)(off & 0xFF), (uint8_t)(off >> 8),
+                                          (uint8_t)((j % 9 == 0) ? CAL_FLAG_SWAP : 0) };
+    calStore(cal, j, 1, rec);
+  }
+  calBuild(cal, lut);
+  tab0.lut = lut;
+  tab1.lut = lut + PCA_BOARDS_PER_BUS;
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    pcaInvalidate(tab0); pcaInvalidate(tab1);
+    actionPacked(tab0, tab1, P[it & 1]);
+  }
+  const double cal_ns = (nowNs() - t0) / ITERS;
+
+  printf("Packed half frame -> I2C writes, full write of 64 boards, %d iterations (host CPU)\n", ITERS);
+  printf("  hand-off of precomputed images  : %9.0f ns/frame  (copy into queue + fake Wire)\n", hof_ns);
+  printf("  buildX + per-magnet math        : %9.0f ns/frame\n", ref_ns);
+  printf("  MAG_IMG table, no X512 staging  : %9.0f ns/frame\n", tab_ns);
+  printf("  per-board calibrated tables     : %9.0f ns/frame\n", cal_ns);
+  printf("  saved per frame                 : %9.0f ns (%.0f%%)\n", ref_ns - tab_ns, 100.0 * (ref_ns - tab_ns) / ref_ns);
+  printf("  register images match on all boards\n");
+
+  // deep frames read the committed set (bus.cal): records staged after it change nothing until
+  // the next calApply, as nibble frames keep their tables
+  static constexpr int DEEP = 8;
+  static CalSet      active;
+  static PatternBank bank;
+  static uint16_t    values[X_VALUES];
+  static uint8_t     half[2 * depthBusBytes(DEEP)];
+  static uint8_t     before[2][PCA_BOARDS_PER_BUS][PCA_IMG_BYTES];
+  static uint8_t     after[2][PCA_BOARDS_PER_BUS][PCA_IMG_BYTES];
+  for (int j = 0; j < X_VALUES; ++j) values[j] = (uint16_t)((j * 37) % 255);
+  deepPack(values, X_VALUES, DEEP, half);
+
+  calApply(cal, active, lut, tab0, tab1, bank);
+  deepSnapshot(tab0, tab1, half, DEEP, before);
+
+  const uint8_t half_gain[CAL_REC_BYTES] = { (uint8_t)((CAL_GAIN_ONE / 2) & 0xFF), (uint8_t)((CAL_GAIN_ONE / 2) >> 8), 0, 0, 0 };
+  for (int j = 0; j < CAL_MAGNETS; ++j) calStore(cal, j, 1, half_gain);
+  deepSnapshot(tab0, tab1, half, DEEP, after);
+  if (memcmp(before, after, sizeof(before)) != 0) {
+    printf("MISMATCH: staged calibration records reached a deep frame before the commit\n");
+    return 1;
+  }
+  calApply(cal, active, lut, tab0, tab1, bank);
+  deepSnapshot(tab0, tab1, half, DEEP, after);
+  if (memcmp(before, after, sizeof(before)) == 0) {
+    printf("MISMATCH: committed calibration did not reach deep frames\n");
+    return 1;
+  }
+  printf("  deep frames keep the committed calibration until the next commit\n");
+  return 0;
+}
@@ -0,0 +1,286 @@
+// ===========================================
+// filename: bench_suite.cpp
+// ===========================================
+// Baseline of the command layer on the host, per Pico frame:
+// - CPU ns/frame of each stage: crc16 (HDR+DATA), readExactBytes, buildX, readAck, pollAck,
+//   actionX (unpacked, blocking Wire), actionPacked (full / dirty, blocking and async queue)
+// - I2C transactions / wire bytes per frame for patterns with different densities of change
+//
+// Usage:
+//   bench_suite                               print the tables
+//   bench_suite --csv > base.csv              same numbers, machine readable
+//   bench_suite --baseline base.csv [--tol 0.3]
+//       exit 1 if a stage got slower than (1 + tol) x baseline or a pattern costs more I2C than before
+
+#include "command.h"
+#include "MemStream.h"
+
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <string>
+
+static constexpr int ITERS = 4000;
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// xorshift | same patterns on every run and machine
+static uint32_t rng = 0x12345678u;
+static uint32_t nextRand() {
+  rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+  return rng;
+}
+
+static inline void setNibble(uint8_t* packed, int m, uint8_t v) {
+  uint8_t& b = packed[m >> 1];
+  b = (m & 1) ? (uint8_t)((b & 0x0F) | (v << 4)) : (uint8_t)((b & 0xF0) | v);
+}
+
+struct Result {
+  std::string key;
+  double      value;
+  bool        timing;     // true: ns (tolerance applies) | false: I2C count (must not grow)
+};
+static std::vector<Result> results;
+
+static void record(const std::string& key, double value, bool timing) {
+  results.push_back({ key, value, timing });
+}
+
+// ++++ STAGES ++++
+static void benchStages() {
+  static uint8_t frame[FRAME_BYTES];
+  for (int i = 0; i < FRAME_BYTES; ++i) frame[i] = (uint8_t)nextRand();
+  uint8_t* data = frame + HDR_BYTES;
+  volatile uint32_t sink = 0;
+
+  // ---- A. crc16 over HDR + DATA ----
+  double t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    sink = sink + crc16_final(crc16_update(crc16_init(), frame, HDR_BYTES + DATA_BYTES));
+    frame[it & 511] ^= 1;
+  }
+  record("stage.crc16", (nowNs() - t0) / ITERS, true);
+
+  // ---- B. readExactBytes of a whole frame from a Stream ----
+  MemStream s;
+  s.feed(frame, FRAME_BYTES);
+  static uint8_t rx[FRAME_BYTES];
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    s.rewind();
+    readExactBytes(s, rx, FRAME_BYTES);
+    sink = sink + rx[it % FRAME_BYTES];
+  }
+  record("stage.readExactBytes", (nowNs() - t0) / ITERS, true);
+
+  // ---- C. buildX ----
+  static uint8_t X[X_VALUES];
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    buildX(data + DATA_HALF, X);
+    sink = sink + X[it & 511];
+    data[DATA_HALF + (it & 255)] ^= 1;
+  }
+  record("stage.buildX", (nowNs() - t0) / ITERS, true);
+
+  // ---- D. readAck / pollAck of one 7-byte ACK ----
+  uint8_t ack[ACK_BYTES];
+  makeAck(ack, 42, 1);
+  MemStream a;
+  a.feed(ack, ACK_BYTES);
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    uint8_t st = 0;
+    a.rewind();
+    sink = sink + (readAck(a, 42, &st, 1000000) ? st : 0);
+  }
+  record("stage.readAck", (nowNs() - t0) / ITERS, true);
+
+  AckRx arx;
+  memset(&arx, 0, sizeof(arx));
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    uint32_t q = 0;
+    uint8_t st = 0;
+    a.rewind();
+    sink = sink + (pollAck(a, arx, &q, &st) ? q : 0);
+  }
+  record("stage.pollAck", (nowNs() - t0) / ITERS, true);
+
+  // ---- E. I2C apply (counting fake Wire, CPU only) ----
+  static uint8_t P[2][DATA_HALF];
+  for (int f = 0; f < 2; ++f) {
+    for (int i = 0; i < DATA_HALF; ++i) P[f][i] = (uint8_t)nextRand();
+  }
+  static uint8_t XX[2][X_VALUES];
+  buildX(P[0], XX[0]);
+  buildX(P[1], XX[1]);
+
+  static TwoWire w0, w1, q0, q1;
+  static PcaBus  b0, b1, a0, a1;
+  pcaBusInit(b0, w0, PCA_BASE_ADDR); pcaBusInit(b1, w1, PCA_BASE_ADDR);
+  pcaBusInit(a0, q0, PCA_BASE_ADDR); pcaBusInit(a1, q1, PCA_BASE_ADDR);
+  i2cAsyncEnable(a0); i2cAsyncEnable(a1);
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    pcaInvalidate(b0); pcaInvalidate(b1);
+    actionX(b0, b1, XX[it & 1]);
+  }
+  record("stage.actionX.full", (nowNs() - t0) / ITERS, true);
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    pcaInvalidate(b0); pcaInvalidate(b1);
+    actionPacked(b0, b1, P[it & 1]);
+  }
+  record("stage.actionPacked.full", (nowNs() - t0) / ITERS, true);
+
+  t0 = nowNs();
+  for (int it = 0; it < ITERS; ++it) {
+    pcaInvalidate(a0); pcaInvalidate(a1);
+    actionPacked(a0, a1, P[it & 1]);
+  }
+  record("stage.actionPacked.full.async", (nowNs() - t0) / ITERS, true);
+
+  // 10 % of the magnets change every frame
+  static uint8_t D[DATA_HALF];
+  memcpy(D, P[0], DATA_HALF);
+  actionPacked(b0, b1, D);
+  double dirty_ns = 0;
+  for (int it = 0; it < ITERS; ++it) {
+    for (int k = 0; k < X_VALUES / 10; ++k) setNibble(D, (int)(nextRand() % X_VALUES), (uint8_t)(nextRand() % 15));
+    t0 = nowNs();
+    actionPacked(b0, b1, D);
+    dirty_ns += nowNs() - t0;
+  }
+  record("stage.actionPacked.dirty10", dirty_ns / ITERS, true);
+  (void)sink;
+}
+
+// ++++ I2C COST PER PATTERN ++++
+// steady state (shadow valid, refresh off): each frame changes "changed" magnets of the previous one
+static void benchPatterns() {
+  struct Pattern { const char* name; int changed; };
+  static const Pattern patterns[] = {
+    { "static",      0   },
+    { "1-magnet",    1   },
+    { "1pct",        5   },
+    { "10pct",       51  },
+    { "25pct",       128 },
+    { "50pct",       256 },
+    { "all",         512 },
+  };
+  static constexpr int FRAMES = 50;
+
+  for (const Pattern& p : patterns) {
+    static TwoWire w0, w1;
+    static PcaBus  b0, b1;
+    pcaBusInit(b0, w0, PCA_BASE_ADDR);
+    pcaBusInit(b1, w1, PCA_BASE_ADDR);
+
+    static uint8_t D[DATA_HALF];
+    for (int i = 0; i < DATA_HALF; ++i) D[i] = 0x77;                       // all OFF
+    actionPacked(b0, b1, D);                                                // initial full write
+
+    uint64_t tx = 0, by = 0;
+    for (int f = 0; f < FRAMES; ++f) {
+      for (int k = 0; k < p.changed; ++k) {
+        const int m = (p.changed == X_VALUES) ? k : (int)(nextRand() % X_VALUES);
+        const uint8_t old = (uint8_t)((D[m >> 1] >> ((m & 1) * 4)) & 0x0F);
+        uint8_t v = (uint8_t)(nextRand() % 15);
+        if (v == old || (v == 7) != (old == 7)) v = (uint8_t)((old + 1 + nextRand() % 6) % 15);
+        if (v == 7) v = 8;                                                  // a real change of registers
+        setNibble(D, m, v);
+      }
+      actionPacked(b0, b1, D);
+      tx += b0.frame.transactions + b1.frame.transactions;
+      by += b0.frame.bytes + b1.frame.bytes;
+    }
+    record(std::string("i2c.") + p.name + ".transactions", (double)tx / FRAMES, false);
+    record(std::string("i2c.") + p.name + ".bytes",        (double)by / FRAMES, false);
+  }
+
+  // full write (first frame / refresh) for reference
+  static TwoWire w0, w1;
+  static PcaBus  b0, b1;
+  pcaBusInit(b0, w0, PCA_BASE_ADDR);
+  pcaBusInit(b1, w1, PCA_BASE_ADDR);
+  static uint8_t D[DATA_HALF];
+  memset(D, 0x9A, sizeof(D));
+  actionPacked(b0, b1, D);
+  record("i2c.full.transactions", b0.frame.transactions + b1.frame.transactions, false);
+  record("i2c.full.bytes",        b0.frame.bytes + b1.frame.bytes, false);
+
+  // uniform frames after it (BROADCAST): one ALL_CALL write per bus
+  memset(D, 0x33, sizeof(D));
+  actionPacked(b0, b1, D);
+  record("i2c.uniform.transactions", b0.frame.transactions + b1.frame.transactions, false);
+  record("i2c.uniform.bytes",        b0.frame.bytes + b1.frame.bytes, false);
+  memset(D, 0x77, sizeof(D));
+  actionPacked(b0, b1, D);
+  record("i2c.off.transactions", b0.frame.transactions + b1.frame.transactions, false);
+  record("i2c.off.bytes",        b0.frame.bytes + b1.frame.bytes, false);
+}
+
+// ++++ BASELINE ++++
+static int compareBaseline(const char* path, double tol) {
+  FILE* f = fopen(path, "r");
+  if (!f) { printf("cannot open baseline %s\n", path); return 2; }
+  std::map<std::string, double> base;
+  char key[128];
+  double v;
+  while (fscanf(f, "%127[^,],%lf\n", key, &v) == 2) base[key] = v;
+  fclose(f);
+
+  int bad = 0;
+  for (const Result& r : results) {
+    auto it = base.find(r.key);
+    if (it == base.end()) continue;
+    const double limit = r.timing ? it->second * (1.0 + tol) : it->second + 0.5;
+    const bool   ok    = r.value <= limit;
+    printf("  %-34s %12.1f  base %12.1f  %s\n", r.key.c_str(), r.value, it->second, ok ? "ok" : "REGRESSION");
+    if (!ok) ++bad;
+  }
+  printf("%d regression(s), timing tolerance %.0f%%\n", bad, tol * 100.0);
+  return bad ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  bool csv = false;
+  const char* baseline = nullptr;
+  double tol = 0.3;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    if (a == "--csv") csv = true;
+    else if (a == "--baseline" && i + 1 < argc) baseline = argv[++i];
+    else if (a == "--tol" && i + 1 < argc) tol = atof(argv[++i]);
+    else { printf("usage: %s [--csv] [--baseline file.csv [--tol 0.3]]\n", argv[0]); return 2; }
+  }
+
+  benchStages();
+  benchPatterns();
+
+  if (baseline) return compareBaseline(baseline, tol);
+
+  if (csv) {
+    for (const Result& r : results) printf("%s,%.1f\n", r.key.c_str(), r.value);
+    return 0;
+  }
+
+  printf("Command layer stages, one Pico frame, %d iterations (host CPU, counting fake Wire)\n", ITERS);
+  for (const Result& r : results) {
+    if (r.timing) printf("  %-34s %10.1f ns/frame\n", r.key.c_str() + 6, r.value);
+  }
+  printf("\nI2C cost per Pico frame (both buses), steady state, 50 frames per pattern\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    if (r.timing || r.key.find(".transactions") == std::string::npos) continue;
+    const std::string name = r.key.substr(4, r.key.size() - 4 - 13);
+    printf("  %-10s %8.1f transactions  %8.1f bytes\n", name.c_str(), r.value, results[i + 1].value);
+  }
+  return 0;
+}
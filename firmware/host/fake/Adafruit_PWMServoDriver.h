@@ -0,0 +1,38 @@
+// ===========================================
+// filename: Adafruit_PWMServoDriver.h (host fake)
+// ===========================================
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// Same register traffic as the Adafruit driver for the calls the firmware makes.
+// setPWM() is kept so the legacy one-transaction-per-channel path can be measured.
+class Adafruit_PWMServoDriver {
+public:
+  Adafruit_PWMServoDriver(uint8_t addr = 0x40, TwoWire* i2c = &Wire) : _addr(addr), _i2c(i2c) {}
+
+  bool begin() { write8(0x00, 0x80); return true; }                 // MODE1 <- RESTART (reset)
+  void setPWMFreq(float) { write8(0x00, 0xA0); }                    // MODE1 <- RESTART | AI
+
+  uint8_t setPWM(uint8_t num, uint16_t on, uint16_t off) {
+    _i2c->beginTransmission(_addr);
+    _i2c->write((uint8_t)(0x06 + 4 * num));
+    _i2c->write((uint8_t)on);
+    _i2c->write((uint8_t)(on >> 8));
+    _i2c->write((uint8_t)off);
+    _i2c->write((uint8_t)(off >> 8));
+    return _i2c->endTransmission();
+  }
+
+private:
+  void write8(uint8_t reg, uint8_t v) {
+    _i2c->beginTransmission(_addr);
+    _i2c->write(reg);
+    _i2c->write(v);
+    _i2c->endTransmission();
+  }
+
+  uint8_t  _addr;
+  TwoWire* _i2c;
+};
@@ -0,0 +1,87 @@
+// ===========================================
+// filename: Arduino.h (host fake)
+// ===========================================
+#pragma once
+
+// Minimal stand-in for the Arduino core so command.cpp builds on Linux.
+// Only what the firmware actually uses is provided.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ++++ TIME ++++
+uint32_t micros();
+uint32_t millis();
+void     delay(uint32_t ms);
+void     delayMicroseconds(uint32_t us);
+
+// ++++ GPIO / INTERRUPTS ++++
+//
+// One global pin file (30 GPIOs). Both simulated Picos share it, which is what the sim wants
+// for the wires between them (SPI_READY_PIN) and for boot straps both boards agree on.
+// - digitalRead of a pin nobody drives: HIGH with INPUT_PULLUP, LOW otherwise
+// - noInterrupts() / interrupts(): one recursive lock, also held while fake peripherals run
+//   "interrupt" callbacks (SPISlave), so sketch critical sections really exclude them
+// - attachInterrupt: CHANGE / RISING / FALLING edges caused by digitalWrite (from either Pico)
+//   call the handler on the writer's thread, with the interrupt lock held
+enum { LOW = 0, HIGH = 1, CHANGE = 2, FALLING = 3, RISING = 4 };
+enum { INPUT = 0, OUTPUT = 1, INPUT_PULLUP = 2, INPUT_PULLDOWN = 3 };
+typedef void (*voidFuncPtr)();
+void pinMode(uint8_t pin, int mode);
+void digitalWrite(uint8_t pin, int level);
+int  digitalRead(uint8_t pin);
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(int pin, voidFuncPtr handler, int mode);
+void detachInterrupt(int pin);
+void noInterrupts();
+void interrupts();
+
+// ++++ STREAM ++++
+//
+// Same virtual surface as Arduino's Stream/Print for the calls the firmware makes.
+class Stream {
+public:
+  virtual ~Stream() {}
+  virtual int    available() = 0;
+  virtual int    read() = 0;
+  virtual size_t write(const uint8_t* src, size_t n) = 0;
+
+  virtual size_t readBytes(char* dst, size_t n) {
+    size_t got = 0;
+    while (got < n && available() > 0) dst[got++] = (char)read();
+    return got;
+  }
+  size_t write(uint8_t b) { return write(&b, 1); }
+  virtual void flush() {}                 // wait until everything written has left
+
+  // tud_cdc_read() on a USB CDC port (fake/tusb.h): whatever is there, up to max, in one call
+  virtual int directRead(uint8_t* dst, int max) {
+    int n = available();
+    if (n > max) n = max;
+    return n > 0 ? (int)readBytes((char*)dst, (size_t)n) : 0;
+  }
+};
+
+// ++++ RP2040 INTER-CORE FIFO ++++
+//
+// rp2040.fifo with the arduino-pico surface. Each host thread acts as core 0 unless it called
+// fakeSetCore(1); a push from core c lands in the other core's queue (8 words deep, like the SIO).
+class FakeFifo {
+public:
+  void     push(uint32_t v);
+  bool     push_nb(uint32_t v);
+  uint32_t pop();
+  bool     pop_nb(uint32_t* v);
+  int      available();
+};
+
+class RP2040 {
+public:
+  FakeFifo fifo;
+};
+
+extern RP2040 rp2040;
+
+void fakeSetCore(int core);     // mark the calling thread as core 0 / core 1
@@ -0,0 +1,73 @@
+// ===========================================
+// filename: LittleFS.h (host fake)
+// ===========================================
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// arduino-pico's LittleFS for the calls the firmware makes (CALIBRATION in command.h). Files live
+// in memory for the life of the process: the simulator declares one FS per Pico namespace, so each
+// sketch sees its own flash, and setup() finds what an earlier run of it saved.
+class FS;
+
+class File {
+public:
+  File() {}
+  File(std::vector<uint8_t>* data, bool write) : data_(data), write_(write) {}
+
+  size_t write(const uint8_t* src, size_t n) {
+    if (!data_ || !write_) return 0;
+    data_->insert(data_->end(), src, src + n);
+    return n;
+  }
+  int read(uint8_t* dst, size_t n) {
+    if (!data_ || write_) return -1;
+    if (n > data_->size() - pos_) n = data_->size() - pos_;
+    memcpy(dst, data_->data() + pos_, n);
+    pos_ += n;
+    return (int)n;
+  }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  void   close() { data_ = nullptr; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+private:
+  std::vector<uint8_t>* data_  = nullptr;
+  bool                  write_ = false;
+  size_t                pos_   = 0;
+};
+
+class FS {
+public:
+  bool begin() { return true; }
+
+  // "r": existing file | "w": truncated or created
+  File open(const char* path, const char* mode) {
+    if (mode[0] == 'w') {
+      std::vector<uint8_t>& f = files_[path];
+      f.clear();
+      return File(&f, true);
+    }
+    auto it = files_.find(path);
+    return it == files_.end() ? File() : File(&it->second, false);
+  }
+  bool exists(const char* path) const { return files_.count(path) != 0; }
+  bool remove(const char* path) { return files_.erase(path) != 0; }
+  bool rename(const char* from, const char* to) {
+    auto it = files_.find(from);
+    if (it == files_.end()) return false;
+    files_[to] = std::move(it->second);                 // replaces "to", like lfs_rename()
+    files_.erase(from);
+    return true;
+  }
+
+private:
+  std::map<std::string, std::vector<uint8_t>> files_;
+};
+
+extern FS LittleFS;
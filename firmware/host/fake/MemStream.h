@@ -0,0 +1,37 @@
+// ===========================================
+// filename: MemStream.h (host fake)
+// ===========================================
+#pragma once
+
+// In-memory Stream for host benches: bytes fed with feed() are read back by the firmware code,
+// bytes the firmware writes collect in "out". No timing, no threads.
+
+#include "Arduino.h"
+
+#include <vector>
+
+class MemStream : public Stream {
+public:
+  std::vector<uint8_t> in;
+  size_t               pos = 0;
+  std::vector<uint8_t> out;
+
+  void feed(const uint8_t* src, size_t n) { in.insert(in.end(), src, src + n); }
+  void rewind()                           { pos = 0; }
+  void clear()                            { in.clear(); pos = 0; out.clear(); }
+
+  int available() override { return (int)(in.size() - pos); }
+  int read() override      { return (pos < in.size()) ? in[pos++] : -1; }
+
+  size_t readBytes(char* dst, size_t n) override {
+    const size_t k = (n < in.size() - pos) ? n : (in.size() - pos);
+    memcpy(dst, in.data() + pos, k);
+    pos += k;
+    return k;
+  }
+  size_t write(const uint8_t* src, size_t n) override {
+    out.insert(out.end(), src, src + n);
+    return n;
+  }
+  using Stream::write;
+};
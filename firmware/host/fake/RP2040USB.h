@@ -0,0 +1,19 @@
+// ===========================================
+// filename: RP2040USB.h (host fake)
+// ===========================================
+#pragma once
+
+// arduino-pico core: the mutex held around every TinyUSB call (SerialUSB, the USB task) and the
+// CoreMutex guard that takes it. One thread per simulated Pico reads its USB port, so the fake
+// guard always succeeds and locks nothing.
+struct mutex_t {
+  int unused;
+};
+
+extern mutex_t __usb_mutex;
+
+class CoreMutex {
+public:
+  explicit CoreMutex(mutex_t*) {}
+  explicit operator bool() const { return true; }
+};
@@ -0,0 +1,55 @@
+// ===========================================
+// filename: SPI.h (host fake)
+// ===========================================
+#pragma once
+
+#include <Arduino.h>
+
+#include <chrono>
+
+// arduino-pico's SPIClassRP2040 (master) for the calls SpiPicoLink makes. A transfer is exchanged
+// with the one SPISlaveClass that called begin() (host loopback, see SPISlave.h): the slave's
+// receive callback gets the bytes, its setData() bytes come back, zeros when it has none.
+// transferAsync() schedules the bit time at the clock of beginTransaction(); finishedAsync()
+// turns true once it has passed, and that is when the bytes move.
+enum BitOrder { LSBFIRST = 0, MSBFIRST = 1 };
+enum SPIMode  { SPI_MODE0 = 0, SPI_MODE1 = 1, SPI_MODE2 = 2, SPI_MODE3 = 3 };
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock = 1000000, BitOrder order = MSBFIRST, SPIMode mode = SPI_MODE0)
+    : clock_hz(clock), bit_order(order), data_mode(mode) {}
+  uint32_t clock_hz;
+  BitOrder bit_order;
+  SPIMode  data_mode;
+};
+
+class SPIClassRP2040 {
+public:
+  bool setRX(uint8_t)  { return true; }
+  bool setTX(uint8_t)  { return true; }
+  bool setSCK(uint8_t) { return true; }
+  bool setCS(uint8_t)  { return true; }
+  void begin(bool hwCS = false) { (void)hwCS; }
+  void end() {}
+
+  void beginTransaction(SPISettings s) { clock_hz = s.clock_hz; }
+  void endTransaction() {}
+
+  bool transferAsync(const void* send, void* recv, size_t bytes);
+  bool finishedAsync();
+
+  // bus time of everything clocked so far, 8 bits per byte
+  double busTimeUs() const { return bits * 1e6 / (double)clock_hz; }
+  void   resetCounters() { bytes = 0; bits = 0; }
+
+  uint32_t clock_hz = 1000000;
+  uint64_t bytes    = 0;
+  uint64_t bits     = 0;
+
+private:
+  const uint8_t* tx_ = nullptr;
+  uint8_t*       rx_ = nullptr;
+  size_t         n_  = 0;                // bytes of the transfer still to exchange
+  std::chrono::steady_clock::time_point done_at_;
+};
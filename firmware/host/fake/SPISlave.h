@@ -0,0 +1,37 @@
+// ===========================================
+// filename: SPISlave.h (host fake)
+// ===========================================
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// arduino-pico's SPISlaveClass for the calls SpiPicoLink makes. begin() makes this object the
+// far end of every fake SPIClassRP2040 transfer in the process (host loopback of the SPI link).
+// Callbacks run on the master's thread with the fake interrupt lock held, like the SPI interrupt
+// on the slave Pico.
+typedef void (*SPISlaveRecvHandler)(uint8_t* data, size_t len);
+typedef void (*SPISlaveSentHandler)();
+
+class SPISlaveClass {
+public:
+  bool setRX(uint8_t)  { return true; }
+  bool setTX(uint8_t)  { return true; }
+  bool setSCK(uint8_t) { return true; }
+  bool setCS(uint8_t)  { return true; }
+
+  void begin(SPISettings s);
+  void end();
+  void onDataRecv(SPISlaveRecvHandler h) { recv_cb_ = h; }
+  void onDataSent(SPISlaveSentHandler h) { sent_cb_ = h; }
+  void setData(const uint8_t* data, size_t len) { out_ = data; out_left_ = len; }
+
+  // fake master side: n bytes clocked in from tx, the same number shifted out into rx
+  void exchange(const uint8_t* tx, uint8_t* rx, size_t n);
+
+private:
+  SPISlaveRecvHandler recv_cb_  = nullptr;
+  SPISlaveSentHandler sent_cb_  = nullptr;
+  const uint8_t*      out_      = nullptr;
+  size_t              out_left_ = 0;
+};
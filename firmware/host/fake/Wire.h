@@ -0,0 +1,80 @@
+// ===========================================
+// filename: Wire.h (host fake)
+// ===========================================
+#pragma once
+
+#include <Arduino.h>
+#include <hardware/i2c.h>
+
+#include <chrono>
+
+// Host TwoWire: records every transaction instead of driving pins.
+// - Keeps a 256-byte register file per 7-bit address (auto-increment always on)
+// - Counts transactions / wire bytes and the bit time they would take at the set clock
+// - realtime = true makes each transaction block for that bit time (for wall-clock benches)
+// - error_rate / latency_us (simulator): a transaction is NACKed with that probability (registers
+//   untouched, endTransmission() returns 2) and each one holds the bus latency_us longer
+// - absent[addr] (simulator): no board at addr, every transaction to it is address-NACKed after
+//   the address byte; async transfers leave the TX abort flag in hw (hardware/i2c.h)
+// - PCA9685 broadcast: a write to ALL_CALL (0x70) lands on every present address with MODE1.ALLCALL
+//   set (NACKed if there is none), and ALL_LED_* (0xFA..0xFD) are copied into all 16 channels;
+//   MODE1 starts at the power-on 0x11 (SLEEP | ALLCALL) on every address
+#define WIRE_BUFFER_SIZE 256
+
+class TwoWire {
+public:
+  TwoWire();
+  void begin() {}
+  void setClock(uint32_t hz) { clock_hz = hz; }
+
+  void beginTransmission(uint8_t addr);
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* src, size_t n);
+  uint8_t endTransmission(bool stop = true);
+
+  uint8_t requestFrom(uint8_t addr, uint8_t n, bool stop = true);
+
+  // arduino-pico DMA transfers: registers land at once, the bus stays busy for the bit time
+  bool writeAsync(uint8_t addr, const void* buf, size_t n, bool stop = true);
+  bool finishedAsync();
+  void abortAsync() { busy_until = std::chrono::steady_clock::time_point(); }
+  int available();
+  int read();
+
+  // bus time of everything sent so far, START + 9 bits/byte + STOP per transaction
+  double busTimeUs() const { return bus_bits * 1e6 / (double)clock_hz; }
+  void   resetCounters() { transactions = 0; bytes = 0; bus_bits = 0; }
+  void   seedErrors(uint32_t s) { rng = s ? s : 1; }
+
+  uint8_t  regs[128][256] = {};     // register file, regs[addr][reg]
+  uint32_t clock_hz     = 100000;
+  uint32_t transactions = 0;
+  uint32_t bytes        = 0;        // incl. address byte
+  uint64_t bus_bits     = 0;
+  bool     realtime     = false;
+  double   error_rate   = 0.0;
+  uint32_t latency_us   = 0;
+  uint32_t errors       = 0;        // NACKed transactions
+  bool     absent[128]  = {};
+  i2c_hw_t hw           = {};
+
+private:
+  void pace(uint64_t bits);
+  void store(uint8_t addr, const uint8_t* buf, int n);
+  bool account(uint8_t addr, const uint8_t* buf, int n);
+  uint64_t addressNack();
+  bool fault();
+  uint32_t rng = 0x9E3779B9u;
+  std::chrono::steady_clock::time_point busy_until;
+
+  uint8_t tx_addr = 0;
+  uint8_t tx_buf[WIRE_BUFFER_SIZE];
+  int     tx_len  = 0;
+  uint8_t rx_buf[WIRE_BUFFER_SIZE];
+  int     rx_len  = 0;
+  int     rx_pos  = 0;
+  uint8_t reg_ptr[128] = {};
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
@@ -0,0 +1,381 @@
+// ===========================================
+// filename: arduino_fake.cpp (host fake)
+// ===========================================
+#include <Arduino.h>
+#include <SPI.h>
+#include <SPISlave.h>
+#include <Wire.h>
+#include <pico/time.h>
+#include <RP2040USB.h>
+#include <LittleFS.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ++++ TIME ++++
+static const auto t_boot = std::chrono::steady_clock::now();
+
+uint32_t micros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now() - t_boot).count();
+}
+
+uint32_t millis() { return micros() / 1000; }
+
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+// ++++ GPIO / INTERRUPTS ++++
+static constexpr int PIN_COUNT = 30;
+static std::atomic<int>     pin_mode[PIN_COUNT];
+static std::atomic<int>     pin_level[PIN_COUNT];
+static std::atomic<bool>    pin_driven[PIN_COUNT];
+static std::recursive_mutex irq_mu;
+
+void pinMode(uint8_t pin, int mode) {
+  if (pin < PIN_COUNT) pin_mode[pin] = mode;
+}
+
+static std::atomic<voidFuncPtr> pin_isr[PIN_COUNT];
+static std::atomic<int>         pin_isr_mode[PIN_COUNT];
+
+void digitalWrite(uint8_t pin, int level) {
+  if (pin >= PIN_COUNT) return;
+  const int was = digitalRead(pin);
+  const int now = level ? HIGH : LOW;
+  pin_level[pin]  = now;
+  pin_driven[pin] = true;
+
+  const voidFuncPtr isr = pin_isr[pin];
+  if (!isr || was == now) return;
+  const int mode = pin_isr_mode[pin];
+  if (mode == CHANGE || (mode == RISING && now == HIGH) || (mode == FALLING && now == LOW)) {
+    noInterrupts();
+    isr();
+    interrupts();
+  }
+}
+
+void attachInterrupt(int pin, voidFuncPtr handler, int mode) {
+  if (pin < 0 || pin >= PIN_COUNT) return;
+  pin_isr_mode[pin] = mode;
+  pin_isr[pin]      = handler;
+}
+
+void detachInterrupt(int pin) {
+  if (pin >= 0 && pin < PIN_COUNT) pin_isr[pin] = nullptr;
+}
+
+int digitalRead(uint8_t pin) {
+  std::this_thread::yield();                      // the firmware polls pins in tight loops
+  if (pin >= PIN_COUNT) return LOW;
+  if (pin_driven[pin]) return pin_level[pin];
+  return (pin_mode[pin] == INPUT_PULLUP) ? HIGH : LOW;
+}
+
+void noInterrupts() { irq_mu.lock(); }
+void interrupts()   { irq_mu.unlock(); }
+
+// ++++ ALARMS ++++
+// one detached thread per alarm; cancel_alarm only sets a flag the thread checks before firing
+struct FakeAlarm {
+  std::atomic<bool> cancelled{false};
+};
+static std::mutex                                          alarm_mu;
+static std::vector<std::shared_ptr<FakeAlarm>>             alarms;   // index + 1 = alarm_id_t
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool /*fire_if_past*/) {
+  auto a = std::make_shared<FakeAlarm>();
+  alarm_id_t id;
+  {
+    std::lock_guard<std::mutex> lk(alarm_mu);
+    alarms.push_back(a);
+    id = (alarm_id_t)alarms.size();
+  }
+  std::thread([a, id, callback, user_data, us] {
+    auto target = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    for (;;) {
+      std::this_thread::sleep_until(target);
+      if (a->cancelled) return;
+      const auto started = std::chrono::steady_clock::now();
+      noInterrupts();
+      const int64_t again = a->cancelled ? 0 : callback(id, user_data);
+      interrupts();
+      if (again == 0) return;
+      target = (again > 0) ? target + std::chrono::microseconds(again) : started + std::chrono::microseconds(-again);
+    }
+  }).detach();
+  return id;
+}
+
+bool cancel_alarm(alarm_id_t id) {
+  std::lock_guard<std::mutex> lk(alarm_mu);
+  if (id < 1 || id > (alarm_id_t)alarms.size()) return false;
+  return !alarms[(size_t)id - 1]->cancelled.exchange(true);
+}
+
+// ++++ RP2040 INTER-CORE FIFO ++++
+RP2040 rp2040;
+
+static constexpr size_t FIFO_DEPTH = 8;
+static thread_local int this_core = 0;
+static std::mutex              fifo_mu;
+static std::condition_variable fifo_cv;
+static std::deque<uint32_t>    fifo_rx[2];      // fifo_rx[c]: words waiting for core c
+
+void fakeSetCore(int core) { this_core = core ? 1 : 0; }
+
+void FakeFifo::push(uint32_t v) {
+  std::unique_lock<std::mutex> lk(fifo_mu);
+  std::deque<uint32_t>& q = fifo_rx[this_core ^ 1];
+  fifo_cv.wait(lk, [&] { return q.size() < FIFO_DEPTH; });
+  q.push_back(v);
+  fifo_cv.notify_all();
+}
+
+bool FakeFifo::push_nb(uint32_t v) {
+  std::lock_guard<std::mutex> lk(fifo_mu);
+  std::deque<uint32_t>& q = fifo_rx[this_core ^ 1];
+  if (q.size() >= FIFO_DEPTH) return false;
+  q.push_back(v);
+  fifo_cv.notify_all();
+  return true;
+}
+
+uint32_t FakeFifo::pop() {
+  std::unique_lock<std::mutex> lk(fifo_mu);
+  std::deque<uint32_t>& q = fifo_rx[this_core];
+  fifo_cv.wait(lk, [&] { return !q.empty(); });
+  const uint32_t v = q.front();
+  q.pop_front();
+  fifo_cv.notify_all();
+  return v;
+}
+
+bool FakeFifo::pop_nb(uint32_t* v) {
+  std::lock_guard<std::mutex> lk(fifo_mu);
+  std::deque<uint32_t>& q = fifo_rx[this_core];
+  if (q.empty()) return false;
+  *v = q.front();
+  q.pop_front();
+  fifo_cv.notify_all();
+  return true;
+}
+
+int FakeFifo::available() {
+  std::lock_guard<std::mutex> lk(fifo_mu);
+  return (int)fifo_rx[this_core].size();
+}
+
+// ++++ USB ++++
+mutex_t __usb_mutex;
+
+// ++++ FLASH ++++
+FS LittleFS;                            // benches; the simulator gives each Pico its own
+
+// ++++ I2C ++++
+TwoWire Wire;
+TwoWire Wire1;
+i2c_inst_t i2c0_inst = { &Wire.hw };
+i2c_inst_t i2c1_inst = { &Wire1.hw };
+
+void TwoWire::beginTransmission(uint8_t addr) {
+  tx_addr = addr & 0x7F;
+  tx_len  = 0;
+}
+
+size_t TwoWire::write(uint8_t b) {
+  if (tx_len >= WIRE_BUFFER_SIZE) return 0;
+  tx_buf[tx_len++] = b;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* src, size_t n) {
+  size_t w = 0;
+  while (w < n && write(src[w])) ++w;
+  return w;
+}
+
+// realtime: block the caller for the bit time, scheduled back to back so sleep jitter does not add up
+void TwoWire::pace(uint64_t bits) {
+  if (!realtime) return;
+  const auto now = std::chrono::steady_clock::now();
+  if (busy_until < now) busy_until = now;
+  busy_until += std::chrono::nanoseconds((int64_t)(bits * 1000000000ull / clock_hz) + latency_us * 1000ll);
+  std::this_thread::sleep_until(busy_until);
+}
+
+// xorshift per bus | true -> this transaction is NACKed
+bool TwoWire::fault() {
+  if (error_rate <= 0.0) return false;
+  rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+  return (rng / 4294967296.0) < error_rate;
+}
+
+// PCA9685 ALL_CALL address / ALL_LED registers / MODE1.ALLCALL (BROADCAST in command.h)
+static constexpr uint8_t ALLCALL_ADDR   = 0x70;
+static constexpr uint8_t ALL_LED_REG    = 0xFA;
+static constexpr uint8_t LED0_REG       = 0x06;
+static constexpr uint8_t MODE1_ALL      = 0x01;
+static constexpr uint8_t MODE1_POWER_ON = 0x11;   // SLEEP | ALLCALL
+
+TwoWire::TwoWire() {
+  for (int a = 0; a < 128; ++a) regs[a][0] = MODE1_POWER_ON;
+}
+
+// one device's register writes | ALL_LED_* bytes land in that byte of all 16 channels too
+void TwoWire::store(uint8_t addr, const uint8_t* buf, int n) {
+  uint8_t r = buf[0];
+  for (int i = 1; i < n; ++i, ++r) {
+    regs[addr][r] = buf[i];
+    if (r >= ALL_LED_REG && r < ALL_LED_REG + 4) {
+      for (int ch = 0; ch < 16; ++ch) regs[addr][LED0_REG + 4 * ch + (r - ALL_LED_REG)] = buf[i];
+    }
+  }
+  reg_ptr[addr] = buf[0];
+}
+
+// first byte selects the register, the rest auto-increment from there | false: NACKed
+// ALL_CALL reaches every present board with MODE1.ALLCALL set; NACKed if there is none
+bool TwoWire::account(uint8_t addr, const uint8_t* buf, int n) {
+  transactions += 1;
+  bytes        += (uint32_t)(1 + n);
+  bus_bits     += 2 + 9ull * (uint64_t)(1 + n);
+  if (fault()) { ++errors; return false; }
+  if (addr != ALLCALL_ADDR) {
+    if (n > 0) store(addr, buf, n);
+    return true;
+  }
+  bool any = false;
+  for (int a = 0; a < 128; ++a) {
+    if (a == ALLCALL_ADDR || absent[a] || !(regs[a][0] & MODE1_ALL)) continue;
+    if (n > 0) store((uint8_t)a, buf, n);
+    any = true;
+  }
+  if (!any) ++errors;
+  return any;
+}
+
+// nobody at the address: only START + address byte + STOP go out | returns those bits
+uint64_t TwoWire::addressNack() {
+  transactions += 1;
+  bytes        += 1;
+  bus_bits     += 2 + 9;
+  ++errors;
+  return 2 + 9;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+  if (absent[tx_addr]) {
+    pace(addressNack());
+    return 2;                                        // 2: address NACK
+  }
+  const bool ok = account(tx_addr, tx_buf, tx_len);
+  pace(2 + 9ull * (uint64_t)(1 + tx_len));
+  return ok ? 0 : 2;                                 // 2: address NACK
+}
+
+bool TwoWire::writeAsync(uint8_t addr, const void* buf, size_t n, bool) {
+  if (!finishedAsync()) return false;
+  addr &= 0x7F;
+  uint64_t bits = 2 + 9ull * (1 + n);
+  bool ok;
+  if (absent[addr]) {
+    bits = addressNack();
+    ok   = false;
+  } else {
+    ok = account(addr, (const uint8_t*)buf, (int)n);
+  }
+  hw.raw_intr_stat = ok ? 0 : I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS;   // what the firmware checks afterwards
+  if (realtime) {                                    // schedule, do not block
+    const auto now = std::chrono::steady_clock::now();
+    if (busy_until < now) busy_until = now;
+    busy_until += std::chrono::nanoseconds((int64_t)(bits * 1000000000ull / clock_hz) + latency_us * 1000ll);
+  }
+  return true;
+}
+
+bool TwoWire::finishedAsync() {
+  return !realtime || std::chrono::steady_clock::now() >= busy_until;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t n, bool) {
+  addr &= 0x7F;
+  if (absent[addr]) {
+    pace(addressNack());
+    rx_len = rx_pos = 0;
+    return 0;
+  }
+  const uint64_t bits = 2 + 9ull * (uint64_t)(1 + n);
+  transactions += 1;
+  bytes        += (uint32_t)(1 + n);
+  bus_bits     += bits;
+  pace(bits);
+
+  uint8_t r = reg_ptr[addr];
+  for (int i = 0; i < n; ++i) rx_buf[i] = regs[addr][r++];
+  rx_len = n;
+  rx_pos = 0;
+  return n;
+}
+
+int TwoWire::available() { return rx_len - rx_pos; }
+
+int TwoWire::read() { return (rx_pos < rx_len) ? rx_buf[rx_pos++] : -1; }
+
+// ++++ SPI ++++
+static SPISlaveClass* spi_slave = nullptr;        // far end of every master transfer
+
+bool SPIClassRP2040::transferAsync(const void* send, void* recv, size_t n) {
+  if (!finishedAsync()) return false;
+  tx_ = (const uint8_t*)send;
+  rx_ = (uint8_t*)recv;
+  n_  = n;
+  bytes += n;
+  bits  += 8ull * n;
+  const auto now = std::chrono::steady_clock::now();   // back to back, like DMA chained transfers
+  if (done_at_ < now) done_at_ = now;
+  done_at_ += std::chrono::nanoseconds((int64_t)(8ull * n * 1000000000ull / clock_hz));
+  return true;
+}
+
+bool SPIClassRP2040::finishedAsync() {
+  if (std::chrono::steady_clock::now() < done_at_) {
+    std::this_thread::yield();                    // the firmware polls this in a tight loop
+    return false;
+  }
+  if (n_) {
+    std::lock_guard<std::recursive_mutex> lk(irq_mu);
+    if (spi_slave) spi_slave->exchange(tx_, rx_, n_);
+    else memset(rx_, 0, n_);                      // nobody on the bus: MISO reads low
+    n_ = 0;
+  }
+  return true;
+}
+
+void SPISlaveClass::begin(SPISettings) { spi_slave = this; }
+
+void SPISlaveClass::end() {
+  if (spi_slave == this) spi_slave = nullptr;
+}
+
+void SPISlaveClass::exchange(const uint8_t* tx, uint8_t* rx, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (!out_left_) { rx[i] = 0; continue; }      // TX FIFO empty
+    rx[i] = *out_++;
+    if (--out_left_ == 0 && sent_cb_) sent_cb_(); // may setData() the next buffer right away
+  }
+  uint8_t chunk[64];                              // the callback takes a mutable buffer
+  for (size_t off = 0; off < n; off += sizeof(chunk)) {
+    const size_t k = (n - off < sizeof(chunk)) ? n - off : sizeof(chunk);
+    memcpy(chunk, tx + off, k);
+    if (recv_cb_) recv_cb_(chunk, k);
+  }
+}
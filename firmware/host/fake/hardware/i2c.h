@@ -0,0 +1,28 @@
+// ===========================================
+// filename: hardware/i2c.h (host fake)
+// ===========================================
+#pragma once
+
+#include <stdint.h>
+
+// pico-sdk I2C controller, only the registers the firmware reads: the TX abort flag a NACKed
+// DMA transfer leaves behind. Each fake TwoWire owns one i2c_hw_t (TwoWire::hw) and sets the
+// flag from the result of its last transaction; i2c0 / i2c1 point at Wire's / Wire1's.
+// Reading clr_tx_abrt clears the flag on the chip; here the next transaction does.
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS 0x00000040u
+
+struct i2c_hw_t {
+  volatile uint32_t raw_intr_stat;
+  volatile uint32_t clr_tx_abrt;
+};
+
+struct i2c_inst_t {
+  i2c_hw_t* hw;
+};
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+inline i2c_hw_t* i2c_get_hw(i2c_inst_t* i2c) { return i2c->hw; }
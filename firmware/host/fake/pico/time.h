@@ -0,0 +1,18 @@
+// ===========================================
+// filename: pico/time.h (host fake)
+// ===========================================
+#pragma once
+
+#include <stdint.h>
+
+// pico-sdk hardware alarms for the calls the firmware makes. Each alarm runs on its own host
+// thread; the callback is called with the fake interrupt lock held (see noInterrupts() in
+// Arduino.h), like the timer IRQ on the Pico. Return value, as in the SDK:
+//   > 0: fire again that many us after this alarm was *scheduled* (no drift)
+//   < 0: fire again -value us after the callback started
+//   0  : done
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void* user_data);
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past);
+bool       cancel_alarm(alarm_id_t id);
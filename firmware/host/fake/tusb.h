@@ -0,0 +1,13 @@
+// ===========================================
+// filename: tusb.h (host fake)
+// ===========================================
+#pragma once
+
+#include <Arduino.h>
+
+// TinyUSB CDC device API, only the calls the firmware makes (pico2.ino, USB_DIRECT). On the chip
+// they reach the one CDC port that Serial also wraps; here they go to the Serial of whatever
+// namespace the sketch is compiled in (Stream::directRead, which the simulator's SimSerial
+// overrides to model what one call into the USB stack costs).
+#define tud_cdc_available()   ((uint32_t)Serial.available())
+#define tud_cdc_read(buf, n)  ((uint32_t)Serial.directRead((uint8_t*)(buf), (int)(n)))
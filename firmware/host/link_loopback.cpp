@@ -0,0 +1,245 @@
+// ===========================================
+// filename: link_loopback.cpp (host tool)
+// ===========================================
+// The UART link-speed logic of command.cpp (uartLinkTune / uartLinkFallback on the Pico2 side,
+// uartLinkServe & co. on the Pico1 side) run over a real pty pair instead of Serial1:
+//   master thread (Pico2 role) <-> pty master | pty slave <-> slave thread (Pico1 role)
+// A pty delivers every byte at any speed, so the wire is modelled in PtyStream::write():
+// - bytes are paced at 10 bits per byte of the writer's rate
+// - writer and reader on different rates -> the byte arrives as noise
+// - writer faster than --max-baud -> OVER_RATE_ERROR bit flips per byte (cable limit)
+// After tuning, data packets are exchanged stop-and-wait; --degrade-at N lowers the cable limit
+// to --degrade-baud after N packets, so the run-time fallback can be watched.
+//
+// Usage: link_loopback [--frames N] [--max-baud B] [--ceiling B] [--degrade-at N --degrade-baud B]
+
+#include "command.h"
+
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+
+static constexpr double OVER_RATE_ERROR = 0.01;
+
+// ++++ PTY STREAM ++++
+class PtyStream : public Stream {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit PtyStream(int fd, uint32_t seed) : fd_(fd), rng_(seed) {}
+  void setPeer(PtyStream* peer) { peer_ = peer; }
+
+  std::atomic<uint32_t> baud{115200};
+  std::atomic<uint32_t> max_clean_baud{0};      // shared cable limit, 0 = none
+  uint64_t              noisy = 0;              // bytes sent as noise (rate mismatch)
+  uint64_t              flipped = 0;            // bytes hit by OVER_RATE_ERROR
+
+  void begin(uint32_t b) {
+    baud = b;
+    termios tio;                                // best effort: a pty accepts any rate
+    if (tcgetattr(fd_, &tio) == 0) {
+      cfsetspeed(&tio, B115200);
+      tcsetattr(fd_, TCSANOW, &tio);
+    }
+  }
+
+  int available() override {
+    int n = 0;
+    if (ioctl(fd_, FIONREAD, &n) != 0) return 0;
+    return n;
+  }
+  int read() override {
+    uint8_t b;
+    return (::read(fd_, &b, 1) == 1) ? b : -1;
+  }
+  size_t readBytes(char* dst, size_t n) override {
+    const ssize_t r = ::read(fd_, dst, n);
+    return r > 0 ? (size_t)r : 0;
+  }
+
+  size_t write(const uint8_t* src, size_t n) override {
+    const uint32_t rate  = baud;
+    const uint32_t limit = max_clean_baud;
+    const auto     byte_ns = std::chrono::nanoseconds(10ull * 1000000000ull / rate);
+
+    for (size_t i = 0; i < n; ++i) {
+      auto now = Clock::now();
+      if (tx_free_ < now) tx_free_ = now;
+      std::this_thread::sleep_until(tx_free_);  // pace at the link rate
+      tx_free_ += byte_ns;
+
+      uint8_t v = src[i];
+      if (peer_ && peer_->baud != rate) {
+        v = (uint8_t)next();                    // receiver samples at the wrong rate
+        ++noisy;
+      } else if (limit && rate > limit && (next() / 4294967296.0) < OVER_RATE_ERROR) {
+        v ^= (uint8_t)(1u << (next() & 7));
+        ++flipped;
+      }
+      while (::write(fd_, &v, 1) != 1) std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return n;
+  }
+  using Stream::write;
+
+  void flush() override {
+    std::this_thread::sleep_until(tx_free_);
+    tcdrain(fd_);
+  }
+
+private:
+  uint32_t next() {
+    rng_ ^= rng_ << 13; rng_ ^= rng_ >> 17; rng_ ^= rng_ << 5;
+    return rng_;
+  }
+
+  int               fd_;
+  uint32_t          rng_;
+  PtyStream*        peer_ = nullptr;
+  Clock::time_point tx_free_{};
+};
+
+static PtyStream* g_master = nullptr;
+static PtyStream* g_slave  = nullptr;
+static void masterBegin(uint32_t b) { g_master->begin(b); }
+static void slaveBegin(uint32_t b)  { g_slave->begin(b); }
+
+// ++++ PICO1 ROLE ++++
+// same receive path as pico1.ino: whole packets, UART_LINK served, COMMIT ACKed
+static std::atomic<bool> run_slave(true);
+
+static void slaveLoop(UartLink& l) {
+  static uint8_t pkt[UART_PKT_BYTES];
+  uint8_t ack[ACK_BYTES];
+  while (run_slave) {
+    uartLinkPoll(l);
+    const int avail = l.s->available();
+    if (avail < UART_PKT_BYTES) {
+      uartLinkWatchRx(l, avail);
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+      continue;
+    }
+    readExactBytes(*l.s, pkt, UART_PKT_BYTES);
+    const uint8_t trailer = pkt[UART_SEQ_BYTES + UART_PAYLOAD_BYTES];
+    if (trailer == UART_LINK) { uartLinkServe(l, pkt); continue; }
+    if (trailer == UART_ABORT) { uartLinkGoodPacket(l); continue; }
+    if (trailer != UART_COMMIT) { uartLinkBadPacket(l); continue; }
+    uartLinkGoodPacket(l);
+    makeAck(ack, rd_u32_le(pkt), LINK_OK);
+    writeExactBytes(*l.s, ack, ACK_BYTES);
+  }
+}
+
+// ++++ MAIN ++++
+static double msSince(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+  int      frames       = 2000;
+  uint32_t max_baud     = 0;
+  uint32_t ceiling      = LINK_BAUDS[LINK_BAUD_COUNT - 1];
+  int      degrade_at   = -1;
+  uint32_t degrade_baud = 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string a = argv[i];
+    const char* v = argv[i + 1];
+    if      (a == "--frames")       frames = atoi(v);
+    else if (a == "--max-baud")     max_baud = (uint32_t)atol(v);
+    else if (a == "--ceiling")      ceiling = (uint32_t)atol(v);
+    else if (a == "--degrade-at")   degrade_at = atoi(v);
+    else if (a == "--degrade-baud") degrade_baud = (uint32_t)atol(v);
+    else {
+      printf("usage: %s [--frames N] [--max-baud B] [--ceiling B] [--degrade-at N --degrade-baud B]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (argc % 2 == 0) {
+    printf("usage: %s [--frames N] [--max-baud B] [--ceiling B] [--degrade-at N --degrade-baud B]\n", argv[0]);
+    return 2;
+  }
+
+  // ---- A. pty pair, raw ----
+  const int mfd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (mfd < 0 || grantpt(mfd) != 0 || unlockpt(mfd) != 0) { perror("posix_openpt"); return 1; }
+  const int sfd = open(ptsname(mfd), O_RDWR | O_NOCTTY);
+  termios tio;
+  if (sfd < 0 || tcgetattr(sfd, &tio) != 0) { perror("pty slave"); return 1; }
+  cfmakeraw(&tio);
+  tcsetattr(sfd, TCSANOW, &tio);
+  printf("pty loopback on %s\n", ptsname(mfd));
+
+  PtyStream ms(mfd, 0x1234567u), ss(sfd, 0x89ABCDEu);
+  ms.setPeer(&ss);
+  ss.setPeer(&ms);
+  ms.max_clean_baud = max_baud;
+  ss.max_clean_baud = max_baud;
+  g_master = &ms;
+  g_slave  = &ss;
+
+  static UartLink master, slave;
+  uartLinkInit(master, ms, masterBegin);
+  uartLinkInit(slave, ss, slaveBegin);
+  master.ceiling = (uint8_t)uartLinkIndexAtMost(ceiling);
+  std::thread t_slave(slaveLoop, std::ref(slave));
+
+  // ---- B. boot handshake ----
+  auto t0 = std::chrono::steady_clock::now();
+  if (!uartLinkWaitPeer(master, LINK_RESYNC_MS)) { printf("peer did not answer\n"); run_slave = false; t_slave.join(); return 1; }
+  uartLinkTune(master);
+  printf("tuned     : %7u baud in %.0f ms (ceiling %u, cable limit %u)\n", (unsigned)uartLinkBaud(master),
+         msSince(t0), (unsigned)LINK_BAUDS[master.ceiling], (unsigned)max_baud);
+
+  // ---- C. data packets, stop-and-wait ----
+  static uint8_t pkt[UART_PKT_BYTES];
+  int ok = 0, lost = 0;
+  t0 = std::chrono::steady_clock::now();
+  for (int f = 0; f < frames; ++f) {
+    if (f == degrade_at) {
+      ms.max_clean_baud = degrade_baud;
+      ss.max_clean_baud = degrade_baud;
+      printf("frame %5d: cable limit drops to %u baud\n", f, (unsigned)degrade_baud);
+    }
+    if (master.degraded) {
+      const auto tf = std::chrono::steady_clock::now();
+      const uint32_t from = uartLinkBaud(master);
+      uartLinkFallback(master);
+      printf("frame %5d: fallback %u -> %u baud in %.0f ms\n", f, (unsigned)from, (unsigned)uartLinkBaud(master),
+             msSince(tf));
+    }
+
+    wr_u32_le(pkt, (uint32_t)f);
+    for (int i = 0; i < UART_PAYLOAD_BYTES; ++i) pkt[UART_SEQ_BYTES + i] = (uint8_t)(f + i);
+    pkt[UART_SEQ_BYTES + UART_PAYLOAD_BYTES] = UART_COMMIT;
+    writeExactBytes(ms, pkt, UART_PKT_BYTES);
+
+    uint8_t status = 0;
+    const uint32_t timeout_us =
+      (uint32_t)(3ull * (UART_PKT_BYTES + ACK_BYTES) * 10ull * 1000000ull / uartLinkBaud(master)) + 20000u;
+    const bool got = readAck(ms, (uint32_t)f, &status, timeout_us);
+    uartLinkFrameResult(master, got);
+    if (got) ++ok; else ++lost;
+  }
+  const double run_ms = msSince(t0);
+
+  run_slave = false;
+  t_slave.join();
+
+  // ---- D. report ----
+  printf("frames    : %d OK, %d lost in %.0f ms (%.1f packets/s)\n", ok, lost, run_ms, 1000.0 * frames / run_ms);
+  printf("final     : %7u baud, %u fallbacks, %u lost ACKs counted\n", (unsigned)uartLinkBaud(master),
+         (unsigned)master.fallbacks, (unsigned)master.lost_acks);
+  printf("wire      : %llu noisy bytes (rate mismatch), %llu flipped (over the cable limit)\n",
+         (unsigned long long)(ms.noisy + ss.noisy), (unsigned long long)(ms.flipped + ss.flipped));
+  close(sfd);
+  close(mfd);
+  return uartLinkBaud(master) == uartLinkBaud(slave) ? 0 : 1;
+}
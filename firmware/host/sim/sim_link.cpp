@@ -0,0 +1,200 @@
+// ===========================================
+// filename: sim_link.cpp (host simulator)
+// ===========================================
+#include "sim_link.h"
+
+#include <thread>
+
+static std::atomic<bool> g_stop(false);
+
+void simStop()    { g_stop = true; }
+bool simStopped() { return g_stop; }
+
+static inline void checkStop() {
+  if (g_stop) throw SimStop();
+}
+
+// ++++ SIM LINK ++++
+void SimLink::configure(const LinkConfig& cfg) {
+  std::lock_guard<std::mutex> lk(mu_);
+  cfg_ = cfg;
+}
+
+void SimLink::setBaud(uint32_t baud) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (baud) cfg_.baud = baud;
+}
+
+void SimLink::setRxCapacity(size_t n) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (n) cfg_.rx_capacity = n;
+}
+
+void SimLink::setMaxCleanBaud(uint32_t baud) {
+  std::lock_guard<std::mutex> lk(mu_);
+  cfg_.max_clean_baud = baud;
+}
+
+bool SimLink::flip() {
+  double p = cfg_.error_rate;
+  if (cfg_.max_clean_baud && cfg_.baud > cfg_.max_clean_baud) p += OVER_RATE_ERROR;
+  if (p <= 0.0) return false;
+  rng_ ^= rng_ << 13; rng_ ^= rng_ >> 17; rng_ ^= rng_ << 5;
+  return (rng_ / 4294967296.0) < p;
+}
+
+bool SimLink::drop() {
+  if (cfg_.drop_rate <= 0.0) return false;
+  rng_ ^= rng_ << 13; rng_ ^= rng_ >> 17; rng_ ^= rng_ << 5;
+  return (rng_ / 4294967296.0) < cfg_.drop_rate;
+}
+
+size_t SimLink::write(const uint8_t* src, size_t n) {
+  static constexpr int UART_TX_FIFO = 32;
+
+  for (size_t i = 0; i < n; ++i) {
+    std::unique_lock<std::mutex> lk(mu_);
+
+    // USB CDC: wait until the receiver has room
+    while (cfg_.flow_control && q_.size() >= cfg_.rx_capacity) {
+      lk.unlock();
+      checkStop();
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+      lk.lock();
+    }
+
+    const auto now = Clock::now();
+    if (tx_free_ < now) tx_free_ = now;
+
+    // UART: the TX FIFO holds 32 bytes, the writer blocks beyond that
+    if (!cfg_.flow_control) {
+      const auto fifo_room_at = tx_free_ - std::chrono::nanoseconds(UART_TX_FIFO * byteNs());
+      if (fifo_room_at > now) {
+        lk.unlock();
+        checkStop();
+        std::this_thread::sleep_until(fifo_room_at);
+        lk.lock();
+      }
+    }
+
+    tx_free_ += std::chrono::nanoseconds(byteNs());
+    busy_ns_ += (uint64_t)byteNs();
+    ++bytes_;
+
+    uint8_t v = src[i];
+    if (flip()) { v ^= (uint8_t)(1u << (rng_ & 7)); ++flipped_; }
+    if (drop()) { ++dropped_; continue; }                                                  // lost on the wire
+
+    if (!cfg_.flow_control && q_.size() >= cfg_.rx_capacity) { ++dropped_; continue; }   // RX overrun
+    q_.push_back({ tx_free_ + std::chrono::microseconds(cfg_.latency_us), v });
+  }
+  return n;
+}
+
+void SimLink::waitTxIdle() {
+  std::unique_lock<std::mutex> lk(mu_);
+  const auto until = tx_free_;
+  lk.unlock();
+  checkStop();
+  std::this_thread::sleep_until(until);
+}
+
+int SimLink::available() {
+  checkStop();
+  std::unique_lock<std::mutex> lk(mu_);
+  const auto now = Clock::now();
+  int k = 0;
+  for (const Byte& b : q_) {                    // arrival times are non-decreasing
+    if (b.at > now) break;
+    ++k;
+  }
+  lk.unlock();
+  if (k == 0) std::this_thread::yield();        // firmware polls available() in tight loops
+  return k;
+}
+
+int SimLink::read() {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (q_.empty() || q_.front().at > Clock::now()) return -1;
+  const uint8_t v = q_.front().v;
+  q_.pop_front();
+  return v;
+}
+
+size_t SimLink::readBytes(uint8_t* dst, size_t n) {
+  std::lock_guard<std::mutex> lk(mu_);
+  const auto now = Clock::now();
+  size_t k = 0;
+  while (k < n && !q_.empty() && q_.front().at <= now) {
+    dst[k++] = q_.front().v;
+    q_.pop_front();
+  }
+  return k;
+}
+
+void SimLink::clear() {
+  std::lock_guard<std::mutex> lk(mu_);
+  q_.clear();
+}
+
+void SimLink::resetStats() {
+  busy_ns_ = 0;
+  bytes_   = 0;
+  flipped_ = 0;
+  dropped_ = 0;
+}
+
+// ++++ SIM SERIAL ++++
+void SimSerial::begin(unsigned long baud) {
+  if (!honor_begin_) return;
+  rx_->setBaud((uint32_t)baud);
+  tx_->setBaud((uint32_t)baud);
+}
+
+void SimSerial::setFIFOSize(size_t n) {
+  rx_->setRxCapacity(n);
+}
+
+void SimSerial::println(const char* s) {
+  write((const uint8_t*)s, strlen(s));
+  write((const uint8_t*)"\r\n", 2);
+}
+
+void SimSerial::charge(size_t calls) const {
+  if (!call_ns_ || !calls) return;
+  const auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds((int64_t)call_ns_ * (int64_t)calls);
+  while (std::chrono::steady_clock::now() < until) {}
+}
+
+int SimSerial::available() {
+  charge(1);
+  return rx_->available();
+}
+
+int SimSerial::read() {
+  charge(1);
+  return rx_->read();
+}
+
+size_t SimSerial::readBytes(char* dst, size_t n) {
+  // Stream::readBytes waits up to its timeout; the sketches only ask for what available() said
+  const size_t k = rx_->readBytes((uint8_t*)dst, n);
+  charge(k);
+  return k;
+}
+
+int SimSerial::directRead(uint8_t* dst, int max) {
+  if (stream_only_) return Stream::directRead(dst, max);
+  charge(1);
+  if (rx_->available() <= 0) return 0;          // yields like available(): the firmware polls
+  return (int)rx_->readBytes(dst, (size_t)max);
+}
+
+size_t SimSerial::write(const uint8_t* src, size_t n) {
+  checkStop();
+  return tx_->write(src, n);
+}
+
+void SimSerial::flush() {
+  tx_->waitTxIdle();
+}
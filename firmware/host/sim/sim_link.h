@@ -0,0 +1,130 @@
+// ===========================================
+// filename: sim_link.h (host simulator)
+// ===========================================
+#pragma once
+
+// Virtual serial links for the end-to-end simulator.
+// - SimLink: one direction of a wire. Bytes leave back to back at the link rate
+//   (10 bits per byte, 8N1), arrive latency_us later, and get one bit flipped with
+//   probability error_rate or vanish with probability drop_rate. The receive side holds rx_capacity bytes:
+//     flow_control = true  (USB CDC): the writer waits for room, nothing is lost
+//     flow_control = false (UART):    bytes arriving at a full receive FIFO are dropped
+//   A UART writer also blocks once its 32-byte TX FIFO is full, like SerialUART::write().
+//   Above max_clean_baud (cable / level-shifter limit) every byte also risks OVER_RATE_ERROR.
+// - SimSerial: the Stream the firmware sees (Serial / Serial1), a pair of SimLinks. A USB port can
+//   also charge CPU time per call into the USB stack (setUsbCallCost), see below.
+//
+// Every blocking call throws SimStop once simStop() was called, so node threads unwind out of
+// readExactBytes() & co. at the end of a run.
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+
+struct SimStop {};
+
+void simStop();
+bool simStopped();
+
+struct LinkConfig {
+  uint32_t baud         = 115200;   // bits per second on the wire, 10 bits per byte
+  uint32_t latency_us   = 0;        // added to every byte (USB: host polling, cables, ...)
+  double   error_rate   = 0.0;      // per byte: one random bit flipped
+  double   drop_rate    = 0.0;      // per byte: lost on the wire (never arrives)
+  size_t   rx_capacity  = 256;      // receive buffer in bytes
+  bool     flow_control = false;    // true: writer waits for room | false: overflow drops
+  uint32_t max_clean_baud = 0;      // > 0: faster rates add OVER_RATE_ERROR per byte
+};
+
+static constexpr double OVER_RATE_ERROR = 0.01;
+
+class SimLink {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit SimLink(const char* name) : name_(name) {
+    for (const char* p = name; *p; ++p) rng_ = rng_ * 31u + (uint8_t)*p;   // own error sequence per link
+    if (!rng_) rng_ = 1;
+  }
+
+  void configure(const LinkConfig& cfg);
+  void setBaud(uint32_t baud);          // firmware Serial1.begin(baud) on either end
+  void setRxCapacity(size_t n);         // firmware Serial1.setFIFOSize(n)
+  void setMaxCleanBaud(uint32_t baud);  // the wire degrades (or recovers) at run time
+
+  size_t write(const uint8_t* src, size_t n);
+  void   waitTxIdle();                  // until the last written byte is on the wire
+  int    available();
+  int    read();
+  size_t readBytes(uint8_t* dst, size_t n);
+  void   clear();                       // drop everything queued (PC: reset_input_buffer)
+
+  // statistics since the last resetStats()
+  void     resetStats();
+  double   busySeconds() const { return busy_ns_ / 1e9; }
+  uint64_t bytes()   const { return bytes_; }
+  uint64_t flipped() const { return flipped_; }
+  uint64_t dropped() const { return dropped_; }
+  uint32_t baud()    const { return cfg_.baud; }
+  const std::string& name() const { return name_; }
+
+private:
+  struct Byte { Clock::time_point at; uint8_t v; };
+
+  int64_t byteNs() const { return (int64_t)(10ull * 1000000000ull / cfg_.baud); }
+  bool    flip();
+  bool    drop();
+
+  std::string       name_;
+  LinkConfig        cfg_;
+  std::mutex        mu_;
+  std::deque<Byte>  q_;
+  Clock::time_point tx_free_{};        // wire idle from here on
+  uint32_t          rng_ = 0x2545F491u;
+
+  std::atomic<uint64_t> busy_ns_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> flipped_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+// Serial / Serial1 of one node | rx and tx may be the same kind of link with different configs
+class SimSerial : public Stream {
+public:
+  SimSerial() {}
+  void attach(SimLink* rx, SimLink* tx, bool honor_begin) { rx_ = rx; tx_ = tx; honor_begin_ = honor_begin; }
+
+  // Arduino surface used by the sketches
+  void begin(unsigned long baud);
+  void setFIFOSize(size_t n);
+  void println(const char* s);
+  explicit operator bool() const { return true; }
+
+  int    available() override;
+  int    read() override;
+  size_t readBytes(char* dst, size_t n) override;
+  int    directRead(uint8_t* dst, int max) override;
+  size_t write(const uint8_t* src, size_t n) override;
+  using Stream::write;
+  void   flush() override;
+
+  // CPU time the reading thread spends per call into the USB stack (busy wait, 0 = free).
+  // Stream path: available() is one call, and readBytes() is one per byte, because arduino-pico's
+  // SerialUSB leaves readBytes() to Stream (one read() per byte). directRead() (tud_cdc_read) is
+  // one call for all the bytes it returns. stream_only: directRead() goes the Stream way too
+  // (the firmware built without USB_DIRECT).
+  void   setUsbCallCost(uint32_t ns, bool stream_only) { call_ns_ = ns; stream_only_ = stream_only; }
+
+private:
+  void   charge(size_t calls) const;
+
+  SimLink* rx_ = nullptr;
+  SimLink* tx_ = nullptr;
+  bool     honor_begin_ = false;       // UART: begin(baud) sets the wire rate | USB CDC: ignored
+  uint32_t call_ns_     = 0;
+  bool     stream_only_ = false;
+};
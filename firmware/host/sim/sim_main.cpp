@@ -0,0 +1,575 @@
+// ===========================================
+// filename: sim_main.cpp (host simulator)
+// ===========================================
+// End-to-end run of the real sketches:
+//   PC thread --USB--> pico2 thread --UART or SPI--> pico1 thread
+//                      pico2 Wire/Wire1       pico1 Wire/Wire1   (realtime fake I2C)
+// The PC side speaks the same protocol as software/test/performance_communication.py
+// (optional OP_SET_WINDOW, then windowed data frames) and reports fps, how busy every link
+// was and the ACK latency distribution.
+//
+// Usage: sim [--frames N] [--window N] [--changed N] [--depth D]
+//            [--usb-baud B] [--usb-latency-us U] [--usb-err P] [--usb-drop P]
+//            [--usb-call-ns N] [--usb-read direct|stream]
+//            [--uart-baud B] [--uart-latency-us U] [--uart-err P]
+//            [--uart-max-baud B] [--uart-degrade-ms T --uart-degrade-baud B]
+//            [--i2c-hz F] [--i2c-latency-us U] [--i2c-err P] [--ack-timeout-ms T] [--pty S]
+//            [--link uart|spi] [--i2c-dead W:B ... [--i2c-dead-ms T] [--i2c-revive-ms R]]
+//            [--all-off-at N] [--max-timeouts N]
+//   --depth D: 4 = MAGIC frames, 6 / 8 / 12 = DEEP_MAGIC frames of D bits per magnet (FRAME DEPTH)
+//   *-err: probability per byte (serial) or per transaction (I2C)
+//   --usb-drop: probability per byte that it never reaches pico2 (the receiver has to resync);
+//               with --usb-err or --usb-drop pico2's resync counters are printed after the run
+//   --usb-call-ns: CPU time of one call into pico2's USB stack (0 = free). --usb-read stream reads
+//                  the way pico2 does without USB_DIRECT (a call per byte), direct one call per
+//                  tud_cdc_read(); the report gives the USB rate pico2 sustained in MB/s
+//   --uart-baud / --i2c-hz 0: keep what the firmware sets in setup() (UART: the negotiated rate)
+//   --uart-max-baud: UART bytes faster than this are corrupted at OVER_RATE_ERROR (cable limit)
+//   --uart-degrade-ms / -baud: T ms into the stream the limit drops to B (run-time fallback)
+//   --pty S: no built-in PC; pico2's USB port is exposed as a pseudo terminal for S seconds,
+//            so the real host tools (software/stream/stream_perf) can talk to the simulated pair
+//   --link spi: both sketches read LINK_STRAP_PIN low at boot and run the Pico1 hop over SPI;
+//               the fake SPI master / SPISlave pair (fake/SPI.h) is the wire, at SPI_LINK_HZ
+//   --i2c-dead W:B: board B (0..31) on wire W (0 pico2 bus0, 1 pico2 bus1, 2 pico1 bus0, 3 pico1 bus1)
+//                   NACKs everything, from boot or T ms into the stream, back R ms into it;
+//                   the board health from OP_GET_STATUS is printed after the run
+//   --all-off-at N: OP_ALL_OFF right behind frame N, with the window still full; its ACK latency,
+//                   the frames still in flight then and the device times from the reply are printed
+//   --max-timeouts N: exit 1 if more than N frames got no ACK of their own (timeout + lost), e.g.
+//                     --usb-err 5e-4 --max-timeouts 0: every frame a bit flip spoils is still ACKed
+
+#include "command.h"
+#include "sim_nodes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct SimConfig {
+  int        frames  = 200;
+  int        window  = 1;
+  int        changed = 51;            // magnets changed per frame (of 1024)
+  int        depth   = DEPTH_NIBBLE;  // bits per magnet: MAGIC (4) or DEEP_MAGIC frames
+  LinkConfig usb;
+  LinkConfig uart;
+  uint32_t   i2c_hz         = 0;
+  uint32_t   i2c_latency_us = 0;
+  double     i2c_err        = 0.0;
+  uint32_t   ack_timeout_ms = 1000;
+  uint32_t   uart_degrade_ms   = 0;
+  uint32_t   uart_degrade_baud = 0;
+  int        pty_s          = 0;      // > 0: bridge pico2's USB to a pty instead of the built-in PC
+  bool       link_spi       = false;  // Pico1 hop over SPI instead of UART
+  std::vector<std::pair<int, int>> i2c_dead;   // (wire, board)
+  uint32_t   i2c_dead_ms    = 0;      // 0: missing from boot
+  uint32_t   i2c_revive_ms  = 0;      // 0: never back
+  uint32_t   usb_call_ns    = 0;      // pico2: CPU time per call into the USB stack
+  bool       usb_stream     = false;  // pico2: read USB through Stream (no USB_DIRECT)
+  int        all_off_at     = 0;      // > 0: OP_ALL_OFF mid-stream, behind this frame
+  int        max_timeouts   = -1;     // >= 0: fail the run above this many unACKed frames
+};
+
+static bool parseArgs(int argc, char** argv, SimConfig& c) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if      (a == "--frames")          c.frames = atoi(v);
+    else if (a == "--window")          c.window = atoi(v);
+    else if (a == "--changed")         c.changed = atoi(v);
+    else if (a == "--depth")           c.depth = atoi(v);
+    else if (a == "--usb-baud")        c.usb.baud = (uint32_t)atol(v);
+    else if (a == "--usb-latency-us")  c.usb.latency_us = (uint32_t)atol(v);
+    else if (a == "--usb-err")         c.usb.error_rate = atof(v);
+    else if (a == "--usb-drop")        c.usb.drop_rate = atof(v);
+    else if (a == "--usb-call-ns")     c.usb_call_ns = (uint32_t)atol(v);
+    else if (a == "--usb-read" && !strcmp(v, "stream")) c.usb_stream = true;
+    else if (a == "--usb-read" && !strcmp(v, "direct")) c.usb_stream = false;
+    else if (a == "--uart-baud")       c.uart.baud = (uint32_t)atol(v);
+    else if (a == "--uart-latency-us") c.uart.latency_us = (uint32_t)atol(v);
+    else if (a == "--uart-err")        c.uart.error_rate = atof(v);
+    else if (a == "--uart-max-baud")   c.uart.max_clean_baud = (uint32_t)atol(v);
+    else if (a == "--uart-degrade-ms") c.uart_degrade_ms = (uint32_t)atol(v);
+    else if (a == "--uart-degrade-baud") c.uart_degrade_baud = (uint32_t)atol(v);
+    else if (a == "--i2c-hz")          c.i2c_hz = (uint32_t)atol(v);
+    else if (a == "--i2c-latency-us")  c.i2c_latency_us = (uint32_t)atol(v);
+    else if (a == "--i2c-err")         c.i2c_err = atof(v);
+    else if (a == "--ack-timeout-ms")  c.ack_timeout_ms = (uint32_t)atol(v);
+    else if (a == "--pty")             c.pty_s = atoi(v);
+    else if (a == "--link" && !strcmp(v, "spi"))  c.link_spi = true;
+    else if (a == "--link" && !strcmp(v, "uart")) c.link_spi = false;
+    else if (a == "--i2c-dead") {
+      int w = -1, b = -1;
+      if (sscanf(v, "%d:%d", &w, &b) != 2 || w < 0 || w > 3 || b < 0 || b >= PCA_BOARDS_PER_BUS) return false;
+      c.i2c_dead.push_back({ w, b });
+    }
+    else if (a == "--i2c-dead-ms")    c.i2c_dead_ms = (uint32_t)atol(v);
+    else if (a == "--i2c-revive-ms")  c.i2c_revive_ms = (uint32_t)atol(v);
+    else if (a == "--all-off-at")     c.all_off_at = atoi(v);
+    else if (a == "--max-timeouts")   c.max_timeouts = atoi(v);
+    else return false;
+  }
+  return c.frames > 0 && c.window >= 1 && c.window <= WINDOW_MAX && (c.depth == DEPTH_NIBBLE || depthOk(c.depth));
+}
+
+// ++++ NODES ++++
+static std::atomic<int> nodes_ready(0);
+
+template <void (*SETUP)(), void (*LOOP)()>
+static void runNode() {
+  try {
+    SETUP();
+    ++nodes_ready;
+    while (!simStopped()) {                         // a loop() that touches no SimSerial (SPI link) never throws
+      LOOP();
+      std::this_thread::yield();                    // ... nor yields, and the host may have one CPU
+    }
+  } catch (const SimStop&) {
+  }
+}
+
+// ++++ PC SIDE ++++
+static void buildFrame(uint8_t* out, uint16_t magic, uint32_t seq, const uint8_t* data512) {
+  wr_u16_le(out, magic);
+  wr_u32_le(out + 2, seq);
+  memcpy(out + HDR_BYTES, data512, DATA_BYTES);
+  wr_u16_le(out + HDR_BYTES + DATA_BYTES, crc16_final(crc16_update(crc16_init(), out, HDR_BYTES + DATA_BYTES)));
+}
+
+// DEEP_MAGIC frame of 2 * X_VALUES values | returns its length
+static int buildDeepFrame(uint8_t* out, uint32_t seq, int depth, const uint16_t* values) {
+  const int n = HDR_BYTES + DEEP_HDR_BYTES + depthDataBytes(depth);
+  wr_u16_le(out, DEEP_MAGIC);
+  wr_u32_le(out + 2, seq);
+  out[HDR_BYTES] = (uint8_t)depth;
+  deepPack(values, 2 * X_VALUES, depth, out + HDR_BYTES + DEEP_HDR_BYTES);
+  wr_u16_le(out + n, crc16_final(crc16_update(crc16_init(), out, n)));
+  return n + CRC_BYTES;
+}
+
+static uint32_t rng = 0xC0FFEEu;
+static uint32_t nextRand() {
+  rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+  return rng;
+}
+
+// wait for one ACK (any SEQ) | false on timeout
+static bool waitAck(SimSerial& pc, AckRx& rx, uint32_t* seq, uint8_t* status, uint32_t timeout_ms) {
+  const auto t_end = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (Clock::now() < t_end) {
+    if (pollAck(pc, rx, seq, status)) return true;
+  }
+  return false;
+}
+
+static int negotiateWindow(SimSerial& pc, int want, uint32_t seq, uint32_t timeout_ms) {
+  uint8_t body[DATA_BYTES] = {};
+  body[0] = OP_SET_WINDOW;
+  wr_u16_le(body + 1, 1);
+  body[3] = (uint8_t)want;
+  uint8_t f[FRAME_BYTES];
+  buildFrame(f, CTRL_MAGIC, seq, body);
+  pc.write(f, FRAME_BYTES);
+
+  AckRx rx;
+  memset(&rx, 0, sizeof(rx));
+  uint32_t aseq = 0;
+  uint8_t  st   = 0;
+  if (!waitAck(pc, rx, &aseq, &st, timeout_ms) || aseq != seq || st != 1) return 1;
+  uint8_t reply[REPLY_LEN_BYTES + 1];
+  readExactBytes(pc, reply, sizeof(reply));
+  return reply[REPLY_LEN_BYTES];
+}
+
+// OP_GET_STATUS after the run: which boards the firmware is still writing, how often pico2's
+// USB receiver had to resync | report lines
+static std::string queryStatus(SimSerial& pc, uint32_t seq, uint32_t timeout_ms, bool health, bool rx_sync) {
+  uint8_t body[DATA_BYTES] = {};
+  body[0] = OP_GET_STATUS;
+  uint8_t f[FRAME_BYTES];
+  buildFrame(f, CTRL_MAGIC, seq, body);
+  pc.write(f, FRAME_BYTES);
+
+  AckRx rx;
+  memset(&rx, 0, sizeof(rx));
+  uint32_t aseq = 0;
+  uint8_t  st   = 0;
+  while (waitAck(pc, rx, &aseq, &st, timeout_ms) && aseq != seq) {}   // late ACKs of lost frames
+  if (aseq != seq || st != 1) return "  pico2 status    : no OP_GET_STATUS reply\n";
+  uint8_t len2[REPLY_LEN_BYTES];
+  readExactBytes(pc, len2, REPLY_LEN_BYTES);
+  uint8_t r[256] = {};
+  const int len = rd_u16_le(len2);
+  readExactBytes(pc, r, len);
+  if (len < STATUS_REPLY_BYTES) return "  pico2 status    : not in this status version\n";
+  std::string out;
+  char line[200];
+  if (health) {
+    snprintf(line, sizeof(line), "  board health    : pico1 %08x %08x  pico2 %08x %08x  (failed txns pico1 %u, pico2 %u)\n",
+             (unsigned)rd_u32_le(&r[18]), (unsigned)rd_u32_le(&r[22]), (unsigned)rd_u32_le(&r[26]),
+             (unsigned)rd_u32_le(&r[30]), (unsigned)rd_u32_le(&r[34]), (unsigned)rd_u32_le(&r[38]));
+    out += line;
+  }
+  if (rx_sync) {
+    snprintf(line, sizeof(line), "  USB resync      : %u resyncs, %u bytes skipped, %u frames cut off by a deadline\n",
+             (unsigned)rd_u32_le(&r[42]), (unsigned)rd_u32_le(&r[46]), (unsigned)rd_u32_le(&r[50]));
+    out += line;
+  }
+  return out;
+}
+
+// ++++ PTY BRIDGE ++++
+// master side <-> pc SimSerial, one thread per direction so a slow USB model does not hold back ACKs.
+// The slave stays open here (raw) so the master does not see a hangup between two client runs.
+static bool runPtyBridge(SimSerial& pc, int seconds) {
+  const int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return false;
+  }
+  const char* name = ptsname(master);
+  const int slave = open(name, O_RDWR | O_NOCTTY);
+  termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+    perror("pty slave");
+    return false;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  printf("pty: %s (open for %d s)\n", name, seconds);
+  fflush(stdout);
+
+  std::atomic<bool> run(true);
+  std::thread down([&] {                          // client -> pico2
+    uint8_t buf[1024];
+    try {
+      while (run) {
+        pollfd p = { master, POLLIN, 0 };
+        if (poll(&p, 1, 5) <= 0) continue;
+        const ssize_t n = read(master, buf, sizeof(buf));
+        if (n > 0) pc.write(buf, (size_t)n);
+      }
+    } catch (const SimStop&) {
+    }
+  });
+  std::thread up([&] {                            // pico2 -> client
+    uint8_t buf[1024];
+    while (run) {
+      size_t n = 0;
+      while (n < sizeof(buf) && pc.available() > 0) buf[n++] = (uint8_t)pc.read();
+      if (!n) { std::this_thread::sleep_for(std::chrono::microseconds(100)); continue; }
+      for (size_t off = 0; off < n;) {
+        const ssize_t w = write(master, buf + off, n - off);
+        if (w > 0) off += (size_t)w;
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  run = false;
+  down.join();
+  up.join();
+  close(slave);
+  close(master);
+  return true;
+}
+
+struct Sent {
+  uint32_t          seq;
+  Clock::time_point t;
+};
+
+static double percentile(std::vector<double>& v, double p) {
+  if (v.empty()) return 0.0;
+  const size_t k = (size_t)(p * (double)(v.size() - 1) + 0.5);
+  return v[std::min(k, v.size() - 1)];
+}
+
+// SPI hop, both directions share the clock
+static void printSpi(const SPIClassRP2040& spi, double run_s) {
+  printf("    %-22s %6.1f %%  %9u Hz    %8llu bytes  (full duplex)\n", "SPI  pico2 <-> pico1",
+         100.0 * spi.busTimeUs() / 1e6 / run_s, (unsigned)spi.clock_hz, (unsigned long long)spi.bytes);
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  cfg.usb.baud         = 8000000;      // USB FS bulk, ~800 kB/s of CDC payload
+  cfg.usb.latency_us   = 1000;         // 1 ms host polling
+  cfg.usb.rx_capacity  = 512;          // CDC buffers
+  cfg.usb.flow_control = true;
+  cfg.uart.baud        = 0;
+  cfg.uart.rx_capacity = 32;           // overwritten by the sketches' Serial1.setFIFOSize()
+  if (!parseArgs(argc, argv, cfg)) {
+    printf("usage: %s [--frames N] [--window N<=%d] [--changed N] [--depth 4|6|8|12]\n"
+           "           [--usb-baud B] [--usb-latency-us U] [--usb-err P]\n"
+           "           [--usb-drop P] [--usb-call-ns N] [--usb-read direct|stream]\n"
+           "           [--uart-baud B] [--uart-latency-us U] [--uart-err P] [--uart-max-baud B]\n"
+           "           [--uart-degrade-ms T --uart-degrade-baud B] [--i2c-hz F] [--i2c-latency-us U] [--i2c-err P]\n"
+           "           [--ack-timeout-ms T] [--pty S] [--link uart|spi]\n"
+           "           [--i2c-dead W:B ... [--i2c-dead-ms T] [--i2c-revive-ms R]]\n"
+           "           [--all-off-at N] [--max-timeouts N]\n",
+           argv[0], WINDOW_MAX);
+    return 2;
+  }
+
+  // ---- A. wiring ----
+  static SimLink usb_down("USB  PC -> pico2"), usb_up("USB  pico2 -> PC");
+  static SimLink uart_down("UART pico2 -> pico1"), uart_up("UART pico1 -> pico2");
+  static SimLink p1_usb_in("pico1 USB in"), p1_usb_out("pico1 USB out");   // pico1's USB is not connected
+  usb_down.configure(cfg.usb);
+  LinkConfig usb_back = cfg.usb;
+  usb_back.drop_rate = 0.0;                         // --usb-drop is about pico2's receiver
+  usb_up.configure(usb_back);
+  LinkConfig uart = cfg.uart;
+  if (uart.baud == 0) uart.baud = 115200;
+  uart_down.configure(uart);
+  uart_up.configure(uart);
+  p1_usb_in.configure(cfg.usb);
+  p1_usb_out.configure(cfg.usb);
+
+  SimSerial pc;
+  pc.attach(&usb_up, &usb_down, false);
+  pico2::Serial.attach(&usb_down, &usb_up, false);
+  pico2::Serial.setUsbCallCost(cfg.usb_call_ns, cfg.usb_stream);
+  pico2::Serial1.attach(&uart_up, &uart_down, cfg.uart.baud == 0);
+  pico1::Serial.attach(&p1_usb_in, &p1_usb_out, false);
+  pico1::Serial1.attach(&uart_down, &uart_up, cfg.uart.baud == 0);
+
+  digitalWrite(LINK_STRAP_PIN, cfg.link_spi ? LOW : HIGH);   // boot strap seen by both sketches
+  SPIClassRP2040& spi = pico2::SPI;
+
+  TwoWire* wires[4] = { &pico2::Wire, &pico2::Wire1, &pico1::Wire, &pico1::Wire1 };
+  const char* wire_names[4] = { "I2C  pico2 bus0", "I2C  pico2 bus1", "I2C  pico1 bus0", "I2C  pico1 bus1" };
+  for (TwoWire* w : wires) w->realtime = true;
+  auto setDead = [&](bool dead) {
+    for (const auto& d : cfg.i2c_dead) wires[d.first]->absent[PCA_BASE_ADDR + d.second] = dead;
+  };
+  if (!cfg.i2c_dead_ms) setDead(true);              // missing at boot: the scan sees it
+
+  // ---- B. boot both sketches ----
+  std::thread t2(runNode<pico2::setup, pico2::loop>);
+  std::thread t1(runNode<pico1::setup, pico1::loop>);
+  while (nodes_ready < 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  for (int i = 0; i < 4; ++i) {
+    TwoWire* w = wires[i];
+    w->seedErrors(0x9E3779B9u + 0x1000193u * (uint32_t)i);
+    if (cfg.i2c_hz) w->setClock(cfg.i2c_hz);
+    w->latency_us = cfg.i2c_latency_us;
+    w->error_rate = cfg.i2c_err;
+    w->resetCounters();
+    w->errors = 0;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  usb_up.clear();                                   // "pico2 setup complete" banner
+
+  SimLink* links[4] = { &usb_down, &usb_up, &uart_down, &uart_up };
+
+  if (cfg.pty_s > 0) {
+    for (SimLink* l : links) l->resetStats();
+    spi.resetCounters();
+    const auto t0 = Clock::now();
+    const bool ok = runPtyBridge(pc, cfg.pty_s);
+    const double run_s = std::chrono::duration<double>(Clock::now() - t0).count();
+    simStop();
+    t1.join();
+    t2.join();
+    if (!ok) return 1;
+    printf("  occupancy over %.1f s (busy time / run time)\n", run_s);
+    for (SimLink* l : links) {
+      printf("    %-22s %6.1f %%  %9.0f baud  %8llu bytes  flipped %llu  dropped %llu\n", l->name().c_str(),
+             100.0 * l->busySeconds() / run_s, (double)l->baud(), (unsigned long long)l->bytes(),
+             (unsigned long long)l->flipped(), (unsigned long long)l->dropped());
+    }
+    if (cfg.link_spi) printSpi(spi, run_s);
+    return 0;
+  }
+
+  uint32_t seq = 1;
+  int window = 1;
+  if (cfg.window > 1) window = negotiateWindow(pc, cfg.window, seq++, cfg.ack_timeout_ms);
+
+  for (SimLink* l : links) l->resetStats();
+  spi.resetCounters();
+
+  // ---- C. stream frames ----
+  static uint8_t data[DATA_BYTES];
+  memset(data, 0x77, sizeof(data));                 // all OFF
+  static uint8_t frame[FRAME_MAX_BYTES];
+  static uint16_t values[2 * X_VALUES];             // --depth: the same, one value per magnet
+  std::fill(values, values + 2 * X_VALUES, depthCenter(cfg.depth));
+
+  std::deque<Sent> inflight;
+  std::vector<double> lat_ms;
+  uint32_t status_count[256] = {};
+  int sent = 0, timeouts = 0, lost = 0, stray = 0;   // lost: no ACK, but a later frame's came
+  double window_full_s = 0.0;
+  AckRx rx;
+  memset(&rx, 0, sizeof(rx));
+  uint32_t off_seq = 0;                             // --all-off-at: its SEQ once sent
+  int      off_behind = 0;                          //   frames in flight when it went out
+  std::string off_line;
+
+  const auto t_start = Clock::now();
+  bool degraded = false;
+  bool died = false, revived = false;
+  while (sent < cfg.frames || !inflight.empty()) {
+    const auto t_run = Clock::now() - t_start;
+    if (cfg.i2c_dead_ms && !died && t_run >= std::chrono::milliseconds(cfg.i2c_dead_ms)) {
+      setDead(true);                                // brown-out / unplugged mid-stream
+      died = true;
+    }
+    if (cfg.i2c_revive_ms && !revived && t_run >= std::chrono::milliseconds(cfg.i2c_revive_ms)) {
+      setDead(false);
+      revived = true;
+    }
+    if (cfg.uart_degrade_ms && !degraded &&
+        Clock::now() - t_start >= std::chrono::milliseconds(cfg.uart_degrade_ms)) {
+      uart_down.setMaxCleanBaud(cfg.uart_degrade_baud);       // the wire gets worse mid-run
+      uart_up.setMaxCleanBaud(cfg.uart_degrade_baud);
+      degraded = true;
+    }
+    if (cfg.all_off_at && sent == cfg.all_off_at && !off_seq) {   // emergency stop, window still full
+      uint8_t body[DATA_BYTES] = {};
+      body[0] = OP_ALL_OFF;
+      buildFrame(frame, CTRL_MAGIC, seq, body);
+      off_seq    = seq++;
+      off_behind = (int)inflight.size();
+      off_line   = "  all off         : no ACK\n";
+      inflight.push_back({ off_seq, Clock::now() });
+      pc.write(frame, FRAME_BYTES);
+      continue;
+    }
+    if (sent < cfg.frames && (int)inflight.size() < window) {
+      int n = FRAME_BYTES;
+      if (cfg.depth == DEPTH_NIBBLE) {
+        for (int k = 0; k < cfg.changed; ++k) {
+          const int m = (int)(nextRand() % (DATA_BYTES * 2));
+          const uint8_t v = (uint8_t)(nextRand() % 15);
+          uint8_t& b = data[m >> 1];
+          b = (m & 1) ? (uint8_t)((b & 0x0F) | (v << 4)) : (uint8_t)((b & 0xF0) | v);
+        }
+        buildFrame(frame, MAGIC, seq, data);
+      } else {
+        for (int k = 0; k < cfg.changed; ++k) {   // any value but all ones (off, as nibble 15)
+          values[nextRand() % (2 * X_VALUES)] = (uint16_t)(nextRand() % ((1u << cfg.depth) - 1));
+        }
+        n = buildDeepFrame(frame, seq, cfg.depth, values);
+      }
+      inflight.push_back({ seq, Clock::now() });
+      pc.write(frame, n);
+      ++seq;
+      ++sent;
+      continue;
+    }
+
+    // window full (or all sent): wait for the oldest ACK
+    const auto t_wait = Clock::now();
+    uint32_t aseq = 0;
+    uint8_t  st   = 0;
+    bool got = false;
+    while (!got && Clock::now() - inflight.front().t < std::chrono::milliseconds(cfg.ack_timeout_ms)) {
+      got = pollAck(pc, rx, &aseq, &st);
+    }
+    window_full_s += std::chrono::duration<double>(Clock::now() - t_wait).count();
+
+    if (!got) {                                     // oldest frame lost
+      ++timeouts;
+      inflight.pop_front();
+      continue;
+    }
+    auto it = std::find_if(inflight.begin(), inflight.end(), [&](const Sent& s) { return s.seq == aseq; });
+    if (it == inflight.end()) { ++stray; continue; }
+    if (aseq == off_seq) {                          // [PICO2_US(4)] [BOTH_US(4)] behind an OK
+      uint8_t r[8] = {};
+      if (st == 1) {
+        uint8_t len2[REPLY_LEN_BYTES];
+        readExactBytes(pc, len2, REPLY_LEN_BYTES);
+        const int len = rd_u16_le(len2);
+        uint8_t body[16] = {};
+        readExactBytes(pc, body, std::min(len, (int)sizeof(body)));
+        memcpy(r, body, sizeof(r));
+      }
+      char line[200];
+      snprintf(line, sizeof(line),
+               "  all off         : status %u, ACK after %.2f ms, %d frames in flight, pico2 off after %u us, both after %u us\n",
+               st, std::chrono::duration<double, std::milli>(Clock::now() - it->t).count(), off_behind,
+               (unsigned)rd_u32_le(r), (unsigned)rd_u32_le(r + 4));
+      off_line = line;
+      lost += (int)(it - inflight.begin());
+      inflight.erase(inflight.begin(), it + 1);
+      continue;
+    }
+    lat_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - it->t).count());
+    ++status_count[st];
+    lost += (int)(it - inflight.begin());           // ACKs come in SEQ order: anything older is lost
+    inflight.erase(inflight.begin(), it + 1);
+  }
+  const double run_s = std::chrono::duration<double>(Clock::now() - t_start).count();
+  std::string health;
+  const bool rx_sync = cfg.usb.error_rate > 0.0 || cfg.usb.drop_rate > 0.0;
+  if (!cfg.i2c_dead.empty() || rx_sync) health = queryStatus(pc, seq++, cfg.ack_timeout_ms, !cfg.i2c_dead.empty(), rx_sync);
+
+  simStop();
+  t1.join();
+  t2.join();
+
+  // ---- D. report ----
+  printf("Simulated %d frames, window %d, %d magnets changed per frame, %d bits per magnet\n", cfg.frames, window,
+         cfg.changed, cfg.depth);
+  printf("  run time        : %8.3f s\n", run_s);
+  printf("  frames / s      : %8.1f (ACKed OK)\n", status_count[1] / run_s);
+  printf("  USB PC -> pico2 : %8.3f MB/s sustained (%s reads%s)\n", usb_down.bytes() / run_s / 1e6,
+         cfg.usb_stream ? "Stream" : "tud_cdc_read", cfg.usb_call_ns ? "" : ", calls free");
+  printf("  ACK status      : OK %u  ERR_MAGIC %u  ERR_CRC %u  ERR_PICO1_ACK %u  timeout %d  lost %d  stray %d\n",
+         status_count[1], status_count[0], status_count[2], status_count[3], timeouts, lost, stray);
+  printf("%s", health.c_str());
+  printf("%s", off_line.c_str());
+
+  std::sort(lat_ms.begin(), lat_ms.end());
+  if (!lat_ms.empty()) {
+    printf("  ACK latency ms  : min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+           lat_ms.front(), percentile(lat_ms, 0.50), percentile(lat_ms, 0.90), percentile(lat_ms, 0.99), lat_ms.back());
+
+    // histogram, 10 equal bins between min and max
+    const double lo = lat_ms.front(), hi = lat_ms.back() + 1e-9;
+    int bins[10] = {};
+    for (double v : lat_ms) ++bins[std::min(9, (int)((v - lo) / (hi - lo) * 10.0))];
+    for (int b = 0; b < 10; ++b) {
+      const int bar = (int)(50.0 * bins[b] / (double)lat_ms.size() + 0.5);
+      printf("    %8.2f .. %8.2f ms %5d %s\n", lo + (hi - lo) * b / 10.0, lo + (hi - lo) * (b + 1) / 10.0,
+             bins[b], std::string((size_t)bar, '#').c_str());
+    }
+  }
+
+  printf("  occupancy (busy time / run time)\n");
+  for (SimLink* l : links) {
+    printf("    %-22s %6.1f %%  %9.0f baud  %8llu bytes  flipped %llu  dropped %llu\n", l->name().c_str(),
+           100.0 * l->busySeconds() / run_s, (double)l->baud(), (unsigned long long)l->bytes(),
+           (unsigned long long)l->flipped(), (unsigned long long)l->dropped());
+  }
+  if (cfg.link_spi) printSpi(spi, run_s);
+  for (int i = 0; i < 4; ++i) {
+    printf("    %-22s %6.1f %%  %9u Hz    %8u txns   NACKed %u\n", wire_names[i],
+           100.0 * wires[i]->busTimeUs() / 1e6 / run_s, (unsigned)wires[i]->clock_hz,
+           (unsigned)wires[i]->transactions, (unsigned)wires[i]->errors);
+  }
+  printf("    %-22s %6.1f %%\n", "PC waiting for ACKs", 100.0 * window_full_s / run_s);
+  if (cfg.max_timeouts >= 0 && timeouts + lost > cfg.max_timeouts) {
+    printf("FAIL: %d frames without an ACK of their own (--max-timeouts %d)\n", timeouts + lost, cfg.max_timeouts);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,36 @@
+// ===========================================
+// filename: sim_nodes.h (host simulator)
+// ===========================================
+#pragma once
+
+// The two sketches, each compiled into its own namespace (sim_pico1.cpp, sim_pico2.cpp) together
+// with its own copy of command.cpp, so both run in one process without sharing globals
+// (Serial, Serial1, Wire, Wire1, the io idle hook, ...).
+
+#include "sim_link.h"
+
+#include <Wire.h>
+#include <SPI.h>
+#include <SPISlave.h>
+
+namespace pico1 {
+extern SimSerial Serial;
+extern SimSerial Serial1;
+extern TwoWire   Wire;
+extern TwoWire   Wire1;
+extern SPIClassRP2040 SPI;
+extern SPISlaveClass  SPISlave;
+void setup();
+void loop();
+}
+
+namespace pico2 {
+extern SimSerial Serial;
+extern SimSerial Serial1;
+extern TwoWire   Wire;
+extern TwoWire   Wire1;
+extern SPIClassRP2040 SPI;
+extern SPISlaveClass  SPISlave;
+void setup();
+void loop();
+}
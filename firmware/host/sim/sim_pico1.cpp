@@ -0,0 +1,35 @@
+// ===========================================
+// filename: sim_pico1.cpp (host simulator)
+// ===========================================
+// pico1.ino + command.cpp inside namespace pico1. The Arduino / Wire / PCA9685 fakes are
+// included first so their include guards keep them global; Serial, Serial1, Wire and Wire1
+// (and SPI, SPISlave, LittleFS, the i2c0 / i2c1 controllers) are declared in the namespace and
+// shadow the global names for the sketch.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <SPISlave.h>
+#include <Adafruit_PWMServoDriver.h>
+#include <LittleFS.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_nodes.h"
+
+namespace pico1 {
+SimSerial Serial;
+SimSerial Serial1;
+TwoWire   Wire;
+TwoWire   Wire1;
+i2c_inst_t i2c0_inst = { &Wire.hw };      // hardware/i2c.h: i2c0 / i2c1 are this Pico's Wire / Wire1
+i2c_inst_t i2c1_inst = { &Wire1.hw };
+SPIClassRP2040 SPI;
+SPISlaveClass  SPISlave;
+FS             LittleFS;          // this Pico's flash (calibration file)
+
+#include "command.h"
+#include "command.cpp"
+#include "pico1.ino"
+}
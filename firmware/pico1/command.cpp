@@ -1,15 +1,28 @@
 #include "command.h"
 #include <string.h>
+#include <hardware/i2c.h>
+#include <LittleFS.h>
 
 // Author: DH HAN and SAM LAB
 
 // ++++ READ and WRITE ++++ 
+// called whenever a blocking helper has nothing to do (async I2C pump etc.)
+static void (*ioIdleHook)() = nullptr;
+
+void setIoIdleHook(void (*hook)()) {
+  ioIdleHook = hook;
+}
+
+static inline void ioIdle() {
+  if (ioIdleHook) ioIdleHook();
+}
+
 // READ from stream "s" | save at "dst" | size: "n" bytes
 void readExactBytes(Stream& s, uint8_t* dst, int n) {
   int got = 0;
   while (got < n) {
     int avail = s.available();
-    if (avail <= 0) continue;
+    if (avail <= 0) { ioIdle(); continue; }
 
     int take = avail;
     if (take > (n - got)) take = (n - got);
@@ -25,7 +38,138 @@ void writeExactBytes(Stream& s, const uint8_t* src, int n) {
   while (sent < n) {
     int w = s.write(src + sent, n - sent);
     sent += w;
+    if (w <= 0) ioIdle();
+  }
+}
+
+// ++++ FRAME RESYNC ++++
+void frameRxInit(FrameRx& rx, Stream& s, uint8_t* buf, const uint16_t* magics, int magic_count) {
+  memset(&rx, 0, sizeof(rx));
+  rx.s           = &s;
+  rx.buf         = buf;
+  rx.magics      = magics;
+  rx.magic_count = (uint8_t)magic_count;
+  rx.aligned     = true;
+}
+
+void frameRxSetDirect(FrameRx& rx, int (*direct)(uint8_t* dst, int max)) {
+  rx.direct = direct;
+}
+
+// up to max bytes into buf + cur_n, replayed ones first | never waits
+static int rxTake(FrameRx& rx, int max) {
+  uint8_t* const dst = rx.buf + rx.cur_n;
+  int r = rx.rp_len - rx.rp_pos;
+  if (r > 0) {
+    if (r > max) r = max;
+    memcpy(dst, rx.replay + rx.rp_pos, r);
+    rx.rp_pos += r;
+  } else {
+    if (rx.direct) {
+      r = rx.direct(dst, max);                         // one call, whatever the source holds
+    } else {
+      r = rx.s->available();
+      if (r <= 0) return 0;
+      if (r > max) r = max;
+      r = rx.s->readBytes((char*)dst, r);
+    }
+    if (r <= 0) return 0;
+    rx.src_n += r;
   }
+  rx.cur_n    += r;
+  rx.t_byte_us = micros();
+  return r;
+}
+
+// stream index of the next byte rxTake hands out: the replay is always the tail right before src_n
+static uint32_t rxAt(const FrameRx& rx) {
+  return rx.src_n - (uint32_t)(rx.rp_len - rx.rp_pos);
+}
+
+static bool rxKnownMagic(const FrameRx& rx, uint16_t magic) {
+  for (int i = 0; i < rx.magic_count; ++i) {
+    if (rx.magics[i] == magic) return true;
+  }
+  return false;
+}
+
+static void rxSkip(FrameRx& rx, int n) {
+  if (!rx.lost) ++rx.resyncs;                          // first byte of a new resync event
+  rx.lost     = true;
+  rx.skipped += n;
+}
+
+static bool rxExpired(const FrameRx& rx) {
+  const uint32_t now = micros();
+  return (now - rx.t_byte_us) > RX_BYTE_TIMEOUT_US || (now - rx.t_frame_us) > RX_FRAME_TIMEOUT_US;
+}
+
+bool frameRxHeader(FrameRx& rx) {
+  while (rx.cur_n < HDR_BYTES) {
+    // MAGIC one byte at a time, SEQ in one go behind it
+    const bool     first = (rx.cur_n == 0);
+    const uint32_t at    = rxAt(rx);
+    if (!rxTake(rx, (rx.cur_n < 2) ? 1 : (HDR_BYTES - rx.cur_n))) {
+      if (rx.cur_n >= 2 && rxExpired(rx)) {            // a header that stopped after its MAGIC
+        ++rx.timeouts;
+        frameRxReject(rx);
+      }
+      return false;
+    }
+    if (first) {
+      rx.t_frame_us = rx.t_byte_us;
+      rx.hdr_at     = at;
+    }
+
+    if (rx.cur_n == 2 && !rxKnownMagic(rx, rd_u16_le(rx.buf))) {
+      rx.buf[0]     = rx.buf[1];                       // slide the 2-byte window by one
+      rx.cur_n      = 1;
+      rx.t_frame_us = rx.t_byte_us;
+      rx.hdr_at     = at;                              // the byte just taken
+      rxSkip(rx, 1);
+    }
+  }
+  rx.aligned = !rx.lost || rx.hdr_at == rx.next_at;
+  return true;
+}
+
+int frameRxReadSome(FrameRx& rx, int max) {
+  if (max > FRAME_MAX_BYTES - rx.cur_n) max = FRAME_MAX_BYTES - rx.cur_n;   // no frame is longer
+  const int r = rxTake(rx, max);
+  if (r > 0) return r;
+  if (!rxExpired(rx)) return 0;
+  ++rx.timeouts;
+  return -1;
+}
+
+bool frameRxRead(FrameRx& rx, int n) {
+  while (n > 0) {
+    const int r = frameRxReadSome(rx, n);
+    if (r < 0) return false;
+    if (r == 0) ioIdle();
+    n -= r;
+  }
+  return true;
+}
+
+void frameRxDone(FrameRx& rx) {
+  rx.cur_n = 0;
+  rx.lost  = false;
+}
+
+void frameRxReject(FrameRx& rx) {
+  if (!rx.lost || rx.hdr_at == rx.next_at) rx.next_at = rx.hdr_at + rx.cur_n;   // trusted: the next one follows it
+  // new replay = buf[1..cur_n) + the replayed bytes not read yet
+  const int left = rx.rp_len - rx.rp_pos;
+  int back = rx.cur_n - 1;
+  if (back + left > FRAME_MAX_BYTES) back = FRAME_MAX_BYTES - left;   // cannot happen, see the header
+  if (back < 0) back = 0;
+  memmove(rx.replay + back, rx.replay + rx.rp_pos, left);
+  memcpy(rx.replay, rx.buf + rx.cur_n - back, back);
+  rx.rp_pos = 0;
+  rx.rp_len = (uint16_t)(back + left);
+  rxSkip(rx, rx.cur_n - back);                         // the failed frame's first byte
+  rx.cur_n  = 0;
 }
 
 // ++++ BYTES UTIL ++++
@@ -58,19 +202,42 @@ void wr_u32_le(uint8_t* p, uint32_t v) {
 }
 
 // ++++ CRC ALGORITHM ++++
-// CRC create - host side
-static inline uint16_t crc16_update(uint16_t crc, uint8_t data) {   
-  crc ^= ((uint16_t)data << 8);         // ** shift data 
-  for (int i = 0; i < 8; i++) {
-    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+// CRC16-CCITT (poly 0x1021, MSB-first): table[b] = CRC of the byte b shifted through 8 rounds,
+// so one lookup replaces the 8-step bit loop. Built at compile time, 512 bytes of const data.
+struct Crc16Table {
+  uint16_t t[256];
+  constexpr Crc16Table() : t() {
+    for (int b = 0; b < 256; b++) {
+      uint16_t crc = (uint16_t)(b << 8);
+      for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+      t[b] = crc;
+    }
+  }
+};
+static constexpr Crc16Table CRC16_TABLE{};
+
+// streaming: feed any split of the message, in order
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, int n) {
+  for (int i = 0; i < n; i++) {
+    crc = (uint16_t)((crc << 8) ^ CRC16_TABLE.t[(uint8_t)((crc >> 8) ^ data[i])]);
   }
   return crc;
 }
 
-// CRC validate - slave side
+// CRC validate - slave side (one shot)
 uint16_t crc16_ccitt(const uint8_t* data, int n, uint16_t init) {
+  return crc16_update(init, data, n);
+}
+
+// bit-by-bit reference (host benchmarks / cross-check only)
+uint16_t crc16_ccitt_bitwise(const uint8_t* data, int n, uint16_t init) {
   uint16_t crc = init;
-  for (int i = 0; i < n; i++) crc = crc16_update(crc, data[i]);
+  for (int k = 0; k < n; k++) {
+    crc ^= ((uint16_t)data[k] << 8);         // ** shift data
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
   return crc;
 }
 
@@ -83,6 +250,69 @@ void buildX(const uint8_t* packed256, uint8_t* X512) {
   }
 }
 
+// ++++ FRAME ENCODINGS ++++
+// Both decoders check the whole BODY first, so a bad one never leaves a half-applied state.
+static inline uint8_t encHalf(int byte_index) {
+  return byte_index < DATA_HALF ? ENC_CHG_PICO1 : ENC_CHG_PICO2;
+}
+
+bool decodeDelta(uint8_t* state512, const uint8_t* body, int len, uint8_t* changed) {
+  // ---- A. check: tokens complete, never past byte 511 ----
+  int i = 0, pos = 0;
+  while (i < len) {
+    if (len - i < 2) return false;
+    pos += body[i];
+    const int n = body[i + 1];
+    i += 2;
+    if (n > len - i || n > DATA_BYTES - pos) return false;
+    i   += n;
+    pos += n;
+  }
+
+  // ---- B. apply ----
+  uint8_t chg = 0;
+  i = 0;
+  pos = 0;
+  while (i < len) {
+    pos += body[i];
+    const int n = body[i + 1];
+    i += 2;
+    for (int k = 0; k < n; ++k, ++pos) {
+      const uint8_t x = body[i++];
+      if (x) {
+        state512[pos] ^= x;
+        chg |= encHalf(pos);
+      }
+    }
+  }
+  *changed = chg;
+  return true;
+}
+
+bool decodeSparse(uint8_t* state512, const uint8_t* body, int len, uint8_t* changed) {
+  // ---- A. check: whole pairs, index < 1024, bits 10..11 clear ----
+  if (len % SPARSE_PAIR_BYTES) return false;
+  for (int i = 0; i < len; i += SPARSE_PAIR_BYTES) {
+    if (rd_u16_le(body + i) & 0x0C00) return false;
+  }
+
+  // ---- B. apply ----
+  uint8_t chg = 0;
+  for (int i = 0; i < len; i += SPARSE_PAIR_BYTES) {
+    const uint16_t p = rd_u16_le(body + i);
+    const int      m = p & 0x03FF;
+    const uint8_t  v = (uint8_t)(p >> 12);
+    uint8_t& b = state512[m >> 1];
+    const uint8_t nb = (m & 1) ? (uint8_t)((b & 0x0F) | (v << 4)) : (uint8_t)((b & 0xF0) | v);
+    if (nb != b) {
+      b = nb;
+      chg |= encHalf(m >> 1);
+    }
+  }
+  *changed = chg;
+  return true;
+}
+
 // ++++ ACTION (send final signal via I2C) ++++
 // IMPROTANT: Communication rule: 
 // -> for ALL buses (i2c0, i2c1) start from 0x40 address increase number by 1    
@@ -120,75 +350,909 @@ void buildX(const uint8_t* packed256, uint8_t* X512) {
 //   intensity = value - 7   => range [-7..+7]
 //   pwm magnitude is based on |intensity| mapped to 0..4095
 
-static constexpr uint8_t  BASE_ADDR  = 0x40;
-static constexpr int      NUM_BOARDS = 32;
-static constexpr int      MAG_PER_BRD = 8;
 static constexpr uint16_t PWM_MAX    = 4095;
 
-// output magnitude of pwm (0..4095) from intensity magnitude (|intensity|)
-static inline uint16_t intensityToPwm(int intensity) {
-  if (intensity == 0) return 0;
-  int mag = abs(intensity);                 // 1..7
-  // linear map: mag=7 -> 4095, mag=1 -> 585 (approx)
-  return (uint16_t)((mag * PWM_MAX) / 7);
-}
-
-// "intensity" is to check the polarity | "pairIdx" is the index you save | "Adafruit_PWMServoDriver" object from the library
-// for each driver, update pwm ("setPWM") to the obj, obj addr
-static inline void setPair(Adafruit_PWMServoDriver& b, int pairIdx, int intensity, uint16_t pwm) {
-  const int left  = 2 * pairIdx;
-  const int right = left + 1;
-
-  // controlling polarity by selecting which side of the pair is driven (H-bridge direction)
-  if (intensity > 0) {
-    b.setPWM(left,  0, pwm);
-    b.setPWM(right, 0, 0);
-  } else if (intensity < 0) {
-    b.setPWM(left,  0, 0);
-    b.setPWM(right, 0, pwm);
-  } else {
-    b.setPWM(left,  0, 0);
-    b.setPWM(right, 0, 0);
+// linear map: |value - 7| = 7 -> 4095, 1 -> 585 (15 is forbidden -> OFF)
+static constexpr uint16_t linearPwm(int value) {
+  return (value == 15) ? 0 : (uint16_t)((((value < 7) ? 7 - value : value - 7) * PWM_MAX) / 7);
+}
+
+// MAG_IMG[value] = register image of one magnet (one pair of channels), built at compile time:
+//   [LEFT  ON_L, ON_H, OFF_L, OFF_H] [RIGHT ON_L, ON_H, OFF_L, OFF_H]
+// -> same bytes setPWM(ch, 0, pwm) puts on the wire for both channels of the pair
+// -> 16 values * 8 bytes = 128 bytes, no subtract / abs / divide / branch per magnet at run time
+static constexpr int MAG_IMG_BYTES = PCA_MAG_IMG_BYTES;
+
+struct MagImgTable {
+  uint8_t v[16][MAG_IMG_BYTES];
+  constexpr MagImgTable() : v() {
+    for (int value = 0; value < 16; ++value) {
+      const int intensity = (value == 15) ? 0 : value - 7;       // 15 is forbidden -> OFF
+      const uint16_t pwm  = linearPwm(value);
+
+      // controlling polarity by selecting which side of the pair is driven (H-bridge direction)
+      const uint16_t left  = (intensity > 0) ? pwm : 0;
+      const uint16_t right = (intensity < 0) ? pwm : 0;
+      v[value][2] = (uint8_t)(left & 0xFF);
+      v[value][3] = (uint8_t)(left >> 8);
+      v[value][PCA_CH_BYTES + 2] = (uint8_t)(right & 0xFF);
+      v[value][PCA_CH_BYTES + 3] = (uint8_t)(right >> 8);         // ON_L / ON_H stay 0
+    }
   }
+};
+static constexpr MagImgTable MAG_IMG{};
+
+// the board table of an uncalibrated bus: MAG_IMG for each of its 8 magnets (1 KB of const data)
+static constexpr BoardLut linearBoard() {
+  BoardLut b{};
+  for (int m = 0; m < PCA_MAG_PER_BOARD; ++m)
+    for (int value = 0; value < 16; ++value)
+      for (int k = 0; k < MAG_IMG_BYTES; ++k) b.v[m][value][k] = MAG_IMG.v[value][k];
+  return b;
 }
+static constexpr BoardLut BOARD_LINEAR = linearBoard();
 
-// Action Main function | apply (applyBus) X512 (magnet state of 512 magnets - 256 bytes) to both buses (128+ byte/bus).
-// - boards0[i] corresponds to address BASE_ADDR + i on bus0
-// - boards1[i] corresponds to address BASE_ADDR + i on bus1
-// Adafruit_PWMServoDriver: class type 
-void actionX(Adafruit_PWMServoDriver* boards0[NUM_BOARDS], Adafruit_PWMServoDriver* boards1[NUM_BOARDS], const uint8_t* X512) {
-
-  // "boards[NUM_BOARDS]" is pca9685 obj | "Xbase" is 256byte (512 magnet state) | for 32 boards, considering each board board[i]
-  auto applyBus = [&](Adafruit_PWMServoDriver* boards[NUM_BOARDS], const uint8_t* Xbase) {
-    
-    // for loop takes a PCA9685 as a chunck
-    for (int dev = 0; dev < NUM_BOARDS; ++dev) {                          // boards0(32) or boards1(32) set
-      Adafruit_PWMServoDriver* b = boards[dev];                           // save a board object | e.g. boards[0] = new Adafruit_PWMServoDriver(0x40) (== b);
-      if (!b) continue;                                                   // if board object is not assigned skip a loop
-
-      // for each PCA9685's addr, 8 magnets per board -> 8 pairs -> 16 PWM channels
-      for (int m = 0; m < MAG_PER_BRD; ++m) {                             // global constexpr MAG_Per_BRD = 8
-        const uint8_t value = Xbase[dev * MAG_PER_BRD + m];               // get an intensity value from X 
-
-        // value 15 is forbidden; safest behavior: turn this magnet OFF
-        if (value == 15) {
-          setPair(*b, m, 0, 0);
-          continue;
-        }
+// table of board dev | chosen once per board, then one lookup per magnet
+static inline const BoardLut& boardLut(const PcaBus& bus, int dev) {
+  return bus.lut ? bus.lut[dev] : BOARD_LINEAR;
+}
+
+// nibble value of magnet m of one board (4 packed bytes, low nibble first)
+static inline uint8_t magValue(const uint8_t* pb, int m) {
+  return (uint8_t)((pb[m >> 1] >> ((m & 1) * 4)) & 0x0F);
+}
+
+static inline void addCost(PcaBus& bus, uint32_t transactions, uint32_t bytes) {
+  bus.frame.transactions += transactions;
+  bus.frame.bytes        += bytes;
+  bus.total.transactions += transactions;
+  bus.total.bytes        += bytes;
+}
+
+// result of one transaction to addr (BOARD HEALTH) | a skipped board that answers is back,
+// a failed write leaves the board behind its shadow, so its next frame rewrites it
+static void pcaResult(PcaBus& bus, uint8_t addr, bool ok) {
+  if (addr == PCA_ALLCALL_ADDR) {                                       // BROADCAST: every board or none
+    if (!ok) {
+      ++bus.nack_total;
+      bus.force = 0xFFFFFFFFu;
+      bus.bcast_nack = true;                                            // per-board writes from now on
+    }
+    return;
+  }
+  const int dev = addr - bus.base_addr;
+  if (dev < 0 || dev >= PCA_BOARDS_PER_BUS) return;
+  const uint32_t bit = 1u << dev;
+  if (ok) {
+    bus.fails[dev] = 0;
+    if (bus.skip & bit) {
+      bus.skip  &= ~bit;
+      bus.force |= bit;                                                 // its registers are unknown
+      bus.bcast_nack = false;                                           // the re-probe set MODE1.ALLCALL
+    }
+    return;
+  }
+  ++bus.nack_total;
+  bus.force |= bit;                                                     // it missed part of a frame
+  if (bus.nacks[dev] < 0xFFFF) ++bus.nacks[dev];
+  if (bus.fails[dev] < PCA_FAIL_SKIP) ++bus.fails[dev];
+  if (bus.fails[dev] >= PCA_FAIL_SKIP) bus.skip |= bit;
+}
+
+// bind bus to a Wire instance | everything else starts at zero (shadow invalid -> full first frame)
+void pcaBusInit(PcaBus& bus, TwoWire& wire, uint8_t base_addr) {
+  memset(&bus, 0, sizeof(bus));
+  bus.wire      = &wire;
+  bus.base_addr = base_addr;
+}
+
+// async: claim the next queue slot | waits (pumping) only if the queue is full
+// the caller fills t.buf[1 .. n] in place, then queueCommit()
+static I2cTxn& queueReserve(PcaBus& bus, uint8_t addr, uint8_t reg, int n) {
+  while (bus.q_count == I2C_QUEUE_DEPTH) i2cPump(bus);
+
+  I2cTxn& t = bus.q[(bus.q_head + bus.q_count) % I2C_QUEUE_DEPTH];
+  t.addr   = addr;
+  t.len    = (uint8_t)(1 + n);
+  t.buf[0] = reg;
+  return t;
+}
+
+static void queueCommit(PcaBus& bus) {
+  ++bus.q_count;
+  ++bus.q_pushed;
+  i2cPump(bus);                                                       // start right away if idle
+}
+
+// async: copy one transaction into the queue
+static void queueTxn(PcaBus& bus, uint8_t addr, uint8_t reg, const uint8_t* src, int n) {
+  I2cTxn& t = queueReserve(bus, addr, reg, n);
+  memcpy(t.buf + 1, src, n);
+  queueCommit(bus);
+}
+
+// burst write | register "reg" of board "dev" | auto-increment walks LEDn registers for us
+static void writeRegsAt(PcaBus& bus, uint8_t addr, uint8_t reg, const uint8_t* src, int n) {
+  int done = 0;
+  while (done < n) {
+    int take = n - done;
+    if (take > I2C_MAX_PAYLOAD) take = I2C_MAX_PAYLOAD;               // Wire buffer limit -> chunk
+
+    if (bus.async) {
+      queueTxn(bus, addr, (uint8_t)(reg + done), src + done, take);
+    } else {
+      bus.wire->beginTransmission(addr);
+      bus.wire->write((uint8_t)(reg + done));                        // start register of this chunk
+      bus.wire->write(src + done, take);
+      pcaResult(bus, addr, bus.wire->endTransmission() == 0);
+    }
+
+    addCost(bus, 1, (uint32_t)(2 + take));                            // addr + reg + payload
+    done += take;
+  }
+}
+
+void pcaWriteRegs(PcaBus& bus, int dev, uint8_t reg, const uint8_t* src, int n) {
+  writeRegsAt(bus, (uint8_t)(bus.base_addr + dev), reg, src, n);
+}
+
+// MODE1.AI must be set for pcaWriteRegs | Adafruit setPWMFreq() sets it already, this makes it explicit
+// MODE1.ALLCALL for BROADCAST | Adafruit begin() clears it
+void pcaEnableAutoIncrement(PcaBus& bus, int dev) {
+  const uint8_t addr = (uint8_t)(bus.base_addr + dev);
+
+  bus.wire->beginTransmission(addr);
+  bus.wire->write(PCA_REG_MODE1);
+  bus.wire->endTransmission();
+  bus.wire->requestFrom(addr, (uint8_t)1);
+  const uint8_t mode1 = bus.wire->available() ? (uint8_t)bus.wire->read() : 0;
+  addCost(bus, 2, 2 + 2);                                             // [addr, reg] + [addr, data]
+
+  const uint8_t want = PCA_MODE1_AI | PCA_MODE1_ALLCALL;
+  if ((mode1 & want) == want) return;
+  const uint8_t v = (uint8_t)(mode1 | want);
+  pcaWriteRegs(bus, dev, PCA_REG_MODE1, &v, 1);
+}
+
+void pcaInvalidate(PcaBus& bus) {
+  bus.shadow_valid = false;
+}
+
+// burst of channels [ch, ch + n) of board "dev" | register bytes come straight from the board table into
+// the Wire buffer (blocking) or the queue slot (async); "img" holds the 8 table rows of this board
+static void writeChannelsAt(PcaBus& bus, uint8_t addr, int ch, int n, const uint8_t* const img[PCA_MAG_PER_BOARD]) {
+  const int     per_txn = I2C_MAX_PAYLOAD / PCA_CH_BYTES;               // Wire buffer limit -> chunk
+  const int     end     = ch + n;
 
-        const int intensity = (int)value - 7;                 // [-7..+7] subtract 7 (offset), make first discrete intensity
-        const uint16_t pwm  = intensityToPwm(intensity);      // trasnslate to PWM value for PCA9685 to output
+  while (ch < end) {
+    const int take = (end - ch < per_txn) ? (end - ch) : per_txn;
+    const uint8_t reg = (uint8_t)(PCA_REG_LED0_ON_L + ch * PCA_CH_BYTES);
 
-        setPair(*b, m, intensity, pwm);                       // make a motor driver input signal, keep it into the Adafruit_PWMServoDriver* boards0, boards1
+    if (bus.async) {
+      I2cTxn& t = queueReserve(bus, addr, reg, take * PCA_CH_BYTES);
+      uint8_t* dst = t.buf + 1;
+      for (int k = ch; k < ch + take; ++k, dst += PCA_CH_BYTES) {
+        memcpy(dst, img[k >> 1] + (k & 1) * PCA_CH_BYTES, PCA_CH_BYTES);
       }
+      queueCommit(bus);
+    } else {
+      bus.wire->beginTransmission(addr);
+      bus.wire->write(reg);                                               // start register of this chunk
+      for (int k = ch; k < ch + take; ++k) {
+        bus.wire->write(img[k >> 1] + (k & 1) * PCA_CH_BYTES, PCA_CH_BYTES);
+      }
+      pcaResult(bus, addr, bus.wire->endTransmission() == 0);
     }
-  };
-  
+
+    addCost(bus, 1, (uint32_t)(2 + take * PCA_CH_BYTES));                // addr + reg + payload
+    ch += take;
+  }
+}
+
+static inline void writeChannels(PcaBus& bus, int dev, int ch, int n, const uint8_t* const img[PCA_MAG_PER_BOARD]) {
+  writeChannelsAt(bus, (uint8_t)(bus.base_addr + dev), ch, n, img);
+}
+
+// start of a frame on one bus: reset the frame cost | true if every board has to be written
+// (first frame, after pcaInvalidate(), periodic refresh, or the shadow holds another depth)
+static bool frameBegin(PcaBus& bus, int depth) {
+  bus.frame.transactions = 0;
+  bus.frame.bytes        = 0;
+
+  bool full = !bus.shadow_valid || bus.shadow_depth != depth;
+  bus.shadow_depth = (uint8_t)depth;
+  if (bus.refresh_every && ++bus.since_refresh >= bus.refresh_every) {
+    full = true;
+    bus.bcast_nack = false;                                             // BROADCAST gets another try
+  }
+  if (full) bus.since_refresh = 0;
+  return full;
+}
+
+// dirty mask of one board going from shadow sb to pb: bit ch set if channel ch registers change
+// (15 and 7 are the same image -> clean)
+static uint16_t boardDirty(const BoardLut& lut, const uint8_t* pb, const uint8_t* sb) {
+  uint16_t dirty = 0;
+  for (int m = 0; m < PCA_MAG_PER_BOARD; ++m) {
+    const uint8_t* now = lut.v[m][magValue(pb, m)];
+    const uint8_t* was = lut.v[m][magValue(sb, m)];
+    if (memcmp(now, was, PCA_CH_BYTES) != 0)                               dirty |= (uint16_t)(1u << (2 * m));
+    if (memcmp(now + PCA_CH_BYTES, was + PCA_CH_BYTES, PCA_CH_BYTES) != 0) dirty |= (uint16_t)(1u << (2 * m + 1));
+  }
+  return dirty;
+}
+
+// next run of dirty channels at or after *ch (short clean gaps are sent along)
+// -> *ch = first channel, returns the channel count (0: none left)
+static int nextDirtyRun(uint16_t dirty, int* ch) {
+  while (*ch < PCA_CHANNELS && !(dirty & (1u << *ch))) ++*ch;
+  if (*ch == PCA_CHANNELS) return 0;
+  int last = *ch;
+  for (int k = *ch + 1; k < PCA_CHANNELS && k - last <= PCA_MERGE_GAP_CH + 1; ++k) {
+    if (dirty & (1u << k)) last = k;
+  }
+  return last - *ch + 1;
+}
+
+// ++++ BROADCAST ++++
+static constexpr uint8_t NIBBLE_OFF = 7;
+
+// one bus of all-off nibbles (0x77), built at compile time like MAG_IMG
+struct OffBusTable {
+  uint8_t v[PCA_PACKED_PER_BUS];
+  constexpr OffBusTable() : v() {
+    for (int i = 0; i < PCA_PACKED_PER_BUS; ++i) v[i] = (uint8_t)((NIBBLE_OFF << 4) | NIBBLE_OFF);
+  }
+};
+static constexpr OffBusTable OFF_BUS{};
+
+// the nibble all 256 magnets hold (NIBBLE_OFF: all off, 7 and 15 mixed) | -1: not uniform
+static int uniformNibble(const uint8_t* packed128) {
+  const uint8_t b0 = packed128[0];
+  bool same = (b0 >> 4) == (b0 & 0x0F);
+  bool off  = (b0 | 0x88) == 0xFF;                                          // both nibbles 7 or 15
+  for (int i = 1; i < PCA_PACKED_PER_BUS && (same || off); ++i) {
+    const uint8_t b = packed128[i];
+    same = same && b == b0;
+    off  = off && (b | 0x88) == 0xFF;
+  }
+  if (off) return NIBBLE_OFF;
+  return same ? (b0 & 0x0F) : -1;
+}
+
+// boards (not skipped) the frame would write
+static int boardsBehind(const PcaBus& bus, const uint8_t* packed128, bool full) {
+  int n = 0;
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    const uint32_t bit = 1u << dev;
+    if (bus.skip & bit) continue;
+    const int k = dev * PCA_PACKED_PER_BOARD;
+    if (full || (bus.force & bit) || memcmp(packed128 + k, bus.shadow + k, PCA_PACKED_PER_BOARD) != 0) ++n;
+  }
+  return n;
+}
+
+// every board that answers holds packed128 (uniform) | before the write: a NACK forces them again
+static void broadcastDone(PcaBus& bus, const uint8_t* packed128) {
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    if (bus.skip & (1u << dev)) continue;
+    memcpy(bus.shadow + dev * PCA_PACKED_PER_BOARD, packed128 + dev * PCA_PACKED_PER_BOARD, PCA_PACKED_PER_BOARD);
+  }
+  bus.force &= bus.skip;
+  bus.shadow_depth = DEPTH_NIBBLE;
+  bus.shadow_valid = true;
+}
+
+static void broadcastOff(PcaBus& bus) {
+  static const uint8_t zeros[PCA_CH_BYTES] = {0};                          // ON = OFF = 0, as MAG_IMG[7]
+  writeRegsAt(bus, PCA_ALLCALL_ADDR, PCA_REG_ALL_LED, zeros, PCA_CH_BYTES);
+}
+
+// uniform frame on one bus | true if it went out as one broadcast
+static bool applyBusUniform(PcaBus& bus, const uint8_t* packed128, bool full) {
+  const int value = uniformNibble(packed128);
+  if (value < 0 || bus.bcast_nack || (value != NIBBLE_OFF && bus.lut)) return false;
+  const int behind = boardsBehind(bus, packed128, full);
+  if (behind == 0 || (value != NIBBLE_OFF && behind < 2)) return false;   // per-board writes are cheaper
+
+  broadcastDone(bus, packed128);
+  if (value == NIBBLE_OFF) {
+    broadcastOff(bus);
+  } else {
+    const uint8_t* img[PCA_MAG_PER_BOARD];
+    for (int m = 0; m < PCA_MAG_PER_BOARD; ++m) img[m] = MAG_IMG.v[value];
+    writeChannelsAt(bus, PCA_ALLCALL_ADDR, 0, PCA_CHANNELS, img);
+  }
+  return true;
+}
+
+// async: forget the queued transactions (the one on the wire finishes) | the tickets taken
+// for them are done, and the shadow no longer says what the boards hold
+static void i2cDrop(PcaBus& bus) {
+  const uint8_t keep = bus.q_busy ? 1 : 0;
+  bus.q_done  += (uint32_t)(bus.q_count - keep);
+  bus.q_count  = keep;
+  bus.shadow_valid = false;
+}
+
+// every board behind -> applyBusPacked broadcasts; both buses are queued before either is waited
+// on, and a NACKed broadcast is followed by the per-board writes of that bus right away
+void pcaAllOff(PcaBus& bus0, PcaBus& bus1, void (*queued)()) {
+  PcaBus* const buses[2] = { &bus0, &bus1 };
+  bool again[2] = { true, true };
+  const bool async = bus0.async && bus1.async;                       // broadcasts only queued, DMA sends them
+  i2cDrop(bus0);
+  i2cDrop(bus1);
+  if (queued && !async) queued();
+  for (int pass = 0; pass < 2; ++pass) {
+    bool     bcast[2]  = { false, false };
+    uint32_t ticket[2] = { 0, 0 };
+    for (int i = 0; i < 2; ++i) {
+      if (!again[i]) continue;
+      PcaBus& bus = *buses[i];
+      bcast[i] = !bus.bcast_nack;
+      bus.force |= ~bus.skip;
+      applyBusPacked(bus, OFF_BUS.v);
+      ticket[i] = i2cTicket(bus);
+    }
+    if (queued && async && pass == 0) queued();
+    for (int i = 0; i < 2; ++i) {
+      if (!again[i]) continue;
+      while (!i2cDone(*buses[i], ticket[i])) {
+        i2cPump(bus0);
+        i2cPump(bus1);
+      }
+      again[i] = bcast[i] && buses[i]->bcast_nack;                   // unanswered: per board now
+    }
+  }
+}
+
+// apply 128 packed bytes (256 magnet states) to one i2c chain of 32 PCA9685 (bus)
+// One table lookup per magnet -> one I2C burst per dirty channel run
+void applyBusPacked(PcaBus& bus, const uint8_t* packed128) {
+  const bool full = frameBegin(bus, DEPTH_NIBBLE);
+  if (applyBusUniform(bus, packed128, full)) return;                        // BROADCAST
+
+  // for loop takes a PCA9685 as a chunck
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    const uint8_t* pb = packed128 + dev * PCA_PACKED_PER_BOARD;
+    uint8_t*       sb = bus.shadow + dev * PCA_PACKED_PER_BOARD;
+    const uint32_t bit = 1u << dev;
+
+    if (bus.skip & bit) continue;                                           // dead / missing board
+    const bool all = full || (bus.force & bit);
+    if (!all && memcmp(pb, sb, PCA_PACKED_PER_BOARD) == 0) continue;     // clean board: skip
+
+    // 8 magnets per board -> 8 table rows -> 16 PWM channels
+    const BoardLut& lut = boardLut(bus, dev);
+    const uint8_t* img[PCA_MAG_PER_BOARD];
+    for (int m = 0; m < PCA_MAG_PER_BOARD; ++m) img[m] = lut.v[m][magValue(pb, m)];
+    const uint16_t dirty = all ? 0xFFFF : boardDirty(lut, pb, sb);
+    memcpy(sb, pb, PCA_PACKED_PER_BOARD);                                   // remember what the board will hold
+    bus.force &= ~bit;
+
+    // one burst per run of dirty channels
+    int ch = 0, n;
+    while ((n = nextDirtyRun(dirty, &ch)) > 0) {
+      writeChannels(bus, dev, ch, n, img);
+      ch += n;
+    }
+  }
+  bus.shadow_valid = true;
+}
+
+// unpacked input (X values, one per magnet) | repack and take the table path
+void applyBus(PcaBus& bus, const uint8_t* Xbase) {
+  uint8_t packed[PCA_PACKED_PER_BUS];
+  for (int i = 0; i < PCA_PACKED_PER_BUS; ++i) {
+    packed[i] = (uint8_t)((Xbase[2 * i] & 0x0F) | ((Xbase[2 * i + 1] & 0x0F) << 4));
+  }
+  applyBusPacked(bus, packed);
+}
+
+// Action Main function | apply (applyBus) X512 (magnet state of 512 magnets - 256 bytes) to both buses (128+ byte/bus).
+// - bus0 board i sits at address bus0.base_addr + i
+// - bus1 board i sits at address bus1.base_addr + i
+void actionX(PcaBus& bus0, PcaBus& bus1, const uint8_t* X512) {
   // bus0 boards: X512[0..255] (256 magnets = 32 boards * 8 magnets)
-  applyBus(boards0, X512);
+  applyBus(bus0, X512);
 
   // bus1 boards: X512[256..511]
-  applyBus(boards1, X512 + 256);
+  applyBus(bus1, X512 + 256);
+}
+
+// same, straight from the packed frame bytes (what the firmware receives)
+void actionPacked(PcaBus& bus0, PcaBus& bus1, const uint8_t* packed256) {
+  applyBusPacked(bus0, packed256);                          // bus0 boards: packed256[0..127]
+  applyBusPacked(bus1, packed256 + PCA_PACKED_PER_BUS);     // bus1 boards: packed256[128..255]
+}
+
+// ++++ FRAME DEPTH ++++
+// bits go in and out of a 32-bit accumulator, LSB first: byte k holds bits 8k..8k+7 of the string
+void deepUnpack(const uint8_t* src, int n, int depth, uint16_t* v) {
+  const uint32_t mask = (1u << depth) - 1;
+  uint32_t acc  = 0;
+  int      bits = 0;
+  for (int m = 0; m < n; ++m) {
+    while (bits < depth) { acc |= (uint32_t)*src++ << bits; bits += 8; }
+    v[m] = (uint16_t)(acc & mask);
+    acc >>= depth;
+    bits -= depth;
+  }
+}
+
+void deepPack(const uint16_t* v, int n, int depth, uint8_t* dst) {
+  const uint32_t mask = (1u << depth) - 1;
+  uint32_t acc  = 0;
+  int      bits = 0;
+  for (int m = 0; m < n; ++m) {
+    acc |= (v[m] & mask) << bits;
+    bits += depth;
+    while (bits >= 8) { *dst++ = (uint8_t)acc; acc >>= 8; bits -= 8; }
+  }
+  if (bits) *dst = (uint8_t)acc;
+}
+
+// per-frame constants of one depth | step = CAL_LEVELS / 2 curve points per C, 8.24 fixed point,
+// rounded up so |value - C| = C lands exactly on the last point
+struct DeepScale {
+  uint16_t center;
+  uint16_t off;                                                       // all ones
+  uint32_t step;
+};
+
+static constexpr int      CURVE_HALF = CAL_LEVELS / 2;                // 7: points from off to full
+static constexpr uint32_t CURVE_END  = (uint32_t)CURVE_HALF << 24;
+
+static DeepScale deepScale(int depth) {
+  DeepScale s;
+  s.center = depthCenter(depth);
+  s.off    = (uint16_t)((1u << depth) - 1);
+  s.step   = (CURVE_END + s.center - 1) / s.center;
+  return s;
+}
+
+// point p (nibble value 0..14) of a curve | nullptr = linear; 7 is off whatever the curve says
+static inline int curvePoint(const uint8_t* curve, int p) {
+  if (p == CURVE_HALF) return 0;
+  return curve ? rd_u16_le(&curve[2 * p]) : linearPwm(p);
+}
+
+// register image of magnet j (bus.cal index) at deep value v: the curve point below |v - C|,
+// plus the share of the step to the next one, then gain / offset / swap as calBuild does
+static void deepImage(const PcaBus& bus, int j, uint16_t v, const DeepScale& s, uint8_t* img) {
+  memset(img, 0, MAG_IMG_BYTES);                                      // ON_L / ON_H stay 0
+  if (v == s.center || v == s.off) return;                            // off stays off
+
+  const bool     up  = v > s.center;
+  const uint32_t mag = up ? (uint32_t)(v - s.center) : (uint32_t)(s.center - v);
+  uint32_t pos = mag * s.step;                                        // curve points from off, 8.24
+  if (pos > CURVE_END) pos = CURVE_END;
+  const int     k    = (int)(pos >> 24);
+  const int32_t frac = (int32_t)((pos >> 8) & 0xFFFF);
+
+  uint32_t       gain   = CAL_GAIN_ONE;
+  int            offset = 0;
+  uint8_t        flags  = 0;
+  const uint8_t* curve  = nullptr;
+  if (bus.cal) {
+    const uint8_t* r = bus.cal->rec[bus.cal_first + j];
+    gain   = rd_u16_le(&r[0]);
+    offset = (int16_t)rd_u16_le(&r[2]);
+    flags  = r[4];
+    curve  = bus.cal->curve[(flags & CAL_CURVE_MASK) >> CAL_CURVE_SHIFT];
+  }
+
+  // nibble values: up walks 8..14, down walks 6..0
+  const int p0 = up ? CURVE_HALF + k : CURVE_HALF - k;
+  int pwm = curvePoint(curve, p0);
+  if (frac) pwm += ((curvePoint(curve, up ? p0 + 1 : p0 - 1) - pwm) * frac) >> 16;
+  pwm = (int)(((uint32_t)pwm * gain) >> 10) + offset;
+  if (pwm < 0) pwm = 0;
+  if (pwm > PWM_MAX) pwm = PWM_MAX;
+
+  bool left = up;
+  if (flags & CAL_FLAG_SWAP) left = !left;
+  uint8_t* ch = img + (left ? 0 : PCA_CH_BYTES);
+  ch[2] = (uint8_t)(pwm & 0xFF);
+  ch[3] = (uint8_t)(pwm >> 8);
+}
+
+// board = depth bytes (8 magnets) | dirty magnets: value differs from the shadow's -> both channels
+void applyBusDeep(PcaBus& bus, const uint8_t* src, int depth) {
+  const bool      full = frameBegin(bus, depth);
+  const DeepScale s    = deepScale(depth);
+
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    const uint8_t* pb = src + dev * depth;
+    uint8_t*       sb = bus.shadow + dev * depth;
+    const uint32_t bit = 1u << dev;
+
+    if (bus.skip & bit) continue;                                           // dead / missing board
+    const bool all = full || (bus.force & bit);
+    if (!all && memcmp(pb, sb, depth) == 0) continue;                       // clean board: skip
+
+    uint16_t now[PCA_MAG_PER_BOARD], was[PCA_MAG_PER_BOARD];
+    deepUnpack(pb, PCA_MAG_PER_BOARD, depth, now);
+    deepUnpack(sb, PCA_MAG_PER_BOARD, depth, was);
+    uint8_t        rows[PCA_MAG_PER_BOARD][MAG_IMG_BYTES];
+    const uint8_t* img[PCA_MAG_PER_BOARD];
+    uint16_t       dirty = all ? 0xFFFF : 0;
+    for (int m = 0; m < PCA_MAG_PER_BOARD; ++m) {
+      deepImage(bus, dev * PCA_MAG_PER_BOARD + m, now[m], s, rows[m]);   // merged runs may send clean ones
+      img[m] = rows[m];
+      if (now[m] != was[m]) dirty |= (uint16_t)(3u << (2 * m));
+    }
+    memcpy(sb, pb, depth);                                                  // remember what the board will hold
+    bus.force &= ~bit;
+
+    int ch = 0, n;
+    while ((n = nextDirtyRun(dirty, &ch)) > 0) {
+      writeChannels(bus, dev, ch, n, img);
+      ch += n;
+    }
+  }
+  bus.shadow_valid = true;
+}
+
+void applyBusDepth(PcaBus& bus, const uint8_t* src, int depth) {
+  if (depth == DEPTH_NIBBLE) applyBusPacked(bus, src);
+  else                       applyBusDeep(bus, src, depth);
+}
+
+void actionDepth(PcaBus& bus0, PcaBus& bus1, const uint8_t* src, int depth) {
+  applyBusDepth(bus0, src, depth);
+  applyBusDepth(bus1, src + depthBusBytes(depth), depth);
+}
+
+// ++++ BOARD HEALTH ++++
+uint8_t pcaPrescale(float hz) {
+  float v = 25000000.0f / (4096.0f * hz) - 1.0f;                       // 25 MHz internal oscillator
+  if (v < 3.0f)   v = 3.0f;
+  if (v > 255.0f) v = 255.0f;
+  return (uint8_t)(v + 0.5f);
+}
+
+// zero-length write per address, like debug/PCAAdressChecker | before i2cAsyncEnable()
+uint32_t pcaScan(PcaBus& bus) {
+  bus.present = 0;
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    bus.wire->beginTransmission((uint8_t)(bus.base_addr + dev));
+    if (bus.wire->endTransmission() == 0) bus.present |= 1u << dev;
+    addCost(bus, 1, 1);
+  }
+  bus.skip = ~bus.present;
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) bus.fails[dev] = (bus.skip >> dev) & 1 ? PCA_FAIL_SKIP : 0;
+  return bus.present;
+}
+
+// next skipped board after the last one probed gets its bring-up writes; the results land in
+// pcaResult (now in blocking mode, from i2cPump in async mode)
+void pcaHealthService(PcaBus& bus, uint32_t now_ms) {
+  if (!bus.skip || (now_ms - bus.probe_ms) < PCA_REPROBE_MS) return;
+  bus.probe_ms = now_ms;
+
+  int dev = bus.probe_dev;
+  do dev = (dev + 1) % PCA_BOARDS_PER_BUS; while (!(bus.skip & (1u << dev)));
+  bus.probe_dev = (uint8_t)dev;
+
+  const uint8_t sleep = PCA_MODE1_AI | PCA_MODE1_ALLCALL | PCA_MODE1_SLEEP;   // a reset board is asleep at 200 Hz
+  const uint8_t wake  = PCA_MODE1_AI | PCA_MODE1_ALLCALL;
+  pcaWriteRegs(bus, dev, PCA_REG_MODE1, &sleep, 1);
+  pcaWriteRegs(bus, dev, PCA_REG_PRESCALE, &bus.prescale, 1);
+  pcaWriteRegs(bus, dev, PCA_REG_MODE1, &wake, 1);
+}
+
+// ++++ CALIBRATION ++++
+void calDefaults(CalSet& cal) {
+  cal.version = 0;
+  for (int c = 0; c < CAL_CURVES; ++c) {
+    for (int value = 0; value < CAL_LEVELS; ++value) wr_u16_le(&cal.curve[c][2 * value], linearPwm(value));
+  }
+  for (int j = 0; j < CAL_MAGNETS; ++j) {
+    wr_u16_le(&cal.rec[j][0], CAL_GAIN_ONE);
+    wr_u16_le(&cal.rec[j][2], 0);
+    cal.rec[j][4] = 0;
+  }
+}
+
+bool calStore(CalSet& cal, int first, int n, const uint8_t* recs) {
+  if (first < 0 || n < 0 || first + n > CAL_MAGNETS) return false;
+  memcpy(cal.rec[first], recs, (size_t)n * CAL_REC_BYTES);
+  return true;
+}
+
+bool calCurve(CalSet& cal, int curve, const uint8_t* pwm) {
+  if (curve < 0 || curve >= CAL_CURVES) return false;
+  memcpy(cal.curve[curve], pwm, CAL_CURVE_BYTES);
+  return true;
+}
+
+// all the arithmetic happens here, once per commit: 512 magnets * 16 values
+void calBuild(const CalSet& cal, BoardLut* lut) {
+  for (int j = 0; j < CAL_MAGNETS; ++j) {
+    const uint8_t* r      = cal.rec[j];
+    const uint32_t gain   = rd_u16_le(&r[0]);
+    const int      offset = (int16_t)rd_u16_le(&r[2]);
+    const uint8_t  flags  = r[4];
+    const uint8_t* curve  = cal.curve[(flags & CAL_CURVE_MASK) >> CAL_CURVE_SHIFT];
+    uint8_t (*img)[MAG_IMG_BYTES] = lut[j / PCA_MAG_PER_BOARD].v[j % PCA_MAG_PER_BOARD];
+
+    for (int value = 0; value < 16; ++value) {
+      memset(img[value], 0, MAG_IMG_BYTES);                           // ON_L / ON_H stay 0
+      const int intensity = (value == 15) ? 0 : value - 7;
+      if (intensity == 0) continue;                                   // off stays off
+
+      int pwm = (int)((rd_u16_le(&curve[2 * value]) * gain) >> 10) + offset;
+      if (pwm < 0) pwm = 0;
+      if (pwm > PWM_MAX) pwm = PWM_MAX;
+
+      // polarity: which side of the pair is driven, swapped for a coil wired the other way
+      bool left = intensity > 0;
+      if (flags & CAL_FLAG_SWAP) left = !left;
+      uint8_t* ch = img[value] + (left ? 0 : PCA_CH_BYTES);
+      ch[2] = (uint8_t)(pwm & 0xFF);
+      ch[3] = (uint8_t)(pwm >> 8);
+    }
+  }
+}
+
+// written next to CAL_FILE first, then renamed over it: a reset mid-write keeps the old set
+static constexpr char CAL_FILE_TMP[] = "/cal.tmp";
+
+bool calSave(const CalSet& cal) {
+  if (cal.version == 0) return !LittleFS.exists(CAL_FILE) || LittleFS.remove(CAL_FILE);
+
+  static uint8_t buf[CAL_FILE_BYTES];
+  int n = 0;
+  wr_u32_le(&buf[n], CAL_FILE_MAGIC);              n += 4;
+  buf[n] = CAL_FORMAT;                             n += 1;
+  wr_u32_le(&buf[n], cal.version);                 n += 4;
+  memcpy(&buf[n], cal.curve, sizeof(cal.curve));   n += sizeof(cal.curve);
+  memcpy(&buf[n], cal.rec, sizeof(cal.rec));       n += sizeof(cal.rec);
+  wr_u16_le(&buf[n], crc16_final(crc16_update(crc16_init(), buf, n)));
+
+  File f = LittleFS.open(CAL_FILE_TMP, "w");
+  if (!f) return false;
+  const bool ok = f.write(buf, CAL_FILE_BYTES) == (size_t)CAL_FILE_BYTES;
+  f.close();
+  return ok && LittleFS.rename(CAL_FILE_TMP, CAL_FILE);
+}
+
+bool calLoad(CalSet& cal) {
+  static uint8_t buf[CAL_FILE_BYTES];
+  File f = LittleFS.open(CAL_FILE, "r");
+  if (!f) return false;
+  const bool whole = f.size() == (size_t)CAL_FILE_BYTES && f.read(buf, CAL_FILE_BYTES) == CAL_FILE_BYTES;
+  f.close();
+  if (!whole) return false;
+
+  const int n = CAL_FILE_BYTES - CRC_BYTES;
+  if (rd_u32_le(&buf[0]) != CAL_FILE_MAGIC || buf[4] != CAL_FORMAT) return false;
+  if (rd_u16_le(&buf[n]) != crc16_final(crc16_update(crc16_init(), buf, n))) return false;
+
+  cal.version = rd_u32_le(&buf[5]);
+  memcpy(cal.curve, &buf[9], sizeof(cal.curve));
+  memcpy(cal.rec, &buf[9 + sizeof(cal.curve)], sizeof(cal.rec));
+  return true;
+}
+
+void calApply(const CalSet& staged, CalSet& active, BoardLut* lut, PcaBus& bus0, PcaBus& bus1, PatternBank& bank) {
+  if (&active != &staged) memcpy(&active, &staged, sizeof(CalSet));
+  if (active.version) {
+    calBuild(active, lut);
+    bus0.lut = lut;
+    bus1.lut = lut + PCA_BOARDS_PER_BUS;
+  } else {
+    bus0.lut = nullptr;
+    bus1.lut = nullptr;
+  }
+  bus0.cal       = active.version ? &active : nullptr;   // deep frames read the set itself (FRAME DEPTH)
+  bus1.cal       = bus0.cal;
+  bus0.cal_first = 0;
+  bus1.cal_first = PCA_MAG_PER_BUS;
+  bankRebuild(bank, bus0, bus1);                  // stored images were made with the old tables
+  pcaInvalidate(bus0);                            // and so are the registers the boards hold
+  pcaInvalidate(bus1);
+}
+
+// ++++ PATTERN BANK ++++
+// board b's 4 packed bytes -> 8 table rows = its 64 LEDn register bytes, in channel order
+static void bankExpand(BankSlot& slot, const PcaBus& bus0, const PcaBus& bus1) {
+  uint8_t* dst = slot.img;
+  for (int b = 0; b < 2 * PCA_BOARDS_PER_BUS; ++b) {
+    const uint8_t*  pb  = slot.packed + b * PCA_PACKED_PER_BOARD;
+    const BoardLut& lut = (b < PCA_BOARDS_PER_BUS) ? boardLut(bus0, b) : boardLut(bus1, b - PCA_BOARDS_PER_BUS);
+    for (int m = 0; m < PCA_MAG_PER_BOARD; ++m, dst += MAG_IMG_BYTES) memcpy(dst, lut.v[m][magValue(pb, m)], MAG_IMG_BYTES);
+  }
+}
+
+void bankStore(PatternBank& bank, int id, const uint8_t* packed256, const PcaBus& bus0, const PcaBus& bus1) {
+  BankSlot& slot = bank.slot[id];
+  memcpy(slot.packed, packed256, DATA_HALF);
+  bankExpand(slot, bus0, bus1);
+  bank.used |= 1u << id;
+}
+
+void bankRebuild(PatternBank& bank, const PcaBus& bus0, const PcaBus& bus1) {
+  for (int id = 0; id < BANK_SLOTS; ++id) {
+    if (bank.used & (1u << id)) bankExpand(bank.slot[id], bus0, bus1);
+  }
+}
+
+// same dirty runs as applyBusPacked, but each burst is a straight slice of the stored image
+static void applyBusImage(PcaBus& bus, const uint8_t* packed128, const uint8_t* img) {
+  const bool full = frameBegin(bus, DEPTH_NIBBLE);
+  for (int dev = 0; dev < PCA_BOARDS_PER_BUS; ++dev) {
+    const uint8_t* pb = packed128 + dev * PCA_PACKED_PER_BOARD;
+    uint8_t*       sb = bus.shadow + dev * PCA_PACKED_PER_BOARD;
+    const uint32_t bit = 1u << dev;
+    if (bus.skip & bit) continue;                                           // dead / missing board
+    const bool all = full || (bus.force & bit);
+    if (!all && memcmp(pb, sb, PCA_PACKED_PER_BOARD) == 0) continue;     // clean board: skip
+
+    const uint16_t dirty = all ? 0xFFFF : boardDirty(boardLut(bus, dev), pb, sb);
+    memcpy(sb, pb, PCA_PACKED_PER_BOARD);
+    bus.force &= ~bit;
+
+    const uint8_t* board = img + dev * PCA_IMG_BYTES;
+    int ch = 0, n;
+    while ((n = nextDirtyRun(dirty, &ch)) > 0) {
+      pcaWriteRegs(bus, dev, (uint8_t)(PCA_REG_LED0_ON_L + ch * PCA_CH_BYTES), board + ch * PCA_CH_BYTES,
+                   n * PCA_CH_BYTES);
+      ch += n;
+    }
+  }
+  bus.shadow_valid = true;
+}
+
+bool bankApply(PatternBank& bank, int id, PcaBus& bus0, PcaBus& bus1) {
+  if (id < 0 || id >= BANK_SLOTS || !(bank.used & (1u << id))) return false;
+  const BankSlot& slot = bank.slot[id];
+  applyBusImage(bus0, slot.packed, slot.img);
+  applyBusImage(bus1, slot.packed + PCA_PACKED_PER_BUS, slot.img + PCA_BOARDS_PER_BUS * PCA_IMG_BYTES);
+  return true;
+}
+
+// ++++ SEQUENCE PLAYBACK ++++
+// ticks only grows from the interrupt side; one 32-bit read is a consistent snapshot
+
+void seqStart(SeqPlayer& p) {
+  p.ticks    = 0;
+  p.applied  = 0;
+  p.overruns = 0;
+  p.ticket0  = 0;
+  p.ticket1  = 0;
+  p.active   = true;
+}
+
+SeqPollResult seqPoll(SeqPlayer& p, PatternBank& bank, PcaBus& bus0, PcaBus& bus1, uint32_t* tick) {
+  const uint32_t t = p.ticks;
+  if (!p.active || p.count == 0 || t == p.applied) return SEQ_IDLE;
+
+  // skipped ticks never get applied; a step still on the wire makes this one start late
+  uint32_t late = t - p.applied - 1;
+  if (p.applied && (!i2cDone(bus0, p.ticket0) || !i2cDone(bus1, p.ticket1))) ++late;
+
+  bankApply(bank, p.ids[(t - 1) % p.count], bus0, bus1);   // queued in async mode, blocking otherwise
+  p.ticket0  = i2cTicket(bus0);
+  p.ticket1  = i2cTicket(bus1);
+  p.applied  = t;
+  p.overruns += late;
+  *tick = t;
+  return late ? SEQ_LATE : SEQ_STEP;
+}
+
+// ++++ STAGE TRACE ++++
+void traceReset(TraceRing& t) {
+  memset(t.count, 0, sizeof(t.count));
+}
+
+// min / avg / max and percentiles over the samples still in the ring (sorted copy, query time only)
+void traceSummary(const TraceRing& t, uint8_t stage, uint8_t* out) {
+  static uint32_t v[TRACE_DEPTH];
+  const uint32_t total = t.count[stage];
+  const int      n     = total < (uint32_t)TRACE_DEPTH ? (int)total : TRACE_DEPTH;
+  uint64_t sum = 0;
+  for (int i = 0; i < n; ++i) {                         // insertion sort: n <= TRACE_DEPTH
+    const uint32_t x = t.us[stage][i];
+    sum += x;
+    int j = i;
+    while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; --j; }
+    v[j] = x;
+  }
+
+  out[0] = stage;
+  wr_u32_le(&out[1], total);
+  wr_u32_le(&out[5],  n ? v[0] : 0);
+  wr_u32_le(&out[9],  n ? (uint32_t)(sum / (uint32_t)n) : 0);
+  wr_u32_le(&out[13], n ? v[n - 1] : 0);
+  wr_u32_le(&out[17], n ? v[(n - 1) * 50 / 100] : 0);
+  wr_u32_le(&out[21], n ? v[(n - 1) * 90 / 100] : 0);
+  wr_u32_le(&out[25], n ? v[(n - 1) * 99 / 100] : 0);
+}
+
+// ++++ ASYNC I2C ENGINE (optional) ++++
+// one transaction on the wire per bus | the DMA reads straight from the queue slot
+
+void i2cAsyncEnable(PcaBus& bus) {
+  bus.async = true;
+}
+
+// TwoWire does not report NACKs of DMA transfers: read (and clear) the controller's abort flag
+static bool i2cAborted(const PcaBus& bus) {
+  i2c_hw_t* hw = i2c_get_hw(bus.wire == &Wire1 ? i2c1 : i2c0);
+  if (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)) return false;
+  (void)hw->clr_tx_abrt;                                              // read to clear
+  return true;
+}
+
+bool i2cPump(PcaBus& bus) {
+  if (bus.q_busy) {
+    bool ok = true;
+    if (!bus.wire->finishedAsync()) {
+      if ((micros() - bus.q_start_us) < I2C_TXN_TIMEOUT_US) return false;
+      bus.wire->abortAsync();                                         // stuck (held bus, dead board)
+      ok = false;
+    }
+    if (i2cAborted(bus)) ok = false;
+    pcaResult(bus, bus.q[bus.q_head].addr, ok);
+    bus.q_busy = false;
+    bus.q_head = (uint8_t)((bus.q_head + 1) % I2C_QUEUE_DEPTH);
+    --bus.q_count;
+    ++bus.q_done;
+  }
+  if (bus.q_count == 0) return true;
+
+  I2cTxn& t = bus.q[bus.q_head];
+  bus.q_start_us = micros();
+  bus.q_busy = bus.wire->writeAsync(t.addr, t.buf, t.len, true);
+  if (!bus.q_busy) {                                                  // could not start: drop it, keep going
+    pcaResult(bus, t.addr, false);                                    // the board missed it (force, NACKs)
+    bus.q_head = (uint8_t)((bus.q_head + 1) % I2C_QUEUE_DEPTH);
+    --bus.q_count;
+    ++bus.q_done;
+  }
+  return false;
+}
+
+uint32_t i2cTicket(const PcaBus& bus) {
+  return bus.q_pushed;
+}
+
+bool i2cDone(const PcaBus& bus, uint32_t ticket) {
+  return (int32_t)(bus.q_done - ticket) >= 0;
+}
+
+// ++++ DUAL CORE (optional) ++++
+// core 0 writes the job slot first, then pushes its index | the FIFO push orders the two
+
+void coreLinkSubmit(CoreLink& link, PcaBus& bus, const uint8_t* packed128, int depth) {
+  if (link.pending == CORE_JOB_SLOTS) {                 // both slots busy: retire the oldest first
+    (void)rp2040.fifo.pop();
+    --link.pending;
+  }
+  const uint8_t slot = link.next;
+  link.bus[slot] = &bus;
+  link.packed[slot] = packed128;
+  link.depth[slot]  = (uint8_t)depth;
+  link.next      = (uint8_t)((slot + 1) % CORE_JOB_SLOTS);
+  ++link.pending;
+  rp2040.fifo.push(slot);
+}
+
+void coreLinkWait(CoreLink& link) {
+  while (link.pending) {
+    (void)rp2040.fifo.pop();                            // jobs finish in submit order
+    --link.pending;
+  }
+}
+
+void coreLinkService(CoreLink& link) {
+  uint32_t slot;
+  if (!rp2040.fifo.pop_nb(&slot)) return;
+  applyBusDepth(*link.bus[slot], link.packed[slot], link.depth[slot]);
+  rp2040.fifo.push(slot);
 }
 
 // ++++ ACK (verification of successful communication) ++++ 
@@ -213,7 +1277,7 @@ bool readAck(Stream& s, uint32_t expected_seq, uint8_t* out_status, uint32_t tim
     while (s.available() && idx < ACK_BYTES) {              // read and save data in buff 
       buf[idx++] = (uint8_t)s.read();
     }
-    if (idx < ACK_BYTES) continue;                          // when 7 bytes are not recieved                  
+    if (idx < ACK_BYTES) { ioIdle(); continue; }            // when 7 bytes are not recieved                  
 
     if (rd_u16_le(&buf[0]) == ACK_MAGIC && rd_u32_le(&buf[2]) == expected_seq) {  // checking if magic and seq are correct if so.. 
       if (out_status) *out_status = buf[6];                                       // if correct, then update out status (1 byte) -> success or not
@@ -225,4 +1289,500 @@ bool readAck(Stream& s, uint32_t expected_seq, uint8_t* out_status, uint32_t tim
     idx = ACK_BYTES - 1;
   }
   return false;                                                                   // return false to show readAck failed = communication failed
-}
\ No newline at end of file
+}
+
+// Pico2 windowed mode | collect ACKs from stream "s" without blocking | SEQ is checked by the caller
+bool pollAck(Stream& s, AckRx& rx, uint32_t* out_seq, uint8_t* out_status) {
+  while (s.available()) {
+    if (ackRxPush(rx, (uint8_t)s.read(), out_seq, out_status)) return true;
+  }
+  return false;
+}
+
+bool ackRxPush(AckRx& rx, uint8_t b, uint32_t* out_seq, uint8_t* out_status) {
+  rx.buf[rx.idx++] = b;
+  if (rx.idx < ACK_BYTES) return false;
+
+  if (rd_u16_le(&rx.buf[0]) == ACK_MAGIC) {                     // aligned ACK
+    *out_seq    = rd_u32_le(&rx.buf[2]);
+    *out_status = rx.buf[6];
+    rx.idx = 0;
+    return true;
+  }
+
+  // resync shift 1 byte
+  memmove(rx.buf, rx.buf + 1, ACK_BYTES - 1);
+  rx.idx = ACK_BYTES - 1;
+  return false;
+}
+
+// ++++ UART LINK SPEED ++++
+
+// ---- A. shared ----
+void uartLinkInit(UartLink& l, Stream& s, void (*set_baud)(uint32_t baud)) {
+  memset(&l, 0, sizeof(l));
+  l.s        = &s;
+  l.set_baud = set_baud;
+  l.idx      = 0;
+  l.ceiling  = LINK_BAUD_COUNT - 1;
+  l.set_baud(LINK_BAUDS[0]);
+}
+
+int uartLinkIndexAtMost(uint32_t baud) {
+  int idx = 0;
+  for (int i = 0; i < LINK_BAUD_COUNT; ++i) {
+    if (LINK_BAUDS[i] <= baud) idx = i;
+  }
+  return idx;
+}
+
+static int linkIndexOf(uint32_t baud) {
+  for (int i = 0; i < LINK_BAUD_COUNT; ++i) {
+    if (LINK_BAUDS[i] == baud) return i;
+  }
+  return -1;
+}
+
+// drop whatever is buffered (stale ACKs, bytes received at the wrong rate)
+static void linkClearInput(Stream& s) {
+  while (s.available() > 0) s.read();
+}
+
+static void linkSwitch(UartLink& l, int idx) {
+  l.s->flush();                                        // last byte fully out at the old rate
+  l.set_baud(LINK_BAUDS[idx]);
+  l.idx = (uint8_t)idx;
+}
+
+// xorshift32 seeded from SEQ -> PAYLOAD[1..255]
+void linkFillTest(uint8_t* payload, uint32_t seq) {
+  uint32_t x = seq ^ 0x9E3779B9u;
+  if (!x) x = 1;
+  payload[0] = LINK_OP_TEST;
+  for (int i = 1; i < UART_PAYLOAD_BYTES; ++i) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    payload[i] = (uint8_t)x;
+  }
+}
+
+bool linkCheckTest(const uint8_t* payload, uint32_t seq) {
+  uint32_t x = seq ^ 0x9E3779B9u;
+  if (!x) x = 1;
+  for (int i = 1; i < UART_PAYLOAD_BYTES; ++i) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    if (payload[i] != (uint8_t)x) return false;
+  }
+  return true;
+}
+
+// ---- B. master (Pico2) ----
+// a link packet + its ACK at the current rate take ~ 270 byte times; allow three, plus margin
+static uint32_t linkTimeoutUs(const UartLink& l) {
+  return (uint32_t)(3ull * (UART_PKT_BYTES + ACK_BYTES) * 10ull * 1000000ull / uartLinkBaud(l)) + 20000u;
+}
+
+// send one link packet (op, PROPOSE baud or TEST pattern) and wait for its ACK
+static bool linkExchange(UartLink& l, uint8_t op, uint32_t baud) {
+  const uint32_t seq = LINK_SEQ_TAG | (l.link_seq++ & 0x00FFFFFFu);
+  uint8_t* payload = l.pkt + UART_SEQ_BYTES;
+
+  wr_u32_le(l.pkt, seq);
+  memset(payload, 0, UART_PAYLOAD_BYTES);
+  if (op == LINK_OP_TEST) {
+    linkFillTest(payload, seq);
+  } else {
+    payload[0] = op;
+    wr_u32_le(&payload[1], baud);
+  }
+  l.pkt[UART_SEQ_BYTES + UART_PAYLOAD_BYTES] = UART_LINK;
+
+  writeExactBytes(*l.s, l.pkt, UART_PKT_BYTES);
+  uint8_t status = 0;
+  return readAck(*l.s, seq, &status, linkTimeoutUs(l)) && status == LINK_OK;
+}
+
+bool uartLinkWaitPeer(UartLink& l, uint32_t timeout_ms) {
+  const uint32_t t0 = millis();
+  while ((millis() - t0) < timeout_ms) {
+    linkClearInput(*l.s);
+    if (linkExchange(l, LINK_OP_PING, 0)) {
+      delay(LINK_PING_MS);                             // let Pico1 work off pings queued at boot
+      linkClearInput(*l.s);
+      return true;
+    }
+    delay(LINK_PING_MS);
+  }
+  return false;
+}
+
+bool uartLinkTry(UartLink& l, int idx) {
+  if (idx < 0 || idx >= LINK_BAUD_COUNT) return false;
+  if (idx == l.idx) return true;
+  const int prev = l.idx;
+
+  // ===== 1) PROPOSE at the current rate =====
+  linkClearInput(*l.s);
+  if (!linkExchange(l, LINK_OP_PROPOSE, LINK_BAUDS[idx])) {
+    delay(LINK_TRIAL_MS + LINK_GUARD_MS);              // Pico1 may have switched and lost its ACK
+    linkClearInput(*l.s);
+    return false;
+  }
+
+  // ===== 2) both switch, test in both directions =====
+  linkSwitch(l, idx);
+  delay(LINK_GUARD_MS);
+  linkClearInput(*l.s);
+
+  bool ok = true;
+  for (int k = 0; k < LINK_TEST_PACKETS && ok; ++k) ok = linkExchange(l, LINK_OP_TEST, 0);
+
+  // ===== 3) confirm = same PROPOSE on the new rate =====
+  if (ok) ok = linkExchange(l, LINK_OP_PROPOSE, LINK_BAUDS[idx]);
+  if (ok) return true;
+
+  // ===== 4) not reliable: back to the old rate, Pico1 follows on its trial deadline =====
+  linkSwitch(l, prev);
+  delay(LINK_TRIAL_MS + LINK_GUARD_MS);
+  linkClearInput(*l.s);
+  if (uartLinkWaitPeer(l, LINK_PING_MS * 4)) return false;
+
+  // confirm got through but its ACK did not: Pico1 stayed on the new rate -> meet at base
+  linkSwitch(l, 0);
+  uartLinkWaitPeer(l, LINK_RESYNC_MS);
+  return false;
+}
+
+uint32_t uartLinkTune(UartLink& l) {
+  if (l.idx > l.ceiling) uartLinkTry(l, l.ceiling);
+  while (l.idx < l.ceiling) {
+    if (!uartLinkTry(l, l.idx + 1)) break;
+  }
+  return uartLinkBaud(l);
+}
+
+uint32_t uartLinkFallback(UartLink& l) {
+  l.degraded   = false;
+  l.mon_frames = 0;
+  l.mon_errors = 0;
+  ++l.fallbacks;
+
+  const int down = (l.idx > 0) ? l.idx - 1 : 0;
+  l.ceiling = (uint8_t)down;                           // do not climb back into the bad rate
+  if (l.idx > 0 && uartLinkTry(l, down)) return uartLinkBaud(l);
+
+  // Pico1 did not answer at the current rate: resync at base, then climb to the new ceiling
+  if (l.idx != 0) linkSwitch(l, 0);
+  if (uartLinkWaitPeer(l, LINK_RESYNC_MS)) uartLinkTune(l);
+  return uartLinkBaud(l);
+}
+
+void uartLinkFrameResult(UartLink& l, bool ok) {
+  if (!ok) {
+    ++l.mon_errors;
+    ++l.lost_acks;
+  }
+  if (l.mon_errors >= LINK_MON_ERRORS) l.degraded = true;
+  if (++l.mon_frames >= LINK_MON_FRAMES) {
+    l.mon_frames = 0;
+    l.mon_errors = 0;
+  }
+}
+
+// ---- C. slave (Pico1) ----
+static void linkReply(UartLink& l, uint32_t seq, uint8_t status) {
+  uint8_t ack[ACK_BYTES];
+  makeAck(ack, seq, status);
+  writeExactBytes(*l.s, ack, ACK_BYTES);
+}
+
+void uartLinkServe(UartLink& l, const uint8_t* pkt) {
+  const uint32_t seq     = rd_u32_le(pkt);
+  const uint8_t* payload = pkt + UART_SEQ_BYTES;
+  uartLinkGoodPacket(l);
+
+  switch (payload[0]) {
+    case LINK_OP_PING:
+      linkReply(l, seq, LINK_OK);
+      return;
+
+    case LINK_OP_TEST:
+      linkReply(l, seq, linkCheckTest(payload, seq) ? LINK_OK : LINK_BAD);
+      return;
+
+    case LINK_OP_PROPOSE: {
+      const int idx = linkIndexOf(rd_u32_le(&payload[1]));
+      if (idx < 0) { linkReply(l, seq, LINK_BAD); return; }
+      if (l.trial && idx == l.idx) {                   // confirm: keep the new rate
+        l.trial = false;
+        linkReply(l, seq, LINK_OK);
+        return;
+      }
+      linkReply(l, seq, LINK_OK);                      // ACK at the old rate, then switch
+      l.trial_prev  = l.trial ? l.trial_prev : l.idx;
+      l.trial       = true;
+      l.trial_t0_ms = millis();
+      linkSwitch(l, idx);
+      linkClearInput(*l.s);
+      return;
+    }
+
+    default:
+      linkReply(l, seq, LINK_BAD);
+      return;
+  }
+}
+
+void uartLinkGoodPacket(UartLink& l) {
+  l.bad_run = 0;
+}
+
+void uartLinkBadPacket(UartLink& l) {
+  linkClearInput(*l.s);
+  if (++l.bad_run < LINK_BAD_MAX) return;
+  l.bad_run = 0;
+  l.trial   = false;
+  if (l.idx != 0) linkSwitch(l, 0);                    // meet Pico2 at the base rate
+}
+
+void uartLinkPoll(UartLink& l) {
+  if (!l.trial || (millis() - l.trial_t0_ms) < LINK_TRIAL_MS) return;
+  l.trial = false;                                     // no confirm: the new rate did not work
+  linkSwitch(l, l.trial_prev);
+  linkClearInput(*l.s);
+}
+
+void uartLinkWatchRx(UartLink& l, int avail) {
+  if (avail <= 0 || avail != l.rx_last) {
+    l.rx_last     = avail;
+    l.rx_since_ms = millis();
+    return;
+  }
+  if ((millis() - l.rx_since_ms) < LINK_STALL_MS) return;
+  l.rx_last = 0;                                       // a partial packet that stopped growing
+  uartLinkBadPacket(l);
+}
+
+
+// ++++ INTER-PICO LINK ++++
+// (member pollAck / sendAck hide the free functions inside the classes)
+static bool streamPollAck(Stream& s, AckRx& rx, uint32_t* out_seq, uint8_t* out_status) {
+  return pollAck(s, rx, out_seq, out_status);
+}
+
+PicoLink& picoLinkSelect(int choice, PicoLink& uart, PicoLink& spi) {
+  if (choice == PICO_LINK_STRAP) {
+    pinMode(LINK_STRAP_PIN, INPUT_PULLUP);
+    delay(1);                                          // let the pull-up settle
+    choice = (digitalRead(LINK_STRAP_PIN) == LOW) ? PICO_LINK_SPI : PICO_LINK_UART;
+  }
+  return (choice == PICO_LINK_SPI) ? spi : uart;
+}
+
+// ---- UART ----
+void UartPicoLink::begin(bool) {
+  uartLinkInit(l_, s_, set_baud_);                     // LINK_BAUDS[0] until tuned
+  rx_.idx = 0;
+}
+
+bool UartPicoLink::pollAck(uint32_t* out_seq, uint8_t* out_status) {
+  return streamPollAck(s_, rx_, out_seq, out_status);
+}
+
+uint32_t UartPicoLink::tune(uint32_t max_rate) {
+  l_.ceiling = (uint8_t)uartLinkIndexAtMost(max_rate);
+  uartLinkTune(l_);                                    // up to the new ceiling, or down onto it
+  rx_.idx = 0;
+  return rate();
+}
+
+void UartPicoLink::fallback() {
+  uartLinkFallback(l_);
+  rx_.idx = 0;
+}
+
+// nothing is applied before the trailer anyway: wait for the whole packet
+bool UartPicoLink::recvPacket(uint8_t* pkt) {
+  const int avail = s_.available();
+  if (avail < UART_PKT_BYTES) {
+    uartLinkWatchRx(l_, avail);                        // bytes stopped short of a packet -> unreadable
+    return false;
+  }
+  readExactBytes(s_, pkt, UART_PKT_BYTES);
+
+  const uint8_t trailer = pkt[UART_PKT_BYTES - 1];
+  if (trailer == UART_LINK) { uartLinkServe(l_, pkt); return false; }              // link-speed probe
+  if (!linkTrailerForSketch(trailer)) { uartLinkBadPacket(l_); return false; }
+  uartLinkGoodPacket(l_);
+  return true;
+}
+
+// ---- SPI, master (Pico2) ----
+SpiPicoLink* SpiPicoLink::slave_self_ = nullptr;
+
+void SpiPicoLink::begin(bool master) {
+  if (master) {
+    pinMode(SPI_LINK_CS, OUTPUT);
+    digitalWrite(SPI_LINK_CS, HIGH);
+    pinMode(SPI_READY_PIN, INPUT_PULLDOWN);
+    spi_.setRX(SPI_LINK_RX);
+    spi_.setSCK(SPI_LINK_SCK);
+    spi_.setTX(SPI_LINK_TX);
+    spi_.begin(false);                                 // CS by hand: one packet = one CS-low burst
+    return;
+  }
+  slave_self_ = this;
+  pinMode(SPI_READY_PIN, OUTPUT);
+  digitalWrite(SPI_READY_PIN, LOW);
+  slave_.setRX(SPI_LINK_RX);
+  slave_.setCS(SPI_LINK_CS);
+  slave_.setSCK(SPI_LINK_SCK);
+  slave_.setTX(SPI_LINK_TX);
+  slave_.onDataRecv(onRecv);
+  slave_.onDataSent(onSent);
+  slave_.begin(SPISettings(SPI_LINK_HZ, MSBFIRST, SPI_MODE3));   // mode 3: CS may stay low between bytes
+}
+
+// one DMA transfer per scratch_-sized piece; whatever Pico1 shifted back goes through the ACK assembler
+void SpiPicoLink::xfer(const uint8_t* src, int n) {
+  while (n > 0) {
+    const int k = (n < (int)sizeof(scratch_)) ? n : (int)sizeof(scratch_);
+    spi_.transferAsync(src, scratch_, (size_t)k);
+    while (!spi_.finishedAsync()) ioIdle();
+
+    for (int i = 0; i < k; ++i) {
+      uint32_t seq;
+      uint8_t  status;
+      if (!ackRxPush(rx_, scratch_[i], &seq, &status)) continue;
+      if (ackq_count_ == ACK_QUEUE) continue;          // cannot happen: WINDOW_MAX ACKs + their trace records
+      const int t = (ackq_head_ + ackq_count_) % ACK_QUEUE;
+      ackq_seq_[t]    = seq;
+      ackq_status_[t] = status;
+      ++ackq_count_;
+    }
+    src += k;
+    n   -= k;
+  }
+  last_xfer_us_ = micros();
+}
+
+void SpiPicoLink::sendBytes(const uint8_t* src, int n) {
+  if (!in_pkt_) {
+    static const uint8_t cmd = SPI_CMD_PKT;
+    spi_.beginTransaction(SPISettings(SPI_LINK_HZ, MSBFIRST, SPI_MODE3));
+    digitalWrite(SPI_LINK_CS, LOW);
+    in_pkt_ = true;
+    xfer(&cmd, 1);
+  }
+  xfer(src, n);
+}
+
+void SpiPicoLink::endPacket() {
+  if (!in_pkt_) return;
+  digitalWrite(SPI_LINK_CS, HIGH);
+  spi_.endTransaction();
+  in_pkt_ = false;
+}
+
+// ACKs that came back with packets first; otherwise clock an ACK read if Pico1 raised READY.
+// Every ACK_NUDGE_US a read goes out even without READY, in case an ACK missed the FIFO
+// while READY was already dropped for it.
+bool SpiPicoLink::pollAck(uint32_t* out_seq, uint8_t* out_status) {
+  if (!ackq_count_ && !in_pkt_ &&
+      (digitalRead(SPI_READY_PIN) == HIGH || (micros() - last_xfer_us_) >= ACK_NUDGE_US)) {
+    static const uint8_t rd[SPI_ACK_READ_BYTES] = { SPI_CMD_ACK };
+    spi_.beginTransaction(SPISettings(SPI_LINK_HZ, MSBFIRST, SPI_MODE3));
+    digitalWrite(SPI_LINK_CS, LOW);
+    xfer(rd, SPI_ACK_READ_BYTES);
+    digitalWrite(SPI_LINK_CS, HIGH);
+    spi_.endTransaction();
+  }
+  if (!ackq_count_) return false;
+
+  *out_seq    = ackq_seq_[ackq_head_];
+  *out_status = ackq_status_[ackq_head_];
+  ackq_head_  = (uint8_t)((ackq_head_ + 1) % ACK_QUEUE);
+  --ackq_count_;
+  return true;
+}
+
+// ---- SPI, slave (Pico1) ----
+void SpiPicoLink::onRecv(uint8_t* data, size_t len) {
+  if (slave_self_) slave_self_->rxBytes(data, len);
+}
+
+// the buffer on the wire is out: start the one that filled up meanwhile
+void SpiPicoLink::onSent() {
+  SpiPicoLink* l = slave_self_;
+  if (!l) return;
+  l->tx_fill_[l->tx_cur_] = 0;
+  l->tx_cur_ ^= 1;
+  l->tx_busy_ = false;
+  l->txNext();
+}
+
+void SpiPicoLink::txNext() {
+  if (!tx_fill_[tx_cur_]) return;
+  slave_.setData(tx_buf_[tx_cur_], (size_t)tx_fill_[tx_cur_]);
+  tx_busy_ = true;
+}
+
+void SpiPicoLink::rxBytes(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    const uint8_t b = data[i];
+    switch (rx_state_) {
+      case RX_CMD:
+        if (b == SPI_CMD_PKT) {
+          rx_state_ = RX_PKT;
+          rx_pos_   = 0;
+          rx_drop_  = (ring_count_ == LINK_RX_PKTS);
+          if (rx_drop_) ++rx_dropped_;
+        } else if (b == SPI_CMD_ACK) {
+          rx_state_ = RX_FILL;
+          rx_pos_   = SPI_ACK_READ_BYTES - 1;
+        } else {
+          ++rx_bad_;                                   // out of step: wait for the next command
+        }
+        break;
+      case RX_PKT:
+        if (!rx_drop_) ring_[(ring_head_ + ring_count_) % LINK_RX_PKTS][rx_pos_] = b;
+        if (++rx_pos_ < UART_PKT_BYTES) break;
+        if (!rx_drop_) ring_count_ = (uint8_t)(ring_count_ + 1);
+        rx_state_ = RX_CMD;
+        break;
+      default:                                         // RX_FILL
+        if (--rx_pos_ == 0) rx_state_ = RX_CMD;
+        break;
+    }
+  }
+
+  // every byte clocked in took one byte of the ACK stream out
+  tx_pending_ = (tx_pending_ > (int)len) ? tx_pending_ - (int)len : 0;
+  if (!tx_pending_) digitalWrite(SPI_READY_PIN, LOW);
+}
+
+bool SpiPicoLink::recvPacket(uint8_t* pkt) {
+  if (!ring_count_) return false;
+  memcpy(pkt, ring_[ring_head_], UART_PKT_BYTES);      // the interrupt only writes behind the last packet
+  noInterrupts();
+  ring_head_  = (uint8_t)((ring_head_ + 1) % LINK_RX_PKTS);
+  ring_count_ = (uint8_t)(ring_count_ - 1);
+  interrupts();
+
+  const uint8_t trailer = pkt[UART_PKT_BYTES - 1];
+  if (linkTrailerForSketch(trailer)) return true;
+  ++rx_bad_;                                           // no link-speed packets on SPI
+  return false;
+}
+
+void SpiPicoLink::sendAck(const uint8_t* ack7) {
+  noInterrupts();
+  const uint8_t fill = tx_busy_ ? (uint8_t)(tx_cur_ ^ 1) : tx_cur_;
+  if (tx_fill_[fill] + ACK_BYTES <= TX_BYTES) {        // at most WINDOW_MAX ACKs (+ trace) are ever owed
+    memcpy(&tx_buf_[fill][tx_fill_[fill]], ack7, ACK_BYTES);
+    tx_fill_[fill] += ACK_BYTES;
+    tx_pending_    += ACK_BYTES;
+  }
+  if (!tx_busy_) txNext();
+  digitalWrite(SPI_READY_PIN, HIGH);
+  interrupts();
+}
@@ -6,6 +6,8 @@
 #include <Arduino.h>
 #include <stdint.h>
 #include <Wire.h>
+#include <SPI.h>
+#include <SPISlave.h>
 #include <Adafruit_PWMServoDriver.h>
 
 // Author: DH HAN and SAM LAB
@@ -17,11 +19,51 @@
 //   [HDR: MAGIC(2) + SEQ(4)] + [DATA: 512 bytes] + [CRC16: 2 bytes]  => total 520 bytes
 //
 // (B) Pico2 <-> Pico1 (UART)
-//   Pico2 sends: SEQ(4) + PAYLOAD(256 bytes)  (and Pico1 returns ACK)
+//   Pico2 sends: SEQ(4) + PAYLOAD(256 bytes) + TRAILER(1)  (and Pico1 returns ACK)
+//   TRAILER = UART_COMMIT once Pico2 has verified the PC frame CRC, UART_ABORT otherwise.
+//   Pico1 applies the payload only on COMMIT and does not ACK an aborted packet. With
+//   cut-through, SEQ + PAYLOAD are streamed while the PC frame is still arriving.
+//   TRAILER = UART_LINK marks a link-speed packet (see UART LINK SPEED); Pico1 ACKs it itself.
+//   TRAILER = UART_BANK_STORE / UART_BANK_APPLY carry pattern bank work (see PATTERN BANK).
+//   TRAILER = UART_SEQ_START arms sequence playback on Pico1 (see SEQUENCE PLAYBACK).
+//   TRAILER = UART_LATCH switches Pico1's latched commit on / off (see LATCHED COMMIT).
+//   TRAILER = UART_HEALTH asks Pico1 for its board health records (see BOARD HEALTH).
+//   TRAILER = UART_CAL_* carry calibration uploads and queries (see CALIBRATION).
+//   A deep frame's half (F) is longer than one payload: it goes as depthLinkPackets() packets of
+//   this size, TRAILER = UART_DEEP_PART | DEPTH on all but the last, which carries
+//   UART_DEEP_COMMIT | DEPTH (or UART_ABORT) and is zero padded (see FRAME DEPTH).
+//   The same packets can also go over SPI instead (see INTER-PICO LINK).
 //
 // ACK format (Pico1 -> Pico2 -> PC)
 //   ACK_BYTES = 7 bytes
 //   [ACK_MAGIC(2)] + [SEQ(4)] + [STATUS(1)]
+//   During sequence playback Pico2 also sends unsolicited progress messages in the same format,
+//   STATUS = STATUS_SEQ_* and SEQ = step counter (see SEQUENCE PLAYBACK).
+//   Pico1 follows each frame ACK with a trace record [ACK_MAGIC][APPLY_US(2) + DONE_US(2)]
+//   [STATUS_TRACE] that Pico2 keeps (see STAGE TRACE); it never reaches the PC.
+//   STATUS_HEALTH_* records (see BOARD HEALTH) and STATUS_CAL_VERSION (see CALIBRATION) stay
+//   between the Picos as well.
+//
+// (C) PC -> Pico2 control frame (USB Serial), same 520-byte framing as (A):
+//   [CTRL_MAGIC(2) + SEQ(4)] + [BODY: OP(1) + LEN(2) + ARGS(LEN) + zero pad => 512] + [CRC16(2)]
+//   Pico2 answers with the 7-byte ACK; if STATUS is OK it is followed by [LEN(2)] + [REPLY(LEN)].
+//   Firmware without control support sees a bad MAGIC, still consumes exactly 520 bytes and
+//   ACKs STATUS_ERR_MAGIC, so the PC can fall back cleanly.
+//
+// (D) PC -> Pico2 encoded data frames (USB Serial), variable length, same meaning as (A):
+//   [DELTA_MAGIC or SPARSE_MAGIC (2) + SEQ(4)] + [BASE_SEQ(4) + LEN(2)] + [BODY(LEN)] + [CRC16(2)]
+//   CRC over everything before it. BODY describes the new 512 bytes relative to the frame
+//   Pico2 holds (the last data frame it accepted); BASE_SEQ must name that frame, otherwise
+//   Pico2 ACKs STATUS_ERR_BASE and the PC has to send a full frame (see FRAME ENCODINGS).
+//   Only offered when OP_GET_STATUS lists the encoding.
+//
+// (E) PC -> Pico2 pattern frame (USB Serial): apply a pattern stored in the bank (PATTERN BANK)
+//   [PATTERN_MAGIC(2) + SEQ(4)] + [ID(1)] + [CRC16(2)]  => 9 bytes, windowed like a data frame
+//
+// (F) PC -> Pico2 deep data frame (USB Serial): DEPTH bits per magnet instead of 4 (FRAME DEPTH)
+//   [DEEP_MAGIC(2) + SEQ(4)] + [DEPTH(1)] + [DATA(depthDataBytes(DEPTH))] + [CRC16(2)]
+//   DEPTH 6 / 8 / 12 -> 768 / 1024 / 1536 data bytes; windowed and ACKed like a data frame.
+//   Only offered when OP_GET_STATUS lists the depth.
 //
 // NOTE
 // - All multi-byte fields here are LITTLE-ENDIAN (LE).
@@ -30,6 +72,13 @@
 static constexpr uint16_t MAGIC     = 0x55AA;   // bytes on wire: AA 55 (LE)
 static constexpr uint16_t ACK_MAGIC = 0x55AA;   // ACK magic (same value, but kept explicit for clarity)
 
+static constexpr uint16_t CTRL_MAGIC = 0x66CC;   // control frame magic, bytes on wire: CC 66
+
+static constexpr uint16_t DELTA_MAGIC  = 0x77D1;  // XOR delta, zero-run coded (FRAME ENCODINGS)
+static constexpr uint16_t SPARSE_MAGIC = 0x88E2;  // (magnet, value) list
+static constexpr uint16_t PATTERN_MAGIC = 0x99B3; // apply bank pattern ID
+static constexpr uint16_t DEEP_MAGIC    = 0xAAF4; // DEPTH bits per magnet (FRAME DEPTH)
+
 static constexpr int HDR_BYTES   = 6;           // MAGIC(2) + SEQ(4)
 static constexpr int CRC_BYTES   = 2;           // CRC16-CCITT
 static constexpr int ACK_BYTES   = 7;           // ACK_MAGIC(2) + SEQ(4) + STATUS(1)
@@ -45,9 +94,176 @@ static constexpr int X_VALUES     = DATA_HALF * 2;  // 512 nibbles -> 512 values
 // Full frame size PC <-> Pico2
 static constexpr int FRAME_BYTES  = HDR_BYTES + DATA_BYTES + CRC_BYTES; // 520 bytes total
 
+// Deep data frames (F): DEPTH bits per magnet, the same split into halves (FRAME DEPTH)
+static constexpr uint8_t DEPTH_NIBBLE   = 4;                      // MAGIC frames
+static constexpr uint8_t DEPTH_MAX      = 12;
+static constexpr int     DEEP_HDR_BYTES = 1;                      // DEPTH(1)
+constexpr bool depthOk(int d)        { return d == 6 || d == 8 || d == 12; }   // deep frames
+constexpr int  depthHalfBytes(int d) { return X_VALUES * d / 8; }               // per Pico: 384 / 512 / 768
+constexpr int  depthDataBytes(int d) { return 2 * depthHalfBytes(d); }          // 768 / 1024 / 1536
+static constexpr int DEEP_HALF_MAX   = depthHalfBytes(DEPTH_MAX);
+static constexpr int FRAME_MAX_BYTES = HDR_BYTES + DEEP_HDR_BYTES + depthDataBytes(DEPTH_MAX) + CRC_BYTES;   // 1545
+
 // UART payload size Pico2 -> Pico1
 static constexpr int UART_SEQ_BYTES      = 4;
 static constexpr int UART_PAYLOAD_BYTES  = 256;
+static constexpr int UART_TRAILER_BYTES  = 1;
+static constexpr uint8_t UART_COMMIT     = 0xC3;
+static constexpr uint8_t UART_ABORT      = 0x3C;
+static constexpr uint8_t UART_LINK       = 0xA5;
+static constexpr uint8_t UART_BANK_STORE = 0xB4;
+static constexpr uint8_t UART_BANK_APPLY = 0xB5;
+static constexpr uint8_t UART_SEQ_START  = 0xB6;
+static constexpr uint8_t UART_LATCH      = 0xB7;
+static constexpr uint8_t UART_HEALTH     = 0xB8;
+static constexpr uint8_t UART_CAL_STORE  = 0xB9;
+static constexpr uint8_t UART_CAL_CURVE  = 0xBA;
+static constexpr uint8_t UART_CAL_COMMIT = 0xBB;
+static constexpr uint8_t UART_CAL_INFO   = 0xBC;
+static constexpr uint8_t UART_ALL_OFF    = 0xBD;
+static constexpr uint8_t UART_DEEP_PART   = 0xD0;   // | DEPTH: part of a deep half, more follow
+static constexpr uint8_t UART_DEEP_COMMIT = 0xE0;   // | DEPTH: last part, apply the half
+static constexpr uint8_t UART_DEEP_KIND   = 0xF0;   // trailer bits that are not the DEPTH
+
+// link packets that carry one deep half: 2 / 2 / 3
+constexpr int depthLinkPackets(int d) { return (depthHalfBytes(d) + UART_PAYLOAD_BYTES - 1) / UART_PAYLOAD_BYTES; }
+static constexpr int LINK_PKTS_PER_FRAME = depthLinkPackets(DEPTH_MAX);
+
+inline bool deepTrailer(uint8_t t) {
+  const uint8_t kind = t & UART_DEEP_KIND;
+  return (kind == UART_DEEP_PART || kind == UART_DEEP_COMMIT) && depthOk(t & ~UART_DEEP_KIND);
+}
+
+// trailers of packets the receiver hands to the sketch (UART_LINK is served inside the link)
+inline bool linkTrailerForSketch(uint8_t t) {
+  return t == UART_COMMIT || t == UART_ABORT || t == UART_BANK_STORE || t == UART_BANK_APPLY ||
+         t == UART_SEQ_START || t == UART_LATCH || t == UART_HEALTH || t == UART_CAL_STORE ||
+         t == UART_CAL_CURVE || t == UART_CAL_COMMIT || t == UART_CAL_INFO || t == UART_ALL_OFF ||
+         deepTrailer(t);
+}
+
+// ++++ CONTROL OPS ++++
+//
+// BODY layout of a control frame: [OP(1)] + [LEN(2)] + [ARGS(LEN)]
+static constexpr int CTRL_BODY_HDR = 3;                           // OP(1) + LEN(2)
+static constexpr int CTRL_ARGS_MAX = DATA_BYTES - CTRL_BODY_HDR;  // 509
+static constexpr int REPLY_LEN_BYTES = 2;
+
+// OP_SET_WINDOW: ARGS = [N(1)] requested frames in flight | REPLY = [N(1)] granted (1..WINDOW_MAX)
+//   N = 1 is stop-and-wait (boot default). With N > 1 the PC may send up to N data frames before
+//   the first ACK; Pico2 ACKs them strictly in SEQ order as each one finishes on both Picos.
+//   Control frames are barriers: Pico2 drains every in-flight frame before answering one.
+static constexpr uint8_t OP_SET_WINDOW = 0x01;
+static constexpr int     WINDOW_MAX    = 8;
+
+// OP_GET_STATUS: ARGS = none | REPLY = STATUS_REPLY_BYTES, little-endian:
+//   [0]      STATUS_VERSION
+//   [1]      window
+//   [2..5]   Pico1 link rate: UART baud agreed with Pico1, or the SPI clock
+//   [6..9]   UART baud ceiling (highest rate the tuner may try; SPI: the clock)
+//   [10..11] UART fallbacks since boot
+//   [12..15] frames that lost their Pico1 ACK since boot
+//   [16]     link kind: PICO_LINK_UART / PICO_LINK_SPI                       (version 2)
+//   [17]     encoded data frames understood: ENC_DELTA | ENC_SPARSE           (version 3)
+//   [18..33] board health, bit b = board b is written (BOARD HEALTH)         (version 4)
+//            boards in data order: Pico1 bus0, Pico1 bus1, Pico2 bus0, Pico2 bus1, 32 each;
+//            Pico1's 64 bits are 0 if it did not answer the health request
+//   [34..37] I2C transactions that failed on Pico1 since boot
+//   [38..41] I2C transactions that failed on Pico2 since boot
+//   [42..45] USB receive resyncs since boot (FRAME RESYNC)                   (version 5)
+//   [46..49] bytes skipped by them
+//   [50..53] frames cut off by a receive deadline
+//   [54..55] bits per magnet understood, bit d = DEPTH d (4 = MAGIC frames)  (version 6)
+//   New fields are only ever appended; the PC reads what LEN says.
+static constexpr uint8_t  OP_GET_STATUS      = 0x02;
+static constexpr uint8_t  STATUS_VERSION     = 6;
+static constexpr int      STATUS_REPLY_BYTES = 56;
+static constexpr uint16_t STATUS_DEPTHS      = (1u << DEPTH_NIBBLE) | (1u << 6) | (1u << 8) | (1u << 12);
+
+// OP_SET_LINK: ARGS = [MAX_BAUD(4)] | REPLY = [BAUD(4)] agreed UART rate
+//   Sets the UART ceiling to the fastest LINK_BAUDS entry <= MAX_BAUD and renegotiates.
+//   On the SPI link nothing changes and the reply is the SPI clock.
+static constexpr uint8_t OP_SET_LINK = 0x03;
+
+// OP_BANK_STORE: ARGS = [ID(1)] + [HALF(1)] + [PACKED(256)] | REPLY = [ID(1)]
+//   Stores one half of pattern ID (HALF 0 = bytes 0..255 -> Pico1, 1 = bytes 256..511 -> Pico2).
+//   A pattern can be applied once both halves are stored (PATTERN_MAGIC frame).
+// OP_BANK_INFO: ARGS = none | REPLY = BANK_INFO_BYTES, little-endian:
+//   [0]      BANK_SLOTS
+//   [1..4]   bitmap of IDs stored on both Picos
+//   [5..8]   bytes per slot on each Pico (packed half + register images)
+//   [9..12]  bytes the bank reserves in RAM on each Pico
+//   [13..16] bytes in use on Pico2 (stored halves * slot bytes)
+static constexpr uint8_t OP_BANK_STORE   = 0x04;
+static constexpr uint8_t OP_BANK_INFO    = 0x05;
+static constexpr int     BANK_STORE_ARGS = 2 + DATA_HALF;
+static constexpr uint8_t BANK_HALF_PICO1 = 0;
+static constexpr uint8_t BANK_HALF_PICO2 = 1;
+static constexpr int     BANK_INFO_BYTES = 17;
+
+// OP_SEQ_LOAD: ARGS = [FIRST(1)] + [N(1)] + N * ([ID(1)] + [DURATION_US(4)]) | REPLY = [COUNT(2)]
+//   Writes steps FIRST .. FIRST+N-1 of the sequence; it now has COUNT = FIRST+N steps (a load
+//   with FIRST = 0 starts a new sequence). ID is a bank pattern, DURATION_US how long it stays.
+// OP_SEQ_START: ARGS = [LOOPS(2), 0 = until stopped] + [REPORT_EVERY(2), 0 = none] | REPLY = [COUNT(2)]
+//   Starts timed playback (SEQUENCE PLAYBACK); every ID must be stored on both Picos.
+// OP_SEQ_STOP: ARGS = none | REPLY = [STEPS(4)] + [OVERRUNS_PICO2(4)] + [OVERRUNS_PICO1(4)]
+//   Any data, encoded or pattern frame and any control op except OP_GET_STATUS / OP_GET_TRACE
+//   also stop it.
+static constexpr uint8_t OP_SEQ_LOAD     = 0x06;
+static constexpr uint8_t OP_SEQ_START    = 0x07;
+static constexpr uint8_t OP_SEQ_STOP     = 0x08;
+static constexpr int     SEQ_STEP_BYTES  = 5;
+static constexpr int     SEQ_LOAD_MAX    = (CTRL_ARGS_MAX - 2) / SEQ_STEP_BYTES;   // 101 steps per frame
+static constexpr int     SEQ_STOP_BYTES  = 12;
+
+// OP_SET_LATCH: ARGS = [ON(1)] | REPLY = [ON(1)]
+//   Latched commit (LATCHED COMMIT): every data / encoded / pattern frame is staged behind the
+//   PCA9685 /OE lines and released on all four buses at once. While on, a STATUS_OK ACK of such a
+//   frame is followed by [LEN(2)] + [HOLD_US(4)] + [SKEW_US(2)], like a control reply.
+static constexpr uint8_t OP_SET_LATCH      = 0x09;
+static constexpr int     LATCH_REPLY_BYTES = 6;
+
+// OP_GET_TRACE: ARGS = [RESET(1)] optional | REPLY = [STAGES(1)] + STAGES * TRACE_SUMMARY_BYTES
+//   Per stage (STAGE TRACE), little-endian, times in us over the last TRACE_DEPTH samples:
+//   [STAGE(1)] [COUNT(4), since reset] [MIN(4)] [AVG(4)] [MAX(4)] [P50(4)] [P90(4)] [P99(4)]
+//   RESET != 0 clears the rings after the reply.
+static constexpr uint8_t OP_GET_TRACE        = 0x0A;
+static constexpr int     TRACE_SUMMARY_BYTES = 29;
+
+// OP_CAL_STORE: ARGS = [FIRST(2)] + [N(1)] + N * CAL_REC_BYTES | REPLY = [N(1)]
+//   Stages the calibration of magnets FIRST .. FIRST+N-1, N <= CAL_STORE_MAX (data order: magnet m
+//   is nibble m of the 512 data bytes, 0..511 on Pico1, 512..1023 on Pico2). Record, little-endian:
+//   [GAIN(2)]   1/1024 steps (1024 = 1.0)
+//   [OFFSET(2)] signed PWM counts added to every level that is not off
+//   [FLAGS(1)]  CAL_FLAG_SWAP: drive the other side of the pair | curve index << CAL_CURVE_SHIFT
+// OP_CAL_CURVE: ARGS = [CURVE(1)] + CAL_LEVELS * [PWM(2)] | REPLY = [CURVE(1)]
+//   PWM (0..4095) of values 0..14 before gain and offset; value 7 stays off whatever it says.
+//   Every curve starts as the linear map |value - 7| * 4095 / 7.
+// OP_CAL_COMMIT: ARGS = [VERSION(4)] + [SAVE(1)] | REPLY = [VERSION(4)]
+//   Both Picos expand the staged set into their register-image tables (CALIBRATION); the pattern
+//   bank is re-expanded and the next frame rewrites every board. SAVE != 0 also writes the set to
+//   flash, where setup() finds it after a reset (STATUS_ERR_FLASH: active, but not saved).
+//   VERSION 0 drops the calibration: the staged set goes back to defaults, SAVE removes the file.
+// OP_CAL_INFO: ARGS = none | REPLY = [VERSION_PICO1(4)] + [VERSION_PICO2(4)], 0 = uncalibrated
+static constexpr uint8_t OP_CAL_STORE  = 0x0B;
+static constexpr uint8_t OP_CAL_CURVE  = 0x0C;
+static constexpr uint8_t OP_CAL_COMMIT = 0x0D;
+static constexpr uint8_t OP_CAL_INFO   = 0x0E;
+
+// OP_ALL_OFF: ARGS = none | REPLY = [PICO2_US(4)] + [BOTH_US(4)], from the frame's header to
+//   Pico2's boards off / to Pico1's ACK (both halves off)
+//   Emergency stop: every board of both Picos off with one ALL_CALL write per bus (BROADCAST).
+//   No barrier: frames still in flight lose their queued I2C writes and are ACKed as they finish.
+//   Pico1 gets a UART_ALL_OFF packet before Pico2 starts on its own buses. Ends sequence
+//   playback; encoded frames need a full frame next (STATUS_ERR_BASE).
+//   STATUS_ERR_PICO1_ACK: Pico2's boards are off, Pico1 did not answer.
+static constexpr uint8_t OP_ALL_OFF    = 0x0F;
+
+// Pico1 keeps this many bytes of UART receive buffer so a full window of forwarded packets
+// can queue up while it is busy on I2C (deep frames: LINK_PKTS_PER_FRAME packets each).
+static constexpr int UART_PKT_BYTES      = UART_SEQ_BYTES + UART_PAYLOAD_BYTES + UART_TRAILER_BYTES;   // 261
+static constexpr int LINK_RX_PKTS        = WINDOW_MAX * LINK_PKTS_PER_FRAME;
+static constexpr int UART_RX_FIFO_BYTES  = LINK_RX_PKTS * UART_PKT_BYTES;
 
 // ++++ BYTES UTIL ++++
 //
@@ -63,14 +279,77 @@ void     wr_u32_le(uint8_t* p, uint32_t v);           // 4 bytes write (LE)
 // Exact read/write helpers for Stream (Serial / UART).
 // - readExactBytes: blocks until exactly n bytes are read into dst
 // - writeExactBytes: blocks until exactly n bytes are written from src
+// - while they (and readAck) wait, the idle hook runs, e.g. to keep async I2C queues moving
 void readExactBytes(Stream& s, uint8_t* dst, int n);
 void writeExactBytes(Stream& s, const uint8_t* src, int n);
+void setIoIdleHook(void (*hook)());
+
+// ++++ FRAME RESYNC ++++
+//
+// Byte-level receiver for PC -> Pico2 frames (USB Serial); readExactBytes() would wait forever.
+// The frame is assembled in place: every byte lands in buf (the sketch's frame buffer) in
+// arrival order, MAGIC at buf[0], so a frame is exactly as contiguous as it was on the wire.
+// - Hunt (frameRxHeader, never blocks): bytes are taken one at a time until two of them form
+//   one of the sketch's MAGICs, then SEQ. Every run of skipped bytes is one resync event.
+// - Body (frameRxRead / frameRxReadSome): read against two deadlines, RX_BYTE_TIMEOUT_US since
+//   the last byte and RX_FRAME_TIMEOUT_US since the first MAGIC byte. A stall returns false.
+// - Reject (frameRxReject): a frame that failed (CRC, header field, deadline) hands its bytes
+//   back, minus the first, to the hunter. One dropped byte makes frame N swallow the start of
+//   N+1; the hunt finds N+1's MAGIC among the replayed bytes and N+1 is taken as usual.
+//   The replayed bytes always start inside the rejected frame, so FRAME_MAX_BYTES of room is enough.
+// - aligned: this header sat right behind the last good frame, or right behind a rejected frame
+//   that was itself aligned (next_at: a bit flip keeps the length, so the PC's next frame starts
+//   exactly cur_n bytes on, however the hunter gets there). Only then is its SEQ worth an error
+//   ACK; any other header found by hunting that fails is dropped without one.
+// - Direct source (frameRxSetDirect): bytes come from a bulk read function instead of s, e.g.
+//   tud_cdc_read() straight out of the TinyUSB CDC FIFO (pico2.ino, USB_DIRECT).
+static constexpr uint32_t RX_BYTE_TIMEOUT_US  = 20000;    // gap inside a frame (USB sends 64 B packets)
+static constexpr uint32_t RX_FRAME_TIMEOUT_US = 100000;   // whole frame, ~100 frame times at full speed
+
+struct FrameRx {
+  Stream*         s;
+  int           (*direct)(uint8_t* dst, int max);   // optional: replaces s, returns 0..max
+  const uint16_t* magics;                // frame MAGICs the sketch understands
+  uint8_t         magic_count;
+  uint8_t*        buf;                   // FRAME_MAX_BYTES, the frame being received
+  uint16_t        cur_n;                 // bytes in buf
+  uint8_t         replay[FRAME_MAX_BYTES];   // rejected bytes, read before s
+  uint16_t        rp_pos, rp_len;
+  uint32_t        src_n;                 // bytes read from the source (s / direct), wraps
+  uint32_t        hdr_at;                // stream index of buf[0]
+  uint32_t        next_at;               // stream index where the frame after the last trusted one starts
+  bool            aligned;               // current header: nothing skipped since the last good frame
+  bool            lost;                  // bytes skipped / rejected since the last good frame
+  uint32_t        t_byte_us;             // last byte taken
+  uint32_t        t_frame_us;            // first MAGIC byte of the current frame
+
+  // since boot
+  uint32_t        resyncs;               // hunts that had to skip bytes
+  uint32_t        skipped;               // bytes skipped by them
+  uint32_t        timeouts;              // frames cut off by a deadline
+};
+
+void frameRxInit(FrameRx& rx, Stream& s, uint8_t* buf, const uint16_t* magics, int magic_count);
+void frameRxSetDirect(FrameRx& rx, int (*direct)(uint8_t* dst, int max));
+bool frameRxHeader(FrameRx& rx);              // true once MAGIC + SEQ are in buf[0..HDR_BYTES)
+int  frameRxReadSome(FrameRx& rx, int max);   // next bytes into buf + cur_n | -1 past a deadline
+bool frameRxRead(FrameRx& rx, int n);         // next n bytes | false past a deadline
+void frameRxDone(FrameRx& rx);                // frame intact (CRC ok)
+void frameRxReject(FrameRx& rx);              // frame failed: hunt through its bytes
 
 // ++++ CRC ALGORITHM ++++
 //
 // CRC16-CCITT for validating frames (host computes CRC, slave validates).
-// init default is 0xFFFF (common CRC-CCITT init).
+// init default is 0xFFFF (common CRC-CCITT init). Table driven, one lookup per byte.
+// Streaming over the bytes in place (no staging copy):
+//   uint16_t c = crc16_init();  c = crc16_update(c, hdr, 6);  c = crc16_update(c, data, 512);  crc16_final(c)
+// Check value: crc16_ccitt("123456789", 9) == 0x29B1 (same as Python binascii.crc_hqx(b, 0xFFFF)).
+static constexpr uint16_t CRC16_INIT = 0xFFFF;
+inline uint16_t crc16_init() { return CRC16_INIT; }
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, int n);
+inline uint16_t crc16_final(uint16_t crc) { return crc; }     // no reflection, no final xor
 uint16_t crc16_ccitt(const uint8_t* data, int n, uint16_t init = 0xFFFF);
+uint16_t crc16_ccitt_bitwise(const uint8_t* data, int n, uint16_t init = 0xFFFF);   // reference
 
 // ++++ BUILD CONTROL INPUT ++++
 //
@@ -79,22 +358,529 @@ uint16_t crc16_ccitt(const uint8_t* data, int n, uint16_t init = 0xFFFF);
 // - Output: X512 (512 values) each in {0..15}
 //   X512[2*i+0] = low nibble
 //   X512[2*i+1] = high nibble
+// (the firmware applies packed bytes directly, see actionPacked; buildX / actionX stay for tools)
 void buildX(const uint8_t* packed256, uint8_t* X512);
 
+// ++++ FRAME ENCODINGS ++++
+//
+// Encoded data frames (D) carry only what changed against the reference frame (state512):
+// - DELTA_MAGIC:  BODY = XOR of the new 512 bytes with state512, zero-run coded as repeated
+//                 [ZERO_RUN(1)] + [LIT_LEN(1)] + [LIT(LIT_LEN)]: skip ZERO_RUN unchanged bytes,
+//                 then XOR LIT_LEN bytes in. Bytes past the last token are unchanged.
+// - SPARSE_MAGIC: BODY = repeated [PAIR(2)] LE: magnet index in bits 0..9, new value 0..15
+//                 in bits 12..15 (magnet m = nibble m of the 512 bytes, low nibble first).
+// decodeDelta / decodeSparse update state512 in place and report in *changed which halves
+// actually differ now (ENC_CHG_PICO1 = bytes 0..255, ENC_CHG_PICO2 = bytes 256..511). A
+// malformed BODY returns false and leaves state512 untouched.
+static constexpr int     ENC_HDR_BYTES  = 6;                            // BASE_SEQ(4) + LEN(2)
+static constexpr int     ENC_BODY_MAX   = DATA_BYTES - ENC_HDR_BYTES;   // 506: fits the frame buffer
+static constexpr int     SPARSE_PAIR_BYTES = 2;
+static constexpr uint8_t ENC_DELTA      = 0x01;   // OP_GET_STATUS [17] bits
+static constexpr uint8_t ENC_SPARSE     = 0x02;
+static constexpr uint8_t ENC_CHG_PICO1  = 0x01;
+static constexpr uint8_t ENC_CHG_PICO2  = 0x02;
+
+bool decodeDelta(uint8_t* state512, const uint8_t* body, int len, uint8_t* changed);
+bool decodeSparse(uint8_t* state512, const uint8_t* body, int len, uint8_t* changed);
+
+// ++++ PCA9685 BUS ++++
+//
+// Register map used by the bulk path:
+// - LEDn_ON_L/ON_H/OFF_L/OFF_H are 4 consecutive registers per channel, LED0_ON_L = 0x06
+// - 16 channels => 64 register bytes per board (LED0..LED15)
+// - MODE1.AI (auto-increment) lets one write stream all 64 bytes after a single register byte
+// - ALL_LED_ON_L.. (0xFA..0xFD) load the same 4 bytes into all 16 channels at once
+// - MODE1.ALLCALL: the board also answers PCA_ALLCALL_ADDR, so one write reaches every board of
+//   the bus (BROADCAST); on at power-on, but Adafruit begin() clears it
+static constexpr uint8_t PCA_BASE_ADDR      = 0x40;   // board i on a bus -> 0x40 + i
+static constexpr uint8_t PCA_ALLCALL_ADDR   = 0x70;   // ALLCALLADR power-on value (0xE0 >> 1)
+static constexpr int     PCA_BOARDS_PER_BUS = 32;     // 0x40..0x5F
+static constexpr int     PCA_MAG_PER_BOARD  = 8;      // 8 magnets (pairs) per board
+static constexpr int     PCA_CHANNELS       = 16;     // 2 channels per magnet
+static constexpr int     PCA_CH_BYTES       = 4;      // ON_L, ON_H, OFF_L, OFF_H
+static constexpr int     PCA_IMG_BYTES      = PCA_CHANNELS * PCA_CH_BYTES;  // 64 bytes
+static constexpr int     PCA_MAG_IMG_BYTES  = 2 * PCA_CH_BYTES;             // one magnet: LEFT + RIGHT
+
+static constexpr uint8_t PCA_REG_MODE1      = 0x00;
+static constexpr uint8_t PCA_REG_LED0_ON_L  = 0x06;
+static constexpr uint8_t PCA_REG_ALL_LED    = 0xFA;   // ALL_LED_ON_L
+static constexpr uint8_t PCA_REG_PRESCALE   = 0xFE;   // PWM frequency, only writable while asleep
+static constexpr uint8_t PCA_MODE1_AI       = 0x20;   // register auto-increment
+static constexpr uint8_t PCA_MODE1_SLEEP    = 0x10;   // oscillator off
+static constexpr uint8_t PCA_MODE1_ALLCALL  = 0x01;   // answer PCA_ALLCALL_ADDR
+
+// Largest register payload per I2C transaction (the register byte is not counted).
+// arduino-pico's TwoWire buffers WIRE_BUFFER_SIZE (256) bytes, so a whole board fits in one
+// transaction. Cores with the classic 32-byte buffer fall back to 28-byte (7 channel) chunks.
+#ifdef WIRE_BUFFER_SIZE
+static constexpr int I2C_MAX_PAYLOAD = ((WIRE_BUFFER_SIZE - 1) / PCA_CH_BYTES) * PCA_CH_BYTES;
+#else
+static constexpr int I2C_MAX_PAYLOAD = (31 / PCA_CH_BYTES) * PCA_CH_BYTES;
+#endif
+
+// I2C cost counters
+// - transactions: START .. STOP sequences (one endTransmission each)
+// - bytes: bytes clocked on the wire, including the address byte and the register byte
+struct I2cStats {
+  uint32_t transactions;
+  uint32_t bytes;
+};
+
+static constexpr int PCA_MAG_PER_BUS = PCA_BOARDS_PER_BUS * PCA_MAG_PER_BOARD;   // 256
+static constexpr int PCA_PACKED_PER_BOARD = PCA_MAG_PER_BOARD / 2;                // 4 bytes (2 magnets per byte)
+static constexpr int PCA_PACKED_PER_BUS   = PCA_MAG_PER_BUS / 2;                  // 128 bytes
+static constexpr int PCA_SHADOW_BYTES     = PCA_MAG_PER_BUS * DEPTH_MAX / 8;      // 384: deepest frame
+
+// Dirty runs closer than this many clean channels are merged into one burst
+// (4 extra bytes per channel are cheaper than a new START + address + register byte).
+static constexpr int PCA_MERGE_GAP_CH = 3;
+
+// One I2C bus with its chain of PCA9685 boards (base_addr .. base_addr + 31).
+// - frame: cost of the most recent actionX() on this bus
+// - total: running cost since boot
+// - shadow: packed magnet values (nibbles) last written to the boards
+//   only channels whose register images differ from the shadow's are sent
+// - shadow_depth: bits per magnet in shadow (DEPTH_NIBBLE, or a deep frame's DEPTH, FRAME DEPTH)
+// - lut: register images of every board (CALIBRATION), nullptr = the linear table for all
+// - cal / cal_first: the set behind lut and this bus's first magnet in it, for deep frames
+// - refresh_every: rewrite every board every N frames even if clean (0 = never);
+//   recovers boards that lost their registers (brown-out, hot-plug)
+//
+// - skip / fails / nacks: board health, see BOARD HEALTH
+//
+// Async engine (bus.async, see ASYNC I2C ENGINE): pcaWriteRegs() copies each transaction into
+// the bus queue and returns; i2cPump() hands the queue to the DMA-driven Wire one at a time.
+static constexpr int I2C_QUEUE_DEPTH = 64;                   // 2 per board; the writer waits if full
+
+struct I2cTxn {
+  uint8_t addr;
+  uint8_t len;                                               // bytes in buf
+  uint8_t buf[1 + PCA_IMG_BYTES];                            // [start register] + payload
+};
+
+struct BoardLut;
+struct CalSet;
+
+struct PcaBus {
+  TwoWire*  wire;
+  uint8_t   base_addr;
+  const BoardLut* lut;            // PCA_BOARDS_PER_BUS tables, or nullptr
+  const CalSet*   cal;            // nullptr = linear
+  uint16_t  cal_first;            // 0 (bus0) or PCA_MAG_PER_BUS (bus1)
+  I2cStats  frame;
+  I2cStats  total;
+
+  uint8_t   shadow[PCA_SHADOW_BYTES];
+  uint8_t   shadow_depth;
+  bool      shadow_valid;         // false -> next frame is a full write
+  uint16_t  refresh_every;
+  uint16_t  since_refresh;
+
+  bool      async;
+  I2cTxn    q[I2C_QUEUE_DEPTH];
+  uint8_t   q_head;
+  uint8_t   q_count;
+  bool      q_busy;               // q[q_head] is on the wire
+  uint32_t  q_pushed;             // transactions queued since boot (ticket counter)
+  uint32_t  q_done;               // transactions finished since boot
+  uint32_t  q_start_us;           // when q[q_head] went on the wire
+
+  uint32_t  present;              // boot scan: bit dev answered
+  uint32_t  skip;                 // bit dev: frames leave the board out until a re-probe answers
+  uint32_t  force;                // bit dev: next frame rewrites all of its channels (recovered)
+  bool      bcast_nack;           // an ALL_CALL write went unanswered (BROADCAST)
+  uint8_t   fails[PCA_BOARDS_PER_BUS];    // failed transactions in a row
+  uint16_t  nacks[PCA_BOARDS_PER_BUS];    // failed transactions since boot (saturating)
+  uint32_t  nack_total;
+  uint8_t   prescale;             // PRE_SCALE written by a re-probe (pcaPrescale)
+  uint8_t   probe_dev;            // last board re-probed (round robin over skip)
+  uint32_t  probe_ms;             // millis() of the last re-probe
+};
+
+// pcaBusInit:
+// - Zeroes counters and shadow, binds the bus to wire / base_addr
+// - The first actionX() after init is a full write
+void pcaBusInit(PcaBus& bus, TwoWire& wire, uint8_t base_addr);
+
+// pcaWriteRegs:
+// - Writes n register bytes starting at register reg of board dev, using auto-increment
+// - Splits into I2C_MAX_PAYLOAD chunks when the Wire buffer is too small for n
+// - Adds the cost to bus.frame and bus.total
+void pcaWriteRegs(PcaBus& bus, int dev, uint8_t reg, const uint8_t* src, int n);
+
+// pcaEnableAutoIncrement:
+// - Read-modify-write of MODE1 so that MODE1.AI and MODE1.ALLCALL are set on board dev
+// - Call once per board after Adafruit_PWMServoDriver::begin()/setPWMFreq()
+void pcaEnableAutoIncrement(PcaBus& bus, int dev);
+
+// ++++ BROADCAST ++++
+//
+// With MODE1.ALLCALL every board of a bus answers PCA_ALLCALL_ADDR, so the whole bus takes one
+// write where a full frame takes 32 (one per board, 66 bytes each):
+// - all off: the 4 ALL_LED bytes, 6 bytes on the wire (about 60 us at 1 MHz)
+// - every magnet at the same nibble: one board's 64-byte image (uncalibrated buses only; with
+//   calibration each magnet has its own image, so only all off is uniform)
+// applyBusPacked takes this path by itself when a bus's 128 bytes are uniform (all off: 7 and 15
+// mixed) and more than one board is behind (all off: any board). pcaAllOff is the emergency stop
+// behind OP_ALL_OFF / UART_ALL_OFF, whatever the frame depth. The shadow then holds the uniform
+// bytes; skipped boards miss the write and keep their force bit, and a broadcast nobody ACKs
+// forces every board and turns the bus back to per-board writes until the next refresh or a
+// re-probe that answers (bus.bcast_nack).
+// pcaAllOff drops whatever async work is still queued on either bus (the all off supersedes it),
+// queues both buses' broadcasts and returns once the boards are off, per board if a broadcast
+// went unanswered. queued (optional) runs before anything is waited on: in async mode once both
+// broadcasts are with the DMA, else before them (Pico2: UART_ALL_OFF to Pico1).
+void pcaAllOff(PcaBus& bus0, PcaBus& bus1, void (*queued)() = nullptr);
+
+// pcaInvalidate:
+// - Forgets the shadow so the next actionX() rewrites every board of the bus
+void pcaInvalidate(PcaBus& bus);
+
+// ++++ BOARD HEALTH ++++
+//
+// A missing or browned-out board NACKs every write and would cost bus time on every frame, so
+// each bus keeps a skip mask of boards that frames leave out:
+// - pcaScan (boot, blocking): address probe of all 32 boards, the same check as
+//   debug/PCAAdressChecker; boards that do not answer start skipped and are not brought up
+// - every transaction's result is charged to its board (endTransmission() in blocking mode, the
+//   controller's abort flag, a timeout or a transfer that could not start in async mode);
+//   PCA_FAIL_SKIP failures in a row put the board into the skip mask
+// - pcaHealthService (loop): every PCA_REPROBE_MS one skipped board gets its bring-up writes
+//   (MODE1 sleep, PRE_SCALE, MODE1 wake); once one of them is ACKed the board leaves the mask
+//   and the next frame rewrites all of its channels
+// Frames still ACK STATUS_OK: the other boards got their values. OP_GET_STATUS reports the mask.
+// Pico1 answers a UART_HEALTH packet (SEQ = tag) with three records in the ACK format, then
+// the ACK: STATUS_HEALTH_BUS0 / _BUS1 with SEQ = pcaHealthy() of that bus, STATUS_HEALTH_NACKS
+// with SEQ = nack_total of both buses.
+static constexpr uint8_t  PCA_FAIL_SKIP      = 3;
+static constexpr uint32_t PCA_REPROBE_MS     = 500;
+static constexpr uint32_t I2C_TXN_TIMEOUT_US = 5000;   // async: abort a transaction stuck this long
+
+// PRE_SCALE for a PWM frequency (same rounding as Adafruit_PWMServoDriver::setPWMFreq)
+uint8_t  pcaPrescale(float hz);
+
+// pcaScan: blocking presence check of the 32 addresses | sets bus.present and bus.skip, returns present
+uint32_t pcaScan(PcaBus& bus);
+
+// pcaHealthService: re-probe one skipped board if PCA_REPROBE_MS have passed (call from loop)
+void     pcaHealthService(PcaBus& bus, uint32_t now_ms);
+
+// pcaHealthy: bit dev = board dev is being written
+inline uint32_t pcaHealthy(const PcaBus& bus) { return ~bus.skip; }
+
+static constexpr uint8_t STATUS_HEALTH_BUS0  = 11;
+static constexpr uint8_t STATUS_HEALTH_BUS1  = 12;
+static constexpr uint8_t STATUS_HEALTH_NACKS = 13;
+
 // ++++ ACTION (send final signal via I2C) ++++
 //
 // actionX signature MUST match command.cpp:
-// - boards0 and boards1 are arrays of pointers to Adafruit_PWMServoDriver objects.
+// - bus0 and bus1 are the two I2C buses of this Pico (Wire, Wire1), 32 boards each.
 // - X512 is 512 magnet states:
 //     X512[0..255]   -> bus0 boards (32 boards * 8 magnets)
 //     X512[256..511] -> bus1 boards (32 boards * 8 magnets)
 //
 // NOTE
-// - The actual I2C writes are performed via Adafruit_PWMServoDriver::setPWM inside command.cpp.
-// - Any internal helper (intensityToPwm, setPair, etc.) stays in command.cpp to avoid duplication.
-void actionX(Adafruit_PWMServoDriver* boards0,
-             Adafruit_PWMServoDriver* boards1,
-             const uint8_t* X512);
+// - Each board is written as ONE auto-increment burst of LED0..LED15 (64 bytes) instead of
+//   16 separate setPWM() transactions: 64 transactions per frame per Pico instead of 1024.
+// - Register values are identical to what setPWM(ch, 0, pwm) writes.
+// - Only boards / channel ranges that changed since the last frame are written (bus.shadow);
+//   a frame identical to the previous one costs no I2C traffic at all.
+// - Boards in bus.skip are left out (BOARD HEALTH); their shadow keeps the last values they took.
+// - bus.frame holds the I2C cost of this call after it returns.
+// - The value -> register mapping is a 16-entry table per magnet (bus.lut, CALIBRATION; MAG_IMG in
+//   command.cpp when uncalibrated): each nibble value maps to the 8 bytes of its left/right LEDn
+//   registers, copied straight into the I2C transmit buffer (Wire buffer or async queue slot).
+//   No per-magnet arithmetic at run time.
+void actionX(PcaBus& bus0, PcaBus& bus1, const uint8_t* X512);
+
+// actionPacked:
+// - Same as actionX() but reads the packed frame bytes directly (no X512 unpack):
+//     packed256[0..127]   -> bus0 boards (low nibble = even magnet, high nibble = odd magnet)
+//     packed256[128..255] -> bus1 boards
+void actionPacked(PcaBus& bus0, PcaBus& bus1, const uint8_t* packed256);
+
+// applyBusPacked / applyBus:
+// - The per-bus half of actionPacked() / actionX(): 128 packed bytes or 256 magnet states of this bus
+// - Lets the two buses run on different cores (see DUAL CORE)
+void applyBusPacked(PcaBus& bus, const uint8_t* packed128);
+void applyBus(PcaBus& bus, const uint8_t* Xbase);
+
+// ++++ FRAME DEPTH ++++
+//
+// A nibble gives 15 levels of the PCA9685's 12-bit PWM; finer steps would take the PC many
+// dithered frames. DEEP_MAGIC frames (F) carry DEPTH = 6, 8 or 12 bits per magnet instead.
+// - Packing: magnet m is bits [m * DEPTH, (m + 1) * DEPTH) of the data read as one little-endian
+//   bit string (DEPTH 4 is exactly the nibble layout). A board's 8 magnets take DEPTH bytes, a bus
+//   depthBusBytes(), a Pico's half depthHalfBytes(); the first half is Pico1's, as for nibbles.
+// - Values follow the nibble rule: C = 2^(DEPTH-1) - 1 is off, above C drives LEFT, below C
+//   RIGHT, at |value - C| / C of full scale; all ones is off too (the 15 of nibbles).
+//     DEPTH 6: C = 31 | 8: C = 127 | 12: C = 2047
+// - Calibration applies: |value - C| lands between two points of the magnet's curve (linear in
+//   between), then gain, offset and swap as for nibbles.
+// - 4096 values do not fit a table per magnet: applyBusDeep works out the two channels of each
+//   magnet of a changed board per frame (multiplies and shifts, no divide). bus.shadow keeps the
+//   deep bytes, so unchanged boards and magnets cost no I2C, as for nibbles; a frame of another
+//   depth (nibble frames and patterns included) rewrites every board.
+// - Link: Pico1's half goes as depthLinkPackets() packets of the usual size, see (B).
+// - Encoded (D) and pattern (E) frames stay 4-bit; after a deep frame Pico2 has no reference
+//   for delta / sparse frames until the next MAGIC frame (STATUS_ERR_BASE).
+constexpr int      depthBusBytes(int d) { return PCA_MAG_PER_BUS * d / 8; }   // 192 / 256 / 384
+constexpr uint16_t depthCenter(int d)   { return (uint16_t)((1u << (d - 1)) - 1); }
+
+// deepUnpack / deepPack: n magnet values <-> their DEPTH-bit packing (n * DEPTH a multiple of 8)
+void deepUnpack(const uint8_t* src, int n, int depth, uint16_t* v);
+void deepPack(const uint16_t* v, int n, int depth, uint8_t* dst);
+
+// applyBusDeep: depthBusBytes(depth) bytes to one bus, dirty magnets only (as applyBusPacked)
+void applyBusDeep(PcaBus& bus, const uint8_t* src, int depth);
+// applyBusDepth: applyBusPacked for DEPTH_NIBBLE, applyBusDeep otherwise
+void applyBusDepth(PcaBus& bus, const uint8_t* src, int depth);
+// actionDepth: a Pico's half of any depth to both buses (bus1 from src + depthBusBytes(depth))
+void actionDepth(PcaBus& bus0, PcaBus& bus1, const uint8_t* src, int depth);
+
+// ++++ CALIBRATION ++++
+//
+// Coils differ, so each magnet can have its own value -> PWM map instead of the linear one. The PC
+// uploads a set (OP_CAL_STORE / OP_CAL_CURVE, forwarded to Pico1 as UART_CAL_* packets) and commits
+// it (OP_CAL_COMMIT); only then is it expanded, off the frame path, into one BoardLut per board:
+// the 16 register images of each of its 8 magnets. Frames keep doing a single table lookup per
+// magnet, just in the board's table (bus.lut) instead of MAG_IMG.
+// - pwm(value) = curve[value] * GAIN / 1024 + OFFSET, clamped to 0..4095; value 7 and 15 are off
+// - CAL_FLAG_SWAP exchanges the LEFT / RIGHT channel of the pair (coil wired the other way)
+// - CAL_CURVES shared curves of CAL_LEVELS points; each magnet picks one in FLAGS
+// - calSave / calLoad: the set in LittleFS (CAL_FILE), tagged with CAL_FILE_MAGIC + CAL_FORMAT,
+//   the PC's VERSION and a CRC16; setup() loads and applies it, a bad or missing file means linear.
+//   Needs a filesystem in the flash layout (Tools > Flash Size: "... FS: 64KB" or more).
+// - Pico1 answers UART_CAL_INFO with a STATUS_CAL_VERSION record (SEQ = its version), then the ACK
+static constexpr int      CAL_LEVELS         = 15;                        // values 0..14
+static constexpr int      CAL_CURVES         = 4;
+static constexpr int      CAL_CURVE_BYTES    = CAL_LEVELS * 2;            // PWM(2) per level
+static constexpr int      CAL_REC_BYTES      = 5;                         // GAIN(2) + OFFSET(2) + FLAGS(1)
+static constexpr int      CAL_MAGNETS        = 2 * PCA_MAG_PER_BUS;       // per Pico: 512
+static constexpr int      CAL_STORE_HDR      = 3;                         // FIRST(2) + N(1)
+static constexpr int      CAL_STORE_MAX      = (UART_PAYLOAD_BYTES - CAL_STORE_HDR) / CAL_REC_BYTES;   // 50
+static constexpr uint16_t CAL_GAIN_ONE       = 1024;
+static constexpr uint8_t  CAL_FLAG_SWAP      = 0x01;
+static constexpr int      CAL_CURVE_SHIFT    = 4;
+static constexpr uint8_t  CAL_CURVE_MASK     = 0x30;
+static constexpr uint32_t CAL_FILE_MAGIC     = 0x4C41434D;                // "MCAL"
+static constexpr uint8_t  CAL_FORMAT         = 1;
+static constexpr uint8_t  STATUS_CAL_VERSION = 14;
+static constexpr char     CAL_FILE[]         = "/cal.bin";
+
+// register images of one board: [magnet][value] -> LEFT + RIGHT LEDn registers (1 KB)
+struct BoardLut {
+  uint8_t v[PCA_MAG_PER_BOARD][16][PCA_MAG_IMG_BYTES];
+};
+
+// this Pico's half of a set, kept as the records came in (the file is the same bytes)
+struct CalSet {
+  uint32_t version;                             // 0 = uncalibrated
+  uint8_t  curve[CAL_CURVES][CAL_CURVE_BYTES];
+  uint8_t  rec[CAL_MAGNETS][CAL_REC_BYTES];     // magnet j: bus j / 256, board (j % 256) / 8, pair j % 8
+};
+
+// CAL_FILE: [CAL_FILE_MAGIC(4)] [CAL_FORMAT(1)] [VERSION(4)] [curves] [records] [CRC16(2)]
+static constexpr int CAL_FILE_BYTES = 4 + 1 + 4 + CAL_CURVES * CAL_CURVE_BYTES + CAL_MAGNETS * CAL_REC_BYTES + CRC_BYTES;
+
+// calDefaults: version 0, linear curves, unit gain, no offset, no swap
+void calDefaults(CalSet& cal);
+// calStore / calCurve: stage records of magnets first .. first+n-1 / one curve | false if out of range
+bool calStore(CalSet& cal, int first, int n, const uint8_t* recs);
+bool calCurve(CalSet& cal, int curve, const uint8_t* pwm);
+// calBuild: expand the set into 2 * PCA_BOARDS_PER_BUS tables (bus0's boards, then bus1's)
+void calBuild(const CalSet& cal, BoardLut* lut);
+// calSave / calLoad: CAL_FILE in LittleFS | calLoad leaves cal untouched if the file is bad
+bool calSave(const CalSet& cal);
+bool calLoad(CalSet& cal);
+
+// ++++ PATTERN BANK ++++
+//
+// Each Pico keeps BANK_SLOTS patterns of its own half in RAM, already converted to register
+// images: applying one sends slices of the stored image, no nibble-to-register conversion.
+// - Pico2 receives OP_BANK_STORE, keeps HALF 1 and forwards HALF 0 to Pico1 as a link packet
+//   [SEQ = ID] + [PACKED(256)] + [UART_BANK_STORE]; Pico1 ACKs it with SEQ = ID.
+// - A PATTERN_MAGIC frame goes to Pico1 as [SEQ] + [ID, zero pad (256)] + [UART_BANK_APPLY] and
+//   is ACKed like a data frame (STATUS_ERR_BANK if the ID is not stored).
+// - Only dirty channel runs are sent, as for frames (against the bus shadow), and the shadows
+//   follow the pattern, so the next data frame is still only a diff.
+// - bankStore: preconvert packed256 (this Pico's half: bus0 = [0..127], bus1 = [128..255]) with
+//   the buses' tables (CALIBRATION)
+// - bankRebuild: preconvert every stored pattern again (after the tables changed)
+// - bankApply: write pattern id to both buses (queued in async mode) | false if id is not stored
+static constexpr int BANK_SLOTS     = 16;
+static constexpr int BANK_IMG_BYTES = 2 * PCA_BOARDS_PER_BUS * PCA_IMG_BYTES;   // 4096 per half
+static_assert(BANK_SLOTS <= 32, "bank bitmaps are 32 bits");
+
+struct BankSlot {
+  uint8_t packed[DATA_HALF];                  // shadow update on apply
+  uint8_t img[BANK_IMG_BYTES];                // board 0..31 of bus0, then bus1: LED0..LED15 each
+};
+
+struct PatternBank {
+  BankSlot slot[BANK_SLOTS];
+  uint32_t used;                              // bit id: slot holds a pattern
+};
+
+static constexpr uint32_t BANK_SLOT_BYTES = sizeof(BankSlot);
+
+void bankStore(PatternBank& bank, int id, const uint8_t* packed256, const PcaBus& bus0, const PcaBus& bus1);
+void bankRebuild(PatternBank& bank, const PcaBus& bus0, const PcaBus& bus1);
+bool bankApply(PatternBank& bank, int id, PcaBus& bus0, PcaBus& bus1);
+
+// calApply: copy the staged set into active and make it the set of both buses (calBuild into lut,
+// or linear for version 0; bus.cal = &active for deep frames, so later calStore / calCurve into
+// staged change nothing until the next commit), re-expand the bank and rewrite every board with
+// the next frame | nothing may be queued
+void calApply(const CalSet& staged, CalSet& active, BoardLut* lut, PcaBus& bus0, PcaBus& bus1, PatternBank& bank);
+
+// ++++ SEQUENCE PLAYBACK ++++
+//
+// A list of (bank pattern, duration) steps played by the Picos themselves, so step timing does
+// not depend on USB or the PC.
+// - Pico2 owns the clock: a pico-sdk alarm (add_alarm_in_us) fires at every step boundary,
+//   rescheduled from its previous target (no drift), and toggles SYNC_PIN. Pico1 counts both
+//   edges of SYNC_PIN from a pin interrupt, so both halves see tick n at the same moment.
+// - The interrupt side only counts ticks; loop() on each Pico applies step (tick - 1) % COUNT
+//   with bankApply (seqPoll). The I2C apply time is the only floor on step duration.
+// - A step is late (an overrun) if ticks were skipped or the previous step's I2C writes were
+//   still queued when the tick came; only the newest tick is applied.
+// - OP_SEQ_START sends Pico1 [SEQ = COUNT] + [IDS(256)] + [UART_SEQ_START] and waits for its
+//   ACK (it resets Pico1's tick counter) before the first tick.
+// - Progress goes up the ACK stream as [ACK_MAGIC][STEP(4)][STATUS_SEQ_*]:
+//     STATUS_SEQ_STEP    every REPORT_EVERY steps, once applied on Pico2
+//     STATUS_SEQ_OVERRUN per late step (Pico1 sends its own to Pico2, which passes them on)
+//     STATUS_SEQ_DONE    after the last step's duration (LOOPS * COUNT steps)
+static constexpr int      SEQ_MAX_STEPS      = 256;
+static constexpr uint32_t SEQ_MIN_STEP_US    = 200;    // shorter durations are raised to this
+static constexpr uint8_t  SYNC_PIN           = 21;     // Pico2 -> Pico1 step tick (toggles)
+static constexpr uint8_t  STATUS_SEQ_STEP    = 7;
+static constexpr uint8_t  STATUS_SEQ_OVERRUN = 8;
+static constexpr uint8_t  STATUS_SEQ_DONE    = 9;
+
+struct SeqPlayer {
+  uint8_t           ids[SEQ_MAX_STEPS];
+  uint16_t          count;
+  bool              active;
+  volatile uint32_t ticks;        // interrupt side: step boundaries since start
+  uint32_t          applied;      // last tick seqPoll applied
+  uint32_t          overruns;
+  uint32_t          ticket0;      // i2cTicket(bus0 / bus1) after the last step was queued
+  uint32_t          ticket1;
+};
+
+enum SeqPollResult { SEQ_IDLE, SEQ_STEP, SEQ_LATE };
+
+// seqStart: ticks / applied / overruns back to 0, active | call with the interrupt source stopped
+void seqStart(SeqPlayer& p);
+// seqPoll: apply the newest tick if there is one | *tick = that tick
+SeqPollResult seqPoll(SeqPlayer& p, PatternBank& bank, PcaBus& bus0, PcaBus& bus1, uint32_t* tick);
+
+// ++++ LATCHED COMMIT ++++
+//
+// Without it each board takes its new values when its own I2C write ends, so one frame reaches
+// the 1024 magnets spread over the whole I2C time of both Picos. With OP_SET_LATCH on:
+// - Each Pico drives /OE of its own 64 boards (PICO1_OE_PIN / PICO2_OE_PIN) and pulls it high
+//   while it writes a frame. The PCA9685 has no shadow registers, so "held" means blanked:
+//   the outputs are off from the start of staging until the release.
+// - Pico1 stages on COMMIT / BANK_APPLY and ACKs once its writes are done (as always).
+// - Pico2 releases when its own writes are done and Pico1 has ACKed: it toggles LATCH_PIN, and
+//   drives its own /OE low. Pico1 drives its /OE low from the LATCH_PIN interrupt.
+// - Skew: Pico1's /OE net is also wired to Pico2 (input on the same GP number); Pico2 times
+//   from its own release until it reads that net low. 0xFFFF = not seen within LATCH_SKEW_MAX_US.
+// - HOLD_US = how long Pico2's outputs were held for the frame.
+// - A frame is staged only after the previous one was released (window still pipelines USB).
+// Wiring: GP10 (LATCH) Pico2 -> Pico1, GP11 (Pico1 /OE net) Pico1 -> Pico2, GP12 Pico2's /OE net.
+static constexpr uint8_t  LATCH_PIN          = 10;
+static constexpr uint8_t  PICO1_OE_PIN       = 11;
+static constexpr uint8_t  PICO2_OE_PIN       = 12;
+static constexpr uint32_t LATCH_SKEW_MAX_US  = 1000;
+static constexpr uint16_t LATCH_SKEW_UNKNOWN = 0xFFFF;
+
+// ++++ STAGE TRACE ++++
+//
+// micros() durations of each step of a frame, one fixed ring of TRACE_DEPTH samples per stage
+// (no allocation, a few stores per sample). OP_GET_TRACE summarizes them for the PC.
+// Pico1 measures its own two stages and sends them after each frame ACK as a STATUS_TRACE record,
+// which Pico2 adds to its rings, so one query covers both Picos.
+//   TR_USB_RX      Pico2: header read -> last CRC byte read (cut-through: includes forwarding)
+//   TR_CRC         Pico2: CRC16 over the frame
+//   TR_FORWARD     Pico2: writing the packet to the Pico1 link
+//   TR_BUS0/1      Pico2: apply start -> that bus's writes are on the wire (applyBusPacked / bank)
+//   TR_PICO1_WAIT  Pico2: packet forwarded -> Pico1's ACK
+//   TR_FRAME       Pico2: header read -> ACK to the PC
+//   TR_P1_APPLY    Pico1: CPU time of the apply (queueing in async mode, the writes otherwise)
+//   TR_P1_DONE     Pico1: packet received -> both buses done (its ACK)
+enum TraceStage : uint8_t {
+  TR_USB_RX, TR_CRC, TR_FORWARD, TR_BUS0, TR_BUS1, TR_PICO1_WAIT, TR_FRAME, TR_P1_APPLY, TR_P1_DONE,
+  TRACE_STAGES
+};
+static constexpr int     TRACE_DEPTH  = 128;
+static constexpr uint8_t STATUS_TRACE = 10;
+
+struct TraceRing {
+  uint32_t us[TRACE_STAGES][TRACE_DEPTH];
+  uint32_t count[TRACE_STAGES];               // samples since reset; ring slot = count % TRACE_DEPTH
+};
+
+inline void traceAdd(TraceRing& t, uint8_t stage, uint32_t us) {
+  t.us[stage][t.count[stage] % TRACE_DEPTH] = us;
+  ++t.count[stage];
+}
+void traceReset(TraceRing& t);
+// traceSummary: the OP_GET_TRACE record of one stage (TRACE_SUMMARY_BYTES)
+void traceSummary(const TraceRing& t, uint8_t stage, uint8_t* out);
+
+// messages in the ACK stream that are not an answer to a packet / frame
+inline bool ackIsMessage(uint8_t status) {
+  return status == STATUS_SEQ_STEP || status == STATUS_SEQ_OVERRUN || status == STATUS_SEQ_DONE ||
+         status == STATUS_TRACE || status == STATUS_HEALTH_BUS0 || status == STATUS_HEALTH_BUS1 ||
+         status == STATUS_HEALTH_NACKS || status == STATUS_CAL_VERSION;
+}
+
+// ++++ ASYNC I2C ENGINE (optional) ++++
+//
+// Non-blocking writes through arduino-pico's DMA I2C (TwoWire::writeAsync / finishedAsync).
+// - i2cAsyncEnable: switch a bus to queued mode after bring-up (bring-up itself stays blocking;
+//   sync and async transfers must not be mixed on one Wire afterwards)
+// - i2cPump: retire the finished transaction, start the next one; returns true when idle.
+//   Cheap, call it from loop() and from the io idle hook. Both buses run at the same time.
+// - i2cTicket / i2cDone: take a ticket after queueing a frame, poll it for completion
+void     i2cAsyncEnable(PcaBus& bus);
+bool     i2cPump(PcaBus& bus);
+uint32_t i2cTicket(const PcaBus& bus);
+bool     i2cDone(const PcaBus& bus, uint32_t ticket);
+
+// ++++ DUAL CORE (optional) ++++
+//
+// Wire and Wire1 are independent peripherals, so bus1 can be written by core 1 while core 0
+// writes bus0 (and keeps USB / UART going).
+// - Core 0 submits (bus, packed128) jobs, core 1 services them from loop1() (deep frames: any
+//   depth's bus bytes, applyBusDepth)
+// - Handoff is one 32-bit word through the RP2040 inter-core FIFO (rp2040.fifo):
+//     core0 -> core1 : job slot index
+//     core1 -> core0 : same slot index once the bus is written
+// - Two job slots: core 0 may hand over the next frame while core 1 is still writing the previous
+//   one. The packed bytes are read in place and must stay untouched until waited for.
+static constexpr int CORE_JOB_SLOTS = 2;
+
+struct CoreLink {
+  PcaBus*        bus[CORE_JOB_SLOTS];
+  const uint8_t* packed[CORE_JOB_SLOTS];
+  uint8_t        depth[CORE_JOB_SLOTS];      // FRAME DEPTH of packed
+  uint8_t        next;        // slot used by the next submit
+  uint8_t        pending;     // submitted and not yet waited for
+};
+
+// core 0: hand one bus to core 1 (blocks only if both slots are still busy)
+void coreLinkSubmit(CoreLink& link, PcaBus& bus, const uint8_t* packed128, int depth = DEPTH_NIBBLE);
+
+// core 0: block until every submitted job is done
+void coreLinkWait(CoreLink& link);
+
+// core 1: run one job if there is one (call from loop1)
+void coreLinkService(CoreLink& link);
 
 // ++++ ACK (verification of successful communication) ++++
 //
@@ -109,3 +895,271 @@ void makeAck(uint8_t* ack7, uint32_t seq, uint8_t status);
 // - If valid: writes status to out_status and returns true
 // - If timeout or mismatch: returns false
 bool readAck(Stream& s, uint32_t expected_seq, uint8_t* out_status, uint32_t timeout_us);
+
+// pollAck:
+// - Non-blocking: consumes whatever bytes the stream has into rx, never waits
+// - Returns true once a complete ACK starting with ACK_MAGIC is assembled (any SEQ);
+//   the caller matches SEQ itself. Misaligned bytes are shifted out one at a time.
+struct AckRx {
+  uint8_t buf[ACK_BYTES];
+  int     idx;
+};
+bool pollAck(Stream& s, AckRx& rx, uint32_t* out_seq, uint8_t* out_status);
+
+// ackRxPush: the same assembler fed one byte at a time (byte sources that are not a Stream)
+bool ackRxPush(AckRx& rx, uint8_t b, uint32_t* out_seq, uint8_t* out_status);
+
+
+// ++++ UART LINK SPEED ++++
+//
+// Pico2 (master) and Pico1 (slave) both boot at LINK_BAUDS[0] and agree on a faster rate:
+// - Link packets use the normal UART packet framing with TRAILER = UART_LINK and
+//   PAYLOAD[0] = LINK_OP_*; SEQ carries LINK_SEQ_TAG | n. Pico1 answers every one with an ACK
+//   (STATUS LINK_OK / LINK_BAD) at the rate it received it on.
+// - One step (uartLinkTry):
+//     PROPOSE(baud) at the current rate -> ACK -> both switch -> LINK_TEST_PACKETS PRBS packets,
+//     each checked and ACKed by Pico1 -> PROPOSE(same baud) again = confirm.
+//   Any miss on the new rate: Pico2 goes back, Pico1 goes back by itself after LINK_TRIAL_MS
+//   without a confirm. "Reliable" = no error in the whole test (~2 kB down, 63 B up).
+// - Tune: from the current rate step up while it works, stop at the first failure or the ceiling.
+// - Run time: Pico2 counts frames that lost their Pico1 ACK (uartLinkFrameResult). Too many in
+//   LINK_MON_FRAMES -> degraded; the next frame boundary steps one rate down (uartLinkFallback)
+//   and lowers the ceiling. If Pico1 can no longer be reached at all, both drop to
+//   LINK_BAUDS[0]: Pico2 pings there, Pico1 gets there after LINK_BAD_MAX unreadable packets.
+// - Stream::flush() is called before every switch so nothing is cut off mid-byte.
+static constexpr uint32_t LINK_BAUDS[]    = { 115200, 230400, 460800, 921600, 1500000, 3000000 };
+static constexpr int      LINK_BAUD_COUNT = sizeof(LINK_BAUDS) / sizeof(LINK_BAUDS[0]);
+
+static constexpr uint32_t LINK_SEQ_TAG      = 0xF1000000u;   // never reached by frame SEQs
+static constexpr uint8_t  LINK_OP_PING      = 0x01;
+static constexpr uint8_t  LINK_OP_PROPOSE   = 0x02;          // PAYLOAD[1..4] = baud
+static constexpr uint8_t  LINK_OP_TEST      = 0x03;          // PAYLOAD[1..255] = PRBS(SEQ)
+static constexpr uint8_t  LINK_OK           = 1;
+static constexpr uint8_t  LINK_BAD          = 2;
+
+static constexpr int      LINK_TEST_PACKETS = 8;
+static constexpr uint32_t LINK_TRIAL_MS     = 500;    // Pico1 reverts if no confirm by then
+static constexpr uint32_t LINK_GUARD_MS     = 2;      // after a switch, before the first byte
+static constexpr uint32_t LINK_PING_MS      = 50;     // ping period while waiting for Pico1
+static constexpr uint32_t LINK_RESYNC_MS    = 2000;   // give up reaching Pico1 after this
+static constexpr uint32_t LINK_STALL_MS     = 250;    // partial packet not growing -> unreadable
+static constexpr int      LINK_BAD_MAX      = 3;      // Pico1: unreadable packets in a row -> base rate
+static constexpr int      LINK_MON_FRAMES   = 64;     // Pico2: monitor period (frames)
+static constexpr int      LINK_MON_ERRORS   = 4;      // Pico2: lost ACKs per period -> degraded
+
+struct UartLink {
+  Stream*  s;
+  void   (*set_baud)(uint32_t baud);   // e.g. Serial1.begin(baud)
+  uint8_t  idx;                        // LINK_BAUDS index in use
+  uint8_t  ceiling;                    // master: highest index uartLinkTune() may try
+  uint32_t link_seq;                   // master: next link packet SEQ (low bits)
+  uint8_t  pkt[UART_PKT_BYTES];        // master: link packet being sent
+
+  // slave
+  bool     trial;                      // switched, confirm not seen yet
+  uint8_t  trial_prev;                 // index to go back to
+  uint32_t trial_t0_ms;
+  uint8_t  bad_run;                    // unreadable packets in a row
+  int      rx_last;                    // available() at the last uartLinkWatchRx()
+  uint32_t rx_since_ms;                // ... and since when it has not grown
+
+  // master monitor
+  uint16_t mon_frames;
+  uint16_t mon_errors;
+  bool     degraded;                   // fallback due at the next frame boundary
+  uint16_t fallbacks;                  // since boot
+  uint32_t lost_acks;                  // since boot
+};
+
+// uartLinkInit: both sides, at LINK_BAUDS[0] (calls set_baud) | ceiling = every rate
+void     uartLinkInit(UartLink& l, Stream& s, void (*set_baud)(uint32_t baud));
+inline uint32_t uartLinkBaud(const UartLink& l) { return LINK_BAUDS[l.idx]; }
+int      uartLinkIndexAtMost(uint32_t baud);        // fastest LINK_BAUDS index <= baud (min 0)
+
+// master (Pico2) | all of these block; call them with nothing in flight
+bool     uartLinkWaitPeer(UartLink& l, uint32_t timeout_ms);   // ping until Pico1 answers
+bool     uartLinkTry(UartLink& l, int idx);                    // one step, true if now at idx
+uint32_t uartLinkTune(UartLink& l);                            // climb to the fastest reliable rate
+uint32_t uartLinkFallback(UartLink& l);                        // one rate down, or resync at base
+void     uartLinkFrameResult(UartLink& l, bool ok);            // per ACKed frame: ok = Pico1 answered
+
+// slave (Pico1)
+void     uartLinkServe(UartLink& l, const uint8_t* pkt);       // a packet with TRAILER = UART_LINK
+void     uartLinkGoodPacket(UartLink& l);                      // any readable packet
+void     uartLinkBadPacket(UartLink& l);                       // unknown TRAILER, stalled bytes
+void     uartLinkPoll(UartLink& l);                            // trial deadline
+void     uartLinkWatchRx(UartLink& l, int avail);              // partial packet stall check
+
+// PRBS used by LINK_OP_TEST (both sides generate it from SEQ)
+void     linkFillTest(uint8_t* payload, uint32_t seq);
+bool     linkCheckTest(const uint8_t* payload, uint32_t seq);
+
+
+// ++++ INTER-PICO LINK ++++
+//
+// The Pico2 -> Pico1 hop behind one packet interface, so the sketches do not care which wire
+// carries it. The packet is always the UART packet of (B): [SEQ(4)] + [PAYLOAD(256)] + [TRAILER(1)].
+// - Pico2 (master): sendBytes() streams the bytes of one packet as they become available
+//   (cut-through), endPacket() closes it; pollAck() never blocks.
+// - Pico1 (slave): recvPacket() hands over whole COMMIT / ABORT packets (link housekeeping
+//   packets never reach the sketch), sendAck() queues one 7-byte ACK; ACKs stay in call order.
+// - Rate management (waitPeer / tune / degraded / fallback) is a no-op on links without it.
+// Implementations:
+// - UartPicoLink: Serial1 with the UART LINK SPEED tuner (wire format unchanged)
+// - SpiPicoLink:  SPI, Pico2 is the master, see (D) below
+// Choice (PICO_LINK in both sketches): PICO_LINK_UART / PICO_LINK_SPI fixed at compile time, or
+// PICO_LINK_STRAP = LINK_STRAP_PIN read once at boot (open = UART, tied to GND = SPI).
+//
+// (D) Pico2 <-> Pico1 over SPI (SPI mode 3, Pico2 drives SCK and CS, SPI_LINK_HZ):
+//   packet:   [SPI_CMD_PKT] + packet (261 bytes), one CS-low burst, clocked in pieces with cut-through
+//   ACK read: [SPI_CMD_ACK] + (SPI_ACK_READ_BYTES - 1) filler bytes, only while SPI_READY_PIN is high
+//   Full duplex: every byte Pico2 clocks brings one byte of Pico1's ACK stream back (ACKs back
+//   to back, filler when there is none), so ACKs also ride along on packets; SPI_READY_PIN (driven
+//   by Pico1) only asks Pico2 to clock when it has nothing to send. Pico1 frames packets by byte
+//   count behind the command byte. Pico2 moves every piece by DMA (SPI.transferAsync); Pico1's
+//   SPISlave drains the receive FIFO from its interrupt into a LINK_RX_PKTS packet ring.
+//   Wiring: TX -> RX both ways (GP19 -> GP16), SCK, CS, READY and GND straight through.
+static constexpr int      PICO_LINK_UART  = 0;
+static constexpr int      PICO_LINK_SPI   = 1;
+static constexpr int      PICO_LINK_STRAP = 2;
+
+static constexpr uint8_t  LINK_STRAP_PIN  = 22;        // PICO_LINK_STRAP: open = UART, GND = SPI
+
+static constexpr uint8_t  SPI_LINK_RX     = 16;        // spi0 RX: MISO on Pico2, MOSI on Pico1
+static constexpr uint8_t  SPI_LINK_CS     = 17;        // Pico2: plain GPIO held low per packet
+static constexpr uint8_t  SPI_LINK_SCK    = 18;
+static constexpr uint8_t  SPI_LINK_TX     = 19;        // spi0 TX: MOSI on Pico2, MISO on Pico1
+static constexpr uint8_t  SPI_READY_PIN   = 20;        // Pico1 -> Pico2: ACK bytes waiting
+// the RP2040 SPI slave needs SCK <= clk_peri / 12 (~10 MHz); Pico1 also empties its RX FIFO from
+// an interrupt, so stay below that: 8 MHz is ~3.3x the fastest UART rate
+static constexpr uint32_t SPI_LINK_HZ     = 8000000;
+
+static constexpr uint8_t  SPI_CMD_PKT     = 0xD2;
+static constexpr uint8_t  SPI_CMD_ACK     = 0xE1;
+static constexpr int      SPI_ACK_READ_BYTES = 1 + ACK_BYTES;
+
+class PicoLink {
+public:
+  virtual ~PicoLink() {}
+  virtual void     begin(bool master) = 0;
+  virtual uint8_t  kind() const = 0;                   // PICO_LINK_UART / PICO_LINK_SPI
+  virtual uint32_t rate() const = 0;                   // UART baud / SPI clock
+  virtual uint32_t ceiling() const { return rate(); }
+  virtual uint16_t fallbacks() const { return 0; }
+  virtual uint32_t lostAcks() const = 0;
+
+  // master (Pico2)
+  virtual void     sendBytes(const uint8_t* src, int n) = 0;
+  virtual void     endPacket() {}
+  virtual bool     pollAck(uint32_t* out_seq, uint8_t* out_status) = 0;
+  virtual void     frameResult(bool ok) = 0;           // per frame: did Pico1 answer
+  virtual bool     waitPeer(uint32_t timeout_ms) { (void)timeout_ms; return true; }
+  virtual uint32_t tune(uint32_t max_rate) { (void)max_rate; return rate(); }
+  virtual bool     degraded() const { return false; }  // fallback() due at the next frame boundary
+  virtual void     fallback() {}
+
+  // slave (Pico1)
+  virtual bool     recvPacket(uint8_t* pkt) = 0;       // non-blocking, pkt = UART_PKT_BYTES
+  virtual void     sendAck(const uint8_t* ack7) = 0;
+  virtual void     poll() {}                           // call every loop()
+};
+
+// picoLinkSelect: PICO_LINK_* choice -> one of the two links (reads LINK_STRAP_PIN if asked to)
+PicoLink& picoLinkSelect(int choice, PicoLink& uart, PicoLink& spi);
+
+class UartPicoLink : public PicoLink {
+public:
+  UartPicoLink(Stream& s, void (*set_baud)(uint32_t baud)) : s_(s), set_baud_(set_baud) {}
+
+  void     begin(bool master) override;
+  uint8_t  kind() const override { return PICO_LINK_UART; }
+  uint32_t rate() const override { return uartLinkBaud(l_); }
+  uint32_t ceiling() const override { return LINK_BAUDS[l_.ceiling]; }
+  uint16_t fallbacks() const override { return l_.fallbacks; }
+  uint32_t lostAcks() const override { return l_.lost_acks; }
+
+  void     sendBytes(const uint8_t* src, int n) override { writeExactBytes(s_, src, n); }
+  bool     pollAck(uint32_t* out_seq, uint8_t* out_status) override;
+  void     frameResult(bool ok) override { uartLinkFrameResult(l_, ok); }
+  bool     waitPeer(uint32_t timeout_ms) override { return uartLinkWaitPeer(l_, timeout_ms); }
+  uint32_t tune(uint32_t max_rate) override;
+  bool     degraded() const override { return l_.degraded; }
+  void     fallback() override;
+
+  bool     recvPacket(uint8_t* pkt) override;
+  void     sendAck(const uint8_t* ack7) override { writeExactBytes(s_, ack7, ACK_BYTES); }
+  void     poll() override { uartLinkPoll(l_); }
+
+private:
+  Stream&  s_;
+  void   (*set_baud_)(uint32_t baud);
+  UartLink l_;
+  AckRx    rx_;                                        // master: Pico1 ACK assembler
+};
+
+class SpiPicoLink : public PicoLink {
+public:
+  SpiPicoLink(SPIClassRP2040& spi, SPISlaveClass& slave) : spi_(spi), slave_(slave) {}
+
+  void     begin(bool master) override;
+  uint8_t  kind() const override { return PICO_LINK_SPI; }
+  uint32_t rate() const override { return SPI_LINK_HZ; }
+  uint32_t lostAcks() const override { return lost_acks_; }
+
+  void     sendBytes(const uint8_t* src, int n) override;
+  void     endPacket() override;
+  bool     pollAck(uint32_t* out_seq, uint8_t* out_status) override;
+  void     frameResult(bool ok) override { if (!ok) ++lost_acks_; }
+
+  bool     recvPacket(uint8_t* pkt) override;
+  void     sendAck(const uint8_t* ack7) override;
+
+  uint32_t rxDropped() const { return rx_dropped_; }   // slave: packets lost to a full ring
+  uint32_t rxBad() const { return rx_bad_; }           // slave: stray command bytes, bad trailers
+
+private:
+  static constexpr int      ACK_QUEUE    = 4 * WINDOW_MAX;
+  static constexpr int      TX_BYTES     = 2 * WINDOW_MAX * ACK_BYTES;   // frame ACKs + trace records
+  static constexpr uint32_t ACK_NUDGE_US = 1000;       // master: clock an ACK read this often anyway
+  enum : uint8_t { RX_CMD, RX_PKT, RX_FILL };
+
+  // master
+  void xfer(const uint8_t* src, int n);                // clock n bytes out, parse what comes back
+  // slave, from the SPISlave interrupt (or with interrupts off)
+  static void onRecv(uint8_t* data, size_t len);
+  static void onSent();
+  static SpiPicoLink* slave_self_;
+  void rxBytes(const uint8_t* data, size_t len);
+  void txNext();
+
+  SPIClassRP2040& spi_;
+  SPISlaveClass&  slave_;
+  uint32_t lost_acks_ = 0;
+
+  // master
+  bool     in_pkt_ = false;                            // CS is low
+  uint32_t last_xfer_us_ = 0;
+  uint8_t  scratch_[128];                              // full-duplex receive side of one piece
+  AckRx    rx_ = {};
+  uint32_t ackq_seq_[ACK_QUEUE];
+  uint8_t  ackq_status_[ACK_QUEUE];
+  uint8_t  ackq_head_  = 0;
+  uint8_t  ackq_count_ = 0;
+
+  // slave receive: command byte, then a packet or ACK-read filler
+  uint8_t           ring_[LINK_RX_PKTS][UART_PKT_BYTES];
+  volatile uint8_t  ring_head_  = 0;
+  volatile uint8_t  ring_count_ = 0;
+  uint8_t           rx_state_   = RX_CMD;
+  int               rx_pos_     = 0;
+  bool              rx_drop_    = false;               // ring was full when this packet started
+  uint32_t          rx_dropped_ = 0;
+  uint32_t          rx_bad_     = 0;
+
+  // slave transmit: one buffer on the wire, one filling up
+  uint8_t           tx_buf_[2][TX_BYTES];
+  int               tx_fill_[2]  = { 0, 0 };
+  uint8_t           tx_cur_      = 0;                  // buffer on the wire (tx_busy_) or next to go
+  bool              tx_busy_     = false;
+  volatile int      tx_pending_  = 0;                  // ACK bytes not clocked out yet
+};
@@ -3,6 +3,10 @@
 // ===========================================
 #include "command.h"
 #include <Adafruit_PWMServoDriver.h>
+#include <pico/time.h>
+#include <tusb.h>
+#include <RP2040USB.h>
+#include <LittleFS.h>
 
 // Author: DH HAN and SAM LAB
 //
@@ -12,25 +16,83 @@
 //     DATA_BYTES(512): packed 4-bit magnet values for 1024 magnets
 //     CRC_BYTES (2)  : CRC16-CCITT over [HDR + DATA] (little-endian stored)
 // - Pico2 splits DATA into two halves:
-//     first 256 bytes  -> forwarded to Pico1 over UART (with SEQ)
-//     second 256 bytes -> used locally on Pico2 (buildX + actionX)
+//     first 256 bytes  -> forwarded to Pico1 over the inter-Pico link (UART or SPI, PICO_LINK)
+//                         with SEQ, then COMMIT/ABORT trailer
+//     second 256 bytes -> used locally on Pico2 (actionPacked, table lookup per magnet)
 // - Pico2 waits ACK from Pico1 (ACK_BYTES=7) and then sends ACK to PC
+// - Window (OP_SET_WINDOW control frame, default 1 = stop-and-wait):
+//     up to `window` frames are in flight; each is forwarded + applied as soon as it arrives,
+//     and ACKs go to the PC in SEQ order once Pico1 has ACKed that frame too
+// - Encoded data frames (DELTA_MAGIC / SPARSE_MAGIC, see FRAME ENCODINGS in command.h):
+//     Pico2 rebuilds the full 512 bytes in state512 (the last accepted data frame) and forwards
+//     the first half only when it changed; BASE_SEQ != that frame -> STATUS_ERR_BASE
+// - Pattern bank (PATTERN BANK in command.h): OP_BANK_STORE keeps the second half here and
+//     forwards the first half to Pico1; a 9-byte PATTERN_MAGIC frame applies pattern ID on both
+// - Sequence playback (SEQUENCE PLAYBACK in command.h): OP_SEQ_LOAD / OP_SEQ_START play bank
+//     patterns on an alarm schedule, SYNC_PIN ticks Pico1; progress goes out as extra ACKs
+// - Latched commit (LATCHED COMMIT in command.h, OP_SET_LATCH): frames are staged behind /OE and
+//     released on both Picos at once before the ACK, which then reports hold time and skew
+// - Stage trace (STAGE TRACE in command.h, OP_GET_TRACE): per-stage micros() rings on both
+//     Picos; Pico1 sends its stage times after each ACK, Pico2 summarizes all of them
+// - Board health (BOARD HEALTH in command.h): boards missing at boot or NACKing at run time are
+//     skipped and re-probed; OP_GET_STATUS asks Pico1 for its half (UART_HEALTH) and reports
+//     the health bitmap of all 128 boards
+// - USB receive (FRAME RESYNC in command.h): frames are assembled in frame[] by a MAGIC-hunting
+//     receiver with deadlines; with USB_DIRECT it reads the TinyUSB CDC FIFO itself (tud_cdc_read)
+// - Calibration (CALIBRATION in command.h, OP_CAL_*): per-magnet gain / offset / polarity / curve,
+//     staged on both Picos (Pico1's half as UART_CAL_* packets), expanded into per-board register
+//     tables on commit and kept in LittleFS; setup() loads the saved set
+// - Deep frames (FRAME DEPTH in command.h, DEEP_MAGIC): 6 / 8 / 12 bits per magnet; Pico1's half
+//     is forwarded as UART_DEEP_PART packets and a UART_DEEP_COMMIT packet (ABORT on a CRC failure)
+// - Broadcast (BROADCAST in command.h): a uniform bus goes out as one ALL_CALL write; OP_ALL_OFF
+//     turns both Picos' boards off that way (UART_ALL_OFF to Pico1 first), past the ring barrier
 // - PCA9685 addressing rule (per bus):
 //     start BASE_ADDR=0x40, increment by 1
 //     32 boards per bus => 0x40..0x5F
+// - UART rate: both Picos boot at 115200; setup() tunes up to UART_BAUD_MAX (uartLinkTune) and
+//   loop() steps down when Pico1 ACKs start going missing (uartLinkFallback)
+// - SPI link (PICO_LINK): Pico2 is the master at SPI_LINK_HZ, no tuning
 //
 // NOTE
 // - All validation must be strict:
 //     MAGIC must match
 //     CRC must match
 //     ACK must match expected SEQ
-// - If CRC fails, do NOT forward to Pico1; just return status fail to PC.
+// - If CRC fails, do NOT let Pico1 apply it (ABORT trailer); just return status fail to PC.
 
 
 // ++++ CONFIG (EDIT ONLY THESE) ++++
 static constexpr uint8_t  BASE_ADDR = 0x40;
 static constexpr uint32_t I2C_HZ    = 1000000;
 static constexpr float    PCA_PWM_FREQ_HZ = 1000.0f;
+static constexpr uint16_t FULL_REFRESH_FRAMES = 200;   // rewrite all boards every N frames (0 = only changes)
+static constexpr uint32_t UART_BAUD_MAX = 3000000;     // fastest UART rate the link tuner may try (LINK_BAUDS)
+static constexpr uint32_t UART_PEER_WAIT_MS = 3000;    // boot: how long to wait for Pico1 to answer
+
+// Pico2 <-> Pico1 wire, same choice on both Picos (see INTER-PICO LINK in command.h):
+// PICO_LINK_UART | PICO_LINK_SPI | PICO_LINK_STRAP (LINK_STRAP_PIN at boot: open = UART, GND = SPI)
+static constexpr int      PICO_LINK = PICO_LINK_STRAP;
+
+// 1: I2C writes are queued and sent by DMA (Wire.writeAsync), both buses at once, while loop()
+//    keeps serving the serial links | 0: blocking writes
+#define ASYNC_I2C 1
+
+// 1: stream SEQ + first half to Pico1 while the PC frame is still arriving (CRC updated per chunk),
+//    then COMMIT / ABORT after the CRC check | 0: forward only after the whole frame is verified
+#define CUT_THROUGH 1
+
+// only used when ASYNC_I2C is 0:
+// 1: core 0 writes bus0 (Wire), core 1 writes bus1 (Wire1) in parallel | 0: both buses on core 0
+#define DUAL_CORE 1
+
+// 1: micros() per frame stage into fixed rings, summarized by OP_GET_TRACE (STAGE TRACE) | 0: off
+#define STAGE_TRACE 1
+
+// 1: the frame receiver pulls bytes with tud_cdc_read() straight from the TinyUSB CDC FIFO into
+//    frame[], as many as are there in one call | 0: Serial.available() + Serial.readBytes(), which
+//    on arduino-pico's SerialUSB is one Serial.read() (USB mutex + two TinyUSB calls) per byte.
+//    Needs the Pico SDK USB stack (Tools > USB Stack: "Pico SDK"), the default.
+#define USB_DIRECT 1
 
 // ACK status codes (1 byte)
 // - keep it simple and explicit
@@ -38,36 +100,168 @@ static constexpr uint8_t STATUS_OK            = 1;
 static constexpr uint8_t STATUS_ERR_MAGIC     = 0;
 static constexpr uint8_t STATUS_ERR_CRC       = 2;
 static constexpr uint8_t STATUS_ERR_PICO1_ACK = 3;
+static constexpr uint8_t STATUS_ERR_OP        = 4;   // unknown control op / bad args
+static constexpr uint8_t STATUS_ERR_BASE      = 5;   // encoded frame: not against state512 / bad body
+static constexpr uint8_t STATUS_ERR_BANK      = 6;   // pattern frame: ID not stored on both Picos
+static constexpr uint8_t STATUS_ERR_FLASH     = 15;  // OP_CAL_COMMIT: tables active, set not saved
 
 
 // ++++ GLOBAL BUFFERS ++++
-// frame parts
-static uint8_t hdr[HDR_BYTES];              // MAGIC(2) + SEQ(4)
-static uint8_t data512[DATA_BYTES];         // packed 512 bytes (1024 magnets * 4 bits)
-static uint8_t crc2[CRC_BYTES];             // received CRC (2 bytes)
+// one receive buffer for the whole frame; CRC, UART forwarding and the I2C path all read it in place
+// (sized for the deepest DEEP_MAGIC frame)
+alignas(4) static uint8_t frame[FRAME_MAX_BYTES];
+static uint8_t* const hdr     = frame;                          // MAGIC(2) + SEQ(4)
+static uint8_t* const data512 = frame + HDR_BYTES;              // packed 512 bytes (1024 magnets * 4 bits)
+static uint8_t* const crc2    = frame + HDR_BYTES + DATA_BYTES; // received CRC (2 bytes)
+
+// reference frame for encoded data frames: the last data frame accepted (CRC OK), fully decoded
+static uint8_t  state512[DATA_BYTES];
+static uint32_t stateSeq   = 0;
+static bool     stateValid = false;             // false until the first full frame
+static bool     pico1Stale = false;             // a Pico1 packet went unanswered: resend its half
 
-// computed check buffer (HDR + DATA)
-static uint8_t checkBuf[HDR_BYTES + DATA_BYTES];
+// pattern bank: this Pico's half as register images; Pico1's half only packed (for state512)
+static PatternBank bank;
+static uint8_t     bankPico1[BANK_SLOTS][DATA_HALF];
+static uint32_t    bankPico1Used = 0;               // bit id: Pico1 ACKed its half of pattern id
 
-// Pico2 local action buffer
-static uint8_t X[X_VALUES];                 // 512 values (0..15) for 512 magnets controlled by Pico2
+// calibration: the staged set of this half (OP_CAL_STORE / OP_CAL_CURVE), the committed one and
+// the tables it was expanded into, Pico1's active version
+static CalSet      cal;
+static CalSet      calActive;                       // deep frames read it (bus.cal)
+static BoardLut    calLut[2 * PCA_BOARDS_PER_BUS];  // 64 KB: bus0's boards, then bus1's
+static uint32_t    pico1CalVersion = 0;             // from STATUS_CAL_VERSION (OP_CAL_INFO)
+
+// sequence playback: steps (ids in seqPlayer), durations, and the alarm that ticks both Picos
+static SeqPlayer        seqPlayer;
+static uint32_t         seqDur[SEQ_MAX_STEPS];
+static uint32_t         seqTotal       = 0;           // ticks to play, 0 = until stopped
+static uint16_t         seqReportEvery = 0;
+static alarm_id_t       seqAlarm       = 0;
+static bool             seqSyncLevel   = false;       // SYNC_PIN, toggled per tick
+static volatile bool    seqEnded       = false;       // alarm: last step's duration is over
+static uint32_t         seqPico1Overruns = 0;         // late steps reported by Pico1
+
+// latched commit: staged frames wait behind /OE for the release (LATCH_PIN toggles)
+static bool             latchMode  = false;
+static bool             latchLevel = false;
 
 // ack buffers
 static uint8_t ack7[ACK_BYTES];             // Pico2 -> PC ACK
-static uint8_t pico1_status = 0;
+
+// timeout_us must be chosen realistically for:
+// - Pico1 link receive + I2C apply + ACK send-back
+// start with 200ms and tune down later (counted from the moment the frame was forwarded)
+static constexpr uint32_t ACK_TIMEOUT_US = 200000;
+// OP_CAL_COMMIT with SAVE: Pico1 writes its flash before it ACKs
+static constexpr uint32_t CAL_SAVE_TIMEOUT_US = 2000000;
+
+
+// ++++ IN-FLIGHT RING ++++
+// One entry per accepted frame, oldest first. An entry is ACKed to the PC when it reaches the
+// head and Pico1 has answered (or it never went to Pico1, e.g. CRC failure).
+struct InFlight {
+  uint32_t seq;
+  uint8_t  status;        // local result (STATUS_OK or an error)
+  bool     wait_pico1;    // true until the Pico1 ACK for seq arrives
+  uint32_t t_fwd_us;      // when the packet went to Pico1
+  bool     wait_i2c;      // ASYNC_I2C: local writes still queued
+  uint32_t ticket0;       // i2cTicket(bus0) after this frame was queued
+  uint32_t ticket1;       // i2cTicket(bus1)
+  bool     latch;         // latched commit: release both Picos before the ACK
+  uint32_t t_hold_us;     // when Pico2's /OE went high for this frame
+  uint32_t t_hdr_us;      // STAGE_TRACE: header read
+  uint32_t t_apply_us;    //              local apply started
+  uint8_t  traced;        //              bit 0/1: TR_BUS0/TR_BUS1 recorded
+};
+
+static InFlight ring[WINDOW_MAX];
+static uint8_t  ringHead  = 0;
+static uint8_t  ringCount = 0;
+static uint8_t  window    = 1;              // 1 = stop-and-wait (boot default)
+
+// the answer to the last pico1Post(), picked out of Pico1's ACKs by serviceRing()
+static bool     pico1Waiting = false;
+static uint32_t pico1WaitTag = 0;
+static uint32_t pico1WaitT0  = 0;           // when the packet went out
+static uint32_t pico1WaitUs  = 0;           // when the answer came in
+static uint8_t  pico1WaitStatus = 0;
+
+
+// ++++ FRAME RESYNC ++++
+// every frame the PC may send; the hunter skips anything that does not start with one of them
+static const uint16_t usbMagics[] = { MAGIC, CTRL_MAGIC, DELTA_MAGIC, SPARSE_MAGIC, PATTERN_MAGIC, DEEP_MAGIC };
+static FrameRx usbRx;
+
+#if USB_DIRECT
+// under the core's USB mutex, like every SerialUSB call (the USB task runs tud_task() under it)
+static int usbDirectRead(uint8_t* dst, int max) {
+  CoreMutex m(&__usb_mutex);
+  if (!m) return 0;
+  return (int)tud_cdc_read(dst, (uint32_t)max);
+}
+#endif
+
+
+// ++++ STAGE TRACE ++++
+static uint32_t frameT0 = 0;                // micros() when the current frame's header was read
+
+#if STAGE_TRACE
+static TraceRing traceRing;
+#endif
+
+static inline void trace(uint8_t stage, uint32_t us) {
+#if STAGE_TRACE
+  traceAdd(traceRing, stage, us);
+#else
+  (void)stage;
+  (void)us;
+#endif
+}
+
+
+// ++++ PICO1 LINK ++++
+// UART (rate agreed with Pico1, see UART LINK SPEED) or SPI master, picked in setup()
+static void uartBegin(uint32_t baud) {
+  Serial1.begin(baud);
+}
+
+static UartPicoLink uartLink(Serial1, uartBegin);
+static SpiPicoLink  spiLink(SPI, SPISlave);
+static PicoLink*    pico1Link = &uartLink;
 
 
 // ++++ PCA9685 OBJECTS ++++
 // Two buses on Pico2 (Wire, Wire1), each has 32 boards.
+// boards0/boards1 are used for bring-up only; frames are written through bus0/bus1 (burst path).
 static Adafruit_PWMServoDriver* boards0[32];
 static Adafruit_PWMServoDriver* boards1[32];
+static PcaBus bus0;
+static PcaBus bus1;
+static uint32_t pico1Health[2] = {0, 0};       // Pico1's pcaHealthy(bus0 / bus1), from UART_HEALTH
+static uint32_t pico1Nacks     = 0;            // failed I2C transactions on Pico1
+#if DUAL_CORE && !ASYNC_I2C
+static CoreLink coreLink;                      // core 0 <-> core 1 job handoff (DUAL_CORE)
+#endif
+
+// keeps both async I2C queues moving | loop() and every blocking serial wait call it
+static void pumpI2c() {
+  i2cPump(bus0);
+  i2cPump(bus1);
+}
 
-static void initPcaBus(Adafruit_PWMServoDriver* boards[32], TwoWire& wire, uint8_t base_addr) {
+// boards that do not answer the scan stay skipped (no bring-up, pcaHealthService re-probes them)
+static void initPcaBus(Adafruit_PWMServoDriver* boards[32], PcaBus& bus) {
+  bus.prescale = pcaPrescale(PCA_PWM_FREQ_HZ);
+  pcaScan(bus);
   for (int i = 0; i < 32; ++i) {
-    const uint8_t addr = (uint8_t)(base_addr + i);
-    boards[i] = new Adafruit_PWMServoDriver(addr, &wire);
+    const uint8_t addr = (uint8_t)(bus.base_addr + i);
+    boards[i] = nullptr;
+    if (bus.skip & (1u << i)) continue;
+    boards[i] = new Adafruit_PWMServoDriver(addr, bus.wire);
     boards[i]->begin();
     boards[i]->setPWMFreq(PCA_PWM_FREQ_HZ);
+    pcaEnableAutoIncrement(bus, i);          // burst writes in actionX rely on MODE1.AI
     delay(2);
   }
 }
@@ -75,112 +269,1065 @@ static void initPcaBus(Adafruit_PWMServoDriver* boards[32], TwoWire& wire, uint8
 
 // ++++ SETUP ++++
 void setup() {
-  // ---- A. SERIAL ----
+  // ---- A. SERIAL / PICO1 LINK ----
   Serial.begin(115200);     // PC <-> Pico2 (USB)
-  Serial1.begin(115200);    // Pico2 <-> Pico1 (UART)
+  Serial1.setFIFOSize(2 * WINDOW_MAX * ACK_BYTES);   // UART: a window of Pico1 ACKs + trace records
+  pico1Link = &picoLinkSelect(PICO_LINK, uartLink, spiLink);
+  pico1Link->begin(true);                        // Pico2 <-> Pico1, UART at LINK_BAUDS[0] until tuned
+  pinMode(SYNC_PIN, OUTPUT);                     // sequence step tick to Pico1
+  digitalWrite(SYNC_PIN, LOW);
+  pinMode(LATCH_PIN, OUTPUT);                    // latched commit: release edge to Pico1
+  digitalWrite(LATCH_PIN, LOW);
+  pinMode(PICO2_OE_PIN, OUTPUT);                 // /OE of this Pico's boards: low = outputs on
+  digitalWrite(PICO2_OE_PIN, LOW);
+  pinMode(PICO1_OE_PIN, INPUT);                  // Pico1's /OE net, for the skew
   while (!Serial) {}
+  frameRxInit(usbRx, Serial, frame, usbMagics, sizeof(usbMagics) / sizeof(usbMagics[0]));
+#if USB_DIRECT
+  frameRxSetDirect(usbRx, usbDirectRead);
+#endif
 
   // ---- B. I2C ----
+  pcaBusInit(bus0, Wire,  BASE_ADDR);
+  pcaBusInit(bus1, Wire1, BASE_ADDR);
+  bus0.refresh_every = FULL_REFRESH_FRAMES;
+  bus1.refresh_every = FULL_REFRESH_FRAMES;
   Wire.begin();
   Wire1.begin();
   Wire.setClock(I2C_HZ);
   Wire1.setClock(I2C_HZ);
 
   // ---- C. PCA bring-up ----
-  initPcaBus(boards0, Wire,  BASE_ADDR);   // bus0: 0x40..0x5F
-  initPcaBus(boards1, Wire1, BASE_ADDR);   // bus1: 0x40..0x5F
+  initPcaBus(boards0, bus0);   // bus0 (Wire):  0x40..0x5F
+  initPcaBus(boards1, bus1);   // bus1 (Wire1): 0x40..0x5F
+
+#if ASYNC_I2C
+  i2cAsyncEnable(bus0);        // from here on frames only queue I2C work
+  i2cAsyncEnable(bus1);
+  setIoIdleHook(pumpI2c);
+#endif
+
+  // ---- D. link rate ----
+  // UART: Pico1 may still be bringing up its boards, ping until it answers, then climb
+  // SPI: nothing to agree on
+  if (pico1Link->waitPeer(UART_PEER_WAIT_MS)) pico1Link->tune(UART_BAUD_MAX);
+
+  // ---- E. calibration ----
+  // the set saved by the last OP_CAL_COMMIT; none (or a bad file) = linear
+  calDefaults(cal);
+  if (LittleFS.begin() && calLoad(cal)) calApply(cal, calActive, calLut, bus0, bus1, bank);
 
   Serial.println("pico2 setup complete");
 }
 
 
+// ++++ ACK / RING HELPERS ++++
+static void sendAck(uint32_t seq, uint8_t status) {
+  makeAck(ack7, seq, status);
+  writeExactBytes(Serial, ack7, ACK_BYTES);
+}
+
+// control reply = ACK + [LEN(2)] + [REPLY(LEN)] (only when status is OK)
+static void sendReply(uint32_t seq, const uint8_t* body, uint16_t len) {
+  uint8_t len2[REPLY_LEN_BYTES];
+  sendAck(seq, STATUS_OK);
+  wr_u16_le(len2, len);
+  writeExactBytes(Serial, len2, REPLY_LEN_BYTES);
+  writeExactBytes(Serial, body, len);
+}
+
+static void ringPush(uint32_t seq, uint8_t status, bool wait_pico1) {
+  InFlight& e = ring[(ringHead + ringCount) % WINDOW_MAX];
+  e.seq        = seq;
+  e.status     = status;
+  e.wait_pico1 = wait_pico1;
+  e.t_fwd_us   = micros();
+  e.wait_i2c   = false;
+  e.latch      = false;
+  e.t_hdr_us   = frameT0;
+  e.traced     = 0;
+  ++ringCount;
+}
+
+static InFlight& ringTail() {
+  return ring[(ringHead + ringCount - 1) % WINDOW_MAX];
+}
+
+// frames that may stay in flight while the next one is staged: none in latch mode, the previous
+// frame has to be released before its boards are written again
+static int ringRoom() {
+  return latchMode ? 0 : window - 1;
+}
+
+
+// ++++ LATCHED COMMIT ++++
+// the ring tail (this frame) is released before its ACK | blank_local: Pico2's half changes
+static void latchHold(bool blank_local) {
+  InFlight& e = ringTail();
+  e.latch     = true;
+  e.t_hold_us = micros();
+  if (blank_local) digitalWrite(PICO2_OE_PIN, HIGH);
+}
+
+// both /OE nets low together | returns how long Pico1's net took to follow
+static uint16_t latchRelease() {
+  latchLevel = !latchLevel;
+  digitalWrite(LATCH_PIN, latchLevel ? HIGH : LOW);   // Pico1: /OE low from its pin interrupt
+  digitalWrite(PICO2_OE_PIN, LOW);
+  const uint32_t t0 = micros();
+  while (digitalRead(PICO1_OE_PIN) == HIGH) {
+    if ((micros() - t0) >= LATCH_SKEW_MAX_US) return LATCH_SKEW_UNKNOWN;
+  }
+  return (uint16_t)(micros() - t0);
+}
+
+// ACK of a latched frame: release first (also on failure, the outputs must come back), then
+// ACK + [LEN] + [HOLD_US][SKEW_US] if it went through
+static void latchAck(const InFlight& e) {
+  const uint16_t skew = latchRelease();
+  if (e.status != STATUS_OK) {
+    sendAck(e.seq, e.status);
+    return;
+  }
+  uint8_t r[LATCH_REPLY_BYTES];
+  wr_u32_le(&r[0], micros() - e.t_hold_us);
+  wr_u16_le(&r[4], skew);
+  sendReply(e.seq, r, LATCH_REPLY_BYTES);
+}
+
+// a message from Pico1 that is not an answer (ackIsMessage) | wherever its ACKs are read
+static void pico1Message(uint32_t aseq, uint8_t astatus) {
+  switch (astatus) {
+    case STATUS_SEQ_OVERRUN:                                    // Pico1 was late on a step
+      ++seqPico1Overruns;
+      sendAck(aseq, STATUS_SEQ_OVERRUN);
+      break;
+    case STATUS_TRACE:                                          // Pico1's stage times of the frame it just ACKed
+      trace(TR_P1_APPLY, aseq & 0xFFFF);
+      trace(TR_P1_DONE, aseq >> 16);
+      break;
+    case STATUS_HEALTH_BUS0:  pico1Health[0] = aseq; break;     // answers to UART_HEALTH
+    case STATUS_HEALTH_BUS1:  pico1Health[1] = aseq; break;
+    case STATUS_HEALTH_NACKS: pico1Nacks     = aseq; break;
+    case STATUS_CAL_VERSION:  pico1CalVersion = aseq; break;    // answer to UART_CAL_INFO
+    default: break;
+  }
+}
+
+// ACK every finished frame at the head | Pico1 answers in order, so its ACK can only be for
+// the oldest entry still waiting; older SEQs (late after a timeout) are dropped.
+static void serviceRing() {
+  uint32_t aseq;
+  uint8_t  astatus;
+  pumpI2c();
+  while (pico1Link->pollAck(&aseq, &astatus)) {
+    if (ackIsMessage(astatus)) {
+      pico1Message(aseq, astatus);
+      continue;
+    }
+    bool framed = false;
+    for (int k = 0; k < ringCount; ++k) {
+      InFlight& e = ring[(ringHead + k) % WINDOW_MAX];
+      if (!e.wait_pico1 || e.seq != aseq) continue;
+      framed = true;
+      e.wait_pico1 = false;
+      trace(TR_PICO1_WAIT, micros() - e.t_fwd_us);
+      pico1Link->frameResult(true);
+      // If Pico1 reports failure (status byte), propagate it as-is (or map if you want).
+      // Here: if status == 1 => keep the local result, else => use that status directly.
+      if (astatus != STATUS_OK && e.status == STATUS_OK) e.status = astatus;
+      if (astatus != STATUS_OK) pico1Stale = true;
+      break;
+    }
+    if (!framed && pico1Waiting && aseq == pico1WaitTag) {   // Pico1 answers in order: after the frames
+      pico1Waiting    = false;
+      pico1WaitStatus = astatus;
+      pico1WaitUs     = micros();
+    }
+  }
+
+#if ASYNC_I2C && STAGE_TRACE
+  // per-bus finish times of every queued frame, not only the head's
+  for (int k = 0; k < ringCount; ++k) {
+    InFlight& e = ring[(ringHead + k) % WINDOW_MAX];
+    if (!e.wait_i2c) continue;
+    if (!(e.traced & 1) && i2cDone(bus0, e.ticket0)) { e.traced |= 1; trace(TR_BUS0, micros() - e.t_apply_us); }
+    if (!(e.traced & 2) && i2cDone(bus1, e.ticket1)) { e.traced |= 2; trace(TR_BUS1, micros() - e.t_apply_us); }
+  }
+#endif
+
+  while (ringCount) {
+    InFlight& e = ring[ringHead];
+    if (e.wait_i2c) {
+      if (!i2cDone(bus0, e.ticket0) || !i2cDone(bus1, e.ticket1)) break;
+      e.wait_i2c = false;
+    }
+    if (e.wait_pico1) {
+      if ((micros() - e.t_fwd_us) < ACK_TIMEOUT_US) break;      // still in time
+      e.wait_pico1 = false;
+      e.status     = STATUS_ERR_PICO1_ACK;
+      pico1Link->frameResult(false);
+      pico1Stale   = true;                                      // its boards may be behind state512
+    }
+    if (e.latch) latchAck(e);
+    else sendAck(e.seq, e.status);
+    trace(TR_FRAME, micros() - e.t_hdr_us);
+    ringHead = (uint8_t)((ringHead + 1) % WINDOW_MAX);
+    --ringCount;
+  }
+}
+
+// block until at most `keep` frames are still in flight
+static void drainRing(int keep) {
+  while (ringCount > keep) serviceRing();
+}
+
+
+// ++++ LOCAL APPLY ++++
+#if ASYNC_I2C
+// the ring tail (this frame) is done once the writes queued so far are on the wire
+// t_apply_us: when its writes started to be queued
+static void ringTailWaitI2c(uint32_t t_apply_us) {
+  InFlight& e = ringTail();
+  e.t_apply_us = t_apply_us;
+  e.wait_i2c = true;
+  e.ticket0  = i2cTicket(bus0);
+  e.ticket1  = i2cTicket(bus1);
+}
+#endif
+
+// Pico2's half: half[0..127] -> bus0, half[128..255] -> bus1 | nibbles go through the board tables
+// (CALIBRATION) straight into the I2C transmit buffers, no X[512] unpack. The ring tail is this frame.
+// depth: a deep frame's DEPTH, bus1's bytes then start at depthBusBytes(depth) (FRAME DEPTH)
+static void applyLocal(const uint8_t* half, int depth = DEPTH_NIBBLE) {
+  const uint8_t* const half1 = half + depthBusBytes(depth);
+  const uint32_t t0 = micros();
+#if ASYNC_I2C
+  applyBusDepth(bus0, half, depth);                          // queued only; DMA drains both buses while we go on
+  applyBusDepth(bus1, half1, depth);
+  ringTailWaitI2c(t0);                                       // TR_BUS0/1 from serviceRing()
+#elif DUAL_CORE
+  coreLinkSubmit(coreLink, bus1, half1, depth);              // core 1: bus1 (Wire1)
+  applyBusDepth(bus0, half, depth);                          // core 0: bus0 (Wire)
+  trace(TR_BUS0, micros() - t0);
+  coreLinkWait(coreLink);                     // bus1 done before this frame can be ACKed
+  trace(TR_BUS1, micros() - t0);
+#else
+  applyBusDepth(bus0, half, depth);                          // actionDepth, one bus at a time
+  trace(TR_BUS0, micros() - t0);
+  applyBusDepth(bus1, half1, depth);
+  trace(TR_BUS1, micros() - t0);
+#endif
+}
+
+
+// a frame that did not arrive intact: ACK it only if its header can be trusted, then let the
+// hunter look through its bytes for the next MAGIC
+static void rxFailed(uint32_t seq, uint8_t status) {
+  if (usbRx.aligned) {
+    drainRing(ringRoom());
+    ringPush(seq, status, false);
+    serviceRing();
+  }
+  frameRxReject(usbRx);
+}
+
+// ++++ ENCODED DATA FRAMES ++++
+// after the header: [BASE_SEQ(4) + LEN(2)] + [BODY(LEN)] + [CRC(2)], read into frame[] in place
+// (CRC right behind BODY, as on the wire).
+// No cut-through here: the body is small and Pico1 only hears about the frame if its half changed.
+static void handleEncoded(uint16_t magic, uint32_t seq) {
+  uint8_t* const enc  = data512;                  // BASE_SEQ + LEN, BODY right behind
+  uint8_t* const body = enc + ENC_HDR_BYTES;
+  if (!frameRxRead(usbRx, ENC_HDR_BYTES)) { rxFailed(seq, STATUS_ERR_CRC); return; }
+  const uint32_t base = rd_u32_le(&enc[0]);
+  const int      len  = rd_u16_le(&enc[4]);
+
+  if (len > ENC_BODY_MAX) {                       // not a frame of ours (or a MAGIC found in noise)
+    rxFailed(seq, STATUS_ERR_MAGIC);
+    return;
+  }
+  if (!frameRxRead(usbRx, len + CRC_BYTES)) {
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  trace(TR_USB_RX, micros() - frameT0);
+  drainRing(ringRoom());                          // room in the ring for this one
+
+  const uint32_t t_crc = micros();
+  const uint16_t crc_calc = crc16_final(crc16_update(crc16_init(), frame, HDR_BYTES + ENC_HDR_BYTES + len));
+  trace(TR_CRC, micros() - t_crc);
+  if (rd_u16_le(body + len) != crc_calc) {
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  frameRxDone(usbRx);
+
+  // ---- rebuild the full frame ----
+  uint8_t changed = 0;
+  const bool ok = stateValid && base == stateSeq &&
+                  (magic == DELTA_MAGIC ? decodeDelta(state512, body, len, &changed)
+                                        : decodeSparse(state512, body, len, &changed));
+  if (!ok) {                                      // PC has to resync with a full frame
+    ringPush(seq, STATUS_ERR_BASE, false);
+    serviceRing();
+    return;
+  }
+  stateSeq = seq;
+
+  // ---- Pico1: whole packet, only if its half changed ----
+  if ((changed & ENC_CHG_PICO1) || pico1Stale) {
+    uint8_t seq4[UART_SEQ_BYTES];
+    const uint8_t commit = UART_COMMIT;
+    const uint32_t t_fwd = micros();
+    wr_u32_le(seq4, seq);
+    pico1Link->sendBytes(seq4, UART_SEQ_BYTES);
+    pico1Link->sendBytes(state512, UART_PAYLOAD_BYTES);
+    pico1Link->sendBytes(&commit, UART_TRAILER_BYTES);
+    pico1Link->endPacket();
+    trace(TR_FORWARD, micros() - t_fwd);
+    pico1Stale = false;
+    ringPush(seq, STATUS_OK, true);
+  } else {
+    ringPush(seq, STATUS_OK, false);
+  }
+  if (latchMode) latchHold(changed & ENC_CHG_PICO2);
+
+  // ---- Pico2: local buses, only if its half changed ----
+  if (changed & ENC_CHG_PICO2) applyLocal(state512 + DATA_HALF);
+
+  drainRing(window - 1);                          // window == 1: ACK right here
+}
+
+
+// ++++ PATTERN FRAMES ++++
+// after the header: [ID(1)] + [CRC(2)]. Pico1 gets [SEQ] + [ID, zero pad] + [UART_BANK_APPLY]
+// (the link keeps its fixed packet size); both Picos write the stored register images.
+static void handlePattern(uint32_t seq) {
+  static uint8_t pad[UART_PAYLOAD_BYTES];         // ID in byte 0, rest stays zero
+  if (!frameRxRead(usbRx, 1 + CRC_BYTES)) {       // ID, CRC right behind it
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  trace(TR_USB_RX, micros() - frameT0);
+
+  const uint32_t t_crc = micros();
+  const uint16_t crc_calc = crc16_final(crc16_update(crc16_init(), frame, HDR_BYTES + 1));
+  trace(TR_CRC, micros() - t_crc);
+  if (rd_u16_le(data512 + 1) != crc_calc) {
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  frameRxDone(usbRx);
+  drainRing(ringRoom());
+  const uint8_t id = data512[0];
+  if (id >= BANK_SLOTS || !(bank.used & bankPico1Used & (1u << id))) {
+    ringPush(seq, STATUS_ERR_BANK, false);
+    serviceRing();
+    return;
+  }
+
+  const uint8_t apply = UART_BANK_APPLY;
+  const uint32_t t_fwd = micros();
+  pad[0] = id;
+  pico1Link->sendBytes(&hdr[2], UART_SEQ_BYTES);
+  pico1Link->sendBytes(pad, UART_PAYLOAD_BYTES);
+  pico1Link->sendBytes(&apply, UART_TRAILER_BYTES);
+  pico1Link->endPacket();
+  trace(TR_FORWARD, micros() - t_fwd);
+  pico1Stale = false;
+  ringPush(seq, STATUS_OK, true);
+  if (latchMode) latchHold(true);
+
+  // the pattern is the new reference frame for encoded frames
+  memcpy(state512, bankPico1[id], DATA_HALF);
+  memcpy(state512 + DATA_HALF, bank.slot[id].packed, DATA_HALF);
+  stateSeq   = seq;
+  stateValid = true;
+
+  const uint32_t t_apply = micros();
+  bankApply(bank, id, bus0, bus1);                // queued in async mode, blocking otherwise
+#if ASYNC_I2C
+  ringTailWaitI2c(t_apply);
+#else
+  trace(TR_BUS1, micros() - t_apply);             // both buses, one after the other
+#endif
+  drainRing(window - 1);
+}
+
+// ++++ DEEP FRAMES ++++
+// after the header: [DEPTH(1)] + [DATA(depthDataBytes)] + [CRC(2)] (FRAME DEPTH in command.h).
+// Pico1's half is longer than one link payload: it goes out in UART_PAYLOAD_BYTES parts, each its
+// own packet with SEQ; all but the last carry UART_DEEP_PART | DEPTH, the last one (zero padded)
+// UART_DEEP_COMMIT | DEPTH, or UART_ABORT when the frame fails. Pico1 answers the last one only.
+struct DeepFwd {
+  uint8_t depth;
+  int     half;           // depthHalfBytes(depth)
+  int     sent;           // bytes of the half forwarded so far
+  int     fill;           // payload bytes in the packet being sent, -1 = none open
+};
+
+static void deepFwdBytes(DeepFwd& f, const uint8_t* src, int n) {
+  while (n > 0) {
+    if (f.fill < 0) {
+      pico1Link->sendBytes(&hdr[2], UART_SEQ_BYTES);
+      f.fill = 0;
+    }
+    const int k = (n < UART_PAYLOAD_BYTES - f.fill) ? n : (UART_PAYLOAD_BYTES - f.fill);
+    pico1Link->sendBytes(src, k);
+    src    += k;
+    n      -= k;
+    f.sent += k;
+    f.fill += k;
+    if (f.fill == UART_PAYLOAD_BYTES && f.sent < f.half) {      // part full, more to come
+      const uint8_t part = UART_DEEP_PART | f.depth;
+      pico1Link->sendBytes(&part, UART_TRAILER_BYTES);
+      pico1Link->endPacket();
+      f.fill = -1;
+    }
+  }
+}
+
+// finish the last packet with `trailer` | nothing went out yet: Pico1 never hears of the frame
+static void deepFwdClose(DeepFwd& f, uint8_t trailer) {
+  static const uint8_t zeros[UART_PAYLOAD_BYTES] = {0};
+  if (f.sent == 0) return;
+  if (f.fill < 0) {
+    pico1Link->sendBytes(&hdr[2], UART_SEQ_BYTES);
+    f.fill = 0;
+  }
+  if (f.fill < UART_PAYLOAD_BYTES) pico1Link->sendBytes(zeros, UART_PAYLOAD_BYTES - f.fill);
+  pico1Link->sendBytes(&trailer, UART_TRAILER_BYTES);
+  pico1Link->endPacket();
+  f.fill = -1;
+}
+
+static void handleDeep(uint32_t seq) {
+  uint8_t* const deep = data512 + DEEP_HDR_BYTES;  // DATA right behind DEPTH, CRC behind DATA
+  if (!frameRxRead(usbRx, DEEP_HDR_BYTES)) {
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  const uint8_t depth = data512[0];
+  if (!depthOk(depth)) {                          // not a frame of ours (or a MAGIC found in noise)
+    rxFailed(seq, STATUS_ERR_MAGIC);
+    return;
+  }
+  const int half  = depthHalfBytes(depth);
+  const int total = depthDataBytes(depth);
+  drainRing(ringRoom());                          // room in the ring for this one
+
+  DeepFwd  f = { depth, half, 0, -1 };
+  uint32_t crc_us = 0, fwd_us = 0;
+#if CUT_THROUGH
+  // as for MAGIC frames: Pico1's half goes out while the rest is still arriving
+  uint32_t t = micros();
+  uint16_t crc_calc = crc16_update(crc16_init(), frame, HDR_BYTES + DEEP_HDR_BYTES);
+  crc_us += micros() - t;
+
+  int got = 0;
+  while (got < total) {
+    const int r = frameRxReadSome(usbRx, total - got);           // into deep + got
+    if (r < 0) break;
+    if (r == 0) { pumpI2c(); continue; }
+    t = micros();
+    crc_calc = crc16_update(crc_calc, deep + got, r);
+    crc_us += micros() - t;
+    if (got < half) {
+      t = micros();
+      deepFwdBytes(f, deep + got, (r < half - got) ? r : (half - got));
+      fwd_us += micros() - t;
+    }
+    got += r;
+  }
+  if (got < total || !frameRxRead(usbRx, CRC_BYTES)) {
+    deepFwdClose(f, UART_ABORT);
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  crc_calc = crc16_final(crc_calc);
+#else
+  if (!frameRxRead(usbRx, total + CRC_BYTES)) {
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  const uint32_t t_crc = micros();
+  const uint16_t crc_calc = crc16_final(crc16_update(crc16_init(), frame, HDR_BYTES + DEEP_HDR_BYTES + total));
+  crc_us = micros() - t_crc;
+#endif
+  trace(TR_USB_RX, micros() - frameT0);
+  trace(TR_CRC, crc_us);
+
+  if (rd_u16_le(deep + total) != crc_calc) {
+    deepFwdClose(f, UART_ABORT);                  // Pico1 drops the parts it already has
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  frameRxDone(usbRx);
+  stateValid = false;                             // no 4-bit reference for encoded frames now
+  pico1Stale = false;
+
+  const uint32_t t_fwd = micros();
+#if !CUT_THROUGH
+  deepFwdBytes(f, deep, half);
+#endif
+  deepFwdClose(f, (uint8_t)(UART_DEEP_COMMIT | depth));
+  trace(TR_FORWARD, fwd_us + (micros() - t_fwd));
+  ringPush(seq, STATUS_OK, true);
+  if (latchMode) latchHold(true);
+
+  applyLocal(deep + half, depth);
+  drainRing(window - 1);
+}
+
+// one packet to Pico1 outside the frame window (OP_BANK_STORE, OP_SEQ_START) | its ACK has SEQ = tag
+static void pico1Post(uint32_t tag, const uint8_t* payload, uint8_t trailer) {
+  uint8_t seq4[UART_SEQ_BYTES];
+  wr_u32_le(seq4, tag);
+  pico1Link->sendBytes(seq4, UART_SEQ_BYTES);
+  pico1Link->sendBytes(payload, UART_PAYLOAD_BYTES);
+  pico1Link->sendBytes(&trailer, UART_TRAILER_BYTES);
+  pico1Link->endPacket();
+  pico1WaitTag = tag;
+  pico1WaitT0  = micros();
+  pico1Waiting = true;
+}
+
+// wait for the answer to pico1Post(), counted from when it went out | false if Pico1 did not answer
+static bool pico1Answer(uint8_t* out_status, uint32_t timeout_us = ACK_TIMEOUT_US) {
+  while (pico1Waiting) {
+    if ((micros() - pico1WaitT0) >= timeout_us) {
+      pico1Waiting = false;
+      return false;
+    }
+    serviceRing();
+  }
+  *out_status = pico1WaitStatus;
+  return true;
+}
+
+// pico1Post + pico1Answer, with the ring drained (control barrier)
+static bool pico1Request(uint32_t tag, const uint8_t* payload, uint8_t trailer, uint8_t* out_status,
+                         uint32_t timeout_us = ACK_TIMEOUT_US) {
+  pico1Post(tag, payload, trailer);
+  return pico1Answer(out_status, timeout_us);
+}
+
+
+// ++++ SEQUENCE PLAYBACK ++++
+// alarm callback (timer interrupt): tick both Picos, come back after this step's duration.
+// Returning the duration reschedules from the previous target, so steps do not drift.
+static int64_t seqAlarmTick(alarm_id_t, void*) {
+  const uint32_t t = seqPlayer.ticks + 1;
+  if (seqTotal && t > seqTotal) {                 // last step has had its time
+    seqEnded = true;
+    return 0;
+  }
+  seqSyncLevel = !seqSyncLevel;
+  digitalWrite(SYNC_PIN, seqSyncLevel ? HIGH : LOW);
+  seqPlayer.ticks = t;
+  return seqDur[(t - 1) % seqPlayer.count];
+}
+
+static void seqStop() {
+  if (!seqPlayer.active) return;
+  if (seqAlarm > 0) cancel_alarm(seqAlarm);
+  seqAlarm   = 0;
+  seqPlayer.active = false;
+}
+
+// loop(): apply the step the alarm moved to, report progress / overruns / the end to the PC
+static void seqService() {
+  if (!seqPlayer.active) return;
+  uint32_t tick;
+  const SeqPollResult r = seqPoll(seqPlayer, bank, bus0, bus1, &tick);
+  if (r == SEQ_LATE) sendAck(tick, STATUS_SEQ_OVERRUN);
+  if (r != SEQ_IDLE && seqReportEvery && tick % seqReportEvery == 0) sendAck(tick, STATUS_SEQ_STEP);
+
+  if (seqEnded && seqPlayer.applied == seqPlayer.ticks) {
+    seqPlayer.active = false;
+    seqAlarm   = 0;
+    sendAck(seqPlayer.applied, STATUS_SEQ_DONE);
+  }
+}
+
+
+// ++++ CONTROL FRAMES ++++
+static uint32_t allOffSeq = 0;
+
+static void allOffPost() {
+  static const uint8_t zero[UART_PAYLOAD_BYTES] = {0};
+  pico1Post(allOffSeq, zero, UART_ALL_OFF);
+}
+
+// OP_ALL_OFF, without the control barrier: both local buses at once, UART_ALL_OFF to Pico1 before
+// anything is waited on (async: right behind the queued broadcasts, so a link still busy with
+// forwarded frames does not hold up Pico2's own). Frames still in flight lose their queued writes
+// but keep their place in the ACK order; Pico1 ACKs them before this one.
+static void allOff(uint32_t seq) {
+  seqStop();
+  allOffSeq = seq;
+  pcaAllOff(bus0, bus1, allOffPost);              // one ALL_CALL write per bus (BROADCAST)
+  const uint32_t pico2_us = micros() - frameT0;
+  stateValid = false;                             // no 4-bit reference for encoded frames now
+
+  drainRing(0);
+  uint8_t st;
+  if (!pico1Answer(&st) || st != STATUS_OK) {
+    sendAck(seq, STATUS_ERR_PICO1_ACK);
+    return;
+  }
+  uint8_t r[8];
+  wr_u32_le(&r[0], pico2_us);
+  wr_u32_le(&r[4], pico1WaitUs - frameT0);
+  sendReply(seq, r, 8);
+}
+
+// body = data512: [OP(1)] + [LEN(2)] + [ARGS(LEN)]
+static void handleControl(uint32_t seq, const uint8_t* body) {
+  const uint8_t  op   = body[0];
+  const uint16_t len  = rd_u16_le(&body[1]);
+  const uint8_t* args = body + CTRL_BODY_HDR;
+
+  if (op == OP_ALL_OFF && len <= CTRL_ARGS_MAX) {
+    allOff(seq);
+    return;
+  }
+  drainRing(0);                                   // barrier: nothing in flight while control runs
+
+  if (len > CTRL_ARGS_MAX) {
+    sendAck(seq, STATUS_ERR_OP);
+    return;
+  }
+  if (op != OP_GET_STATUS && op != OP_GET_TRACE) seqStop();   // playback only runs with the PC just watching
+
+  switch (op) {
+    case OP_SET_WINDOW: {
+      if (len < 1) break;
+      uint8_t n = args[0];
+      if (n < 1) n = 1;
+      if (n > WINDOW_MAX) n = WINDOW_MAX;
+      window = n;
+      sendReply(seq, &window, 1);
+      return;
+    }
+    case OP_GET_STATUS: {
+      uint8_t r[STATUS_REPLY_BYTES];
+      r[0] = STATUS_VERSION;
+      r[1] = window;
+      wr_u32_le(&r[2], pico1Link->rate());
+      wr_u32_le(&r[6], pico1Link->ceiling());
+      wr_u16_le(&r[10], pico1Link->fallbacks());
+      wr_u32_le(&r[12], pico1Link->lostAcks());
+      r[16] = pico1Link->kind();
+      r[17] = ENC_DELTA | ENC_SPARSE;
+      uint8_t st;                                 // Pico1's half of the health bitmap (payload unused)
+      if (!pico1Request(seq, args, UART_HEALTH, &st) || st != STATUS_OK) {
+        pico1Health[0] = pico1Health[1] = 0;
+      }
+      wr_u32_le(&r[18], pico1Health[0]);
+      wr_u32_le(&r[22], pico1Health[1]);
+      wr_u32_le(&r[26], pcaHealthy(bus0));
+      wr_u32_le(&r[30], pcaHealthy(bus1));
+      wr_u32_le(&r[34], pico1Nacks);
+      wr_u32_le(&r[38], bus0.nack_total + bus1.nack_total);
+      wr_u32_le(&r[42], usbRx.resyncs);
+      wr_u32_le(&r[46], usbRx.skipped);
+      wr_u32_le(&r[50], usbRx.timeouts);
+      wr_u16_le(&r[54], STATUS_DEPTHS);
+      sendReply(seq, r, STATUS_REPLY_BYTES);
+      return;
+    }
+    case OP_SET_LINK: {
+      if (len < 4) break;
+      uint8_t r[4];
+      wr_u32_le(r, pico1Link->tune(rd_u32_le(args)));   // UART: up to the new ceiling, or down onto it
+      sendReply(seq, r, 4);
+      return;
+    }
+    case OP_BANK_STORE: {
+      if (len < BANK_STORE_ARGS || args[0] >= BANK_SLOTS || args[1] > BANK_HALF_PICO2) break;
+      const uint8_t id = args[0];
+      if (args[1] == BANK_HALF_PICO2) {
+        bankStore(bank, id, args + 2, bus0, bus1);
+      } else {
+        bankPico1Used &= ~(1u << id);             // half-written on Pico1 until it ACKs
+        uint8_t st;
+        if (!pico1Request(id, args + 2, UART_BANK_STORE, &st) || st != STATUS_OK) {
+          sendAck(seq, STATUS_ERR_PICO1_ACK);
+          return;
+        }
+        memcpy(bankPico1[id], args + 2, DATA_HALF);
+        bankPico1Used |= 1u << id;
+      }
+      sendReply(seq, &id, 1);
+      return;
+    }
+    case OP_BANK_INFO: {
+      uint8_t r[BANK_INFO_BYTES];
+      int halves = 0;
+      for (int k = 0; k < BANK_SLOTS; ++k) halves += (bank.used >> k) & 1;
+      r[0] = BANK_SLOTS;
+      wr_u32_le(&r[1], bank.used & bankPico1Used);
+      wr_u32_le(&r[5], BANK_SLOT_BYTES);
+      wr_u32_le(&r[9], (uint32_t)sizeof(bank.slot));
+      wr_u32_le(&r[13], (uint32_t)halves * BANK_SLOT_BYTES);
+      sendReply(seq, r, BANK_INFO_BYTES);
+      return;
+    }
+    case OP_SEQ_LOAD: {
+      if (len < 2) break;
+      const int first = args[0];
+      const int n     = args[1];
+      if (n > SEQ_LOAD_MAX || len < 2 + n * SEQ_STEP_BYTES || first + n > SEQ_MAX_STEPS) break;
+      bool ids_ok = true;
+      for (int k = 0; k < n; ++k) ids_ok = ids_ok && args[2 + k * SEQ_STEP_BYTES] < BANK_SLOTS;
+      if (!ids_ok) break;
+
+      for (int k = 0; k < n; ++k) {
+        const uint8_t* st  = args + 2 + k * SEQ_STEP_BYTES;
+        const uint32_t dur = rd_u32_le(&st[1]);
+        seqPlayer.ids[first + k] = st[0];
+        seqDur[first + k]        = dur < SEQ_MIN_STEP_US ? SEQ_MIN_STEP_US : dur;
+      }
+      seqPlayer.count = (uint16_t)(first + n);
+      uint8_t r[2];
+      wr_u16_le(r, seqPlayer.count);
+      sendReply(seq, r, 2);
+      return;
+    }
+    case OP_SEQ_START: {
+      if (len < 4 || seqPlayer.count == 0) break;
+      uint32_t need = 0;
+      for (int k = 0; k < seqPlayer.count; ++k) need |= 1u << seqPlayer.ids[k];
+      if ((need & bank.used & bankPico1Used) != need) {
+        sendAck(seq, STATUS_ERR_BANK);
+        return;
+      }
+
+      // Pico1 gets the step list and zeroes its tick count before the first edge
+      static_assert(SEQ_MAX_STEPS == UART_PAYLOAD_BYTES, "step ids travel as one link payload");
+      uint8_t st = STATUS_ERR_PICO1_ACK;
+      if (!pico1Request(seqPlayer.count, seqPlayer.ids, UART_SEQ_START, &st) || st != STATUS_OK) {
+        sendAck(seq, st == STATUS_ERR_BANK ? STATUS_ERR_BANK : STATUS_ERR_PICO1_ACK);
+        return;
+      }
+      seqStart(seqPlayer);
+      seqTotal         = (uint32_t)rd_u16_le(&args[0]) * seqPlayer.count;
+      seqReportEvery   = rd_u16_le(&args[2]);
+      seqEnded         = false;
+      seqPico1Overruns = 0;
+      stateValid       = false;                   // encoded frames need a full frame after playback
+
+      uint8_t r[2];
+      wr_u16_le(r, seqPlayer.count);
+      sendReply(seq, r, 2);                       // reply first: progress ACKs follow it
+      seqAlarm = add_alarm_in_us(SEQ_MIN_STEP_US, seqAlarmTick, nullptr, true);
+      return;
+    }
+    case OP_SET_LATCH: {
+      if (len < 1) break;
+      static uint8_t zero[UART_PAYLOAD_BYTES];
+      const uint8_t on = args[0] ? 1 : 0;
+      uint8_t st = STATUS_ERR_PICO1_ACK;
+      if (!pico1Request(on, zero, UART_LATCH, &st) || st != STATUS_OK) {
+        sendAck(seq, STATUS_ERR_PICO1_ACK);
+        return;
+      }
+      latchMode = on;
+      sendReply(seq, &on, 1);
+      return;
+    }
+    case OP_CAL_STORE: {
+      if (len < CAL_STORE_HDR) break;
+      const int first = rd_u16_le(&args[0]);
+      const int n     = args[2];
+      if (n > CAL_STORE_MAX || len < CAL_STORE_HDR + n * CAL_REC_BYTES || first + n > 2 * CAL_MAGNETS) break;
+      const uint8_t* recs = args + CAL_STORE_HDR;
+
+      // magnets below CAL_MAGNETS are Pico1's: they go over as one packet, same layout
+      const int n1 = (first >= CAL_MAGNETS) ? 0 : (first + n <= CAL_MAGNETS) ? n : CAL_MAGNETS - first;
+      if (n1 > 0) {
+        static uint8_t p[UART_PAYLOAD_BYTES];
+        wr_u16_le(&p[0], (uint16_t)first);
+        p[2] = (uint8_t)n1;
+        memcpy(p + CAL_STORE_HDR, recs, (size_t)n1 * CAL_REC_BYTES);
+        uint8_t st;
+        if (!pico1Request(seq, p, UART_CAL_STORE, &st) || st != STATUS_OK) {
+          sendAck(seq, STATUS_ERR_PICO1_ACK);
+          return;
+        }
+      }
+      if (n > n1) calStore(cal, first + n1 - CAL_MAGNETS, n - n1, recs + n1 * CAL_REC_BYTES);
+      const uint8_t r = (uint8_t)n;
+      sendReply(seq, &r, 1);
+      return;
+    }
+    case OP_CAL_CURVE: {
+      if (len < 1 + CAL_CURVE_BYTES || args[0] >= CAL_CURVES) break;
+      static uint8_t p[UART_PAYLOAD_BYTES];
+      memcpy(p, args, 1 + CAL_CURVE_BYTES);
+      uint8_t st;
+      if (!pico1Request(seq, p, UART_CAL_CURVE, &st) || st != STATUS_OK) {
+        sendAck(seq, STATUS_ERR_PICO1_ACK);
+        return;
+      }
+      calCurve(cal, args[0], args + 1);
+      sendReply(seq, &args[0], 1);
+      return;
+    }
+    case OP_CAL_COMMIT: {
+      if (len < 5) break;
+      const uint32_t version = rd_u32_le(&args[0]);
+      const bool     save    = args[4] != 0;
+      static uint8_t p[UART_PAYLOAD_BYTES];       // [SAVE(1)], SEQ = VERSION
+      p[0] = save ? 1 : 0;
+      uint8_t st = STATUS_ERR_PICO1_ACK;
+      if (!pico1Request(version, p, UART_CAL_COMMIT, &st, save ? CAL_SAVE_TIMEOUT_US : ACK_TIMEOUT_US) ||
+          (st != STATUS_OK && st != STATUS_ERR_FLASH)) {
+        sendAck(seq, STATUS_ERR_PICO1_ACK);
+        return;
+      }
+      pico1CalVersion = version;
+
+      if (version == 0) calDefaults(cal);
+      cal.version = version;
+      calApply(cal, calActive, calLut, bus0, bus1, bank);   // off the frame path: the ring is drained
+      const bool saved = !save || calSave(calActive);
+      if (st == STATUS_ERR_FLASH || !saved) {
+        sendAck(seq, STATUS_ERR_FLASH);
+        return;
+      }
+      uint8_t r[4];
+      wr_u32_le(r, version);
+      sendReply(seq, r, 4);
+      return;
+    }
+    case OP_CAL_INFO: {
+      static uint8_t zero[UART_PAYLOAD_BYTES];
+      uint8_t st;                                 // Pico1's version comes as a STATUS_CAL_VERSION record
+      if (!pico1Request(seq, zero, UART_CAL_INFO, &st) || st != STATUS_OK) {
+        sendAck(seq, STATUS_ERR_PICO1_ACK);
+        return;
+      }
+      uint8_t r[8];
+      wr_u32_le(&r[0], pico1CalVersion);
+      wr_u32_le(&r[4], calActive.version);
+      sendReply(seq, r, 8);
+      return;
+    }
+#if STAGE_TRACE
+    case OP_GET_TRACE: {
+      static uint8_t r[1 + TRACE_STAGES * TRACE_SUMMARY_BYTES];
+      r[0] = TRACE_STAGES;
+      for (uint8_t k = 0; k < TRACE_STAGES; ++k) traceSummary(traceRing, k, &r[1 + k * TRACE_SUMMARY_BYTES]);
+      sendReply(seq, r, sizeof(r));
+      if (len >= 1 && args[0]) traceReset(traceRing);
+      return;
+    }
+#endif
+    case OP_SEQ_STOP: {                           // already stopped above; counts of the last run
+      uint8_t r[SEQ_STOP_BYTES];
+      wr_u32_le(&r[0], seqPlayer.applied);
+      wr_u32_le(&r[4], seqPlayer.overruns);
+      wr_u32_le(&r[8], seqPico1Overruns);
+      sendReply(seq, r, SEQ_STOP_BYTES);
+      return;
+    }
+    default:
+      break;
+  }
+  sendAck(seq, STATUS_ERR_OP);
+}
+
+
+#if CUT_THROUGH
+// close a packet whose payload is already (partly) on the wire to Pico1: pad the payload to its
+// fixed size, UART_ABORT makes Pico1 drop it | sent = payload bytes forwarded so far
+static void pico1AbortPacket(int sent) {
+  static const uint8_t zeros[UART_PAYLOAD_BYTES] = {0};
+  const uint8_t abort1 = UART_ABORT;
+  if (sent < UART_PAYLOAD_BYTES) pico1Link->sendBytes(zeros, UART_PAYLOAD_BYTES - sent);
+  pico1Link->sendBytes(&abort1, UART_TRAILER_BYTES);
+  pico1Link->endPacket();
+}
+#endif
+
+
 // ++++ MAIN LOOP ++++
 void loop() {
 
+  // ============================================
+  // 0) ACK whatever finished since the last frame
+  // ============================================
+  serviceRing();
+  seqService();                                   // sequence playback: step, progress, end
+  pcaHealthService(bus0, millis());               // re-probe a skipped board now and then
+  pcaHealthService(bus1, millis());
+
+  // too many lost Pico1 ACKs at this UART rate: step down between frames
+  if (pico1Link->degraded()) {
+    drainRing(0);
+    pico1Link->fallback();
+  }
+
   // ============================================
   // 1) Read frame header: MAGIC(2) + SEQ(4)
   // ============================================
-  readExactBytes(Serial, hdr, HDR_BYTES);
+  // the hunter only stops at a known MAGIC; until then loop() keeps servicing Pico1 ACKs / timeouts
+  if (!frameRxHeader(usbRx)) return;              // header lands in hdr (= frame)
+  frameT0 = micros();
 
-  // verify MAGIC first (strict)
   const uint16_t magic = rd_u16_le(&hdr[0]);
   const uint32_t seq   = rd_u32_le(&hdr[2]);
+  if (magic != CTRL_MAGIC) seqStop();             // any frame takes the array back from playback
 
-  if (magic != MAGIC) {
-    // consume the rest of the frame defensively (to resync)
-    // but note: if stream is misaligned, this may still be noisy.
-    readExactBytes(Serial, data512, DATA_BYTES);
-    readExactBytes(Serial, crc2, CRC_BYTES);
-
-    makeAck(ack7, seq, STATUS_ERR_MAGIC);
-    writeExactBytes(Serial, ack7, ACK_BYTES);
+  if (magic == DELTA_MAGIC || magic == SPARSE_MAGIC) {
+    handleEncoded(magic, seq);
+    return;
+  }
+  if (magic == PATTERN_MAGIC) {
+    handlePattern(seq);
+    return;
+  }
+  if (magic == DEEP_MAGIC) {
+    handleDeep(seq);
     return;
   }
 
+  // window full -> wait for the oldest frame before taking this one
+  // (already here: with CUT_THROUGH the packet to Pico1 starts while DATA is still arriving)
+  const bool fwd = (magic == MAGIC);              // control frames never go to Pico1
+  if (fwd) drainRing(ringRoom());
+
+#if CUT_THROUGH
+  // ============================================
+  // 2+3+4) Read DATA(512), CRC it and stream the FIRST HALF to Pico1 as it arrives
+  // ============================================
+  uint32_t crc_us = 0, fwd_us = 0;                              // STAGE_TRACE: CRC / forwarding share of the loop
+  uint32_t t = micros();
+  uint16_t crc_calc = crc16_update(crc16_init(), hdr, HDR_BYTES);
+  crc_us += micros() - t;
+  t = micros();
+  if (fwd) pico1Link->sendBytes(&hdr[2], UART_SEQ_BYTES);      // SEQ is already LE in the header
+  fwd_us += micros() - t;
+
+  int got = 0;
+  while (got < DATA_BYTES) {
+    const int r = frameRxReadSome(usbRx, DATA_BYTES - got);      // into data512 + got
+    if (r < 0) break;                                               // stalled: past a deadline
+    if (r == 0) { pumpI2c(); continue; }
+    t = micros();
+    crc_calc = crc16_update(crc_calc, data512 + got, r);            // CRC over [HDR + DATA] so far
+    crc_us += micros() - t;
+
+    if (fwd && got < UART_PAYLOAD_BYTES) {                          // Pico1 half: pass it on now
+      const int f = (r < UART_PAYLOAD_BYTES - got) ? r : (UART_PAYLOAD_BYTES - got);
+      t = micros();
+      pico1Link->sendBytes(data512 + got, f);
+      fwd_us += micros() - t;
+    }
+    got += r;
+  }
+  if (got < DATA_BYTES || !frameRxRead(usbRx, CRC_BYTES)) {
+    if (fwd) pico1AbortPacket(got);
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  crc_calc = crc16_final(crc_calc);
+  if (fwd) {
+    trace(TR_USB_RX, micros() - frameT0);
+    trace(TR_CRC, crc_us);
+  }
+#else
   // ============================================
   // 2) Read DATA(512) and CRC(2)
   // ============================================
-  readExactBytes(Serial, data512, DATA_BYTES);
-  readExactBytes(Serial, crc2, CRC_BYTES);
+  if (!frameRxRead(usbRx, DATA_BYTES + CRC_BYTES)) {   // data512, then crc2
+    rxFailed(seq, STATUS_ERR_CRC);
+    return;
+  }
+  if (fwd) trace(TR_USB_RX, micros() - frameT0);
 
   // ============================================
   // 3) CRC validate over [HDR + DATA]
   // ============================================
-  // build check buffer = hdr + data
-  memcpy(checkBuf, hdr, HDR_BYTES);
-  memcpy(checkBuf + HDR_BYTES, data512, DATA_BYTES);
+  // hdr and data512 are contiguous in frame[]: one pass, in place
+  const uint32_t t_crc = micros();
+  const uint16_t crc_calc = crc16_final(crc16_update(crc16_init(), frame, HDR_BYTES + DATA_BYTES));
+  if (fwd) trace(TR_CRC, micros() - t_crc);
+#endif
 
   const uint16_t crc_recv = rd_u16_le(&crc2[0]);
-  const uint16_t crc_calc = crc16_ccitt(checkBuf, (HDR_BYTES + DATA_BYTES), 0xFFFF);
 
   if (crc_recv != crc_calc) {
-    makeAck(ack7, seq, STATUS_ERR_CRC);
-    writeExactBytes(Serial, ack7, ACK_BYTES);
+#if CUT_THROUGH
+    if (fwd) {                                    // Pico1 already has the payload: tell it to drop it
+      pico1AbortPacket(DATA_BYTES);
+    }
+#endif
+    rxFailed(seq, STATUS_ERR_CRC);                // ACKed in order, never applied by Pico1
     return;
   }
+  frameRxDone(usbRx);
+
+  if (magic == CTRL_MAGIC) {
+    handleControl(seq, data512);
+    return;
+  }
+
+  // new reference frame for encoded frames (the bytes are still in place for steps 4 and 5)
+  memcpy(state512, data512, DATA_BYTES);
+  stateSeq   = seq;
+  stateValid = true;
+  pico1Stale = false;
 
   // ============================================
   // 4) Forward FIRST HALF (256 bytes) to Pico1 with SEQ
   // ============================================
-  // UART payload rule:
-  // - Pico2 -> Pico1: [SEQ(4)] + [256 bytes]
-  uint8_t uart_pkt[UART_SEQ_BYTES + UART_PAYLOAD_BYTES];
-  wr_u32_le(&uart_pkt[0], seq);
-  memcpy(&uart_pkt[UART_SEQ_BYTES], data512, UART_PAYLOAD_BYTES);
-
-  writeExactBytes(Serial1, uart_pkt, (UART_SEQ_BYTES + UART_PAYLOAD_BYTES));
+  // UART payload rule (same packet on SPI):
+  // - Pico2 -> Pico1: [SEQ(4)] + [256 bytes] + [COMMIT(1)]
+#if CUT_THROUGH
+  const uint8_t commit = UART_COMMIT;             // SEQ + payload are already on the wire
+  t = micros();
+  pico1Link->sendBytes(&commit, UART_TRAILER_BYTES);
+#else
+  // header write, then the payload straight out of the receive buffer (no packet copy)
+  const uint8_t commit = UART_COMMIT;
+  uint32_t fwd_us = 0;
+  const uint32_t t = micros();
+  pico1Link->sendBytes(&hdr[2], UART_SEQ_BYTES);
+  pico1Link->sendBytes(data512, UART_PAYLOAD_BYTES);
+  pico1Link->sendBytes(&commit, UART_TRAILER_BYTES);
+#endif
+  pico1Link->endPacket();
+  fwd_us += micros() - t;
+  trace(TR_FORWARD, fwd_us);
+  ringPush(seq, STATUS_OK, true);
+  if (latchMode) latchHold(true);
 
   // ============================================
   // 5) Local action on Pico2 using SECOND HALF (256 bytes)
   // ============================================
-  // data512[256..511] => unpack to X[0..511] (0..15)
-  buildX(data512 + DATA_HALF, X);
-
-  // apply to two buses (Pico2 controls 512 magnets)
-  actionX(boards0, boards1, X);
+  // data512[256..383] -> bus0, data512[384..511] -> bus1
+  // apply to two buses (Pico2 controls 512 magnets) | Pico1 works on its half meanwhile
+  applyLocal(data512 + DATA_HALF);
 
   // ============================================
-  // 6) Read ACK from Pico1 (must match expected SEQ)
+  // 6) ACK to PC
   // ============================================
-  // timeout_us must be chosen realistically for:
-  // - Pico1 UART receive + I2C apply + ACK send-back
-  // start with 200ms and tune down later
-  const uint32_t ACK_TIMEOUT_US = 200000;
+  // window == 1: wait right here for Pico1 and the local I2C (stop-and-wait)
+  // window  > 1: the ACK goes out from serviceRing() once both are done; the PC keeps sending
+  drainRing(window - 1);
+}
 
-  bool ok = readAck(Serial1, seq, &pico1_status, ACK_TIMEOUT_US);
-  if (!ok) {
-    makeAck(ack7, seq, STATUS_ERR_PICO1_ACK);
-    writeExactBytes(Serial, ack7, ACK_BYTES);
-    return;
-  }
 
-  // ============================================
-  // 7) Send final ACK to PC
-  // ============================================
-  // If Pico1 reports failure (status byte), propagate it as-is (or map if you want).
-  // Here: if pico1_status == 1 => OK, else => use that status directly.
-  const uint8_t final_status = (pico1_status == 1) ? STATUS_OK : pico1_status;
+// ++++ CORE 1 ++++
+// Only services bus1 jobs handed over by loop(); all USB / Pico1 link work stays on core 0.
+#if DUAL_CORE && !ASYNC_I2C
+void setup1() {}
 
-  makeAck(ack7, seq, final_status);
-  writeExactBytes(Serial, ack7, ACK_BYTES);
+void loop1() {
+  coreLinkService(coreLink);
 }
+#endif
@@ -3,16 +3,38 @@
 // ===========================================
 #include "command.h"
 #include <Adafruit_PWMServoDriver.h>
+#include <LittleFS.h>
 
 // Author: DH HAN and SAM LAB
 //
 // IMPORTANT (do not break comment intent)
-// - Pico1 receives UART packet from Pico2:
-//     [SEQ(4)] + [DATA_HALF(256 bytes)]
-// - Pico1 unpacks the 256 bytes into X512 (512 values 0..15)
-// - Pico1 applies actionX() to its two I2C buses (64 boards total -> 512 magnets)
+// - Pico1 receives a packet from Pico2 over the inter-Pico link (UART or SPI slave, PICO_LINK):
+//     [SEQ(4)] + [DATA_HALF(256 bytes)] + [TRAILER(1)]
+// - Only a COMMIT trailer is applied and ACKed; ABORT (PC frame failed CRC) is dropped silently
+// - Pattern bank (PATTERN BANK in command.h): UART_BANK_STORE stores the payload as pattern SEQ
+//   (ACKed right away), UART_BANK_APPLY writes pattern payload[0] and is ACKed like a frame
+// - Sequence playback (SEQUENCE PLAYBACK in command.h): UART_SEQ_START carries the step IDs;
+//   every SYNC_PIN edge from Pico2 is one step, late steps are reported with STATUS_SEQ_OVERRUN
+// - Latched commit (LATCHED COMMIT in command.h): UART_LATCH turns it on / off; frames are then
+//   written with this Pico's /OE high, and a LATCH_PIN edge from Pico2 drives it low again
+// - Stage trace (STAGE TRACE in command.h): each frame ACK is followed by a STATUS_TRACE record
+//   [APPLY_US(2) + DONE_US(2)] that Pico2 adds to its rings
+// - Board health (BOARD HEALTH in command.h): boards missing at boot or NACKing at run time are
+//   skipped and re-probed; UART_HEALTH is answered with the STATUS_HEALTH_* records
+// - Calibration (CALIBRATION in command.h): UART_CAL_STORE / UART_CAL_CURVE stage this half's set,
+//   UART_CAL_COMMIT (SEQ = version) expands it into the board tables and saves it to LittleFS,
+//   UART_CAL_INFO is answered with a STATUS_CAL_VERSION record; setup() loads the saved set
+// - Deep frames (FRAME DEPTH in command.h): UART_DEEP_PART packets are collected in deepHalf, the
+//   UART_DEEP_COMMIT packet completes and applies it (ACKed like a frame, STATUS_ERR_PICO1_ACK if
+//   a part is missing); ABORT leaves the collected parts to be dropped by the next frame
+// - All off (BROADCAST in command.h): UART_ALL_OFF ends playback, drops the queued I2C writes and
+//   turns every board off with one ALL_CALL write per bus, then ACKs (after the frames before it)
+// - Pico1 applies the 256 packed bytes (512 values 0..15) in place with actionPacked()
+//   to its two I2C buses (64 boards total -> 512 magnets)
 // - Pico1 returns ACK(7) to Pico2:
 //     [ACK_MAGIC(2)] + [SEQ(4)] + [STATUS(1)]
+// - UART_LINK packets are link-speed probes from Pico2 (UartPicoLink answers them itself);
+//   unreadable packets count towards falling back to the 115200 boot rate
 //
 // PCA9685 addressing rule (per bus):
 // - start BASE_ADDR=0x40, increment by 1
@@ -23,27 +45,125 @@
 static constexpr uint8_t  BASE_ADDR = 0x40;
 static constexpr uint32_t I2C_HZ    = 1000000;
 static constexpr float    PCA_PWM_FREQ_HZ = 1000.0f;
+static constexpr uint16_t FULL_REFRESH_FRAMES = 200;   // rewrite all boards every N frames (0 = only changes)
+
+// Pico2 <-> Pico1 wire, same choice on both Picos (see INTER-PICO LINK in command.h):
+// PICO_LINK_UART | PICO_LINK_SPI | PICO_LINK_STRAP (LINK_STRAP_PIN at boot: open = UART, GND = SPI)
+static constexpr int      PICO_LINK = PICO_LINK_STRAP;
+
+// 1: I2C writes are queued and sent by DMA (Wire.writeAsync), both buses at once, while loop()
+//    keeps serving the serial links | 0: blocking writes
+#define ASYNC_I2C 1
+
+// only used when ASYNC_I2C is 0:
+// 1: core 0 writes bus0 (Wire), core 1 writes bus1 (Wire1) in parallel | 0: both buses on core 0
+#define DUAL_CORE 1
+
+// 1: follow every frame ACK with this Pico's stage times (STATUS_TRACE record, STAGE TRACE) | 0: off
+#define STAGE_TRACE 1
 
 // status codes (keep consistent with your system)
-static constexpr uint8_t STATUS_OK = 1;
+static constexpr uint8_t STATUS_OK        = 1;
+static constexpr uint8_t STATUS_ERR_PICO1_ACK = 3;   // deep frame: a part of the half went missing
+static constexpr uint8_t STATUS_ERR_OP    = 4;   // calibration record / curve out of range
+static constexpr uint8_t STATUS_ERR_BANK  = 6;   // pattern not stored here (e.g. Pico1 rebooted)
+static constexpr uint8_t STATUS_ERR_FLASH = 15;  // calibration active, but not saved
 
 
 // ++++ GLOBAL BUFFERS ++++
-static uint8_t seq4[UART_SEQ_BYTES];          // 4 bytes
-static uint8_t packed256[UART_PAYLOAD_BYTES]; // 256 bytes
-static uint8_t X[X_VALUES];                   // 512 values (0..15)
+// one receive buffer for the whole link packet, read in place
+alignas(4) static uint8_t pkt[UART_PKT_BYTES];
+static uint8_t* const seq4      = pkt;                                        // 4 bytes
+static uint8_t* const packed256 = pkt + UART_SEQ_BYTES;                       // 256 bytes
+static const uint8_t& trailer   = pkt[UART_SEQ_BYTES + UART_PAYLOAD_BYTES];   // UART_COMMIT / UART_ABORT
 static uint8_t ack7[ACK_BYTES];
 
+// ++++ PENDING ACKS (ASYNC_I2C) ++++
+// A frame is ACKed once its queued I2C writes are done; the next packet is received meanwhile.
+struct Pending {
+  uint32_t seq;
+  uint8_t  status;
+  uint32_t ticket0;       // i2cTicket(bus0) after this frame was queued
+  uint32_t ticket1;       // i2cTicket(bus1)
+  uint32_t t_rx_us;       // STAGE_TRACE: packet received
+  uint32_t apply_us;      //              CPU time of the apply
+};
+
+static Pending pend[WINDOW_MAX];
+static uint8_t pendHead  = 0;
+static uint8_t pendCount = 0;
+
+// ++++ DEEP FRAMES ++++
+// the half of the deep frame deepSeq, collected part by part (UART_PAYLOAD_BYTES each)
+static uint8_t  deepHalf[DEEP_HALF_MAX];
+static uint32_t deepSeq   = 0;
+static uint8_t  deepDepth = 0;
+static int      deepParts = 0;            // parts of deepSeq stored so far
+
+// ++++ PATTERN BANK ++++
+static PatternBank bank;
+
+// ++++ CALIBRATION ++++
+// the staged set of this half (UART_CAL_STORE / UART_CAL_CURVE), the committed one and the tables
+// it was expanded into (64 KB)
+static CalSet   cal;
+static CalSet   calActive;                      // deep frames read it (bus.cal)
+static BoardLut calLut[2 * PCA_BOARDS_PER_BUS];
+
+// ++++ SEQUENCE PLAYBACK ++++
+// the SYNC_PIN interrupt only counts edges; loop() applies the step
+static SeqPlayer seqPlayer;
+
+static void onSyncEdge() {
+  seqPlayer.ticks = seqPlayer.ticks + 1;
+}
+
+// ++++ LATCHED COMMIT ++++
+// frames stage behind /OE; Pico2's LATCH_PIN edge releases them (any edge, outputs back on)
+static bool latchMode = false;
+
+static void onLatchEdge() {
+  digitalWrite(PICO1_OE_PIN, LOW);
+}
+
+// ++++ PICO2 LINK ++++
+// UART (rate chosen by Pico2, see UART LINK SPEED) or SPI slave, picked in setup()
+static void uartBegin(uint32_t baud) {
+  Serial1.begin(baud);
+}
+
+static UartPicoLink uartLink(Serial1, uartBegin);
+static SpiPicoLink  spiLink(SPI, SPISlave);
+static PicoLink*    pico2Link = &uartLink;
+
 // ++++ PCA9685 OBJECTS ++++
+// boards0/boards1 are used for bring-up only; frames are written through bus0/bus1 (burst path).
 static Adafruit_PWMServoDriver* boards0[32];
 static Adafruit_PWMServoDriver* boards1[32];
+static PcaBus bus0;
+static PcaBus bus1;
+#if DUAL_CORE && !ASYNC_I2C
+static CoreLink coreLink;                      // core 0 <-> core 1 job handoff (DUAL_CORE)
+#endif
+
+// keeps both async I2C queues moving | loop() and every blocking serial wait call it
+static void pumpI2c() {
+  i2cPump(bus0);
+  i2cPump(bus1);
+}
 
-static void initPcaBus(Adafruit_PWMServoDriver* boards[32], TwoWire& wire, uint8_t base_addr) {
+// boards that do not answer the scan stay skipped (no bring-up, pcaHealthService re-probes them)
+static void initPcaBus(Adafruit_PWMServoDriver* boards[32], PcaBus& bus) {
+  bus.prescale = pcaPrescale(PCA_PWM_FREQ_HZ);
+  pcaScan(bus);
   for (int i = 0; i < 32; ++i) {
-    const uint8_t addr = (uint8_t)(base_addr + i);
-    boards[i] = new Adafruit_PWMServoDriver(addr, &wire);
+    const uint8_t addr = (uint8_t)(bus.base_addr + i);
+    boards[i] = nullptr;
+    if (bus.skip & (1u << i)) continue;
+    boards[i] = new Adafruit_PWMServoDriver(addr, bus.wire);
     boards[i]->begin();
     boards[i]->setPWMFreq(PCA_PWM_FREQ_HZ);
+    pcaEnableAutoIncrement(bus, i);          // burst writes in actionX rely on MODE1.AI
     delay(2);
   }
 }
@@ -51,41 +171,285 @@ static void initPcaBus(Adafruit_PWMServoDriver* boards[32], TwoWire& wire, uint8
 
 // ++++ SETUP ++++
 void setup() {
-  // UART link from Pico2
-  Serial1.begin(115200);
+  // link from Pico2 | deep RX buffer (UART FIFO / SPI packet ring): in windowed mode Pico2
+  // forwards the next frames while this Pico is still busy on I2C
+  Serial1.setFIFOSize(UART_RX_FIFO_BYTES);
+  pico2Link = &picoLinkSelect(PICO_LINK, uartLink, spiLink);
+  pico2Link->begin(false);                      // UART: LINK_BAUDS[0] until Pico2 proposes more
+  pinMode(SYNC_PIN, INPUT);                      // sequence step tick from Pico2, both edges count
+  attachInterrupt(digitalPinToInterrupt(SYNC_PIN), onSyncEdge, CHANGE);
+  pinMode(PICO1_OE_PIN, OUTPUT);                 // /OE of this Pico's boards: low = outputs on
+  digitalWrite(PICO1_OE_PIN, LOW);
+  pinMode(LATCH_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(LATCH_PIN), onLatchEdge, CHANGE);
 
   // I2C buses on Pico1
+  pcaBusInit(bus0, Wire,  BASE_ADDR);
+  pcaBusInit(bus1, Wire1, BASE_ADDR);
+  bus0.refresh_every = FULL_REFRESH_FRAMES;
+  bus1.refresh_every = FULL_REFRESH_FRAMES;
   Wire.begin();
   Wire1.begin();
   Wire.setClock(I2C_HZ);
   Wire1.setClock(I2C_HZ);
 
   // PCA bring-up
-  initPcaBus(boards0, Wire,  BASE_ADDR);
-  initPcaBus(boards1, Wire1, BASE_ADDR);
+  initPcaBus(boards0, bus0);
+  initPcaBus(boards1, bus1);
+
+#if ASYNC_I2C
+  i2cAsyncEnable(bus0);        // from here on frames only queue I2C work
+  i2cAsyncEnable(bus1);
+  setIoIdleHook(pumpI2c);
+#endif
+
+  // calibration saved by the last UART_CAL_COMMIT; none (or a bad file) = linear
+  calDefaults(cal);
+  if (LittleFS.begin() && calLoad(cal)) calApply(cal, calActive, calLut, bus0, bus1, bank);
+}
+
+
+// frame ACK + its STATUS_TRACE record [APPLY_US(2) + DONE_US(2)] (saturated at 65535 us)
+static void sendFrameAck(uint32_t seq, uint8_t status, uint32_t t_rx_us, uint32_t apply_us) {
+  makeAck(ack7, seq, status);
+  pico2Link->sendAck(ack7);
+#if STAGE_TRACE
+  uint32_t done_us = micros() - t_rx_us;
+  if (apply_us > 0xFFFF) apply_us = 0xFFFF;
+  if (done_us  > 0xFFFF) done_us  = 0xFFFF;
+  makeAck(ack7, (done_us << 16) | apply_us, STATUS_TRACE);
+  pico2Link->sendAck(ack7);
+#else
+  (void)t_rx_us;
+  (void)apply_us;
+#endif
+}
+
+// ACK every frame whose I2C writes have finished (in order)
+static void serviceAcks() {
+  pumpI2c();
+  while (pendCount) {
+    const Pending& p = pend[pendHead];
+    if (!i2cDone(bus0, p.ticket0) || !i2cDone(bus1, p.ticket1)) break;
+    sendFrameAck(p.seq, p.status, p.t_rx_us, p.apply_us);
+    pendHead = (uint8_t)((pendHead + 1) % WINDOW_MAX);
+    --pendCount;
+  }
+}
+
+
+// a sequence step is due: apply it, tell Pico2 if it came late
+static void seqService() {
+  uint32_t tick;
+  if (seqPoll(seqPlayer, bank, bus0, bus1, &tick) != SEQ_LATE) return;
+  makeAck(ack7, tick, STATUS_SEQ_OVERRUN);
+  pico2Link->sendAck(ack7);
 }
 
 
 // ++++ MAIN LOOP ++++
 void loop() {
 
+  serviceAcks();
+  seqService();
+  pcaHealthService(bus0, millis());               // core 1 is idle here (DUAL_CORE waits per frame)
+  pcaHealthService(bus1, millis());
+  pico2Link->poll();                              // UART: trial rate without confirm -> go back
+
   // ============================================
-  // 1) Receive UART packet: SEQ(4) + DATA(256)
+  // 1) Receive packet: SEQ(4) + DATA(256) + TRAILER(1)
   // ============================================
-  readExactBytes(Serial1, seq4, UART_SEQ_BYTES);
-  readExactBytes(Serial1, packed256, UART_PAYLOAD_BYTES);
+  // whole packets only; link-speed probes and unreadable packets are handled inside the link
+  if (!pico2Link->recvPacket(pkt)) return;
 
   const uint32_t seq = rd_u32_le(&seq4[0]);
 
+  // pattern upload (OP_BANK_STORE on Pico2, nothing else in flight): SEQ is the pattern ID
+  if (trailer == UART_BANK_STORE) {
+    const bool ok = seq < (uint32_t)BANK_SLOTS;
+    if (ok) bankStore(bank, (int)seq, packed256, bus0, bus1);
+    makeAck(ack7, seq, ok ? STATUS_OK : STATUS_ERR_BANK);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // playback start (OP_SEQ_START on Pico2, nothing else in flight): SEQ is the step count,
+  // the payload the step IDs; ticks start from 0 once this is ACKed
+  if (trailer == UART_SEQ_START) {
+    bool ok = seq > 0 && seq <= (uint32_t)SEQ_MAX_STEPS;
+    for (uint32_t k = 0; ok && k < seq; ++k) ok = packed256[k] < BANK_SLOTS && (bank.used & (1u << packed256[k]));
+    seqPlayer.active = false;
+    if (ok) {
+      memcpy(seqPlayer.ids, packed256, seq);
+      seqPlayer.count = (uint16_t)seq;
+      noInterrupts();
+      seqStart(seqPlayer);
+      interrupts();
+    }
+    makeAck(ack7, seq, ok ? STATUS_OK : STATUS_ERR_BANK);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // latched commit on / off (OP_SET_LATCH on Pico2): SEQ is the new setting
+  if (trailer == UART_LATCH) {
+    latchMode = (seq != 0);
+    if (!latchMode) digitalWrite(PICO1_OE_PIN, LOW);
+    makeAck(ack7, seq, STATUS_OK);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // board health (OP_GET_STATUS on Pico2, nothing else in flight): records, then the ACK
+  if (trailer == UART_HEALTH) {
+    makeAck(ack7, pcaHealthy(bus0), STATUS_HEALTH_BUS0);
+    pico2Link->sendAck(ack7);
+    makeAck(ack7, pcaHealthy(bus1), STATUS_HEALTH_BUS1);
+    pico2Link->sendAck(ack7);
+    makeAck(ack7, bus0.nack_total + bus1.nack_total, STATUS_HEALTH_NACKS);
+    pico2Link->sendAck(ack7);
+    makeAck(ack7, seq, STATUS_OK);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // calibration upload (OP_CAL_* on Pico2, nothing else in flight): payload as in the PC's ARGS
+  if (trailer == UART_CAL_STORE || trailer == UART_CAL_CURVE) {
+    const bool ok = (trailer == UART_CAL_STORE)
+                        ? calStore(cal, rd_u16_le(&packed256[0]), packed256[2], packed256 + CAL_STORE_HDR)
+                        : calCurve(cal, packed256[0], packed256 + 1);
+    makeAck(ack7, seq, ok ? STATUS_OK : STATUS_ERR_OP);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // calibration commit: SEQ is the version (0 = back to linear), payload[0] != 0 saves it
+  if (trailer == UART_CAL_COMMIT) {
+    if (seq == 0) calDefaults(cal);
+    cal.version = seq;
+    calApply(cal, calActive, calLut, bus0, bus1, bank);
+    const bool saved = !packed256[0] || calSave(calActive);
+    makeAck(ack7, seq, saved ? STATUS_OK : STATUS_ERR_FLASH);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // calibration query: version record, then the ACK
+  if (trailer == UART_CAL_INFO) {
+    makeAck(ack7, calActive.version, STATUS_CAL_VERSION);
+    pico2Link->sendAck(ack7);
+    makeAck(ack7, seq, STATUS_OK);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // all off (OP_ALL_OFF on Pico2, frames may still be in flight): one ALL_CALL write per bus, both
+  // queued at once; the pending frames lose their writes and are ACKed first, then this once off
+  if (trailer == UART_ALL_OFF) {
+    seqPlayer.active = false;
+    pcaAllOff(bus0, bus1);
+    serviceAcks();
+    makeAck(ack7, seq, STATUS_OK);
+    pico2Link->sendAck(ack7);
+    return;
+  }
+
+  // deep frame part (not the last): stored, never ACKed | another SEQ or DEPTH starts over, which
+  // drops the parts of an ABORTed frame
+  if ((trailer & UART_DEEP_KIND) == UART_DEEP_PART) {
+    const uint8_t depth = trailer & ~UART_DEEP_KIND;
+    if (seq != deepSeq || depth != deepDepth) {
+      deepSeq   = seq;
+      deepDepth = depth;
+      deepParts = 0;
+    }
+    if (deepParts < depthLinkPackets(depth) - 1) {
+      memcpy(deepHalf + deepParts * UART_PAYLOAD_BYTES, packed256, UART_PAYLOAD_BYTES);
+    }
+    ++deepParts;
+    return;
+  }
+
+  // Pico2 streams the payload before it has checked the PC CRC; apply only on COMMIT
+  const bool pattern = (trailer == UART_BANK_APPLY);
+  const bool deep    = (trailer & UART_DEEP_KIND) == UART_DEEP_COMMIT;
+  if (trailer != UART_COMMIT && !pattern && !deep) return;
+  seqPlayer.active = false;                       // frames from the PC end playback
+  const uint32_t t_rx = micros();
+  if (latchMode) digitalWrite(PICO1_OE_PIN, HIGH); // held until Pico2's LATCH_PIN edge
+
+  // deep: the last part completes deepHalf | src = nullptr if a part went missing (nothing applied)
+  uint8_t        status = STATUS_OK;
+  int            depth  = DEPTH_NIBBLE;
+  const uint8_t* src    = packed256;
+  if (deep) {
+    depth = trailer & ~UART_DEEP_KIND;
+    const int before = depthLinkPackets(depth) - 1;
+    if (seq == deepSeq && depth == deepDepth && deepParts == before) {
+      memcpy(deepHalf + before * UART_PAYLOAD_BYTES, packed256, depthHalfBytes(depth) - before * UART_PAYLOAD_BYTES);
+      src = deepHalf;
+    } else {
+      src    = nullptr;
+      status = STATUS_ERR_PICO1_ACK;
+    }
+    deepParts = 0;
+  }
+
   // ============================================
-  // 2) Unpack and apply on Pico1
+  // 2) Apply on Pico1
   // ============================================
-  buildX(packed256, X);
-  actionX(boards0, boards1, X);
+  // packed256[0..127] -> bus0, packed256[128..255] -> bus1 (read in place, table lookup per magnet)
+  // pattern: the stored register images of pattern packed256[0]
+  // deep: deepHalf, bus1 from depthBusBytes(depth)
+
+#if ASYNC_I2C
+  while (pendCount == WINDOW_MAX) serviceAcks();
+  const uint32_t t_apply = micros();
+  if (pattern) {
+    if (!bankApply(bank, packed256[0], bus0, bus1)) status = STATUS_ERR_BANK;   // queued only
+  } else if (src) {
+    applyBusDepth(bus0, src, depth);                              // queued only; ACK goes out from serviceAcks()
+    applyBusDepth(bus1, src + depthBusBytes(depth), depth);
+  }
+
+  Pending& p = pend[(pendHead + pendCount) % WINDOW_MAX];
+  p.seq      = seq;
+  p.status   = status;
+  p.ticket0  = i2cTicket(bus0);
+  p.ticket1  = i2cTicket(bus1);
+  p.t_rx_us  = t_rx;
+  p.apply_us = micros() - t_apply;
+  ++pendCount;
+  serviceAcks();
+  return;
+#else
+  const uint32_t t_apply = micros();
+  if (pattern) {                                                  // both buses on core 0
+    if (!bankApply(bank, packed256[0], bus0, bus1)) status = STATUS_ERR_BANK;
+  } else if (src) {
+#if DUAL_CORE
+    coreLinkSubmit(coreLink, bus1, src + depthBusBytes(depth), depth); // core 1: bus1 (Wire1)
+    applyBusDepth(bus0, src, depth);                                   // core 0: bus0 (Wire)
+    coreLinkWait(coreLink);
+#else
+    actionDepth(bus0, bus1, src, depth);
+#endif
+  }
+#endif
 
   // ============================================
   // 3) Send ACK back to Pico2
   // ============================================
-  makeAck(ack7, seq, STATUS_OK);
-  writeExactBytes(Serial1, ack7, ACK_BYTES);
+  sendFrameAck(seq, status, t_rx, micros() - t_apply);
+}
+
+
+// ++++ CORE 1 ++++
+// Only services bus1 jobs handed over by loop(); the Pico2 link stays on core 0.
+#if DUAL_CORE && !ASYNC_I2C
+void setup1() {}
+
+void loop1() {
+  coreLinkService(coreLink);
 }
+#endif
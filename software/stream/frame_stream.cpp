@@ -0,0 +1,731 @@
+// ===========================================
+// filename: frame_stream.cpp
+// ===========================================
+#include "frame_stream.h"
+
+#include <string.h>
+
+// ++++ CRC ++++
+struct FsCrcTable {
+  uint16_t t[256];
+  constexpr FsCrcTable() : t() {
+    for (int b = 0; b < 256; b++) {
+      uint16_t crc = (uint16_t)(b << 8);
+      for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+      t[b] = crc;
+    }
+  }
+};
+static constexpr FsCrcTable FS_CRC{};
+
+uint16_t fsCrc16(const uint8_t* data, size_t n, uint16_t crc) {
+  for (size_t i = 0; i < n; i++) crc = (uint16_t)((crc << 8) ^ FS_CRC.t[(uint8_t)((crc >> 8) ^ data[i])]);
+  return crc;
+}
+
+static inline void wrU16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static inline void wrU32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i)); }
+static inline uint16_t rdU16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t rdU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ++++ FRAME DEPTH ++++
+// bits go through a 32-bit accumulator, LSB first, as deepPack / deepUnpack in command.cpp
+int fsPackDepth(const uint16_t* values, int depth, uint8_t* out) {
+  const uint32_t mask = (1u << depth) - 1;
+  uint32_t acc  = 0;
+  int      bits = 0, n = 0;
+  for (int m = 0; m < FS_MAGNETS; ++m) {
+    acc |= (values[m] & mask) << bits;
+    bits += depth;
+    while (bits >= 8) { out[n++] = (uint8_t)acc; acc >>= 8; bits -= 8; }
+  }
+  return n;
+}
+
+void fsUnpackDepth(const uint8_t* in, int depth, uint16_t* values) {
+  const uint32_t mask = (1u << depth) - 1;
+  uint32_t acc  = 0;
+  int      bits = 0;
+  for (int m = 0; m < FS_MAGNETS; ++m) {
+    while (bits < depth) { acc |= (uint32_t)*in++ << bits; bits += 8; }
+    values[m] = (uint16_t)(acc & mask);
+    acc >>= depth;
+    bits -= depth;
+  }
+}
+
+// command.h TraceStage order
+static const char* const FS_TRACE_STAGES[] = {
+  "usb_rx", "crc", "forward", "bus0", "bus1", "pico1_wait", "frame", "p1_apply", "p1_done",
+};
+
+const char* fsTraceStageName(uint8_t stage) {
+  return stage < sizeof(FS_TRACE_STAGES) / sizeof(FS_TRACE_STAGES[0]) ? FS_TRACE_STAGES[stage] : "?";
+}
+
+// ++++ ENCODINGS ++++
+// Both return the BODY length, or -1 as soon as it would exceed `limit` (then another encoding
+// or the full frame is smaller anyway).
+
+// XOR against ref, zero-run coded: [ZERO_RUN(1)][LIT_LEN(1)][LIT...], trailing zeros implied
+static int encodeDelta(const uint8_t* ref, const uint8_t* data, uint8_t* out, int limit) {
+  int n = 0, pos = 0;
+  while (pos < FS_DATA_BYTES) {
+    int z = 0;
+    while (pos < FS_DATA_BYTES && data[pos] == ref[pos] && z < 255) { ++pos; ++z; }
+    if (pos == FS_DATA_BYTES) break;
+
+    // literal run; a single unchanged byte between two changes is cheaper inside it than a new token
+    const int start = pos;
+    int lit = 0;
+    while (pos < FS_DATA_BYTES && lit < 255) {
+      if (data[pos] != ref[pos]) { ++pos; ++lit; continue; }
+      if (lit < 254 && pos + 1 < FS_DATA_BYTES && data[pos + 1] != ref[pos + 1]) { pos += 2; lit += 2; continue; }
+      break;
+    }
+    if (n + 2 + lit > limit) return -1;
+    out[n++] = (uint8_t)z;
+    out[n++] = (uint8_t)lit;
+    for (int k = 0; k < lit; ++k) out[n++] = (uint8_t)(data[start + k] ^ ref[start + k]);
+  }
+  return n;
+}
+
+// one [PAIR(2)] per changed magnet: index bits 0..9, value bits 12..15
+static int encodeSparse(const uint8_t* ref, const uint8_t* data, uint8_t* out, int limit) {
+  int n = 0;
+  for (int i = 0; i < FS_DATA_BYTES; ++i) {
+    const uint8_t x = (uint8_t)(data[i] ^ ref[i]);
+    if (!x) continue;
+    for (int h = 0; h < 2; ++h) {
+      if (!((x >> (4 * h)) & 0x0F)) continue;
+      if (n + 2 > limit) return -1;
+      const uint8_t v = (uint8_t)((data[i] >> (4 * h)) & 0x0F);
+      wrU16(out + n, (uint16_t)((2 * i + h) | (v << 12)));
+      n += 2;
+    }
+  }
+  return n;
+}
+
+// ++++ OPEN / CLOSE ++++
+bool FrameStream::open(const FrameStreamConfig& cfg, std::string* err) {
+  close();
+  cfg_ = cfg;
+  if (cfg_.pool < FS_WINDOW_MAX) cfg_.pool = FS_WINDOW_MAX;
+  if (!port_.open(cfg_.port.c_str(), cfg_.baud, err)) return false;
+
+  slots_ = std::vector<Slot>((size_t)cfg_.pool);
+  free_.clear();
+  for (int i = cfg_.pool - 1; i >= 0; --i) free_.push_back(i);
+  to_write_.clear();
+  inflight_.clear();
+  outstanding_ = 0;
+  next_seq_    = 0;
+  window_      = 1;
+  stats_       = FrameStreamStats();
+  hist_.reset();
+  enc_mask_    = 0;
+  ref_valid_   = false;
+  seq_         = FrameSeqProgress();
+  latch_       = false;
+
+  run_ = true;
+  writer_ = std::thread(&FrameStream::writerLoop, this);
+  reader_ = std::thread(&FrameStream::readerLoop, this);
+
+  if (cfg_.encode) {                                      // which encodings the firmware decodes
+    FrameStatus st;
+    queryStatus(&st);
+    resetHistogram();
+  }
+  return true;
+}
+
+void FrameStream::close() {
+  if (run_.exchange(false)) {
+    cv_.notify_all();
+    writer_.join();
+    reader_.join();
+
+    std::lock_guard<std::mutex> lk(mu_);                  // whatever is left never gets an ACK
+    while (!inflight_.empty()) { const int i = inflight_.front(); inflight_.pop_front(); FrameResult r; r.lost = true; finish(i, r); }
+    while (!to_write_.empty()) { const int i = to_write_.front(); to_write_.pop_front(); FrameResult r; r.lost = true; finish(i, r); }
+  }
+  port_.close();
+}
+
+// ++++ SUBMIT ++++
+std::future<FrameResult> FrameStream::enqueue(uint16_t magic, const uint8_t* body, const uint8_t* body2, uint16_t body2_len,
+                                              uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> lk(mu_);
+  cv_.wait(lk, [&] { return !run_ || (!free_.empty() && outstanding_ < window_); });
+  if (!run_) {
+    std::promise<FrameResult> p;
+    FrameResult r;
+    r.lost = true;
+    p.set_value(r);
+    return p.get_future();
+  }
+
+  const int idx = free_.back();
+  free_.pop_back();
+  Slot& s = slots_[(size_t)idx];
+  s.seq  = next_seq_++;
+  s.ctrl = (magic == FS_CTRL_MAGIC);
+  s.timeout_ms = timeout_ms ? timeout_ms : cfg_.ack_timeout_ms;
+  s.done = std::promise<FrameResult>();
+  s.len  = FS_FRAME_BYTES;
+
+  std::future<FrameResult> f = s.done.get_future();
+  to_write_.push_back(idx);
+  ++outstanding_;
+  ++stats_.submitted;
+
+  if (magic == FS_MAGIC) {                                // data: full or encoded
+    s.len = buildData(s, body);
+    cv_.notify_all();
+    return f;
+  }
+  if (magic == FS_PATTERN_MAGIC) {                        // [MAGIC][SEQ][ID][CRC]
+    wrU16(s.frame, magic);
+    wrU32(s.frame + 2, s.seq);
+    s.frame[FS_HDR_BYTES] = body2[0];
+    wrU16(s.frame + FS_HDR_BYTES + 1, fsCrc16(s.frame, FS_HDR_BYTES + 1));
+    s.len = FS_PATTERN_BYTES;
+    ref_valid_ = false;                                   // Pico2's reference is now the pattern
+    ++stats_.pattern;
+    cv_.notify_all();
+    return f;
+  }
+  if (magic == FS_DEEP_MAGIC) {                           // [MAGIC][SEQ][DEPTH][DATA(body2_len)][CRC]
+    const int n = FS_HDR_BYTES + FS_DEEP_HDR_BYTES + body2_len;
+    wrU16(s.frame, magic);
+    wrU32(s.frame + 2, s.seq);
+    s.frame[FS_HDR_BYTES] = body2[0];
+    memcpy(s.frame + FS_HDR_BYTES + FS_DEEP_HDR_BYTES, body, body2_len);
+    wrU16(s.frame + n, fsCrc16(s.frame, (size_t)n));
+    s.len = n + FS_CRC_BYTES;
+    ref_valid_ = false;                                   // Pico2 drops its 4-bit reference
+    ++stats_.deep;
+    stats_.data_bytes += (uint64_t)s.len;
+    cv_.notify_all();
+    return f;
+  }
+
+  // frame built in its pool slot: [MAGIC][SEQ][DATA][CRC]
+  wrU16(s.frame, magic);
+  wrU32(s.frame + 2, s.seq);
+  uint8_t* data = s.frame + FS_HDR_BYTES;
+  if (body) {
+    memcpy(data, body, FS_DATA_BYTES);
+  } else {                                                // control: OP(1) + LEN(2) + ARGS, zero pad
+    memset(data, 0, FS_DATA_BYTES);
+    memcpy(data, body2, 3);
+    memcpy(data + 3, body2 + 3, body2_len);
+  }
+  wrU16(s.frame + FS_HDR_BYTES + FS_DATA_BYTES, fsCrc16(s.frame, FS_HDR_BYTES + FS_DATA_BYTES));
+  cv_.notify_all();
+  return f;
+}
+
+// smallest of: full [MAGIC][SEQ][DATA][CRC] | [DELTA/SPARSE_MAGIC][SEQ][BASE_SEQ][LEN][BODY][CRC]
+int FrameStream::buildData(Slot& s, const uint8_t* data512) {
+  uint8_t* const enc  = s.frame + FS_HDR_BYTES;
+  uint8_t* const body = enc + FS_ENC_HDR_BYTES;
+
+  uint16_t magic = FS_MAGIC;
+  int      len   = FS_ENC_BODY_MAX - 1;                   // encoded frames must beat FS_FRAME_BYTES
+  if (ref_valid_ && (enc_mask_ & FS_ENC_DELTA)) {
+    const int d = encodeDelta(ref_, data512, body, len);
+    if (d >= 0) { magic = FS_DELTA_MAGIC; len = d; }
+  }
+  if (ref_valid_ && (enc_mask_ & FS_ENC_SPARSE)) {
+    const int sp = encodeSparse(ref_, data512, scratch_, magic == FS_MAGIC ? len : len - 1);
+    if (sp >= 0) { magic = FS_SPARSE_MAGIC; len = sp; memcpy(body, scratch_, (size_t)sp); }
+  }
+
+  wrU16(s.frame, magic);
+  wrU32(s.frame + 2, s.seq);
+  int n;
+  if (magic == FS_MAGIC) {
+    memcpy(enc, data512, FS_DATA_BYTES);
+    n = FS_HDR_BYTES + FS_DATA_BYTES;
+    chain_seq_ = s.seq;
+    ref_valid_ = (enc_mask_ != 0);
+    ++stats_.full;
+  } else {
+    wrU32(enc, ref_seq_);
+    wrU16(enc + 4, (uint16_t)len);
+    n = FS_HDR_BYTES + FS_ENC_HDR_BYTES + len;
+    ++(magic == FS_DELTA_MAGIC ? stats_.delta : stats_.sparse);
+  }
+  wrU16(s.frame + n, fsCrc16(s.frame, (size_t)n));
+  n += FS_CRC_BYTES;
+
+  memcpy(ref_, data512, FS_DATA_BYTES);                   // the next frame builds on this one
+  ref_seq_ = s.seq;
+  stats_.data_bytes += (uint64_t)n;
+  return n;
+}
+
+std::future<FrameResult> FrameStream::submit(const uint8_t* data512) {
+  return enqueue(FS_MAGIC, data512, nullptr, 0, 0);
+}
+
+std::future<FrameResult> FrameStream::submitDeep(const uint16_t* values, int depth) {
+  uint8_t packed[FS_DEEP_DATA_MAX];
+  if (!fsDepthOk(depth)) {                                // nothing goes out
+    std::promise<FrameResult> p;
+    FrameResult r;
+    r.lost = true;
+    p.set_value(r);
+    return p.get_future();
+  }
+  const int n = fsPackDepth(values, depth, packed);
+  if (depth == FS_DEPTH_NIBBLE) return submit(packed);
+  const uint8_t d = (uint8_t)depth;
+  return enqueue(FS_DEEP_MAGIC, packed, &d, (uint16_t)n, 0);
+}
+
+std::future<FrameResult> FrameStream::applyPattern(uint8_t id) {
+  return enqueue(FS_PATTERN_MAGIC, nullptr, &id, 0, 0);
+}
+
+std::future<FrameResult> FrameStream::submitControl(uint8_t op, const uint8_t* args, uint16_t len, uint32_t timeout_ms) {
+  if (len > FS_DATA_BYTES - 3) len = FS_DATA_BYTES - 3;
+  std::vector<uint8_t> body(3 + (size_t)len);
+  body[0] = op;
+  wrU16(&body[1], len);
+  if (len) memcpy(&body[3], args, len);   // len 0: args may be null
+  return enqueue(FS_CTRL_MAGIC, nullptr, body.data(), len, timeout_ms);
+}
+
+int FrameStream::setWindow(int want) {
+  if (want < 1) want = 1;
+  if (want > FS_WINDOW_MAX) want = FS_WINDOW_MAX;
+  const uint8_t arg = (uint8_t)want;
+  FrameResult r = submitControl(FS_OP_SET_WINDOW, &arg, 1).get();
+  drain();
+
+  int granted = 1;                                        // refused / old firmware: stop-and-wait
+  if (!r.lost && r.status == FS_STATUS_OK && !r.reply.empty()) granted = r.reply[0];
+  if (granted < 1) granted = 1;
+
+  std::lock_guard<std::mutex> lk(mu_);
+  window_ = granted;
+  cv_.notify_all();
+  return granted;
+}
+
+bool FrameStream::queryStatus(FrameStatus* out) {
+  FrameResult r = submitControl(FS_OP_GET_STATUS, nullptr, 0).get();
+  if (r.lost || r.status != FS_STATUS_OK) return false;
+
+  // fields are appended over firmware versions: take what LEN covers
+  uint8_t b[56] = {0};
+  memcpy(b, r.reply.data(), r.reply.size() < sizeof(b) ? r.reply.size() : sizeof(b));
+  out->version        = b[0];
+  out->window         = b[1];
+  out->uart_baud      = rdU32(b + 2);
+  out->uart_ceiling   = rdU32(b + 6);
+  out->uart_fallbacks = rdU16(b + 10);
+  out->lost_acks      = rdU32(b + 12);
+  out->link           = b[16];
+  out->encodings      = b[17];
+  for (int k = 0; k < 4; ++k) out->health[k] = rdU32(b + 18 + 4 * k);
+  out->i2c_fail_pico1 = rdU32(b + 34);
+  out->i2c_fail_pico2 = rdU32(b + 38);
+  out->rx_resyncs     = rdU32(b + 42);
+  out->rx_skipped     = rdU32(b + 46);
+  out->rx_timeouts    = rdU32(b + 50);
+  out->depths         = rdU16(b + 54);
+
+  std::lock_guard<std::mutex> lk(mu_);
+  enc_mask_ = cfg_.encode ? (uint8_t)(out->encodings & (FS_ENC_DELTA | FS_ENC_SPARSE)) : 0;
+  return true;
+}
+
+bool FrameStream::storePattern(uint8_t id, const uint8_t* data512) {
+  uint8_t args[2 + FS_DATA_BYTES / 2];
+  for (uint8_t half = 0; half < 2; ++half) {             // 0: Pico1's bytes, 1: Pico2's
+    args[0] = id;
+    args[1] = half;
+    memcpy(args + 2, data512 + half * (FS_DATA_BYTES / 2), FS_DATA_BYTES / 2);
+    FrameResult r = submitControl(FS_OP_BANK_STORE, args, sizeof(args)).get();
+    if (r.lost || r.status != FS_STATUS_OK) return false;
+  }
+  return true;
+}
+
+bool FrameStream::queryBank(FrameBank* out) {
+  FrameResult r = submitControl(FS_OP_BANK_INFO, nullptr, 0).get();
+  if (r.lost || r.status != FS_STATUS_OK) return false;
+
+  uint8_t b[17] = {0};
+  memcpy(b, r.reply.data(), r.reply.size() < sizeof(b) ? r.reply.size() : sizeof(b));
+  out->slots      = b[0];
+  out->stored     = rdU32(b + 1);
+  out->slot_bytes = rdU32(b + 5);
+  out->bank_bytes = rdU32(b + 9);
+  out->used_bytes = rdU32(b + 13);
+  return true;
+}
+
+bool FrameStream::loadSequence(const std::vector<FrameSeqStep>& steps) {
+  if (steps.empty() || steps.size() > (size_t)FS_SEQ_MAX_STEPS) return false;
+  uint8_t args[2 + FS_SEQ_LOAD_MAX * 5];
+  for (size_t first = 0; first < steps.size(); first += FS_SEQ_LOAD_MAX) {
+    const size_t n = steps.size() - first < (size_t)FS_SEQ_LOAD_MAX ? steps.size() - first : (size_t)FS_SEQ_LOAD_MAX;
+    args[0] = (uint8_t)first;
+    args[1] = (uint8_t)n;
+    for (size_t k = 0; k < n; ++k) {                     // [ID(1)][DURATION_US(4)] per step
+      args[2 + 5 * k] = steps[first + k].pattern;
+      wrU32(args + 3 + 5 * k, steps[first + k].duration_us);
+    }
+    FrameResult r = submitControl(FS_OP_SEQ_LOAD, args, (uint16_t)(2 + 5 * n)).get();
+    if (r.lost || r.status != FS_STATUS_OK) return false;
+  }
+  return true;
+}
+
+bool FrameStream::startSequence(uint16_t loops, uint16_t report_every) {
+  uint8_t args[4];
+  wrU16(args, loops);
+  wrU16(args + 2, report_every);
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    seq_ = FrameSeqProgress();
+  }
+  FrameResult r = submitControl(FS_OP_SEQ_START, args, 4).get();
+  if (r.lost || r.status != FS_STATUS_OK) return false;
+
+  std::lock_guard<std::mutex> lk(mu_);
+  ref_valid_ = false;                                     // playback replaced Pico2's reference
+  return true;
+}
+
+bool FrameStream::stopSequence(uint32_t* steps, uint32_t* overruns_pico2, uint32_t* overruns_pico1) {
+  FrameResult r = submitControl(FS_OP_SEQ_STOP, nullptr, 0).get();
+  if (r.lost || r.status != FS_STATUS_OK || r.reply.size() < 12) return false;
+  if (steps)          *steps          = rdU32(r.reply.data());
+  if (overruns_pico2) *overruns_pico2 = rdU32(r.reply.data() + 4);
+  if (overruns_pico1) *overruns_pico1 = rdU32(r.reply.data() + 8);
+  return true;
+}
+
+FrameSeqProgress FrameStream::sequenceProgress() {
+  std::lock_guard<std::mutex> lk(mu_);
+  return seq_;
+}
+
+bool FrameStream::waitSequenceDone(uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> lk(mu_);
+  return cv_.wait_for(lk, std::chrono::milliseconds(timeout_ms), [&] { return !run_ || seq_.done; }) && seq_.done;
+}
+
+bool FrameStream::setLatch(bool on) {
+  const uint8_t arg = on ? 1 : 0;
+  FrameResult r = submitControl(FS_OP_SET_LATCH, &arg, 1).get();
+  if (r.lost || r.status != FS_STATUS_OK || r.reply.empty()) return false;
+
+  std::lock_guard<std::mutex> lk(mu_);                  // control frames are barriers: nothing in flight
+  latch_ = (r.reply[0] != 0);
+  return latch_ == on;
+}
+
+FrameCalibration::FrameCalibration() {
+  for (int c = 0; c < FS_CAL_CURVES; ++c) {
+    for (int v = 0; v < FS_CAL_LEVELS; ++v) curve[c][v] = (uint16_t)((v < 7 ? 7 - v : v - 7) * 4095 / 7);
+  }
+}
+
+// OP_CAL_COMMIT: [VERSION(4)] + [SAVE(1)] | the firmware's status, 0xFF if lost
+static uint8_t calCommit(FrameStream& fs, uint32_t version, bool save) {
+  uint8_t args[5];
+  wrU32(args, version);
+  args[4] = save ? 1 : 0;
+  FrameResult r = fs.submitControl(FS_OP_CAL_COMMIT, args, 5, save ? FS_CAL_SAVE_TIMEOUT_MS : 0).get();
+  return r.lost ? 0xFF : r.status;
+}
+
+bool FrameStream::uploadCalibration(const FrameCalibration& cal, bool save, uint8_t* status) {
+  if (status) *status = 0xFF;
+  if (cal.version == 0) return false;                    // version 0 means "none"
+
+  uint8_t args[3 + FS_CAL_STORE_MAX * FS_CAL_REC_BYTES];
+  for (int c = 0; c < FS_CAL_CURVES; ++c) {              // [CURVE(1)] + [PWM(2)] per level
+    args[0] = (uint8_t)c;
+    for (int v = 0; v < FS_CAL_LEVELS; ++v) wrU16(args + 1 + 2 * v, cal.curve[c][v]);
+    FrameResult r = submitControl(FS_OP_CAL_CURVE, args, 1 + 2 * FS_CAL_LEVELS).get();
+    if (r.lost || r.status != FS_STATUS_OK) return false;
+  }
+  for (int first = 0; first < FS_CAL_MAGNETS; first += FS_CAL_STORE_MAX) {
+    const int n = FS_CAL_MAGNETS - first < FS_CAL_STORE_MAX ? FS_CAL_MAGNETS - first : FS_CAL_STORE_MAX;
+    wrU16(args, (uint16_t)first);
+    args[2] = (uint8_t)n;
+    for (int k = 0; k < n; ++k) {                        // [GAIN(2)][OFFSET(2)][FLAGS(1)]
+      const FrameMagCal& m = cal.mag[first + k];
+      uint8_t* rec = args + 3 + k * FS_CAL_REC_BYTES;
+      wrU16(rec, m.gain);
+      wrU16(rec + 2, (uint16_t)m.offset);
+      rec[4] = (uint8_t)((m.swap ? 0x01 : 0x00) | ((m.curve & 0x03) << 4));
+    }
+    FrameResult r = submitControl(FS_OP_CAL_STORE, args, (uint16_t)(3 + n * FS_CAL_REC_BYTES)).get();
+    if (r.lost || r.status != FS_STATUS_OK) return false;
+  }
+
+  const uint8_t st = calCommit(*this, cal.version, save);
+  if (status) *status = st;
+  return st == FS_STATUS_OK;
+}
+
+bool FrameStream::clearCalibration(bool save) {
+  return calCommit(*this, 0, save) == FS_STATUS_OK;
+}
+
+bool FrameStream::queryCalibration(uint32_t* pico1, uint32_t* pico2) {
+  FrameResult r = submitControl(FS_OP_CAL_INFO, nullptr, 0).get();
+  if (r.lost || r.status != FS_STATUS_OK || r.reply.size() < 8) return false;
+  *pico1 = rdU32(r.reply.data());
+  *pico2 = rdU32(r.reply.data() + 4);
+  return true;
+}
+
+bool FrameStream::allOff(uint32_t* pico2_us, uint32_t* both_us) {
+  FrameResult r = submitControl(FS_OP_ALL_OFF, nullptr, 0).get();
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    ref_valid_ = false;                                   // Pico2 drops its 4-bit reference
+  }
+  if (r.lost || r.status != FS_STATUS_OK || r.reply.size() < 4) return false;
+  if (pico2_us) *pico2_us = rdU32(r.reply.data());
+  if (both_us)  *both_us  = r.reply.size() >= 8 ? rdU32(r.reply.data() + 4) : 0;
+  return true;
+}
+
+bool FrameStream::queryTrace(std::vector<FrameTraceStage>* out, bool reset) {
+  const uint8_t arg = reset ? 1 : 0;
+  FrameResult r = submitControl(FS_OP_GET_TRACE, &arg, 1).get();
+  if (r.lost || r.status != FS_STATUS_OK || r.reply.empty()) return false;
+
+  const size_t n = r.reply[0];
+  if (r.reply.size() < 1 + n * FS_TRACE_RECORD_BYTES) return false;
+  out->clear();
+  for (size_t i = 0; i < n; ++i) {                       // [STAGE][COUNT][MIN][AVG][MAX][P50][P90][P99]
+    const uint8_t* b = r.reply.data() + 1 + i * FS_TRACE_RECORD_BYTES;
+    FrameTraceStage t;
+    t.stage = b[0];
+    t.count = rdU32(b + 1);
+    t.min   = rdU32(b + 5);
+    t.avg   = rdU32(b + 9);
+    t.max   = rdU32(b + 13);
+    t.p50   = rdU32(b + 17);
+    t.p90   = rdU32(b + 21);
+    t.p99   = rdU32(b + 25);
+    out->push_back(t);
+  }
+  return true;
+}
+
+uint32_t FrameStream::setLinkCeiling(uint32_t max_baud) {
+  uint8_t arg[4];
+  wrU32(arg, max_baud);
+  FrameResult r = submitControl(FS_OP_SET_LINK, arg, 4, FS_LINK_TIMEOUT_MS).get();
+  if (r.lost || r.status != FS_STATUS_OK || r.reply.size() < 4) return 0;
+  return rdU32(r.reply.data());
+}
+
+void FrameStream::drain() {
+  std::unique_lock<std::mutex> lk(mu_);
+  cv_.wait(lk, [&] { return !run_ || outstanding_ == 0; });
+}
+
+FrameStreamStats FrameStream::stats() {
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
+
+LatencyHistogram FrameStream::histogram() {
+  std::lock_guard<std::mutex> lk(mu_);
+  return hist_;
+}
+
+void FrameStream::resetHistogram() {
+  std::lock_guard<std::mutex> lk(mu_);
+  hist_.reset();
+}
+
+// ++++ COMPLETION ++++
+void FrameStream::finish(int idx, FrameResult r) {
+  Slot& s = slots_[(size_t)idx];
+  r.seq = s.seq;
+  if (r.lost) ++stats_.lost;
+
+  // a data frame Pico2 did not take: the chain of encoded frames is broken from here on
+  // (a failure older than the last full frame no longer matters)
+  const bool refused = r.lost || r.status == FS_STATUS_ERR_MAGIC || r.status == FS_STATUS_ERR_CRC ||
+                       r.status == FS_STATUS_ERR_BASE;
+  if (!s.ctrl && refused && (int32_t)(s.seq - chain_seq_) >= 0) ref_valid_ = false;
+  s.done.set_value(std::move(r));
+  free_.push_back(idx);
+  --outstanding_;
+  cv_.notify_all();
+}
+
+void FrameStream::expireOldest(Clock::time_point now) {
+  while (!inflight_.empty()) {
+    const int idx = inflight_.front();
+    if (now - slots_[(size_t)idx].t_sent < std::chrono::milliseconds(slots_[(size_t)idx].timeout_ms)) return;
+    inflight_.pop_front();
+    FrameResult r;
+    r.lost = true;
+    finish(idx, r);
+  }
+}
+
+// ++++ WRITER ++++
+// the timestamp is taken as late as possible so RTT is link + firmware only | cfg.coalesce: every
+// frame queued by then goes out in the same write, back to back
+void FrameStream::writerLoop() {
+  while (run_) {
+    const uint8_t* src;
+    size_t         n = 0;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [&] { return !run_ || !to_write_.empty(); });
+      if (!run_) return;
+      const Clock::time_point now = Clock::now();
+      int k = 0;
+      do {
+        const int idx = to_write_.front();
+        to_write_.pop_front();
+        Slot& sl = slots_[(size_t)idx];
+        sl.t_sent = now;
+        inflight_.push_back(idx);                           // before the bytes leave: the ACK may beat us back
+        if (k == 0 && (!cfg_.coalesce || to_write_.empty())) {
+          src = sl.frame;                                   // a frame on its own: no copy
+        } else {
+          memcpy(wbuf_ + n, sl.frame, (size_t)sl.len);
+          src = wbuf_;
+        }
+        n += (size_t)sl.len;
+        ++k;
+      } while (cfg_.coalesce && !to_write_.empty() && k < FS_WINDOW_MAX);
+      stats_.wire_bytes += n;
+      ++stats_.writes;
+    }
+    if (!port_.writeAll(src, n)) {
+      run_ = false;
+      cv_.notify_all();
+      return;
+    }
+  }
+}
+
+// ++++ READER ++++
+// byte-level ACK assembly with 1-byte resync, then LEN + REPLY for control frames
+void FrameStream::readerLoop() {
+  uint8_t  in[1024];
+  uint8_t  ack[FS_ACK_BYTES];
+  int      ack_n = 0;
+
+  // control reply in progress
+  bool                 in_reply = false;
+  int                  reply_idx = -1;
+  FrameResult          reply_res;
+  uint8_t              len2[2];
+  int                  len_n = 0;
+  int                  reply_len = -1;
+
+  while (run_) {
+    const int got = port_.readSome(in, sizeof(in), 5);
+    const Clock::time_point now = Clock::now();
+    if (got < 0) { run_ = false; cv_.notify_all(); return; }
+
+    for (int k = 0; k < got; ++k) {
+      const uint8_t b = in[k];
+
+      if (in_reply) {
+        if (reply_len < 0) {
+          len2[len_n++] = b;
+          if (len_n == 2) reply_len = rdU16(len2);
+        } else {
+          reply_res.reply.push_back(b);
+        }
+        if (reply_len >= 0 && (int)reply_res.reply.size() >= reply_len) {
+          std::lock_guard<std::mutex> lk(mu_);
+          if (!slots_[(size_t)reply_idx].ctrl && reply_res.reply.size() >= 6) {   // latched frame
+            reply_res.hold_us = (int32_t)rdU32(reply_res.reply.data());
+            reply_res.skew_us = rdU16(reply_res.reply.data() + 4);
+          }
+          finish(reply_idx, std::move(reply_res));
+          in_reply = false;
+        }
+        continue;
+      }
+
+      ack[ack_n++] = b;
+      if (ack_n < FS_ACK_BYTES) continue;
+      if (rdU16(ack) != FS_ACK_MAGIC) {                     // resync shift 1 byte
+        memmove(ack, ack + 1, FS_ACK_BYTES - 1);
+        ack_n = FS_ACK_BYTES - 1;
+        std::lock_guard<std::mutex> lk(mu_);
+        ++stats_.resync_skip;
+        continue;
+      }
+      ack_n = 0;
+
+      const uint32_t seq    = rdU32(ack + 2);
+      const uint8_t  status = ack[6];
+
+      std::lock_guard<std::mutex> lk(mu_);
+      if (status >= FS_STATUS_SEQ_STEP && status <= FS_STATUS_SEQ_DONE) {   // playback progress, SEQ = step
+        if (status == FS_STATUS_SEQ_OVERRUN) ++seq_.overruns;
+        else seq_.steps = seq;
+        if (status == FS_STATUS_SEQ_DONE) { seq_.done = true; cv_.notify_all(); }
+        continue;
+      }
+      if (status == FS_STATUS_TRACE) continue;              // Pico1's stage times, Pico2 keeps them
+      int pos = -1;
+      for (size_t i = 0; i < inflight_.size(); ++i) {
+        if (slots_[(size_t)inflight_[i]].seq == seq) { pos = (int)i; break; }
+      }
+      if (pos < 0) { ++stats_.stray_acks; continue; }
+
+      // pico2 ACKs in SEQ order: anything older than this one is not coming
+      for (int i = 0; i < pos; ++i) {
+        const int old = inflight_.front();
+        inflight_.pop_front();
+        FrameResult r;
+        r.lost = true;
+        finish(old, r);
+      }
+      const int idx = inflight_.front();
+      inflight_.pop_front();
+
+      FrameResult r;
+      r.status = status;
+      r.rtt_us = std::chrono::duration<double, std::micro>(now - slots_[(size_t)idx].t_sent).count();
+      hist_.record(r.rtt_us);
+      ++stats_.acked;
+      if (status == FS_STATUS_OK) ++stats_.ok;
+
+      if ((slots_[(size_t)idx].ctrl || latch_) && status == FS_STATUS_OK) {   // LEN(2) + REPLY follow
+        in_reply  = true;
+        reply_idx = idx;
+        reply_res = std::move(r);
+        reply_res.reply.clear();
+        len_n     = 0;
+        reply_len = -1;
+        continue;
+      }
+      finish(idx, std::move(r));
+    }
+
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!in_reply) expireOldest(now);
+  }
+}
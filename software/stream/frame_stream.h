@@ -0,0 +1,378 @@
+// ===========================================
+// filename: frame_stream.h
+// ===========================================
+#pragma once
+
+// PC side of the frame protocol (firmware/pico2/command.h), for streaming at full link rate.
+//
+// - One writer thread and one reader thread own the port; the caller only submits.
+// - Frames live in a pool allocated once at open(); submit() builds the frame in place
+//   (header, data copy, table CRC) and returns a future that completes with the ACK.
+// - Up to "window" frames are in flight (OP_SET_WINDOW, negotiated by setWindow()); submit()
+//   blocks while the window or the pool is full. pico2 ACKs in SEQ order, so an ACK for SEQ n
+//   also completes every older frame still waiting as lost.
+// - Data frames go out as the smallest of full / XOR delta / sparse (command.h FRAME ENCODINGS)
+//   once open() has seen the firmware list the encodings in OP_GET_STATUS. Encoded frames are
+//   relative to the previous data frame; after any data frame fails (or is lost) the next one
+//   is sent full again, and frames already encoded against it come back STATUS_ERR_BASE.
+// - Pattern bank: storePattern() uploads a pattern once (two OP_BANK_STORE frames), then
+//   applyPattern() switches the whole array with a 9-byte frame, windowed like data frames.
+// - Sequence playback: loadSequence() + startSequence() have the Picos play bank patterns on
+//   their own timer; the progress ACKs they send meanwhile land in sequenceProgress().
+// - Latched commit (setLatch): the firmware releases each frame on all boards at once and
+//   reports the hold time and the release skew it measured in the frame's result.
+// - Stage trace (queryTrace): per-stage latency summaries (min / avg / max / percentiles) the
+//   firmware keeps for both Picos, one OP_GET_TRACE away.
+// - Calibration (uploadCalibration): per-magnet gain / offset / polarity / curve, expanded by the
+//   firmware into its register tables and optionally kept in flash; queryCalibration() tells
+//   whether a set with the same version is already active, so it is not uploaded again.
+// - Frame depth (submitDeep): 6 / 8 / 12 bits per magnet in DEEP_MAGIC frames, for the firmwares
+//   that list the depth in OP_GET_STATUS; always sent full, and the next data frame is full too.
+// - All off (allOff): every magnet off with one broadcast write per I2C bus; the firmware also
+//   broadcasts data frames that are uniform by itself, nothing to do for those here.
+// - RTT is stamped by the writer right before the frame goes to the OS and by the reader right
+//   after the ACK's last byte came back, so caller-side scheduling does not show up in it.
+// - Frames that queue up while the port is busy go out in one write (cfg.coalesce): the USB
+//   stack then fills 64-byte packets across frame boundaries instead of ending every frame with
+//   a short packet (520 bytes = 8 full packets + 8 bytes).
+
+#include "latency_histogram.h"
+#include "serial_port.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ++++ PROTOCOL (mirrors firmware/pico2/command.h) ++++
+static constexpr uint16_t FS_MAGIC      = 0x55AA;
+static constexpr uint16_t FS_ACK_MAGIC  = 0x55AA;
+static constexpr uint16_t FS_CTRL_MAGIC = 0x66CC;
+static constexpr uint16_t FS_DELTA_MAGIC  = 0x77D1;
+static constexpr uint16_t FS_SPARSE_MAGIC = 0x88E2;
+static constexpr uint16_t FS_PATTERN_MAGIC = 0x99B3;
+static constexpr uint16_t FS_DEEP_MAGIC    = 0xAAF4;
+static constexpr int      FS_HDR_BYTES   = 6;
+static constexpr int      FS_DATA_BYTES  = 512;
+static constexpr int      FS_CRC_BYTES   = 2;
+static constexpr int      FS_FRAME_BYTES = FS_HDR_BYTES + FS_DATA_BYTES + FS_CRC_BYTES;   // 520
+static constexpr int      FS_ENC_HDR_BYTES  = 6;                                    // BASE_SEQ(4) + LEN(2)
+static constexpr int      FS_ENC_BODY_MAX   = FS_DATA_BYTES - FS_ENC_HDR_BYTES;     // 506
+static constexpr int      FS_PATTERN_BYTES  = FS_HDR_BYTES + 1 + FS_CRC_BYTES;       // 9
+static constexpr int      FS_MAGNETS        = 1024;
+static constexpr int      FS_DEPTH_NIBBLE   = 4;                                      // MAGIC frames
+static constexpr int      FS_DEPTH_MAX      = 12;
+static constexpr int      FS_DEEP_HDR_BYTES = 1;                                      // DEPTH(1)
+static constexpr int      FS_DEEP_DATA_MAX  = FS_MAGNETS * FS_DEPTH_MAX / 8;          // 1536
+static constexpr int      FS_FRAME_MAX_BYTES = FS_HDR_BYTES + FS_DEEP_HDR_BYTES + FS_DEEP_DATA_MAX + FS_CRC_BYTES;   // 1545
+static constexpr int      FS_ACK_BYTES   = 7;
+static constexpr int      FS_WINDOW_MAX  = 8;
+static constexpr uint32_t FS_LINK_TIMEOUT_MS = 10000;   // OP_SET_LINK: Pico2 renegotiates the UART first
+
+static constexpr uint8_t  FS_OP_SET_WINDOW = 0x01;
+static constexpr uint8_t  FS_OP_GET_STATUS = 0x02;
+static constexpr uint8_t  FS_OP_SET_LINK   = 0x03;
+static constexpr uint8_t  FS_OP_BANK_STORE = 0x04;
+static constexpr uint8_t  FS_OP_BANK_INFO  = 0x05;
+static constexpr uint8_t  FS_OP_SEQ_LOAD   = 0x06;
+static constexpr uint8_t  FS_OP_SEQ_START  = 0x07;
+static constexpr uint8_t  FS_OP_SEQ_STOP   = 0x08;
+static constexpr int      FS_SEQ_MAX_STEPS = 256;
+static constexpr int      FS_SEQ_LOAD_MAX  = 101;      // steps per OP_SEQ_LOAD frame
+static constexpr uint8_t  FS_OP_SET_LATCH  = 0x09;
+static constexpr uint16_t FS_LATCH_SKEW_UNKNOWN = 0xFFFF;
+static constexpr uint8_t  FS_OP_GET_TRACE  = 0x0A;
+static constexpr int      FS_TRACE_RECORD_BYTES = 29;  // per stage in the OP_GET_TRACE reply
+static constexpr uint8_t  FS_OP_CAL_STORE  = 0x0B;
+static constexpr uint8_t  FS_OP_CAL_CURVE  = 0x0C;
+static constexpr uint8_t  FS_OP_CAL_COMMIT = 0x0D;
+static constexpr uint8_t  FS_OP_CAL_INFO   = 0x0E;
+static constexpr uint8_t  FS_OP_ALL_OFF    = 0x0F;
+static constexpr int      FS_CAL_MAGNETS   = 1024;
+static constexpr int      FS_CAL_CURVES    = 4;
+static constexpr int      FS_CAL_LEVELS    = 15;       // values 0..14
+static constexpr int      FS_CAL_STORE_MAX = 50;       // magnets per OP_CAL_STORE frame
+static constexpr int      FS_CAL_REC_BYTES = 5;        // GAIN(2) + OFFSET(2) + FLAGS(1)
+static constexpr uint16_t FS_CAL_GAIN_ONE  = 1024;
+static constexpr uint32_t FS_CAL_SAVE_TIMEOUT_MS = 5000;   // OP_CAL_COMMIT with save: both Picos write flash
+
+static constexpr uint8_t  FS_LINK_UART = 0;            // FrameStatus::link (PICO_LINK_*)
+static constexpr uint8_t  FS_LINK_SPI  = 1;
+
+static constexpr uint8_t  FS_ENC_DELTA  = 0x01;        // FrameStatus::encodings
+static constexpr uint8_t  FS_ENC_SPARSE = 0x02;
+
+static constexpr uint8_t  FS_STATUS_ERR_MAGIC     = 0;
+static constexpr uint8_t  FS_STATUS_OK            = 1;
+static constexpr uint8_t  FS_STATUS_ERR_CRC       = 2;
+static constexpr uint8_t  FS_STATUS_ERR_PICO1_ACK = 3;
+static constexpr uint8_t  FS_STATUS_ERR_OP        = 4;
+static constexpr uint8_t  FS_STATUS_ERR_BASE      = 5;   // encoded frame not against what Pico2 holds
+static constexpr uint8_t  FS_STATUS_ERR_BANK      = 6;   // pattern ID not stored on both Picos
+static constexpr uint8_t  FS_STATUS_SEQ_STEP      = 7;   // progress ACKs (SEQ = step counter), not frame ACKs
+static constexpr uint8_t  FS_STATUS_SEQ_OVERRUN   = 8;
+static constexpr uint8_t  FS_STATUS_SEQ_DONE      = 9;
+static constexpr uint8_t  FS_STATUS_TRACE         = 10;  // Pico1 -> Pico2 only, never expected here
+static constexpr uint8_t  FS_STATUS_ERR_FLASH     = 15;  // calibration active, but not saved to flash
+
+// firmware stage names by TraceStage index (command.h STAGE TRACE) | "?" past the end
+const char* fsTraceStageName(uint8_t stage);
+
+// CRC16-CCITT (poly 0x1021, init 0xFFFF), table driven, streaming like command.cpp
+uint16_t fsCrc16(const uint8_t* data, size_t n, uint16_t crc = 0xFFFF);
+
+// FS_MAGNETS values <-> depth bits each (command.h FRAME DEPTH): magnet m is bits [m * depth,
+// (m + 1) * depth) of the bytes read as one little-endian bit string; depth 4 is the nibble layout
+// of data frames | fsPackDepth returns the byte count, FS_MAGNETS * depth / 8
+int  fsPackDepth(const uint16_t* values, int depth, uint8_t* out);
+void fsUnpackDepth(const uint8_t* in, int depth, uint16_t* values);
+// off at this depth: 2^(depth - 1) - 1 (7 for nibbles); above drives LEFT, below RIGHT, all ones is off too
+inline uint16_t fsDepthCenter(int depth) { return (uint16_t)((1u << (depth - 1)) - 1); }
+inline bool     fsDepthOk(int depth) { return depth == FS_DEPTH_NIBBLE || depth == 6 || depth == 8 || depth == 12; }
+
+struct FrameStreamConfig {
+  std::string port;
+  uint32_t    baud           = 115200;
+  uint32_t    ack_timeout_ms = 500;
+  int         pool           = 2 * FS_WINDOW_MAX;   // preallocated frames
+  bool        encode         = true;                // delta / sparse data frames if the firmware has them
+  bool        coalesce       = true;                // queued frames share one write (full USB packets)
+};
+
+struct FrameResult {
+  uint32_t             seq       = 0;
+  uint8_t              status    = 0;       // FS_STATUS_*, meaningless if lost
+  bool                 lost      = false;   // no ACK: timeout, or a later SEQ was ACKed first
+  double               rtt_us    = 0.0;
+  std::vector<uint8_t> reply;               // control frames with STATUS_OK: REPLY bytes
+  int32_t              hold_us   = -1;      // latched commit, STATUS_OK: outputs held for the frame
+  int32_t              skew_us   = -1;      //   Pico1 release after Pico2's (FS_LATCH_SKEW_UNKNOWN: not seen)
+};
+
+// OP_GET_STATUS reply (fields the firmware did not send stay 0)
+struct FrameStatus {
+  uint8_t  version        = 0;
+  uint8_t  window         = 0;
+  uint32_t uart_baud      = 0;              // Pico2 <-> Pico1 rate: UART baud agreed by the tuner, or SPI clock
+  uint32_t uart_ceiling   = 0;
+  uint16_t uart_fallbacks = 0;
+  uint32_t lost_acks      = 0;              // frames that never got their Pico1 ACK
+  uint8_t  link           = FS_LINK_UART;   // version 2: wire between the Picos
+  uint8_t  encodings      = 0;              // version 3: FS_ENC_* the firmware decodes
+  uint32_t health[4]      = {0, 0, 0, 0};   // version 4: bit = board written, in data order
+                                            //   (Pico1 bus0, Pico1 bus1, Pico2 bus0, Pico2 bus1)
+  uint32_t i2c_fail_pico1 = 0;              // version 4: failed I2C transactions since boot
+  uint32_t i2c_fail_pico2 = 0;
+  uint32_t rx_resyncs     = 0;              // version 5: Pico2 USB receiver hunted for a MAGIC
+  uint32_t rx_skipped     = 0;              //   bytes it skipped doing so
+  uint32_t rx_timeouts    = 0;              //   frames cut off by a receive deadline
+  uint16_t depths         = 0;              // version 6: bit d = frames of d bits per magnet (bit 4: MAGIC)
+};
+
+// OP_BANK_INFO reply
+struct FrameBank {
+  uint8_t  slots      = 0;                  // capacity (pattern IDs 0 .. slots-1)
+  uint32_t stored     = 0;                  // bit id: pattern id is on both Picos
+  uint32_t slot_bytes = 0;                  // RAM per slot on each Pico
+  uint32_t bank_bytes = 0;                  // RAM the bank reserves on each Pico
+  uint32_t used_bytes = 0;                  // RAM holding stored halves on Pico2
+};
+
+// one step of a device-side sequence
+struct FrameSeqStep {
+  uint8_t  pattern     = 0;                 // bank pattern id
+  uint32_t duration_us = 0;
+};
+
+// sequence playback as seen from the progress ACKs (reset by startSequence)
+struct FrameSeqProgress {
+  uint32_t steps    = 0;                    // newest step counter reported (STEP / DONE)
+  uint32_t overruns = 0;                    // OVERRUN messages, either Pico
+  bool     done     = false;
+};
+
+// one stage of the OP_GET_TRACE reply, times in us over the firmware's last samples
+struct FrameTraceStage {
+  uint8_t  stage = 0;                       // TraceStage index, see fsTraceStageName()
+  uint32_t count = 0;                       // samples since the last reset
+  uint32_t min   = 0;
+  uint32_t avg   = 0;
+  uint32_t max   = 0;
+  uint32_t p50   = 0;
+  uint32_t p90   = 0;
+  uint32_t p99   = 0;
+};
+
+// calibration of one magnet (command.h CALIBRATION): pwm = curve[value] * gain / 1024 + offset
+struct FrameMagCal {
+  uint16_t gain   = FS_CAL_GAIN_ONE;        // 1/1024 steps
+  int16_t  offset = 0;                      // PWM counts added to every level that is not off
+  bool     swap   = false;                  // drive the other side of the pair
+  uint8_t  curve  = 0;                      // FrameCalibration::curve index
+};
+
+// a whole set; magnet m = nibble m of the 512 data bytes (0..511 on Pico1, 512..1023 on Pico2)
+struct FrameCalibration {
+  uint32_t    version = 1;                  // != 0; OP_CAL_INFO reports it back
+  uint16_t    curve[FS_CAL_CURVES][FS_CAL_LEVELS];   // PWM of values 0..14 (value 7 is always off)
+  FrameMagCal mag[FS_CAL_MAGNETS];
+  FrameCalibration();                       // linear curves |value - 7| * 4095 / 7, unit gain
+};
+
+struct FrameStreamStats {
+  uint64_t submitted   = 0;
+  uint64_t acked       = 0;
+  uint64_t ok          = 0;
+  uint64_t lost        = 0;
+  uint64_t resync_skip = 0;                 // bytes shifted out while looking for ACK_MAGIC
+  uint64_t stray_acks  = 0;                 // ACK for a SEQ not in flight
+  uint64_t full        = 0;                 // data frames by encoding
+  uint64_t delta       = 0;
+  uint64_t sparse      = 0;
+  uint64_t pattern     = 0;                 // applyPattern() frames
+  uint64_t deep        = 0;                 // submitDeep() frames of 6 / 8 / 12 bits
+  uint64_t data_bytes  = 0;                 // bytes of all data frames on the wire
+  uint64_t wire_bytes  = 0;                 // every byte written, control frames included
+  uint64_t writes      = 0;                 // writes to the port (one per frame without coalescing)
+};
+
+class FrameStream {
+public:
+  FrameStream() {}
+  ~FrameStream() { close(); }
+
+  bool open(const FrameStreamConfig& cfg, std::string* err);
+  void close();
+
+  // OP_SET_WINDOW; returns the granted window (1 if the firmware refuses or does not answer)
+  int setWindow(int want);
+  int window() const { return window_; }
+
+  // OP_GET_STATUS | false if the firmware does not know the op (also picks up the encodings)
+  bool queryStatus(FrameStatus* out);
+
+  // OP_SET_LINK: UART ceiling, Pico2 renegotiates | returns the agreed rate, 0 on failure
+  uint32_t setLinkCeiling(uint32_t max_baud);
+
+  // data frame (512 packed bytes), encoded as small as it gets | blocks while the window or the pool is full
+  std::future<FrameResult> submit(const uint8_t* data512);
+
+  // data frame of FS_MAGNETS values (Pico1's 512 first) at depth bits each | depth 4 goes through
+  // submit(); 6 / 8 / 12 need FrameStatus::depths (older firmware never ACKs them) | blocks like submit()
+  std::future<FrameResult> submitDeep(const uint16_t* values, int depth);
+
+  // OP_BANK_STORE of both halves | false if the firmware refused either (no such slot, Pico1 silent)
+  bool storePattern(uint8_t id, const uint8_t* data512);
+
+  // OP_BANK_INFO | false if the firmware has no bank
+  bool queryBank(FrameBank* out);
+
+  // pattern frame: apply stored pattern id on both Picos | blocks like submit()
+  std::future<FrameResult> applyPattern(uint8_t id);
+
+  // OP_SEQ_LOAD in as many frames as needed | false if the firmware refused (unknown op, bad id)
+  bool loadSequence(const std::vector<FrameSeqStep>& steps);
+
+  // OP_SEQ_START: loops 0 = until stopped, a STEP progress ACK every report_every steps (0 = none)
+  // | false if a pattern is missing on either Pico or Pico1 did not answer
+  bool startSequence(uint16_t loops, uint16_t report_every);
+
+  // OP_SEQ_STOP (also fine after the end) | steps played, overruns on Pico2 / Pico1
+  bool stopSequence(uint32_t* steps, uint32_t* overruns_pico2, uint32_t* overruns_pico1);
+
+  FrameSeqProgress sequenceProgress();
+  bool             waitSequenceDone(uint32_t timeout_ms);   // false on timeout
+
+  // OP_SET_LATCH | false if the firmware does not have it (or Pico1 did not answer)
+  bool setLatch(bool on);
+
+  // OP_GET_TRACE, reset: clear the firmware's rings after reading | false if tracing is compiled out
+  bool queryTrace(std::vector<FrameTraceStage>* out, bool reset);
+
+  // OP_CAL_CURVE per curve, OP_CAL_STORE in FS_CAL_STORE_MAX-magnet frames, then OP_CAL_COMMIT;
+  // save: the Picos also write it to flash | false if any frame failed; *status (optional) is the
+  // commit's status (FS_STATUS_ERR_FLASH: active but not saved)
+  bool uploadCalibration(const FrameCalibration& cal, bool save, uint8_t* status = nullptr);
+
+  // OP_CAL_COMMIT version 0: back to the linear map; save: the saved sets are removed too
+  bool clearCalibration(bool save);
+
+  // OP_CAL_INFO: active versions, 0 = uncalibrated | false if the firmware has no calibration
+  bool queryCalibration(uint32_t* pico1, uint32_t* pico2);
+
+  // OP_ALL_OFF: emergency stop, ends playback too; frames still in flight are not waited for |
+  // false if the firmware does not have it or Pico1 did not answer (Pico2's boards are off then)
+  // *pico2_us / *both_us (optional): on the device, from the frame to Pico2's boards off / to both
+  // Picos off (0 from firmware that only reports the first)
+  bool allOff(uint32_t* pico2_us = nullptr, uint32_t* both_us = nullptr);
+
+  // control frame: OP + LEN + ARGS (zero padded) | pico2 drains its ring before answering
+  // timeout_ms: for ops that take long on the device (0 = cfg.ack_timeout_ms)
+  std::future<FrameResult> submitControl(uint8_t op, const uint8_t* args, uint16_t len, uint32_t timeout_ms = 0);
+
+  // block until nothing is in flight
+  void drain();
+
+  SerialPort&      port() { return port_; }
+  FrameStreamStats stats();
+  LatencyHistogram histogram();               // RTT of ACKed frames (any status)
+  void             resetHistogram();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Slot {
+    uint8_t                  frame[FS_FRAME_MAX_BYTES];
+    int                      len;               // bytes of frame[] to send (encoded frames are shorter)
+    uint32_t                 seq;
+    bool                     ctrl;
+    uint32_t                 timeout_ms;
+    Clock::time_point        t_sent;
+    std::promise<FrameResult> done;
+  };
+
+  std::future<FrameResult> enqueue(uint16_t magic, const uint8_t* body, const uint8_t* body2, uint16_t body2_len,
+                                   uint32_t timeout_ms);
+  int  buildData(Slot& s, const uint8_t* data512);   // caller holds mu_ | returns the frame length
+  void writerLoop();
+  void readerLoop();
+  void finish(int idx, FrameResult r);        // caller holds mu_
+  void expireOldest(Clock::time_point now);   // caller holds mu_
+
+  FrameStreamConfig cfg_;
+  SerialPort        port_;
+  std::vector<Slot> slots_;
+  uint8_t           wbuf_[FS_WINDOW_MAX * FS_FRAME_MAX_BYTES];   // writer: frames sent in one write
+
+  std::mutex              mu_;
+  std::condition_variable cv_;
+  std::vector<int>        free_;              // slot indices ready for submit()
+  std::deque<int>         to_write_;          // submitted, not yet on the wire
+  std::deque<int>         inflight_;          // on the wire, in SEQ order
+  int                     outstanding_ = 0;   // to_write_ + inflight_
+  uint32_t                next_seq_    = 0;
+  int                     window_      = 1;   // firmware boots in stop-and-wait
+  FrameStreamStats        stats_;
+  LatencyHistogram        hist_;
+
+  // encoded data frames: ref_ is the previous data frame, every frame since chain_seq_ (the last
+  // full one) builds on it; any of those failing makes the next frame full again
+  uint8_t                 enc_mask_  = 0;     // FS_ENC_* usable (firmware has them, cfg.encode)
+  uint8_t                 ref_[FS_DATA_BYTES];
+  uint32_t                ref_seq_   = 0;
+  uint32_t                chain_seq_ = 0;
+  bool                    ref_valid_ = false;
+  uint8_t                 scratch_[FS_ENC_BODY_MAX];
+
+  FrameSeqProgress        seq_;               // from progress ACKs, guarded by mu_
+  bool                    latch_ = false;     // OK ACKs of data / pattern frames carry LEN + REPLY
+
+  std::atomic<bool> run_{false};
+  std::thread       writer_, reader_;
+};
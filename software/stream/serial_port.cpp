@@ -0,0 +1,112 @@
+// ===========================================
+// filename: serial_port.cpp
+// ===========================================
+#include "serial_port.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+// termios speed constant for a rate | 0 if the OS has none
+static speed_t speedFor(uint32_t baud) {
+  switch (baud) {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+#ifdef B460800
+    case 460800:  return B460800;
+#endif
+#ifdef B921600
+    case 921600:  return B921600;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+#ifdef B2000000
+    case 2000000: return B2000000;
+#endif
+#ifdef B3000000
+    case 3000000: return B3000000;
+#endif
+    default:      return 0;
+  }
+}
+
+bool SerialPort::open(const char* path, uint32_t baud, std::string* err) {
+  close();
+  fd_ = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd_ < 0) {
+    if (err) *err = std::string("open ") + path + ": " + strerror(errno);
+    return false;
+  }
+
+  termios t;
+  if (tcgetattr(fd_, &t) != 0) {
+    if (err) *err = std::string("tcgetattr: ") + strerror(errno);
+    close();
+    return false;
+  }
+  cfmakeraw(&t);
+  t.c_cflag |= (CLOCAL | CREAD);
+  t.c_cflag &= ~CRTSCTS;
+  t.c_cc[VMIN]  = 0;
+  t.c_cc[VTIME] = 0;
+  if (tcsetattr(fd_, TCSANOW, &t) != 0 || !setBaud(baud)) {
+    if (err) *err = std::string("tcsetattr: ") + strerror(errno);
+    close();
+    return false;
+  }
+  flush();
+  return true;
+}
+
+void SerialPort::close() {
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+}
+
+bool SerialPort::setBaud(uint32_t baud) {
+  const speed_t s = speedFor(baud);
+  if (!s) return false;
+  termios t;
+  if (tcgetattr(fd_, &t) != 0) return false;
+  cfsetispeed(&t, s);
+  cfsetospeed(&t, s);
+  return tcsetattr(fd_, TCSADRAIN, &t) == 0;
+}
+
+bool SerialPort::writeAll(const uint8_t* src, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    const ssize_t w = ::write(fd_, src + done, n - done);
+    if (w > 0) { done += (size_t)w; continue; }
+    if (w < 0 && errno != EAGAIN && errno != EINTR) return false;
+
+    pollfd p = { fd_, POLLOUT, 0 };                         // kernel buffer full: wait for room
+    if (poll(&p, 1, 100) < 0 && errno != EINTR) return false;
+  }
+  return true;
+}
+
+int SerialPort::readSome(uint8_t* dst, size_t n, int timeout_ms) {
+  pollfd p = { fd_, POLLIN, 0 };
+  const int r = poll(&p, 1, timeout_ms);
+  if (r == 0) return 0;
+  if (r < 0) return (errno == EINTR) ? 0 : -1;
+  if (p.revents & (POLLERR | POLLNVAL)) return -1;
+
+  const ssize_t got = ::read(fd_, dst, n);
+  if (got > 0) return (int)got;
+  if (got == 0) return (p.revents & POLLHUP) ? -1 : 0;
+  return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+}
+
+void SerialPort::flush() {
+  tcflush(fd_, TCIOFLUSH);
+}
@@ -0,0 +1,38 @@
+// ===========================================
+// filename: serial_port.h
+// ===========================================
+#pragma once
+
+// POSIX serial port (termios): raw 8N1, no flow control, no line discipline.
+// Works on USB CDC (/dev/ttyACM*, /dev/cu.usbmodem*) and on ptys (simulator).
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class SerialPort {
+public:
+  SerialPort() {}
+  ~SerialPort() { close(); }
+  SerialPort(const SerialPort&) = delete;
+  SerialPort& operator=(const SerialPort&) = delete;
+
+  bool open(const char* path, uint32_t baud, std::string* err);
+  void close();
+  bool isOpen() const { return fd_ >= 0; }
+
+  // termios rate; USB CDC ignores it, a real UART / adapter does not
+  bool setBaud(uint32_t baud);
+
+  // all n bytes or false (port gone)
+  bool writeAll(const uint8_t* src, size_t n);
+
+  // up to n bytes, waits at most timeout_ms for the first one | 0: timeout, -1: port gone
+  int readSome(uint8_t* dst, size_t n, int timeout_ms);
+
+  // drop whatever the OS has buffered in both directions (boot banners, stale ACKs)
+  void flush();
+
+private:
+  int fd_ = -1;
+};
@@ -0,0 +1,484 @@
+// ===========================================
+// filename: stream_perf.cpp
+// ===========================================
+// Streaming benchmark on top of FrameStream; replaces software/test/performance_communication.py
+// for timing runs (the Python script stays as the readable reference of the protocol).
+//
+//   stream_perf --port /dev/ttyACM0 [--baud 115200] [--window 4] [--frames 100] [--timeout-ms 500]
+//               [--uart-max-baud B] [--changes N] [--full-only] [--patterns K [--play-us D]] [--latch]
+//               [--trace] [--no-coalesce] [--cal FILE [--cal-save]] [--depth D] [--all-off] [--quiet]
+//
+// Same test pattern as the Python script: data[i] = (n + i) & 0xFF for the n-th data frame.
+// --changes N: instead, N random magnets change per frame (what delta / sparse frames are for).
+// --full-only: never send encoded frames (FrameStreamConfig::encode = false), for comparison.
+// --patterns K: upload K patterns into the device bank first (pattern k = the test pattern of
+//               frame k), then frame n applies pattern n % K with a 9-byte pattern frame.
+// --play-us D: with --patterns, no frames at all: the K patterns are loaded as a device sequence
+//               of D us per step and played for --frames steps (whole loops) on the Picos' timer;
+//               prints steps/s, overruns and the device time against the scheduled time.
+// --latch: latched commit (OP_SET_LATCH); prints the hold time and release skew per frame and
+//          their min / avg / max.
+// --trace: clear the firmware's stage trace before the run and print its per-stage latency table
+//          (OP_GET_TRACE, both Picos) after it, to see which stage the RTT goes to.
+// --no-coalesce: one write per frame (FrameStreamConfig::coalesce = false), for comparison; by
+//                default frames that queue up share a write and fill whole USB packets.
+// --cal FILE: per-magnet calibration (OP_CAL_*) before the run, unless OP_CAL_INFO already reports
+//             the file's version on both Picos; --cal-save also keeps it in the Picos' flash.
+//             FILE, one setting per line ('#' starts a comment, magnets not listed stay linear):
+//               version V                      set version, != 0
+//               curve C P0 .. P14              PWM of values 0..14 for curve C (0..3)
+//               magnet M|A-B GAIN OFFSET [swap] [curve C]
+//                                              GAIN as a factor (1.0 = as is), OFFSET in PWM counts
+// --depth D: data frames of D bits per magnet (6 / 8 / 12: DEEP_MAGIC frames, 4: as without it);
+//            the test pattern is then value m = (n + m) mod (2^D - 1), --changes sets random values
+// --all-off: OP_ALL_OFF after the run; prints when Pico2's boards and both Picos' were off (device
+//            time from the frame) and the round trip.
+// --uart-max-baud: OP_SET_LINK first (Pico2 renegotiates the UART to Pico1 up to B).
+// The device status (OP_GET_STATUS: UART rate or SPI clock, fallbacks, lost Pico1 ACKs, boards the
+// firmware skips and failed I2C transactions) is printed before and after the run.
+// Per frame: "<seq> OK status=<s> rtt_ms=<t>" (or "<seq> FAIL: lost"), then fps, status counts
+// and the RTT histogram.
+
+#include "frame_stream.h"
+
+#include <chrono>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage() {
+  fprintf(stderr,
+          "usage: stream_perf --port PATH [--baud N] [--window N] [--frames N] [--timeout-ms N]\n"
+          "                   [--uart-max-baud B] [--changes N] [--full-only] [--patterns K [--play-us D]]\n"
+          "                   [--latch] [--trace] [--no-coalesce] [--cal FILE [--cal-save]] [--depth D] [--all-off]\n"
+          "                   [--quiet]\n");
+}
+
+// --cal FILE: see the header | false with a message naming the line
+static bool loadCalFile(const char* path, FrameCalibration* cal, std::string* err) {
+  FILE* f = fopen(path, "r");
+  if (!f) { *err = std::string("cannot open ") + path; return false; }
+  char line[512];
+  int  no = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    ++no;
+    if (char* hash = strchr(line, '#')) *hash = 0;
+    char* tok = strtok(line, " \t\r\n");
+    if (!tok) continue;
+
+    if (!strcmp(tok, "version")) {
+      const char* v = strtok(nullptr, " \t\r\n");
+      cal->version = v ? (uint32_t)strtoul(v, nullptr, 0) : 0;
+      ok = cal->version != 0;
+    } else if (!strcmp(tok, "curve")) {
+      const char* c = strtok(nullptr, " \t\r\n");
+      const int   k = c ? atoi(c) : -1;
+      ok = k >= 0 && k < FS_CAL_CURVES;
+      for (int v = 0; ok && v < FS_CAL_LEVELS; ++v) {
+        const char* p = strtok(nullptr, " \t\r\n");
+        const long  pwm = p ? strtol(p, nullptr, 0) : -1;
+        ok = pwm >= 0 && pwm <= 4095;
+        if (ok) cal->curve[k][v] = (uint16_t)pwm;
+      }
+    } else if (!strcmp(tok, "magnet")) {
+      const char* m = strtok(nullptr, " \t\r\n");
+      const char* g = strtok(nullptr, " \t\r\n");
+      const char* o = strtok(nullptr, " \t\r\n");
+      int a = -1, b = -1;
+      if (m && sscanf(m, "%d-%d", &a, &b) == 1) b = a;
+      const double gain = g ? atof(g) : -1;
+      ok = a >= 0 && b >= a && b < FS_CAL_MAGNETS && o && gain >= 0 && gain * FS_CAL_GAIN_ONE <= 65535;
+      FrameMagCal mc;
+      if (ok) {
+        mc.gain   = (uint16_t)(gain * FS_CAL_GAIN_ONE + 0.5);
+        mc.offset = (int16_t)atoi(o);
+      }
+      for (const char* t; ok && (t = strtok(nullptr, " \t\r\n"));) {
+        if (!strcmp(t, "swap")) {
+          mc.swap = true;
+        } else if (!strcmp(t, "curve")) {
+          const char* c = strtok(nullptr, " \t\r\n");
+          ok = c && atoi(c) >= 0 && atoi(c) < FS_CAL_CURVES;
+          if (ok) mc.curve = (uint8_t)atoi(c);
+        } else {
+          ok = false;
+        }
+      }
+      for (int k = a; ok && k <= b; ++k) cal->mag[k] = mc;
+    } else {
+      ok = false;
+    }
+  }
+  fclose(f);
+  if (!ok) *err = std::string(path) + ":" + std::to_string(no) + ": bad line";
+  return ok;
+}
+
+// --cal: upload unless both Picos already run this version
+static bool applyCalibration(FrameStream& fs, const char* path, bool save) {
+  static FrameCalibration cal;
+  std::string err;
+  if (!loadCalFile(path, &cal, &err)) {
+    fprintf(stderr, "calibration: %s\n", err.c_str());
+    return false;
+  }
+  uint32_t v1 = 0, v2 = 0;
+  if (!fs.queryCalibration(&v1, &v2)) {
+    fprintf(stderr, "calibration: not supported by the firmware (or Pico1 silent)\n");
+    return false;
+  }
+  if (v1 == cal.version && v2 == cal.version) {
+    printf("calibration: version %u already active on both Picos\n", (unsigned)cal.version);
+    return true;
+  }
+  uint8_t st;
+  const auto t0 = std::chrono::steady_clock::now();
+  const bool ok = fs.uploadCalibration(cal, save, &st);
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  if (!ok && st != FS_STATUS_ERR_FLASH) {
+    fprintf(stderr, "calibration: upload failed (status %u)\n", (unsigned)st);
+    return false;
+  }
+  printf("calibration: version %u active (was Pico1 %u, Pico2 %u), %s, %.0f ms\n", (unsigned)cal.version,
+         (unsigned)v1, (unsigned)v2, !save ? "not saved" : ok ? "saved" : "NOT saved (flash error)", ms);
+  return true;
+}
+
+// --trace: one row per firmware stage
+static void printTrace(FrameStream& fs) {
+  std::vector<FrameTraceStage> stages;
+  if (!fs.queryTrace(&stages, false)) {
+    printf("trace: not supported by the firmware\n");
+    return;
+  }
+  printf("trace (us)      %8s %8s %8s %8s %8s %8s %8s\n", "count", "min", "avg", "max", "p50", "p90", "p99");
+  for (const FrameTraceStage& t : stages) {
+    if (!t.count) continue;
+    printf("  %-12s %8u %8u %8u %8u %8u %8u %8u\n", fsTraceStageName(t.stage), (unsigned)t.count, (unsigned)t.min,
+           (unsigned)t.avg, (unsigned)t.max, (unsigned)t.p50, (unsigned)t.p90, (unsigned)t.p99);
+  }
+}
+
+static void printStatus(FrameStream& fs, const char* when) {
+  FrameStatus st;
+  if (!fs.queryStatus(&st)) {
+    printf("status %s: not supported by the firmware\n", when);
+    return;
+  }
+  if (st.link == FS_LINK_SPI)
+    printf("status %s: spi %u Hz, %u lost Pico1 ACKs, window %u\n", when, (unsigned)st.uart_baud,
+           (unsigned)st.lost_acks, (unsigned)st.window);
+  else
+    printf("status %s: uart %u baud (ceiling %u), %u fallbacks, %u lost Pico1 ACKs, window %u\n", when,
+           (unsigned)st.uart_baud, (unsigned)st.uart_ceiling, (unsigned)st.uart_fallbacks, (unsigned)st.lost_acks,
+           (unsigned)st.window);
+  if (st.version < 4) return;
+
+  // boards the firmware skips (missing at boot or NACKing), numbered 0..127 in data order
+  int skipped = 0;
+  for (int b = 0; b < 128; ++b) {
+    if ((st.health[b / 32] >> (b % 32)) & 1) continue;
+    if (!skipped++) printf("status %s: boards skipped:", when);
+    printf(" %d", b);
+  }
+  if (skipped) printf("  (%d of 128)\n", skipped);
+  if (skipped || st.i2c_fail_pico1 || st.i2c_fail_pico2)
+    printf("status %s: failed I2C transactions pico1 %u, pico2 %u\n", when, (unsigned)st.i2c_fail_pico1,
+           (unsigned)st.i2c_fail_pico2);
+  if (st.version < 5) return;
+  if (st.rx_resyncs || st.rx_timeouts)
+    printf("status %s: USB receive resyncs %u (%u bytes skipped), %u frames cut off by a deadline\n", when,
+           (unsigned)st.rx_resyncs, (unsigned)st.rx_skipped, (unsigned)st.rx_timeouts);
+  if (st.version < 6) return;
+  printf("status %s: frame depths", when);
+  for (int d = 1; d <= FS_DEPTH_MAX; ++d) {
+    if ((st.depths >> d) & 1) printf(" %d", d);
+  }
+  printf(" bits\n");
+}
+
+// --depth: true if the firmware takes frames of `depth` bits
+static bool depthSupported(FrameStream& fs, int depth) {
+  FrameStatus st;
+  if (depth == FS_DEPTH_NIBBLE) return true;
+  return fs.queryStatus(&st) && st.version >= 6 && ((st.depths >> depth) & 1);
+}
+
+// frame n: the Python script's pattern, or `changes` random magnets changed (xorshift: same every run)
+static void makeFrame(uint8_t* data512, long n, int changes, uint32_t* rng) {
+  if (!changes) {
+    for (int i = 0; i < FS_DATA_BYTES; ++i) data512[i] = (uint8_t)((n + i) & 0xFF);
+    return;
+  }
+  for (int k = 0; k < changes; ++k) {
+    uint32_t r = *rng;
+    r ^= r << 13; r ^= r >> 17; r ^= r << 5;
+    *rng = r;
+    const int     m = (int)(r % (FS_DATA_BYTES * 2));
+    const uint8_t v = (uint8_t)((r >> 16) % 15);
+    uint8_t& b = data512[m >> 1];
+    b = (m & 1) ? (uint8_t)((b & 0x0F) | (v << 4)) : (uint8_t)((b & 0xF0) | v);
+  }
+}
+
+// --depth: the same at `depth` bits per magnet
+static void makeDeepFrame(uint16_t* values, long n, int changes, int depth, uint32_t* rng) {
+  const uint32_t levels = (1u << depth) - 1;             // all ones is off, as nibble 15
+  if (!changes) {
+    for (int m = 0; m < FS_MAGNETS; ++m) values[m] = (uint16_t)((n + m) % levels);
+    return;
+  }
+  for (int k = 0; k < changes; ++k) {
+    uint32_t r = *rng;
+    r ^= r << 13; r ^= r >> 17; r ^= r << 5;
+    *rng = r;
+    values[r % FS_MAGNETS] = (uint16_t)((r >> 10) % levels);
+  }
+}
+
+// --play-us: the bank patterns as one timed sequence, played by the firmware
+static int playSequence(FrameStream& fs, int patterns, uint32_t step_us, long frames, bool quiet) {
+  std::vector<FrameSeqStep> steps((size_t)patterns);
+  for (int k = 0; k < patterns; ++k) { steps[(size_t)k].pattern = (uint8_t)k; steps[(size_t)k].duration_us = step_us; }
+  const long loops = (frames + patterns - 1) / patterns;
+  if (loops < 1 || loops > 0xFFFF) {
+    fprintf(stderr, "--frames / --patterns gives %ld loops (1..65535)\n", loops);
+    return 2;
+  }
+  if (!fs.loadSequence(steps)) {
+    fprintf(stderr, "sequence: not loaded (not supported by the firmware)\n");
+    return 1;
+  }
+
+  const double expect_s = (double)loops * patterns * step_us / 1e6;
+  const auto   t0 = std::chrono::steady_clock::now();
+  if (!fs.startSequence((uint16_t)loops, quiet ? 0 : (uint16_t)patterns)) {
+    fprintf(stderr, "sequence: not started (pattern missing on a Pico, or Pico1 silent)\n");
+    return 1;
+  }
+  uint32_t shown = 0;
+  while (!fs.waitSequenceDone(200)) {
+    const FrameSeqProgress p = fs.sequenceProgress();
+    if (!quiet && p.steps != shown) printf("step %u  overruns %u\n", (unsigned)(shown = p.steps), (unsigned)p.overruns);
+    if (std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() > 2 * expect_s + 5) {
+      fprintf(stderr, "sequence: no DONE after %.1f s\n", 2 * expect_s + 5);
+      break;
+    }
+  }
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  uint32_t played = 0, over2 = 0, over1 = 0;
+  const FrameSeqProgress p = fs.sequenceProgress();
+  fs.stopSequence(&played, &over2, &over1);
+  printf("\nsequence: %u steps of %u us in %.3f s (scheduled %.3f s)  ->  %.1f steps/s\n", (unsigned)played,
+         (unsigned)step_us, secs, expect_s, secs > 0 ? played / secs : 0.0);
+  printf("overruns: pico2 %u  pico1 %u  (%u OVERRUN ACKs)  done %s\n", (unsigned)over2, (unsigned)over1,
+         (unsigned)p.overruns, p.done ? "yes" : "no");
+  return p.done && played == (uint32_t)(loops * patterns) ? 0 : 1;
+}
+
+// --latch: hold time and release skew over the frames that reported them
+struct LatchSummary {
+  uint64_t n = 0, unknown = 0;
+  int32_t  hold_min = 0, hold_max = 0, skew_min = 0, skew_max = 0;
+  double   hold_sum = 0, skew_sum = 0;
+
+  void add(const FrameResult& r) {
+    if (r.hold_us < 0) return;
+    if (r.skew_us == FS_LATCH_SKEW_UNKNOWN) { ++unknown; return; }
+    if (!n || r.hold_us < hold_min) hold_min = r.hold_us;
+    if (!n || r.hold_us > hold_max) hold_max = r.hold_us;
+    if (!n || r.skew_us < skew_min) skew_min = r.skew_us;
+    if (!n || r.skew_us > skew_max) skew_max = r.skew_us;
+    hold_sum += r.hold_us;
+    skew_sum += r.skew_us;
+    ++n;
+  }
+};
+
+static void report(const FrameResult& r, bool quiet, uint64_t* by_status, LatchSummary* latch) {
+  if (r.lost) {
+    if (!quiet) printf("%u FAIL: lost\n", (unsigned)r.seq);
+    return;
+  }
+  ++by_status[r.status];
+  latch->add(r);
+  if (quiet) return;
+  if (r.hold_us >= 0)
+    printf("%u OK status=%u rtt_ms=%.3f hold_us=%d skew_us=%d\n", (unsigned)r.seq, (unsigned)r.status,
+           r.rtt_us / 1e3, (int)r.hold_us, (int)r.skew_us);
+  else
+    printf("%u OK status=%u rtt_ms=%.3f\n", (unsigned)r.seq, (unsigned)r.status, r.rtt_us / 1e3);
+}
+
+int main(int argc, char** argv) {
+  FrameStreamConfig cfg;
+  int  want_window = 4;
+  long frames      = 100;
+  bool quiet       = false;
+  uint32_t uart_max = 0;
+  int  changes     = 0;
+  int  patterns    = 0;
+  uint32_t play_us = 0;
+  bool latch       = false;
+  bool trace       = false;
+  const char* cal_file = nullptr;
+  bool cal_save    = false;
+  int  depth       = 0;                                  // 0: data frames as 512 packed bytes
+  bool all_off     = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    const bool  has = i + 1 < argc;
+    if      (!strcmp(a, "--port") && has)       cfg.port = argv[++i];
+    else if (!strcmp(a, "--baud") && has)       cfg.baud = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(a, "--window") && has)     want_window = atoi(argv[++i]);
+    else if (!strcmp(a, "--frames") && has)     frames = atol(argv[++i]);
+    else if (!strcmp(a, "--timeout-ms") && has) cfg.ack_timeout_ms = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(a, "--uart-max-baud") && has) uart_max = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(a, "--changes") && has)    changes = atoi(argv[++i]);
+    else if (!strcmp(a, "--full-only"))         cfg.encode = false;
+    else if (!strcmp(a, "--no-coalesce"))       cfg.coalesce = false;
+    else if (!strcmp(a, "--patterns") && has)   patterns = atoi(argv[++i]);
+    else if (!strcmp(a, "--play-us") && has)    play_us = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(a, "--latch"))             latch = true;
+    else if (!strcmp(a, "--trace"))             trace = true;
+    else if (!strcmp(a, "--cal") && has)        cal_file = argv[++i];
+    else if (!strcmp(a, "--cal-save"))          cal_save = true;
+    else if (!strcmp(a, "--depth") && has)      depth = atoi(argv[++i]);
+    else if (!strcmp(a, "--all-off"))           all_off = true;
+    else if (!strcmp(a, "--quiet"))             quiet = true;
+    else { usage(); return 2; }
+  }
+  if (cfg.port.empty() || (play_us && patterns <= 0) || (cal_save && !cal_file) ||
+      (depth && (!fsDepthOk(depth) || patterns > 0))) {
+    usage();
+    return 2;
+  }
+
+  FrameStream fs;
+  std::string err;
+  if (!fs.open(cfg, &err)) {
+    fprintf(stderr, "open %s: %s\n", cfg.port.c_str(), err.c_str());
+    return 1;
+  }
+
+  if (uart_max) printf("uart renegotiated: %u baud\n", (unsigned)fs.setLinkCeiling(uart_max));
+  const int window = fs.setWindow(want_window);
+  printf("window=%d\n", window);
+  if (latch && !fs.setLatch(true)) {
+    fprintf(stderr, "latched commit: not supported by the firmware (or Pico1 silent)\n");
+    return 1;
+  }
+  printStatus(fs, "before");
+  if (cal_file && !applyCalibration(fs, cal_file, cal_save)) return 1;
+  if (depth && !depthSupported(fs, depth)) {
+    fprintf(stderr, "--depth %d: not supported by the firmware\n", depth);
+    return 1;
+  }
+
+  uint8_t data512[FS_DATA_BYTES];
+  if (patterns > 0) {
+    for (int k = 0; k < patterns; ++k) {
+      makeFrame(data512, k, 0, nullptr);
+      if (!fs.storePattern((uint8_t)k, data512)) {
+        fprintf(stderr, "pattern %d: not stored (bank full or not supported)\n", k);
+        return 1;
+      }
+    }
+    FrameBank bank;
+    if (fs.queryBank(&bank))
+      printf("bank: %u slots, stored 0x%08x, %u bytes/slot, %u of %u bytes in use per Pico\n", (unsigned)bank.slots,
+             (unsigned)bank.stored, (unsigned)bank.slot_bytes, (unsigned)bank.used_bytes, (unsigned)bank.bank_bytes);
+  }
+  fs.resetHistogram();   // control round trips are not frames
+  std::vector<FrameTraceStage> scratch;
+  if (trace) fs.queryTrace(&scratch, true);               // nor are the uploads above
+
+  if (play_us) {
+    const int rc = playSequence(fs, patterns, play_us, frames, quiet);
+    if (trace) printTrace(fs);
+    printStatus(fs, "after");
+    fs.close();
+    return rc;
+  }
+
+  // ===== stream =====
+  // submit() blocks on the window; futures are harvested in SEQ order as they complete
+  uint64_t by_status[256] = {0};
+  LatchSummary latch_sum;
+  std::deque<std::future<FrameResult>> pending;
+  memset(data512, 0x77, sizeof(data512));                // all OFF
+  std::vector<uint16_t> values(FS_MAGNETS, fsDepthCenter(depth ? depth : FS_DEPTH_NIBBLE));
+  uint32_t rng = 0xC0FFEEu;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  for (long n = 0; n < frames; ++n) {
+    if (patterns > 0) {
+      pending.push_back(fs.applyPattern((uint8_t)(n % patterns)));
+    } else if (depth) {
+      makeDeepFrame(values.data(), n, changes, depth, &rng);
+      pending.push_back(fs.submitDeep(values.data(), depth));
+    } else {
+      makeFrame(data512, n, changes, &rng);
+      pending.push_back(fs.submit(data512));
+    }
+
+    while (!pending.empty() &&
+           pending.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      report(pending.front().get(), quiet, by_status, &latch_sum);
+      pending.pop_front();
+    }
+  }
+  while (!pending.empty()) {
+    report(pending.front().get(), quiet, by_status, &latch_sum);
+    pending.pop_front();
+  }
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // ===== summary =====
+  const FrameStreamStats st = fs.stats();
+  const int payload = depth ? FS_MAGNETS * depth / 8 : FS_DATA_BYTES;
+  printf("\n%ld frames in %.3f s  ->  %.1f fps  (%.1f kB/s payload)\n", frames, secs, frames / secs,
+         frames * (double)payload / secs / 1e3);
+  printf("wire: %.3f MB/s sustained, %llu writes (%.0f bytes/write%s)\n", st.wire_bytes / secs / 1e6,
+         (unsigned long long)st.writes, st.writes ? (double)st.wire_bytes / st.writes : 0.0,
+         cfg.coalesce ? "" : ", coalescing off");
+  printf("status: OK %llu  ERR_MAGIC %llu  ERR_CRC %llu  ERR_PICO1_ACK %llu  ERR_OP %llu  ERR_BASE %llu  ERR_BANK %llu"
+         "  lost %llu\n",
+         (unsigned long long)by_status[FS_STATUS_OK], (unsigned long long)by_status[FS_STATUS_ERR_MAGIC],
+         (unsigned long long)by_status[FS_STATUS_ERR_CRC], (unsigned long long)by_status[FS_STATUS_ERR_PICO1_ACK],
+         (unsigned long long)by_status[FS_STATUS_ERR_OP], (unsigned long long)by_status[FS_STATUS_ERR_BASE],
+         (unsigned long long)by_status[FS_STATUS_ERR_BANK], (unsigned long long)st.lost);
+  printf("encoding: full %llu  delta %llu  sparse %llu  pattern %llu  deep %llu  ->  %.1f bytes/frame on the wire\n",
+         (unsigned long long)st.full, (unsigned long long)st.delta, (unsigned long long)st.sparse,
+         (unsigned long long)st.pattern, (unsigned long long)st.deep,
+         frames ? (double)(st.data_bytes + st.pattern * FS_PATTERN_BYTES) / (double)frames : 0.0);
+  if (st.resync_skip || st.stray_acks)
+    printf("link: %llu bytes skipped resyncing, %llu stray ACKs\n", (unsigned long long)st.resync_skip,
+           (unsigned long long)st.stray_acks);
+  if (latch_sum.n || latch_sum.unknown)
+    printf("latch: hold_us min %d avg %.1f max %d  skew_us min %d avg %.2f max %d  (%llu frames, %llu skew unknown)\n",
+           (int)latch_sum.hold_min, latch_sum.n ? latch_sum.hold_sum / latch_sum.n : 0.0, (int)latch_sum.hold_max,
+           (int)latch_sum.skew_min, latch_sum.n ? latch_sum.skew_sum / latch_sum.n : 0.0, (int)latch_sum.skew_max,
+           (unsigned long long)latch_sum.n, (unsigned long long)latch_sum.unknown);
+  fs.histogram().print(stdout, "rtt");
+
+  bool off_ok = true;
+  if (all_off) {
+    uint32_t pico2_us = 0, both_us = 0;
+    const auto t_off  = std::chrono::steady_clock::now();
+    off_ok = fs.allOff(&pico2_us, &both_us);
+    const double rtt_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_off).count();
+    if (off_ok) printf("all off: pico2 off after %u us, both after %u us, %.3f ms round trip\n", (unsigned)pico2_us,
+                       (unsigned)both_us, rtt_ms);
+    else        fprintf(stderr, "all off: failed (not supported by the firmware, or Pico1 silent)\n");
+  }
+  if (trace) printTrace(fs);
+  printStatus(fs, "after");
+
+  fs.close();
+  return by_status[FS_STATUS_OK] == (uint64_t)frames && off_ok ? 0 : 1;
+}
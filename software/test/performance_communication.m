@@ -9,7 +9,7 @@ TIMEOUT = 0.5;                             % seconds (ACK wait)
 % Protocol constants
 %% =======================
 MAGIC     = hex2dec('55AA');   % uint16
-ACK_MAGIC = hex2dec('33CC');   % uint16
+ACK_MAGIC = hex2dec('55AA');   % uint16 (same value as MAGIC, see command.h)
 
 DATA_BYTES  = 512;
 HDR_BYTES   = 6;               % MAGIC(2) + SEQ(4)
@@ -75,7 +75,8 @@ function out = build_frame(seq, data512, MAGIC)
         error("data512 must be 512 bytes");
     end
     hdr = [u16le(uint16(MAGIC)), u32le(uint32(seq))];        % 2 + 4 bytes
-    crc = crc16_ccitt(data512, uint16(hex2dec('FFFF')));    % over data only (matches your python)
+    crc = crc16_ccitt(hdr, uint16(hex2dec('FFFF')));        % CRC over [HDR + DATA], as pico2 checks it
+    crc = crc16_ccitt(data512, crc);                        % (streaming: continue from the header CRC)
     out = [hdr, data512(:).', u16le(crc)];                  % row vector uint8
 end
 
@@ -106,19 +107,30 @@ function buf = read_exact(ser, n)
 end
 
 function crc = crc16_ccitt(data, init)
-    % CRC16-CCITT poly 0x1021, init 0xFFFF (bitwise, MSB-first), matches python code
-    crc = uint16(init);
-    for i = 1:numel(data)
-        b = uint16(data(i));
-        crc = bitxor(crc, bitshift(b, 8));
-        for k = 1:8
-            if bitand(crc, uint16(hex2dec('8000')))
-                crc = bitand(bitxor(bitshift(crc, 1), uint16(hex2dec('1021'))), uint16(hex2dec('FFFF')));
-            else
-                crc = bitand(bitshift(crc, 1), uint16(hex2dec('FFFF')));
+    % CRC16-CCITT poly 0x1021, init 0xFFFF (MSB-first), table driven like command.cpp:
+    %   crc = (crc << 8) ^ T[(crc >> 8) ^ b]
+    % crc16_ccitt('123456789', 0xFFFF) == 0x29B1; pass a previous result as init to stream.
+    persistent T
+    if isempty(T)
+        T = zeros(1, 256);
+        for b = 0:255
+            c = b * 256;
+            for k = 1:8
+                if c >= 32768
+                    c = bitxor(mod(c * 2, 65536), 4129);    % 0x1021
+                else
+                    c = mod(c * 2, 65536);
+                end
             end
+            T(b + 1) = c;
         end
     end
+    c = double(init);
+    data = double(data);
+    for i = 1:numel(data)
+        c = bitxor(mod(c * 256, 65536), T(bitxor(floor(c / 256), data(i)) + 1));
+    end
+    crc = uint16(c);
 end
 
 % --- endian helpers (explicit, independent of host endianness) ---
@@ -1,5 +1,8 @@
+import binascii
 import time
 import struct
+from collections import deque
+
 import serial
 
 # config. - USB
@@ -7,9 +10,14 @@ PORT = "/dev/cu.usbmodem1101"
 
 BAUDRATE = 115200
 TIMEOUT  = 0.5
+WINDOW   = 4            # frames in flight (1 = stop-and-wait); negotiated with OP_SET_WINDOW
+
+MAGIC      = 0x55AA     # frame header
+CTRL_MAGIC = 0x66CC     # control frame header
+ACK_MAGIC  = 0x55AA     # ack header (same value as MAGIC, see command.h)
 
-MAGIC     = 0x55AA      # frame header
-ACK_MAGIC = 0x33CC      # ack header
+OP_SET_WINDOW = 0x01
+STATUS_OK     = 1
 
 DATA_BYTES  = 512
 HDR_BYTES   = 6         # MAGIC(2) + SEQ(4)
@@ -19,15 +27,11 @@ FRAME_BYTES = HDR_BYTES + DATA_BYTES + CRC_BYTES  # 520
 ACK_BYTES = 7           # ACK_MAGIC(2) + SEQ(4) + STATUS(1)
 
 def crc16_ccitt(data: bytes, init: int = 0xFFFF) -> int:
-    crc = init
-    for b in data:
-        crc ^= (b << 8) & 0xFFFF
-        for _ in range(8):
-            if crc & 0x8000:
-                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
-            else:
-                crc = (crc << 1) & 0xFFFF
-    return crc
+    # CRC16-CCITT (poly 0x1021, MSB-first, no final xor) == binascii.crc_hqx, table driven in C.
+    # Streaming: crc = crc16_ccitt(part2, crc16_ccitt(part1)) over any split of the message.
+    return binascii.crc_hqx(data, init)
+
+assert crc16_ccitt(b"123456789") == 0x29B1   # same check value as command.cpp
 
 def read_exact(ser: serial.Serial, n: int) -> bytes:
     buf = bytearray()
@@ -38,13 +42,29 @@ def read_exact(ser: serial.Serial, n: int) -> bytes:
         buf.extend(chunk)
     return bytes(buf)
 
-def build_frame(seq: int, data512: bytes) -> bytes:
+def build_frame(seq: int, data512: bytes, magic: int = MAGIC) -> bytes:
     if len(data512) != DATA_BYTES:
         raise ValueError("data512 must be 512 bytes")
-    hdr = struct.pack("<HI", MAGIC, seq)
-    crc = crc16_ccitt(data512)
+    hdr = struct.pack("<HI", magic, seq)
+    crc = crc16_ccitt(data512, crc16_ccitt(hdr))    # CRC over [HDR + DATA], as pico2 checks it
     return hdr + data512 + struct.pack("<H", crc)
 
+def build_ctrl(seq: int, op: int, args: bytes = b"") -> bytes:
+    # control body = OP(1) + LEN(2) + ARGS, zero padded to the usual 512 bytes
+    body = struct.pack("<BH", op, len(args)) + args
+    return build_frame(seq, body.ljust(DATA_BYTES, b"\x00"), CTRL_MAGIC)
+
+def negotiate_window(ser: serial.Serial, seq: int, want: int) -> int:
+    # firmware without control frames answers STATUS != OK -> stay in stop-and-wait
+    ser.write(build_ctrl(seq, OP_SET_WINDOW, bytes([want])))
+    ser.flush()
+    parsed = parse_ack(read_exact(ser, ACK_BYTES))
+    if not parsed or parsed[0] != ACK_MAGIC or parsed[1] != seq or parsed[2] != STATUS_OK:
+        return 1
+    (rlen,) = struct.unpack("<H", read_exact(ser, 2))
+    reply = read_exact(ser, rlen)
+    return reply[0] if reply else 1
+
 def parse_ack(ack7: bytes):
     if len(ack7) != ACK_BYTES:
         return None
@@ -56,38 +76,49 @@ def main():
     ser = serial.Serial(PORT, BAUDRATE, timeout=TIMEOUT)
 
     try:
-        for seq in range(100):
-            # 512 bytes data
-            data512 = bytes([(seq + i) & 0xFF for i in range(DATA_BYTES)])
-
-            frame = build_frame(seq, data512)
-            if len(frame) != FRAME_BYTES:
-                print(seq, "FAIL: frame_len")
-                continue
-
-            t0 = time.perf_counter()
-            ser.write(frame)
+        window = negotiate_window(ser, 0xFFFFFFFF, WINDOW)
+        print(f"window={window}")
+
+        inflight = deque()      # (seq, t0) in send order; pico2 ACKs in the same order
+        seq = 0
+        n_frames = 100
+        while seq < n_frames or inflight:
+            # keep up to `window` frames on the wire
+            while seq < n_frames and len(inflight) < window:
+                # 512 bytes data
+                data512 = bytes([(seq + i) & 0xFF for i in range(DATA_BYTES)])
+
+                frame = build_frame(seq, data512)
+                if len(frame) != FRAME_BYTES:
+                    print(seq, "FAIL: frame_len")
+                    seq += 1
+                    continue
+
+                inflight.append((seq, time.perf_counter()))
+                ser.write(frame)
+                seq += 1
             ser.flush()
 
             ack = read_exact(ser, ACK_BYTES)
             t1 = time.perf_counter()
+            fseq, t0 = inflight.popleft()
 
             rtt_ms = (t1 - t0) * 1000.0
 
             parsed = parse_ack(ack)
             if not parsed:
-                print(seq, f"FAIL: ack_len={len(ack)} rtt_ms={rtt_ms:.3f}")
+                print(fseq, f"FAIL: ack_len={len(ack)} rtt_ms={rtt_ms:.3f}")
                 continue
 
             am, aseq, status = parsed
             if am != ACK_MAGIC:
-                print(seq, f"FAIL: ack_magic=0x{am:04X} rtt_ms={rtt_ms:.3f}")
+                print(fseq, f"FAIL: ack_magic=0x{am:04X} rtt_ms={rtt_ms:.3f}")
                 continue
-            if aseq != seq:
-                print(seq, f"FAIL: ack_seq={aseq} rtt_ms={rtt_ms:.3f}")
+            if aseq != fseq:
+                print(fseq, f"FAIL: ack_seq={aseq} rtt_ms={rtt_ms:.3f}")
                 continue
 
-            print(seq, f"OK status={status} rtt_ms={rtt_ms:.3f}")
+            print(fseq, f"OK status={status} rtt_ms={rtt_ms:.3f}")
 
     finally:
         ser.close()